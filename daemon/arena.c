@@ -0,0 +1,125 @@
+#include "arena.h"
+#include <string.h>
+
+#define ARENA_ROUND(x)		(((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define ARENA_SMALL_CLASSES	16 // 16-byte steps up to 256
+
+G_STATIC_ASSERT(ARENA_CLASSES == ARENA_SMALL_CLASSES + 4 * 4); // 320 ... 4096
+G_STATIC_ASSERT(ARENA_MAX_CLASS <= ARENA_CHUNK_SIZE / 4);
+
+struct arena_chunk {
+	struct arena_chunk *next;
+};
+
+struct arena_large {
+	struct arena_large *next, **pprev;
+	size_t size;
+};
+
+#define CHUNK_HDR	ARENA_ROUND(sizeof(struct arena_chunk))
+#define LARGE_HDR	ARENA_ROUND(sizeof(struct arena_large))
+
+
+static unsigned int arena_class(size_t size) {
+	if (size <= ARENA_SMALL_CLASSES * ARENA_ALIGN)
+		return size ? (size - 1) / ARENA_ALIGN : 0;
+	// four classes per power of two
+	unsigned int bits = 63 - __builtin_clzll(size - 1); // 8 for 257 ... 512
+	unsigned int sub = ((size - 1) >> (bits - 2)) & 3;
+	return ARENA_SMALL_CLASSES + (bits - 8) * 4 + sub;
+}
+
+static size_t arena_class_size(unsigned int cls) {
+	if (cls < ARENA_SMALL_CLASSES)
+		return (cls + 1) * ARENA_ALIGN;
+	cls -= ARENA_SMALL_CLASSES;
+	unsigned int bits = 8 + cls / 4;
+	return (size_t) (4 + cls % 4 + 1) << (bits - 2);
+}
+
+void arena_init(struct arena *a) {
+	memset(a, 0, sizeof(*a));
+}
+
+void arena_destroy(struct arena *a) {
+	while (a->chunks) {
+		struct arena_chunk *c = a->chunks;
+		a->chunks = c->next;
+		g_free(c);
+	}
+	while (a->large) {
+		struct arena_large *l = a->large;
+		a->large = l->next;
+		g_free(l);
+	}
+	arena_init(a);
+}
+
+static void *arena_alloc_large(struct arena *a, size_t size) {
+	struct arena_large *l = g_malloc(LARGE_HDR + size);
+	l->size = size;
+	l->next = a->large;
+	if (l->next)
+		l->next->pprev = &l->next;
+	l->pprev = &a->large;
+	a->large = l;
+	a->size += LARGE_HDR + size;
+	a->used += size;
+	return (char *) l + LARGE_HDR;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+	if (size > ARENA_MAX_CLASS)
+		return arena_alloc_large(a, size);
+
+	unsigned int cls = arena_class(size);
+	size_t cls_size = arena_class_size(cls);
+	void *ret = a->free[cls];
+
+	if (ret) {
+		a->free[cls] = *(void **) ret;
+		goto out;
+	}
+
+	if ((size_t) (a->end - a->pos) < cls_size) {
+		struct arena_chunk *c = g_malloc(ARENA_CHUNK_SIZE);
+		c->next = a->chunks;
+		a->chunks = c;
+		a->pos = (char *) c + CHUNK_HDR;
+		a->end = (char *) c + ARENA_CHUNK_SIZE;
+		a->size += ARENA_CHUNK_SIZE;
+	}
+	ret = a->pos;
+	a->pos += cls_size;
+
+out:
+	a->used += cls_size;
+	return ret;
+}
+
+void *arena_alloc0(struct arena *a, size_t size) {
+	void *ret = arena_alloc(a, size);
+	memset(ret, 0, size);
+	return ret;
+}
+
+void arena_free(struct arena *a, void *p, size_t size) {
+	if (!p)
+		return;
+
+	if (size > ARENA_MAX_CLASS) {
+		struct arena_large *l = (void *) ((char *) p - LARGE_HDR);
+		*l->pprev = l->next;
+		if (l->next)
+			l->next->pprev = l->pprev;
+		a->size -= LARGE_HDR + l->size;
+		a->used -= l->size;
+		g_free(l);
+		return;
+	}
+
+	unsigned int cls = arena_class(size);
+	*(void **) p = a->free[cls];
+	a->free[cls] = p;
+	a->used -= arena_class_size(cls);
+}
@@ -67,8 +67,7 @@ struct xmlrpc_helper {
 static struct global_stats_counter rtpe_stats_intv;		// copied out once per timer run
 
 
-rwlock_t rtpe_callhash_lock;
-GHashTable *rtpe_callhash;
+struct sharded_hash rtpe_callhash;
 struct call_iterator_list rtpe_call_iterators[NUM_CALL_ITERATORS];
 static struct mqtt_timer *global_mqtt_timer;
 
@@ -95,6 +94,8 @@ static int call_timer_delete_monologues(struct call *c) {
 	rwlock_unlock_r(&c->master_lock);
 	rwlock_lock_w(&c->master_lock);
 
+	kernel_batch_begin();
+
 	for (i = c->monologues.head; i; i = i->next) {
 		ml = i->data;
 
@@ -110,6 +111,8 @@ static int call_timer_delete_monologues(struct call *c) {
 		update = true;
 	}
 
+	kernel_batch_end();
+
 	c->ml_deleted = min_deleted;
 
 	rwlock_unlock_w(&c->master_lock);
@@ -127,11 +130,12 @@ void call_make_own_foreign(struct call *c, bool foreign) {
 	statistics_update_foreignown_dec(c);
 	c->foreign_call = foreign ? 1 : 0;
 	statistics_update_foreignown_inc(c);
+	g_atomic_int_set(&c->redis_resync, 1);
 }
 
 
 
-/* called with hashlock held */
+/* called with a reference held, from any of the sweep threads */
 static void call_timer_iterator(struct call *c, struct iterator_helper *hlp) {
 	GList *it;
 	unsigned int check;
@@ -538,215 +542,334 @@ static void count_stream_stats_kernel(struct packet_stream *ps) {
 #define DS(x) DS_io(x, ps, &ke->stats_in, in)
 #define DSo(x) DS_io(x, sink, stats_o, out)
 
-void call_timer(void *ptr) {
-	struct iterator_helper hlp;
-	GList *i;
-	struct rtpengine_list_entry *ke;
+// called without locks held, takes the call's master lock
+static void call_timer_kernel_entry(struct rtpengine_list_entry *ke) {
 	struct packet_stream *ps;
 	int j;
 	struct rtp_stats *rs;
 	unsigned int pt;
 	endpoint_t ep;
-	struct timeval tv_start;
-	long long run_diff_us;
-
-	// timers are run in a single thread, so no locking required here
-	static struct timeval last_run;
-	static long long interval = 900000; // usec
-
-	tv_start = rtpe_now;
 
-	// ready to start?
-	run_diff_us = timeval_diff(&tv_start, &last_run);
-	if (run_diff_us < interval)
+	kernel2endpoint(&ep, &ke->target.local);
+	AUTO_CLEANUP(struct stream_fd *sfd, stream_fd_auto_cleanup) = stream_fd_lookup(&ep);
+	if (!sfd)
 		return;
 
-	last_run = tv_start;
-
-	ZERO(hlp);
-
-	ITERATE_CALL_LIST_START(CALL_ITERATOR_TIMER, c);
-		call_timer_iterator(c, &hlp);
-	ITERATE_CALL_LIST_NEXT_END(c);
-
-	stats_counters_calc_rate(&rtpe_stats, run_diff_us, &rtpe_stats_intv, &rtpe_stats_rate);
-
-	// TODO: should be moved into a separate thread/timer
-	stats_rate_min_max(&rtpe_rate_graphite_min_max, &rtpe_stats_rate);
-
-	// stats derived while iterating calls
-	RTPE_GAUGE_SET(transcoded_media, hlp.transcoded_media);
-
-	// TODO: eliminate/split out most of what this single central timer does
-	i = hlp.count ? kernel_list() : NULL;
-	while (i) {
-		ke = i->data;
+	log_info_stream_fd(sfd);
 
-		kernel2endpoint(&ep, &ke->target.local);
-		AUTO_CLEANUP(struct stream_fd *sfd, stream_fd_auto_cleanup) = stream_fd_lookup(&ep);
-		if (!sfd)
-			goto next;
-
-		log_info_stream_fd(sfd);
+	rwlock_lock_r(&sfd->call->master_lock);
 
-		rwlock_lock_r(&sfd->call->master_lock);
-
-		ps = sfd->stream;
-		if (!ps || ps->selected_sfd != sfd) {
-			rwlock_unlock_r(&sfd->call->master_lock);
-			goto next;
-		}
+	ps = sfd->stream;
+	if (!ps || ps->selected_sfd != sfd) {
+		rwlock_unlock_r(&sfd->call->master_lock);
+		return;
+	}
 
-		uint64_t diff_packets_in, diff_bytes_in, diff_errors_in;
-		uint64_t diff_packets_out, diff_bytes_out, diff_errors_out;
+	uint64_t diff_packets_in, diff_bytes_in, diff_errors_in;
+	uint64_t diff_packets_out, diff_bytes_out, diff_errors_out;
 
-		DS(packets);
-		DS(bytes);
-		DS(errors);
+	DS(packets);
+	DS(bytes);
+	DS(errors);
 
 
-		if (ke->stats_in.packets != atomic64_get(&ps->kernel_stats_in.packets)) {
-			atomic64_set(&ps->last_packet, rtpe_now.tv_sec);
-			count_stream_stats_kernel(ps);
-		}
+	if (ke->stats_in.packets != atomic64_get(&ps->kernel_stats_in.packets)) {
+		atomic64_set(&ps->last_packet, rtpe_now.tv_sec);
+		count_stream_stats_kernel(ps);
+	}
 
-		ps->in_tos_tclass = ke->stats_in.tos;
+	ps->in_tos_tclass = ke->stats_in.tos;
 
 #if (RE_HAS_MEASUREDELAY)
-		/* XXX fix atomicity */
-		ps->stats_in.delay_min = ke->stats_in.delay_min;
-		ps->stats_in.delay_avg = ke->stats_in.delay_avg;
-		ps->stats_in.delay_max = ke->stats_in.delay_max;
+	/* XXX fix atomicity */
+	ps->stats_in.delay_min = ke->stats_in.delay_min;
+	ps->stats_in.delay_avg = ke->stats_in.delay_avg;
+	ps->stats_in.delay_max = ke->stats_in.delay_max;
 #endif
 
-		atomic64_set(&ps->kernel_stats_in.bytes, ke->stats_in.bytes);
-		atomic64_set(&ps->kernel_stats_in.packets, ke->stats_in.packets);
-		atomic64_set(&ps->kernel_stats_in.errors, ke->stats_in.errors);
+	atomic64_set(&ps->kernel_stats_in.bytes, ke->stats_in.bytes);
+	atomic64_set(&ps->kernel_stats_in.packets, ke->stats_in.packets);
+	atomic64_set(&ps->kernel_stats_in.errors, ke->stats_in.errors);
 
-		uint64_t max_diff = 0;
-		int max_pt = -1;
-		for (j = 0; j < ke->target.num_payload_types; j++) {
-			pt = ke->target.pt_input[j].pt_num;
-			rs = g_hash_table_lookup(ps->rtp_stats, GINT_TO_POINTER(pt));
-			if (!rs)
-				continue;
-			if (ke->rtp_stats[j].packets > atomic64_get(&rs->packets)) {
-				uint64_t diff = ke->rtp_stats[j].packets - atomic64_get(&rs->packets);
-				atomic64_add(&rs->packets, diff);
-				if (diff > max_diff) {
-					max_diff = diff;
-					max_pt = j;
-				}
+	uint64_t max_diff = 0;
+	int max_pt = -1;
+	for (j = 0; j < ke->target.num_payload_types; j++) {
+		pt = ke->target.pt_input[j].pt_num;
+		rs = g_hash_table_lookup(ps->rtp_stats, GINT_TO_POINTER(pt));
+		if (!rs)
+			continue;
+		if (ke->rtp_stats[j].packets > atomic64_get(&rs->packets)) {
+			uint64_t diff = ke->rtp_stats[j].packets - atomic64_get(&rs->packets);
+			atomic64_add(&rs->packets, diff);
+			if (diff > max_diff) {
+				max_diff = diff;
+				max_pt = j;
 			}
-			if (ke->rtp_stats[j].bytes > atomic64_get(&rs->bytes))
-				atomic64_add(&rs->bytes,
-						ke->rtp_stats[j].bytes - atomic64_get(&rs->bytes));
-			atomic64_set(&rs->kernel_packets, ke->rtp_stats[j].packets);
-			atomic64_set(&rs->kernel_bytes, ke->rtp_stats[j].bytes);
 		}
+		if (ke->rtp_stats[j].bytes > atomic64_get(&rs->bytes))
+			atomic64_add(&rs->bytes,
+					ke->rtp_stats[j].bytes - atomic64_get(&rs->bytes));
+		atomic64_set(&rs->kernel_packets, ke->rtp_stats[j].packets);
+		atomic64_set(&rs->kernel_bytes, ke->rtp_stats[j].bytes);
+	}
 
-		bool update = false;
+	bool update = false;
 
-		if (diff_packets_in)
-			sfd->call->foreign_media = 0;
+	if (diff_packets_in)
+		sfd->call->foreign_media = 0;
 
-		if (!ke->target.non_forwarding && diff_packets_in) {
-			for (GList *l = ps->rtp_sinks.head; l; l = l->next) {
-				struct sink_handler *sh = l->data;
-				struct packet_stream *sink = sh->sink;
+	if (!ke->target.non_forwarding && diff_packets_in) {
+		for (GList *l = ps->rtp_sinks.head; l; l = l->next) {
+			struct sink_handler *sh = l->data;
+			struct packet_stream *sink = sh->sink;
 
-				if (sh->kernel_output_idx < 0
-						|| sh->kernel_output_idx >= ke->target.num_destinations)
-					continue;
+			if (sh->kernel_output_idx < 0
+					|| sh->kernel_output_idx >= ke->target.num_destinations)
+				continue;
 
-				struct rtpengine_output_info *o = &ke->outputs[sh->kernel_output_idx];
-				struct rtpengine_stats *stats_o = &ke->stats_out[sh->kernel_output_idx];
-
-				DSo(bytes);
-				DSo(packets);
-				DSo(errors);
-
-				atomic64_set(&sink->kernel_stats_out.bytes, stats_o->bytes);
-				atomic64_set(&sink->kernel_stats_out.packets, stats_o->packets);
-				atomic64_set(&sink->kernel_stats_out.errors, stats_o->errors);
-
-				mutex_lock(&sink->out_lock);
-				for (unsigned int u = 0; u < G_N_ELEMENTS(ke->target.ssrc); u++) {
-					if (!ke->target.ssrc[u]) // end of list
-						break;
-					uint32_t out_ssrc = o->ssrc_out[u];
-					if (!out_ssrc)
-						out_ssrc = ke->target.ssrc[u];
-					struct ssrc_ctx *ctx = __hunt_ssrc_ctx(ntohl(out_ssrc),
-							sink->ssrc_out, 0);
-					if (!ctx)
-						continue;
-					if (max_pt != -1)
-						payload_tracker_add(&ctx->tracker, max_pt);
-					if (sink->crypto.params.crypto_suite
-							&& o->encrypt.last_index[u] - ctx->srtp_index > 0x4000)
-					{
-						ilog(LOG_DEBUG, "Updating SRTP encryption index from %" PRIu64
-								" to %" PRIu64,
-								ctx->srtp_index,
-								o->encrypt.last_index[u]);
-						ctx->srtp_index = o->encrypt.last_index[u];
-						update = true;
-					}
-				}
-				mutex_unlock(&sink->out_lock);
-			}
+			struct rtpengine_output_info *o = &ke->outputs[sh->kernel_output_idx];
+			struct rtpengine_stats *stats_o = &ke->stats_out[sh->kernel_output_idx];
+
+			DSo(bytes);
+			DSo(packets);
+			DSo(errors);
 
-			mutex_lock(&ps->in_lock);
+			atomic64_set(&sink->kernel_stats_out.bytes, stats_o->bytes);
+			atomic64_set(&sink->kernel_stats_out.packets, stats_o->packets);
+			atomic64_set(&sink->kernel_stats_out.errors, stats_o->errors);
 
+			mutex_lock(&sink->out_lock);
 			for (unsigned int u = 0; u < G_N_ELEMENTS(ke->target.ssrc); u++) {
 				if (!ke->target.ssrc[u]) // end of list
 					break;
-				struct ssrc_ctx *ctx = __hunt_ssrc_ctx(ntohl(ke->target.ssrc[u]),
-						ps->ssrc_in, 0);
+				uint32_t out_ssrc = o->ssrc_out[u];
+				if (!out_ssrc)
+					out_ssrc = ke->target.ssrc[u];
+				struct ssrc_ctx *ctx = __hunt_ssrc_ctx(ntohl(out_ssrc),
+						sink->ssrc_out, 0);
 				if (!ctx)
 					continue;
-				// TODO: add in SSRC stats similar to __stream_update_stats
-				atomic64_set(&ctx->last_seq, ke->target.decrypt.last_index[u]);
-
 				if (max_pt != -1)
 					payload_tracker_add(&ctx->tracker, max_pt);
-
-				if (sfd->crypto.params.crypto_suite
-						&& ke->target.decrypt.last_index[u]
-						- ctx->srtp_index > 0x4000) {
-					ilog(LOG_DEBUG, "Updating SRTP decryption index from %" PRIu64
+				if (sink->crypto.params.crypto_suite
+						&& o->encrypt.last_index[u] - ctx->srtp_index > 0x4000)
+				{
+					ilog(LOG_DEBUG, "Updating SRTP encryption index from %" PRIu64
 							" to %" PRIu64,
 							ctx->srtp_index,
-							ke->target.decrypt.last_index[u]);
-					ctx->srtp_index = ke->target.decrypt.last_index[u];
+							o->encrypt.last_index[u]);
+					ctx->srtp_index = o->encrypt.last_index[u];
 					update = true;
 				}
 			}
-			mutex_unlock(&ps->in_lock);
+			mutex_unlock(&sink->out_lock);
 		}
 
-		rwlock_unlock_r(&sfd->call->master_lock);
+		mutex_lock(&ps->in_lock);
 
-		if (update)
-			redis_update_onekey(ps->call, rtpe_redis_write);
+		for (unsigned int u = 0; u < G_N_ELEMENTS(ke->target.ssrc); u++) {
+			if (!ke->target.ssrc[u]) // end of list
+				break;
+			struct ssrc_ctx *ctx = __hunt_ssrc_ctx(ntohl(ke->target.ssrc[u]),
+					ps->ssrc_in, 0);
+			if (!ctx)
+				continue;
+			// TODO: add in SSRC stats similar to __stream_update_stats
+			atomic64_set(&ctx->last_seq, ke->target.decrypt.last_index[u]);
+
+			if (max_pt != -1)
+				payload_tracker_add(&ctx->tracker, max_pt);
+
+			if (sfd->crypto.params.crypto_suite
+					&& ke->target.decrypt.last_index[u]
+					- ctx->srtp_index > 0x4000) {
+				ilog(LOG_DEBUG, "Updating SRTP decryption index from %" PRIu64
+						" to %" PRIu64,
+						ctx->srtp_index,
+						ke->target.decrypt.last_index[u]);
+				ctx->srtp_index = ke->target.decrypt.last_index[u];
+				update = true;
+			}
+		}
+		mutex_unlock(&ps->in_lock);
+	}
 
-next:
+	rwlock_unlock_r(&sfd->call->master_lock);
+
+	if (update)
+		redis_update_onekey(ps->call, rtpe_redis_write);
+}
+
+/* The periodic sweep over all calls and kernel entries is split into small units of work that
+ * any number of threads can pick up: the shards of the call hash, and then the individual
+ * entries returned from the kernel. The timer thread takes part and waits for the others. */
+struct call_timer_sweep {
+	void (*func)(struct call_timer_sweep *);
+	struct timeval now;
+	mutex_t lock;
+	cond_t cond;
+	unsigned int running; // threads still working, protected by ->lock
+	volatile gint next; // next unit of work to pick up
+	struct iterator_helper hlp; // merged from all threads, protected by ->lock
+	struct rtpengine_list_entry **entries;
+	unsigned int num_entries;
+};
+
+static GThreadPool *call_timer_pool;
+static mutex_t call_timer_stats_lock = MUTEX_STATIC_INIT;
+static struct call_timer_stats call_timer_stats;
+
+static void call_timer_sweep_calls(struct call_timer_sweep *sw) {
+	struct iterator_helper hlp;
+	GQueue calls = G_QUEUE_INIT;
+	unsigned int idx;
+	struct call *c;
+
+	ZERO(hlp);
+
+	while ((idx = g_atomic_int_add(&sw->next, 1)) < sharded_hash_num_shards(&rtpe_callhash)) {
+		// take references so that the shard isn't locked while we work on the calls
+		struct sharded_hash_shard *sh = &rtpe_callhash.shards[idx];
+		GHashTableIter iter;
+		gpointer key, value;
+		rwlock_lock_r(&sh->lock);
+		g_hash_table_iter_init(&iter, sh->ht);
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			g_queue_push_tail(&calls, obj_get((struct call *) value));
+		rwlock_unlock_r(&sh->lock);
+
+		while ((c = g_queue_pop_head(&calls))) {
+			call_timer_iterator(c, &hlp);
+			obj_put(c);
+		}
+	}
+
+	mutex_lock(&sw->lock);
+	sw->hlp.count += hlp.count;
+	sw->hlp.transcoded_media += hlp.transcoded_media;
+	sw->hlp.del_timeout = g_slist_concat(hlp.del_timeout, sw->hlp.del_timeout);
+	sw->hlp.del_scheduled = g_slist_concat(hlp.del_scheduled, sw->hlp.del_scheduled);
+	mutex_unlock(&sw->lock);
+}
+
+static void call_timer_sweep_kernel(struct call_timer_sweep *sw) {
+	unsigned int idx;
+
+	while ((idx = g_atomic_int_add(&sw->next, 1)) < sw->num_entries) {
+		struct rtpengine_list_entry *ke = sw->entries[idx];
+		call_timer_kernel_entry(ke);
 		g_slice_free1(sizeof(*ke), ke);
-		i = g_list_delete_link(i, i);
 		log_info_pop();
 	}
+}
+
+static void call_timer_sweep_worker(void *p, void *u) {
+	struct call_timer_sweep *sw = p;
+
+	rtpe_now = sw->now;
+	sw->func(sw);
+	log_info_reset();
+
+	mutex_lock(&sw->lock);
+	if (--sw->running == 0)
+		cond_broadcast(&sw->cond);
+	mutex_unlock(&sw->lock);
+}
+
+static void call_timer_sweep_run(struct call_timer_sweep *sw, void (*func)(struct call_timer_sweep *)) {
+	sw->func = func;
+	sw->next = 0;
+	sw->running = 1;
+
+	if (call_timer_pool) {
+		unsigned int num = g_thread_pool_get_max_threads(call_timer_pool);
+		mutex_lock(&sw->lock);
+		sw->running += num;
+		mutex_unlock(&sw->lock);
+		for (unsigned int i = 0; i < num; i++)
+			g_thread_pool_push(call_timer_pool, sw, NULL);
+	}
+
+	// do our share and wait for the others
+	call_timer_sweep_worker(sw, NULL);
+
+	mutex_lock(&sw->lock);
+	while (sw->running)
+		cond_wait(&sw->cond, &sw->lock);
+	mutex_unlock(&sw->lock);
+}
+
+void call_timer(void *ptr) {
+	struct call_timer_sweep sw;
+	struct timeval tv_start, tv_calls, tv_stop;
+	long long run_diff_us;
+
+	// timers are run in a single thread, so no locking required here
+	static struct timeval last_run;
+	static long long interval = 900000; // usec
+
+	tv_start = rtpe_now;
 
-	kill_calls_timer(hlp.del_scheduled, NULL);
-	kill_calls_timer(hlp.del_timeout, rtpe_config.b2b_url);
+	// ready to start?
+	run_diff_us = timeval_diff(&tv_start, &last_run);
+	if (run_diff_us < interval)
+		return;
+
+	last_run = tv_start;
+
+	ZERO(sw);
+	sw.now = tv_start;
+	mutex_init(&sw.lock);
+	cond_init(&sw.cond);
+
+	call_timer_sweep_run(&sw, call_timer_sweep_calls);
+
+	gettimeofday(&tv_calls, NULL);
+
+	stats_counters_calc_rate(&rtpe_stats, run_diff_us, &rtpe_stats_intv, &rtpe_stats_rate);
+
+	// TODO: should be moved into a separate thread/timer
+	stats_rate_min_max(&rtpe_rate_graphite_min_max, &rtpe_stats_rate);
+
+	// stats derived while iterating calls
+	RTPE_GAUGE_SET(transcoded_media, sw.hlp.transcoded_media);
+
+	GList *list = sw.hlp.count ? kernel_list() : NULL;
+	if (list) {
+		sw.num_entries = g_list_length(list);
+		sw.entries = g_new(struct rtpengine_list_entry *, sw.num_entries);
+		unsigned int idx = 0;
+		for (GList *l = list; l; l = l->next)
+			sw.entries[idx++] = l->data;
+		g_list_free(list);
+
+		call_timer_sweep_run(&sw, call_timer_sweep_kernel);
+
+		g_free(sw.entries);
+	}
+
+	mutex_destroy(&sw.lock);
+
+	kill_calls_timer(sw.hlp.del_scheduled, NULL);
+	kill_calls_timer(sw.hlp.del_timeout, rtpe_config.b2b_url);
 
 	call_interfaces_timer();
 
-	struct timeval tv_stop;
 	gettimeofday(&tv_stop, NULL);
 	long long duration = timeval_diff(&tv_stop, &tv_start);
 	ilog(LOG_DEBUG, "timer run time = %llu.%06llu sec", duration / 1000000, duration % 1000000);
 
+	mutex_lock(&call_timer_stats_lock);
+	call_timer_stats.runs++;
+	call_timer_stats.calls = sw.hlp.count;
+	call_timer_stats.kernel_entries = sw.num_entries;
+	call_timer_stats.duration_us = duration;
+	call_timer_stats.max_duration_us = MAX(call_timer_stats.max_duration_us, duration);
+	call_timer_stats.calls_us = timeval_diff(&tv_calls, &tv_start);
+	call_timer_stats.kernel_us = timeval_diff(&tv_stop, &tv_calls);
+	call_timer_stats.interval_us = interval;
+	mutex_unlock(&call_timer_stats_lock);
+
 	// increase timer run duration if runtime was within 10% of the interval
 	if (duration > interval / 10) {
 		interval *= 2;
@@ -760,14 +883,22 @@ next:
 
 	release_closed_sockets();
 }
+
+void call_timer_get_stats(struct call_timer_stats *out) {
+	mutex_lock(&call_timer_stats_lock);
+	*out = call_timer_stats;
+	mutex_unlock(&call_timer_stats_lock);
+}
 #undef DS
 
 
 int call_init() {
-	rtpe_callhash = g_hash_table_new(str_hash, str_equal);
-	if (!rtpe_callhash)
-		return -1;
-	rwlock_init(&rtpe_callhash_lock);
+	sharded_hash_init(&rtpe_callhash, CALLHASH_SHARD_BITS, str_hash, str_equal);
+
+	// the timer thread is one of the sweep threads
+	if (rtpe_config.timer_sweep_threads > 1)
+		call_timer_pool = g_thread_pool_new(call_timer_sweep_worker, NULL,
+				rtpe_config.timer_sweep_threads - 1, TRUE, NULL);
 
 	for (int i = 0; i < NUM_CALL_ITERATORS; i++)
 		mutex_init(&rtpe_call_iterators[i].lock);
@@ -826,24 +957,31 @@ static void __call_iterator_remove(struct call *c) {
 	}
 
 }
+static bool __call_collect(void *key, void *value, void *arg) {
+	GQueue *q = arg;
+	g_queue_push_tail(q, value);
+	return true;
+}
 void call_free(void) {
 	mqtt_timer_stop(&global_mqtt_timer);
-	GList *ll = g_hash_table_get_values(rtpe_callhash);
-	for (GList *l = ll; l; l = l->next) {
-		struct call *c = l->data;
+	if (call_timer_pool)
+		g_thread_pool_free(call_timer_pool, TRUE, TRUE);
+	GQueue calls = G_QUEUE_INIT;
+	sharded_hash_foreach(&rtpe_callhash, __call_collect, &calls);
+	struct call *c;
+	while ((c = g_queue_pop_head(&calls))) {
 		__call_iterator_remove(c);
 		__call_cleanup(c);
 		obj_put(c);
 	}
-	g_list_free(ll);
-	g_hash_table_destroy(rtpe_callhash);
+	sharded_hash_destroy(&rtpe_callhash);
 }
 
 
 
 struct call_media *call_media_new(struct call *call) {
 	struct call_media *med;
-	med = uid_slice_alloc0(med, &call->medias);
+	med = call_uid_alloc0(call, med, &call->medias);
 	med->call = call;
 	codec_store_init(&med->codecs, med);
 	mutex_init(&med->dtmf_lock);
@@ -989,7 +1127,7 @@ static struct endpoint_map *__get_endpoint_map(struct call_media *media, unsigne
 
 make_new:
 	__C_DBG("allocating new %sendpoint map", ep ? "" : "wildcard ");
-	em = uid_slice_alloc0(em, &media->call->endpoint_maps);
+	em = call_uid_alloc0(media->call, em, &media->call->endpoint_maps);
 	if (ep)
 		em->endpoint = *ep;
 	else
@@ -1105,7 +1243,7 @@ static void __rtp_stats_free(void *p) {
 struct packet_stream *__packet_stream_new(struct call *call) {
 	struct packet_stream *stream;
 
-	stream = uid_slice_alloc0(stream, &call->streams);
+	stream = call_uid_alloc0(call, stream, &call->streams);
 	mutex_init(&stream->in_lock);
 	mutex_init(&stream->out_lock);
 	stream->call = call;
@@ -1376,7 +1514,7 @@ void __rtp_stats_update(GHashTable *dst, struct codec_store *cs) {
 
 void free_sink_handler(void *p) {
 	struct sink_handler *sh = p;
-	g_slice_free1(sizeof(*sh), sh);
+	call_obj_free(sh->sink->call, sh, sizeof(*sh));
 }
 
 /**
@@ -1384,7 +1522,7 @@ void free_sink_handler(void *p) {
  * using the __init_streams() through __add_sink_handler().
  */
 void __add_sink_handler(GQueue *q, struct packet_stream *sink, const struct sink_attrs *attrs) {
-	struct sink_handler *sh = g_slice_alloc0(sizeof(*sh));
+	struct sink_handler *sh = call_obj_alloc0(sink->call, sizeof(*sh));
 	sh->sink = sink;
 	sh->kernel_output_idx = -1;
 	if (attrs)
@@ -3160,8 +3298,8 @@ static void __unsubscribe_one_link(struct call_monologue *which, GList *which_cs
 	g_queue_delete_link(&which->subscriptions, which_cs_link);
 	g_hash_table_remove(which->subscriptions_ht, cs->monologue);
 	g_hash_table_remove(from->subscribers_ht, rev_cs->monologue);
-	g_slice_free1(sizeof(*cs), cs);
-	g_slice_free1(sizeof(*rev_cs), rev_cs);
+	call_obj_free(which->call, cs, sizeof(*cs));
+	call_obj_free(which->call, rev_cs, sizeof(*rev_cs));
 }
 static bool __unsubscribe_one(struct call_monologue *which, struct call_monologue *from) {
 	GList *l = g_hash_table_lookup(which->subscriptions_ht, from);
@@ -3207,8 +3345,8 @@ void __add_subscription(struct call_monologue *which, struct call_monologue *to,
 	ilog(LOG_DEBUG, "Subscribing '" STR_FORMAT_M "' to '" STR_FORMAT_M "'",
 			STR_FMT_M(&which->tag),
 			STR_FMT_M(&to->tag));
-	struct call_subscription *which_cs = g_slice_alloc0(sizeof(*which_cs));
-	struct call_subscription *to_rev_cs = g_slice_alloc0(sizeof(*to_rev_cs));
+	struct call_subscription *which_cs = call_obj_alloc0(which->call, sizeof(*which_cs));
+	struct call_subscription *to_rev_cs = call_obj_alloc0(which->call, sizeof(*to_rev_cs));
 	which_cs->monologue = to;
 	to_rev_cs->monologue = which;
 	which_cs->media_offset = offset;
@@ -3484,6 +3622,8 @@ int monologue_subscribe_answer(struct call_monologue *dst_ml, struct sdp_ng_flag
 	}
 
 	__update_init_subscribers(dst_ml, streams, flags, flags->opmode);
+
+	kernel_batch_begin();
 	dialogue_unkernelize(dst_ml);
 
 	for (GList *l = dst_ml->subscriptions.head; l; l = l->next) {
@@ -3493,12 +3633,15 @@ int monologue_subscribe_answer(struct call_monologue *dst_ml, struct sdp_ng_flag
 		__update_init_subscribers(src_ml, NULL, NULL, flags->opmode);
 		dialogue_unkernelize(src_ml);
 	}
+	kernel_batch_end();
 
 	return 0;
 }
 
 /* called with call->master_lock held in W */
 int monologue_unsubscribe(struct call_monologue *dst_ml, struct sdp_ng_flags *flags) {
+	kernel_batch_begin();
+
 	for (GList *l = dst_ml->subscriptions.head; l; ) {
 		GList *next = l->next;
 		struct call_subscription *cs = l->data;
@@ -3515,6 +3658,8 @@ int monologue_unsubscribe(struct call_monologue *dst_ml, struct sdp_ng_flags *fl
 		l = next;
 	}
 
+	kernel_batch_end();
+
 	return 0;
 }
 
@@ -3593,6 +3738,8 @@ next:
 }
 
 static void __call_cleanup(struct call *c) {
+	kernel_batch_begin();
+
 	for (GList *l = c->streams.head; l; l = l->next) {
 		struct packet_stream *ps = l->data;
 
@@ -3609,6 +3756,8 @@ static void __call_cleanup(struct call *c) {
 		g_queue_clear_full(&ps->rtp_mirrors, free_sink_handler);
 	}
 
+	kernel_batch_end();
+
 	for (GList *l = c->medias.head; l; l = l->next) {
 		struct call_media *md = l->data;
 		ice_shutdown(&md->ice_agent);
@@ -3650,13 +3799,14 @@ void call_destroy(struct call *c) {
 		return;
 	}
 
-	rwlock_lock_w(&rtpe_callhash_lock);
-	ret = (g_hash_table_lookup(rtpe_callhash, &c->callid) == c);
+	struct sharded_hash_shard *sh = sharded_hash_shard(&rtpe_callhash, &c->callid);
+	rwlock_lock_w(&sh->lock);
+	ret = (g_hash_table_lookup(sh->ht, &c->callid) == c);
 	if (ret) {
-		g_hash_table_remove(rtpe_callhash, &c->callid);
+		sharded_hash_remove_nl(&rtpe_callhash, sh, &c->callid);
 		RTPE_GAUGE_DEC(total_sessions);
 	}
-	rwlock_unlock_w(&rtpe_callhash_lock);
+	rwlock_unlock_w(&sh->lock);
 
 	// if call not found in callhash => previously deleted
 	if (!ret)
@@ -3877,7 +4027,7 @@ void call_media_free(struct call_media **mdp) {
 	g_queue_clear_full(&md->dtmf_recv, dtmf_event_free);
 	g_queue_clear_full(&md->dtmf_send, dtmf_event_free);
 	mutex_destroy(&md->dtmf_lock);
-	g_slice_free1(sizeof(*md), md);
+	call_obj_free(md->call, md, sizeof(*md));
 	*mdp = NULL;
 }
 
@@ -3897,6 +4047,7 @@ static void __call_free(void *p) {
 	if (c->dtls_cert)
 		obj_put(c->dtls_cert);
 	mqtt_timer_stop(&c->mqtt_timer);
+	poller_release_call(c->poller);
 
 	while (c->monologues.head) {
 		m = g_queue_pop_head(&c->monologues);
@@ -3912,9 +4063,9 @@ static void __call_free(void *p) {
 		sdp_streams_free(&m->last_in_sdp_streams);
 		g_hash_table_destroy(m->subscribers_ht);
 		g_hash_table_destroy(m->subscriptions_ht);
-		g_queue_clear_full(&m->subscribers, call_subscription_free);
-		g_queue_clear_full(&m->subscriptions, call_subscription_free);
-		g_slice_free1(sizeof(*m), m);
+		// subscriptions and the monologue itself go with the call's arena
+		g_queue_clear(&m->subscribers);
+		g_queue_clear(&m->subscriptions);
 	}
 
 	while (c->medias.head) {
@@ -3926,12 +4077,12 @@ static void __call_free(void *p) {
 		em = g_queue_pop_head(&c->endpoint_maps);
 
 		g_queue_clear_full(&em->intf_sfds, (void *) free_intf_list);
-		g_slice_free1(sizeof(*em), em);
 	}
 
 	g_hash_table_destroy(c->tags);
 	g_hash_table_destroy(c->viabranches);
 	g_hash_table_destroy(c->labels);
+	redis_call_fields_free(c->redis_fields);
 
 	while (c->streams.head) {
 		ps = g_queue_pop_head(&c->streams);
@@ -3942,7 +4093,6 @@ static void __call_free(void *p) {
 			ssrc_ctx_put(&ps->ssrc_in[u]);
 		for (unsigned int u = 0; u < G_N_ELEMENTS(ps->ssrc_out); u++)
 			ssrc_ctx_put(&ps->ssrc_out[u]);
-		g_slice_free1(sizeof(*ps), ps);
 	}
 
 	call_buffer_free(&c->buffer);
@@ -3967,7 +4117,11 @@ static struct call *call_create(const str *callid) {
 	c->created = rtpe_now;
 	c->dtls_cert = dtls_cert();
 	c->tos = rtpe_config.default_tos;
-	if (rtpe_config.cpu_affinity)
+	if (rtpe_config.poller_cpu_affinity)
+		c->poller = poller_map_assign_call(rtpe_poller_map);
+	if (poller_cpu(c->poller) >= 0)
+		c->cpu_affinity = poller_cpu(c->poller);
+	else if (rtpe_config.cpu_affinity)
 		c->cpu_affinity = call_socket_cpu_affinity++ % rtpe_config.cpu_affinity;
 	else
 		c->cpu_affinity = -1;
@@ -3983,22 +4137,23 @@ static struct call *call_create(const str *callid) {
 /* returns call with master_lock held in W */
 struct call *call_get_or_create(const str *callid, bool foreign, bool exclusive) {
 	struct call *c;
+	struct sharded_hash_shard *sh = sharded_hash_shard(&rtpe_callhash, callid);
 
 restart:
-	rwlock_lock_r(&rtpe_callhash_lock);
-	c = g_hash_table_lookup(rtpe_callhash, callid);
+	rwlock_lock_r(&sh->lock);
+	c = g_hash_table_lookup(sh->ht, callid);
 	if (!c) {
-		rwlock_unlock_r(&rtpe_callhash_lock);
+		rwlock_unlock_r(&sh->lock);
 		/* completely new call-id, create call */
 		c = call_create(callid);
-		rwlock_lock_w(&rtpe_callhash_lock);
-		if (g_hash_table_lookup(rtpe_callhash, callid)) {
+		rwlock_lock_w(&sh->lock);
+		if (g_hash_table_lookup(sh->ht, callid)) {
 			/* preempted */
-			rwlock_unlock_w(&rtpe_callhash_lock);
+			rwlock_unlock_w(&sh->lock);
 			obj_put(c);
 			goto restart;
 		}
-		g_hash_table_insert(rtpe_callhash, &c->callid, obj_get(c));
+		sharded_hash_insert_nl(&rtpe_callhash, sh, &c->callid, obj_get(c));
 		RTPE_GAUGE_INC(total_sessions);
 
 		c->foreign_call = foreign ? 1 : 0;
@@ -4006,7 +4161,7 @@ restart:
 		statistics_update_foreignown_inc(c);
 
 		rwlock_lock_w(&c->master_lock);
-		rwlock_unlock_w(&rtpe_callhash_lock);
+		rwlock_unlock_w(&sh->lock);
 
 		for (int i = 0; i < NUM_CALL_ITERATORS; i++) {
 			c->iterator[i].link.data = obj_get(c);
@@ -4045,7 +4200,7 @@ restart:
 			obj_hold(c);
 			rwlock_lock_w(&c->master_lock);
 		}
-		rwlock_unlock_r(&rtpe_callhash_lock);
+		rwlock_unlock_r(&sh->lock);
 	}
 
 	if (c)
@@ -4064,17 +4219,18 @@ restart:
  */
 struct call *call_get(const str *callid) {
 	struct call *ret;
+	struct sharded_hash_shard *sh = sharded_hash_shard(&rtpe_callhash, callid);
 
-	rwlock_lock_r(&rtpe_callhash_lock);
-	ret = g_hash_table_lookup(rtpe_callhash, callid);
+	rwlock_lock_r(&sh->lock);
+	ret = g_hash_table_lookup(sh->ht, callid);
 	if (!ret) {
-		rwlock_unlock_r(&rtpe_callhash_lock);
+		rwlock_unlock_r(&sh->lock);
 		return NULL;
 	}
 
 	rwlock_lock_w(&ret->master_lock);
 	obj_hold(ret);
-	rwlock_unlock_r(&rtpe_callhash_lock);
+	rwlock_unlock_r(&sh->lock);
 
 	log_info_call(ret);
 	return ret;
@@ -4099,7 +4255,7 @@ struct call_monologue *__monologue_create(struct call *call) {
 	struct call_monologue *ret;
 
 	__C_DBG("creating new monologue");
-	ret = uid_slice_alloc0(ret, &call->monologues);
+	ret = call_uid_alloc0(call, ret, &call->monologues);
 
 	ret->call = call;
 	ret->created = rtpe_now.tv_sec;
@@ -4160,6 +4316,9 @@ void __monologue_unkernelize(struct call_monologue *monologue) {
 	if (!monologue)
 		return;
 
+	// all streams of the monologue in one go
+	kernel_batch_begin();
+
 	for (l = monologue->medias.head; l; l = l->next) {
 		media = l->data;
 
@@ -4170,8 +4329,12 @@ void __monologue_unkernelize(struct call_monologue *monologue) {
 			__unconfirm_sinks(&stream->rtcp_sinks);
 		}
 	}
+
+	kernel_batch_end();
 }
 void dialogue_unkernelize(struct call_monologue *ml) {
+	kernel_batch_begin();
+
 	__monologue_unkernelize(ml);
 
 	for (GList *sub = ml->subscriptions.head; sub; sub = sub->next) {
@@ -4182,6 +4345,8 @@ void dialogue_unkernelize(struct call_monologue *ml) {
 		struct call_subscription *cs = sub->data;
 		__monologue_unkernelize(cs->monologue);
 	}
+
+	kernel_batch_end();
 }
 
 static void __unkernelize_sinks(GQueue *q) {
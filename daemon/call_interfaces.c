@@ -460,11 +460,9 @@ static void call_status_iterator(struct call *c, struct streambuf_stream *s) {
 }
 
 void calls_status_tcp(struct streambuf_stream *s) {
-	rwlock_lock_r(&rtpe_callhash_lock);
 	streambuf_printf(s->outbuf, "proxy %u "UINT64F"/%i/%i\n",
-		g_hash_table_size(rtpe_callhash),
+		sharded_hash_size(&rtpe_callhash),
 		atomic64_get(&rtpe_stats_rate.bytes_user) + atomic64_get(&rtpe_stats_rate.bytes_kernel), 0, 0);
-	rwlock_unlock_r(&rtpe_callhash_lock);
 
 	ITERATE_CALL_LIST_START(CALL_ITERATOR_MAIN, c);
 		call_status_iterator(c, s);
@@ -1638,8 +1636,7 @@ static enum load_limit_reasons call_offer_session_limit(void) {
 
 	rwlock_lock_r(&rtpe_config.config_lock);
 	if (rtpe_config.max_sessions>=0) {
-		rwlock_lock_r(&rtpe_callhash_lock);
-		if (g_hash_table_size(rtpe_callhash) -
+		if (sharded_hash_size(&rtpe_callhash) -
 				atomic64_get(&rtpe_stats_gauge.foreign_sessions) >= rtpe_config.max_sessions)
 		{
 			/* foreign calls can't get rejected
@@ -1649,7 +1646,6 @@ static enum load_limit_reasons call_offer_session_limit(void) {
 
 			ret = LOAD_LIMIT_MAX_SESSIONS;
 		}
-		rwlock_unlock_r(&rtpe_callhash_lock);
 	}
 
 	if (ret == LOAD_LIMIT_NONE && rtpe_config.load_limit) {
@@ -2058,6 +2054,12 @@ static void ng_stats_stream(bencode_item_t *list, const struct packet_stream *ps
 		bencode_dictionary_add_string_dup(dict, "local address",
 				sockaddr_print_buf(&ps->selected_sfd->socket.local.address));
 		bencode_dictionary_add_string(dict, "family", ps->selected_sfd->socket.local.address.family->name);
+		if (rtpe_config.send_batch) {
+			bencode_item_t *hist = bencode_dictionary_add_list(dict, "send batch sizes");
+			for (unsigned int i = 0; i < STATS_HIST_BUCKETS; i++)
+				bencode_list_add(hist, bencode_integer(bencode_item_buffer(hist),
+						atomic64_get(&ps->selected_sfd->send_batch_sizes[i])));
+		}
 	}
 	ng_stats_endpoint(bencode_dictionary_add_dictionary(dict, "endpoint"), &ps->endpoint);
 	ng_stats_endpoint(bencode_dictionary_add_dictionary(dict, "advertised endpoint"),
@@ -2298,6 +2300,7 @@ void ng_call_stats(struct call *call, const str *fromtag, const str *totag, benc
 	bencode_dictionary_add_integer(output, "created", call->created.tv_sec);
 	bencode_dictionary_add_integer(output, "created_us", call->created.tv_usec);
 	bencode_dictionary_add_integer(output, "last signal", call->last_signal);
+	bencode_dictionary_add_integer(output, "memory", call_memory(call));
 	ssrc = bencode_dictionary_add_dictionary(output, "SSRC");
 
 	tags = bencode_dictionary_add_dictionary(output, "tags");
@@ -2330,18 +2333,20 @@ stats:
 	ng_stats(bencode_dictionary_add_dictionary(dict, "RTCP"), &totals->totals[1], NULL);
 }
 
+struct ng_list_calls_ctx {
+	bencode_item_t *output;
+	long long int limit;
+};
+static bool ng_list_calls_add(void *key, void *value, void *arg) {
+	struct ng_list_calls_ctx *ctx = arg;
+	if (!ctx->limit--)
+		return false;
+	bencode_list_add_str_dup(ctx->output, key);
+	return true;
+}
 static void ng_list_calls(bencode_item_t *output, long long int limit) {
-	GHashTableIter iter;
-	gpointer key, value;
-
-	rwlock_lock_r(&rtpe_callhash_lock);
-
-	g_hash_table_iter_init (&iter, rtpe_callhash);
-	while (limit-- && g_hash_table_iter_next (&iter, &key, &value)) {
-		bencode_list_add_str_dup(output, key);
-	}
-
-	rwlock_unlock_r(&rtpe_callhash_lock);
+	struct ng_list_calls_ctx ctx = { .output = output, .limit = limit };
+	sharded_hash_foreach(&rtpe_callhash, ng_list_calls_add, &ctx);
 }
 
 
@@ -491,11 +491,10 @@ static void cli_incoming_list_totals(str *instr, struct cli_writer *cw) {
 }
 
 static void cli_incoming_list_numsessions(str *instr, struct cli_writer *cw) {
-       rwlock_lock_r(&rtpe_callhash_lock);
-       cw->cw_printf(cw, "Current sessions own: "UINT64F"\n", g_hash_table_size(rtpe_callhash) - atomic64_get(&rtpe_stats_gauge.foreign_sessions));
+       unsigned int cur_sessions = sharded_hash_size(&rtpe_callhash);
+       cw->cw_printf(cw, "Current sessions own: "UINT64F"\n", cur_sessions - atomic64_get(&rtpe_stats_gauge.foreign_sessions));
        cw->cw_printf(cw, "Current sessions foreign: "UINT64F"\n", atomic64_get(&rtpe_stats_gauge.foreign_sessions));
-       cw->cw_printf(cw, "Current sessions total: %i\n", g_hash_table_size(rtpe_callhash));
-       rwlock_unlock_r(&rtpe_callhash_lock);
+       cw->cw_printf(cw, "Current sessions total: %u\n", cur_sessions);
        cw->cw_printf(cw, "Current transcoded media: "UINT64F"\n", atomic64_get(&rtpe_stats_gauge.transcoded_media));
        cw->cw_printf(cw, "Current sessions ipv4 only media: " UINT64F "\n",
 		       atomic64_get(&rtpe_stats_gauge.ipv4_sessions));
@@ -619,10 +618,10 @@ static void cli_list_call_info(struct cli_writer *cw, struct call *c) {
 
 	cw->cw_printf(cw,
 			 "\ncallid: %s\ndeletionmark: %s\ncreated: %i\nproxy: %s\ntos: %u\nlast_signal: %llu\n"
-			 "redis_keyspace: %i\nforeign: %s\n\n",
+			 "redis_keyspace: %i\nforeign: %s\nmemory: %zu\n\n",
 			 c->callid.s, c->ml_deleted ? "yes" : "no", (int) c->created.tv_sec, c->created_from,
 			 (unsigned int) c->tos, (unsigned long long) c->last_signal, c->redis_hosted_db,
-			 IS_FOREIGN_CALL(c) ? "yes" : "no");
+			 IS_FOREIGN_CALL(c) ? "yes" : "no", call_memory(c));
 
 	for (l = c->monologues.head; l; l = l->next) {
 		ml = l->data;
@@ -750,7 +749,7 @@ static void cli_incoming_list_sessions(str *instr, struct cli_writer *cw) {
 		}
 		found++;
 
-		cw->cw_printf(cw, "callid: %60s | deletionmark:%4s | created:%12i | proxy:%s | redis_keyspace:%i | foreign:%s\n", call->callid.s, call->ml_deleted?"yes":"no", (int)call->created.tv_sec, call->created_from, call->redis_hosted_db, IS_FOREIGN_CALL(call)?"yes":"no");
+		cw->cw_printf(cw, "callid: %60s | deletionmark:%4s | created:%12i | proxy:%s | redis_keyspace:%i | foreign:%s | memory:%zu\n", call->callid.s, call->ml_deleted?"yes":"no", (int)call->created.tv_sec, call->created_from, call->redis_hosted_db, IS_FOREIGN_CALL(call)?"yes":"no", call_memory(call));
 
 next:;
 	ITERATE_CALL_LIST_NEXT_END(call);
@@ -17,6 +17,7 @@
 #include "timerthread.h"
 #include "log_funcs.h"
 #include "mqtt.h"
+#include "pktbuf.h"
 #ifdef WITH_TRANSCODING
 #include "fix_frame_channel_layout.h"
 #endif
@@ -875,7 +876,7 @@ static void __codec_rtcp_timer_schedule(struct call_media *media) {
 	struct rtcp_timer *rt = media->rtcp_timer;
 	if (!rt) {
 		media->rtcp_timer = rt = obj_alloc0("rtcp_timer", sizeof(*rt), __rtcp_timer_free);
-		rt->ct.tt_obj.tt = &codec_timers_thread;
+		timerthread_obj_bind(&rt->ct.tt_obj, &codec_timers_thread, media->call);
 		rt->call = obj_get(media->call);
 		rt->media = media;
 		rt->ct.next = rtpe_now;
@@ -1436,7 +1437,7 @@ void mqtt_timer_start(struct mqtt_timer **mqtp, struct call *call, struct call_m
 		return;
 
 	struct mqtt_timer *mqt = *mqtp = obj_alloc0("mqtt_timer", sizeof(*mqt), __mqtt_timer_free);
-	mqt->ct.tt_obj.tt = &codec_timers_thread;
+	timerthread_obj_bind(&mqt->ct.tt_obj, &codec_timers_thread, call);
 	mqt->call = call ? obj_get(call) : NULL;
 	mqt->self = mqtp;
 	mqt->media = media;
@@ -1788,7 +1789,7 @@ out_ch:
 
 void codec_output_rtp(struct media_packet *mp, struct codec_scheduler *csch,
 		struct codec_handler *handler,
-		char *buf, // malloc'd, room for rtp_header + filled-in payload
+		char *buf, // from pktbuf_alloc(), room for rtp_header + filled-in payload
 		unsigned int payload_len,
 		unsigned long payload_ts,
 		int marker, int seq, int seq_inc, int payload_type,
@@ -1816,7 +1817,7 @@ void codec_output_rtp(struct media_packet *mp, struct codec_scheduler *csch,
 	p->s.s = buf;
 	p->s.len = payload_len + sizeof(struct rtp_header);
 	payload_tracker_add(&ssrc_out->tracker, handler->dest_pt.payload_type);
-	p->free_func = free;
+	p->free_func = pktbuf_free;
 	p->ttq_entry.source = handler;
 	p->rtp = rh;
 	p->ts = ts;
@@ -1964,7 +1965,7 @@ static int codec_add_dtmf_packet(struct codec_ssrc_handler *ch, struct codec_ssr
 
 skip:
 	obj_put(&output_ch->h);
-	char *buf = malloc(packet->payload->len + sizeof(struct rtp_header) + RTP_BUFFER_TAIL_ROOM);
+	char *buf = pktbuf_alloc(packet->payload->len + sizeof(struct rtp_header) + RTP_BUFFER_TAIL_ROOM);
 	memcpy(buf + sizeof(struct rtp_header), packet->payload->s, packet->payload->len);
 	if (packet->bypass_seq) // inject original seq
 		codec_output_rtp(mp, &ch->csch, packet->handler ? : h, buf, packet->payload->len, packet->ts,
@@ -2140,12 +2141,10 @@ void codec_packet_free(void *pp) {
 	g_slice_free1(sizeof(*p), p);
 }
 bool codec_packet_copy(struct codec_packet *p) {
-	char *buf = malloc(p->s.len + RTP_BUFFER_TAIL_ROOM);
-	if (!buf)
-		return false;
+	char *buf = pktbuf_alloc(p->s.len + RTP_BUFFER_TAIL_ROOM);
 	memcpy(buf, p->s.s, p->s.len);
 	p->s.s = buf;
-	p->free_func = free;
+	p->free_func = pktbuf_free;
 	return true;
 }
 struct codec_packet *codec_packet_dup(struct codec_packet *p) {
@@ -2461,7 +2460,7 @@ static void __buffer_delay_raw(struct delay_buffer *dbuf, struct codec_handler *
 
 	// also copy packet payload
 	dframe->mp.raw = mp->raw;
-	dframe->mp.raw.s = g_malloc(mp->raw.len + RTP_BUFFER_TAIL_ROOM);
+	dframe->mp.raw.s = pktbuf_alloc(mp->raw.len + RTP_BUFFER_TAIL_ROOM);
 	memcpy(dframe->mp.raw.s, mp->raw.s, mp->raw.len);
 
 	LOCK(&dbuf->lock);
@@ -2579,7 +2578,7 @@ static int __buffer_dtx(struct dtx_buffer *dtxb, struct codec_ssrc_handler *deco
 
 static void delay_frame_free(struct delay_frame *dframe) {
 	av_frame_free(&dframe->frame);
-	g_free(dframe->mp.raw.s);
+	pktbuf_free(dframe->mp.raw.s);
 	media_packet_release(&dframe->mp);
 	if (dframe->ch)
 		obj_put(&dframe->ch->h);
@@ -3254,7 +3253,7 @@ static void __dtx_setup(struct codec_ssrc_handler *ch) {
 	struct dtx_buffer *dtx = ch->dtx_buffer;
 	if (!dtx) {
 		dtx = ch->dtx_buffer = obj_alloc0("dtx_buffer", sizeof(*dtx), __dtx_free);
-		dtx->ct.tt_obj.tt = &codec_timers_thread;
+		timerthread_obj_bind(&dtx->ct.tt_obj, &codec_timers_thread, ch->handler->media->call);
 		dtx->ct.timer_func = __dtx_send_later;
 		mutex_init(&dtx->lock);
 	}
@@ -3292,7 +3291,7 @@ static void __delay_buffer_setup(struct delay_buffer **dbufp,
 		if (!delay)
 			return;
 		dbuf = obj_alloc0("delay_buffer", sizeof(*dbuf), __delay_buffer_free);
-		dbuf->ct.tt_obj.tt = &codec_timers_thread;
+		timerthread_obj_bind(&dbuf->ct.tt_obj, &codec_timers_thread, call);
 		dbuf->ct.timer_func = __delay_send_later;
 		dbuf->handler = h;
 		mutex_init(&dbuf->lock);
@@ -3549,7 +3548,7 @@ void packet_encoded_packetize(encoder_t *enc, struct codec_ssrc_handler *ch, str
 				sizeof(struct telephone_event_payload));
 		unsigned int pkt_len = sizeof(struct rtp_header) + payload_len + RTP_BUFFER_TAIL_ROOM;
 		// prepare our buffers
-		char *buf = malloc(pkt_len);
+		char *buf = pktbuf_alloc(pkt_len);
 		char *payload = buf + sizeof(struct rtp_header);
 		// tell our packetizer how much we want
 		str inout;
@@ -3562,7 +3561,7 @@ void packet_encoded_packetize(encoder_t *enc, struct codec_ssrc_handler *ch, str
 
 		if (G_UNLIKELY(ret == -1 || enc->avpkt->pts == AV_NOPTS_VALUE)) {
 			// nothing
-			free(buf);
+			pktbuf_free(buf);
 			break;
 		}
 
@@ -3630,7 +3629,7 @@ static void packet_encoded_tx(encoder_t *enc, struct codec_ssrc_handler *ch, str
 		char *send_buf = buf;
 		if (repeats > 0) {
 			// need to duplicate the payload as codec_output_rtp consumes it
-			send_buf = malloc(pkt_len);
+			send_buf = pktbuf_alloc(pkt_len);
 			memcpy(send_buf, buf, pkt_len);
 		}
 		codec_output_rtp(mp, &ch->csch, ch->handler, send_buf, inout->len, ch->csch.first_ts
@@ -5065,7 +5064,7 @@ static void __codec_timer_callback_fire(struct codec_timer *ct) {
 }
 void codec_timer_callback(struct call *c, void (*func)(struct call *, void *), void *p, uint64_t delay) {
 	struct timer_callback *cb = obj_alloc0("codec_timer_callback", sizeof(*cb), __codec_timer_callback_free);
-	cb->ct.tt_obj.tt = &codec_timers_thread;
+	timerthread_obj_bind(&cb->ct.tt_obj, &codec_timers_thread, c);
 	cb->call = obj_get(c);
 	cb->timer_callback_func = func;
 	cb->ptr = p;
@@ -5081,11 +5080,12 @@ static void codec_timers_run(void *p) {
 }
 
 void codecs_init(void) {
-	timerthread_init(&codec_timers_thread, codec_timers_run);
+	timerthread_init(&codec_timers_thread, "codec timer", rtpe_config.media_num_threads,
+			codec_timers_run);
 }
 void codecs_cleanup(void) {
 	timerthread_free(&codec_timers_thread);
 }
 void codec_timers_loop(void *p) {
-	timerthread_run(&codec_timers_thread);
+	timerthread_run(&codec_timers_thread, GPOINTER_TO_UINT(p));
 }
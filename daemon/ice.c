@@ -257,7 +257,7 @@ static struct ice_agent *__ice_agent_new(struct call_media *media) {
 	struct call *call = media->call;
 
 	ag = obj_alloc0("ice_agent", sizeof(*ag), __ice_agent_free);
-	ag->tt_obj.tt = &ice_agents_timer_thread;
+	timerthread_obj_bind(&ag->tt_obj, &ice_agents_timer_thread, call);
 	ag->call = obj_get(call);
 	ag->media = media;
 	mutex_init(&ag->lock);
@@ -548,7 +548,7 @@ static void __agent_schedule_abs(struct ice_agent *ag, const struct timeval *tv)
 
 	nxt = *tv;
 
-	mutex_lock(&ice_agents_timer_thread.lock);
+	mutex_lock(&ag->tt_obj.thread->lock);
 	if (ag->tt_obj.last_run.tv_sec) {
 		/* make sure we don't run more often than we should */
 		diff = timeval_diff(&nxt, &ag->tt_obj.last_run);
@@ -556,7 +556,7 @@ static void __agent_schedule_abs(struct ice_agent *ag, const struct timeval *tv)
 			timeval_add_usec(&nxt, TIMER_RUN_INTERVAL * 1000 - diff);
 	}
 	timerthread_obj_schedule_abs_nl(&ag->tt_obj, &nxt);
-	mutex_unlock(&ice_agents_timer_thread.lock);
+	mutex_unlock(&ag->tt_obj.thread->lock);
 }
 static void __agent_deschedule(struct ice_agent *ag) {
 	if (ag)
@@ -565,7 +565,7 @@ static void __agent_deschedule(struct ice_agent *ag) {
 
 void ice_init(void) {
 	random_string((void *) &tie_breaker, sizeof(tie_breaker));
-	timerthread_init(&ice_agents_timer_thread, ice_agents_timer_run);
+	timerthread_init(&ice_agents_timer_thread, "ICE", 1, ice_agents_timer_run);
 }
 
 void ice_free(void) {
@@ -1339,7 +1339,7 @@ err:
 
 
 void ice_thread_run(void *p) {
-	timerthread_run(&ice_agents_timer_thread);
+	timerthread_run(&ice_agents_timer_thread, 0);
 }
 static void ice_agents_timer_run(void *ptr) {
 	struct ice_agent *ag = ptr;
@@ -5,6 +5,7 @@
 #include "codec.h"
 #include "main.h"
 #include "rtcplib.h"
+#include "pktbuf.h"
 #include <math.h>
 #include <errno.h>
 
@@ -21,7 +22,8 @@ static struct timerthread jitter_buffer_thread;
 
 void jitter_buffer_init(void) {
 	//ilog(LOG_DEBUG, "jitter_buffer_init");
-	timerthread_init(&jitter_buffer_thread, timerthread_queue_run);
+	timerthread_init(&jitter_buffer_thread, "jitter buffer", rtpe_config.media_num_threads,
+			timerthread_queue_run);
 }
 
 void jitter_buffer_init_free(void) {
@@ -102,18 +104,19 @@ static struct jb_packet* get_jb_packet(struct media_packet *mp, const str *s) {
 	if (rtp_payload(&mp->rtp, &mp->payload, &mp->raw))
 		return NULL;
 
-	char *buf = malloc(s->len + RTP_BUFFER_HEAD_ROOM + RTP_BUFFER_TAIL_ROOM);
-	if (!buf) {
-		ilog(LOG_ERROR, "Failed to allocate memory: %s", strerror(errno));
-		return NULL;
-	}
-
 	struct jb_packet *p = g_slice_alloc0(sizeof(*p));
 
-	p->buf = buf;
 	media_packet_copy(&p->mp, mp);
 
-	str_init_len(&p->mp.raw, buf + RTP_BUFFER_HEAD_ROOM, s->len);
+	if (mp->pktbuf) {
+		// take over the receive buffer instead of making a copy
+		p->buf = pktbuf_hold(mp->pktbuf);
+		p->mp.raw = *s;
+		return p;
+	}
+
+	p->buf = pktbuf_alloc(s->len + RTP_BUFFER_HEAD_ROOM + RTP_BUFFER_TAIL_ROOM);
+	str_init_len(&p->mp.raw, p->buf + RTP_BUFFER_HEAD_ROOM, s->len);
 	memcpy(p->mp.raw.s, s->s, s->len);
 
 	return p;
@@ -412,14 +415,14 @@ void __jb_packet_free(void *p) {
 
 void jitter_buffer_loop(void *p) {
 	ilog(LOG_DEBUG, "jitter_buffer_loop");
-	timerthread_run(&jitter_buffer_thread);
+	timerthread_run(&jitter_buffer_thread, GPOINTER_TO_UINT(p));
 }
 
 struct jitter_buffer *jitter_buffer_new(struct call *c) {
 	ilog(LOG_DEBUG, "creating jitter_buffer");
 
 	struct jitter_buffer *jb = timerthread_queue_new("jitter_buffer", sizeof(*jb),
-			&jitter_buffer_thread,
+			&jitter_buffer_thread, c,
 			__jb_send_now,
 			__jb_send_later,
 			__jb_free, __jb_packet_free);
@@ -443,7 +446,7 @@ void jb_packet_free(struct jb_packet **jbp) {
 	if (!jbp || !*jbp)
 		return;
 
-	free((*jbp)->buf);
+	pktbuf_free((*jbp)->buf);
 	media_packet_release(&(*jbp)->mp);
 	g_slice_free1(sizeof(**jbp), *jbp);
 	*jbp = NULL;
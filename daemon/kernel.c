@@ -4,6 +4,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <glib.h>
@@ -13,6 +14,7 @@
 
 #include "aux.h"
 #include "log.h"
+#include "xdp.h"
 
 
 
@@ -24,6 +26,14 @@
 
 struct kernel_interface kernel;
 
+// commands collected between kernel_batch_begin() and kernel_batch_end()
+struct kernel_queue {
+	unsigned int depth; // nesting level of kernel_batch_begin()
+	GArray *msgs; // struct rtpengine_message
+	GPtrArray *refs; // for each message: stats slot to fill in for an added target, or NULL
+};
+static __thread struct kernel_queue *kernel_queue; // allocated on first use, lives as long as the thread
+
 
 
 
@@ -91,6 +101,46 @@ fail:
 	return -1;
 }
 
+static int kernel_open_stats(unsigned int id) {
+	char str[64];
+	struct rtpengine_stats_header *h;
+
+	sprintf(str, PREFIX "/%u/stats", id);
+	int fd = open(str, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	// header first, to find out the size
+	h = mmap(NULL, sizeof(*h), PROT_READ, MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED)
+		goto fail;
+	unsigned int num_slots = h->num_slots;
+	uint32_t slot_size = h->slot_size;
+	munmap(h, sizeof(*h));
+
+	errno = EPROTO;
+	if (slot_size != sizeof(struct rtpengine_stats_slot) || num_slots < 2)
+		goto fail;
+
+	size_t size = (size_t) num_slots * slot_size;
+	void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+	close(fd);
+
+	kernel.stats = p;
+	kernel.stats_size = size;
+	kernel.stats_num_slots = num_slots;
+
+	return 0;
+
+fail:;
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return -1;
+}
+
 int kernel_setup_table(unsigned int id) {
 	if (kernel.is_wanted)
 		abort();
@@ -118,6 +168,40 @@ int kernel_setup_table(unsigned int id) {
 	kernel.table = id;
 	kernel.is_open = 1;
 
+	if (kernel_open_stats(id))
+		ilog(LOG_WARN, "Failed to map kernel stats region (%s), reading stream stats "
+				"through the control file", strerror(errno));
+
+	return 0;
+}
+
+void kernel_shutdown_table(void) {
+	if (!kernel.is_open || kernel.is_xdp)
+		return;
+	kernel.is_open = 0;
+	if (kernel.stats)
+		munmap((void *) kernel.stats, kernel.stats_size);
+	kernel.stats = NULL;
+	close(kernel.fd);
+	kernel.fd = -1;
+}
+
+// used in place of the kernel module if that's not available
+int kernel_setup_xdp(void) {
+	if (kernel.is_open)
+		abort();
+
+	kernel.is_wanted = 1;
+
+	if (xdp_init()) {
+		ilog(LOG_ERR, "FAILED TO SET UP XDP FORWARDING, KERNEL FORWARDING DISABLED");
+		return -1;
+	}
+
+	kernel.fd = -1;
+	kernel.is_xdp = 1;
+	kernel.is_open = 1;
+
 	return 0;
 }
 
@@ -128,14 +212,19 @@ int kernel_add_stream(struct rtpengine_target_info *mti) {
 
 	if (!kernel.is_open)
 		return -1;
+	if (kernel.is_xdp)
+		return xdp_add_stream(mti);
 
 	msg.cmd = REMG_ADD_TARGET;
 	msg.u.target = *mti;
 
+	// read instead of write to get the stats slot back
 	// coverity[uninit_use_in_call : FALSE]
-	ret = write(kernel.fd, &msg, sizeof(msg));
-	if (ret > 0)
+	ret = read(kernel.fd, &msg, sizeof(msg));
+	if (ret > 0) {
+		mti->stats_idx = msg.u.target.stats_idx;
 		return 0;
+	}
 
 	ilog(LOG_ERROR, "Failed to push relay stream to kernel: %s", strerror(errno));
 	return -1;
@@ -147,6 +236,8 @@ int kernel_add_destination(struct rtpengine_destination_info *mdi) {
 
 	if (!kernel.is_open)
 		return -1;
+	if (kernel.is_xdp)
+		return xdp_add_destination(mdi);
 
 	msg.cmd = REMG_ADD_DESTINATION;
 	msg.u.destination = *mdi;
@@ -161,6 +252,23 @@ int kernel_add_destination(struct rtpengine_destination_info *mdi) {
 }
 
 
+static bool kernel_address_eq(const struct re_address *a, const struct re_address *b) {
+	if (a->family != b->family || a->port != b->port)
+		return false;
+	if (a->family == AF_INET)
+		return a->u.ipv4 == b->u.ipv4;
+	return memcmp(a->u.ipv6, b->u.ipv6, sizeof(a->u.ipv6)) == 0;
+}
+
+static bool kernel_queue_open(void) {
+	return kernel_queue && kernel_queue->depth;
+}
+
+static void kernel_queue_msg(const struct rtpengine_message *msg, struct kernel_stats_ref *ref) {
+	g_array_append_val(kernel_queue->msgs, *msg);
+	g_ptr_array_add(kernel_queue->refs, ref);
+}
+
 int kernel_del_stream(const struct re_address *a) {
 	struct rtpengine_message msg;
 	int ret;
@@ -172,6 +280,21 @@ int kernel_del_stream(const struct re_address *a) {
 	msg.cmd = REMG_DEL_TARGET;
 	msg.u.target.local = *a;
 
+	if (kernel_queue_open()) {
+		// a target queued before is gone again by the time the batch is done
+		for (unsigned int i = 0; i < kernel_queue->msgs->len; i++) {
+			struct rtpengine_message *m = &g_array_index(kernel_queue->msgs,
+					struct rtpengine_message, i);
+			if (m->cmd == REMG_ADD_TARGET && kernel_address_eq(&m->u.target.local, a))
+				kernel_queue->refs->pdata[i] = NULL;
+		}
+		kernel_queue_msg(&msg, NULL);
+		return 0;
+	}
+
+	if (kernel.is_xdp)
+		return xdp_del_stream(a);
+
 	ret = write(kernel.fd, &msg, sizeof(msg));
 	if (ret > 0)
 		return 0;
@@ -180,6 +303,157 @@ int kernel_del_stream(const struct re_address *a) {
 	return -1;
 }
 
+static int kernel_xdp_msg(struct rtpengine_message *msg) {
+	int ret;
+
+	switch (msg->cmd) {
+		case REMG_ADD_TARGET:
+			ret = xdp_add_stream(&msg->u.target);
+			break;
+		case REMG_ADD_DESTINATION:
+			ret = xdp_add_destination(&msg->u.destination);
+			break;
+		case REMG_DEL_TARGET:
+			ret = xdp_del_stream(&msg->u.target.local);
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	if (ret)
+		return errno ? -errno : -EINVAL;
+	return 0;
+}
+
+// executes the messages in order in as few syscalls as possible, and fills in the result of
+// each in `status`. Returns -1 if the kernel couldn't be talked to at all, with all `status`
+// set to the error.
+int kernel_batch(struct rtpengine_message *msgs, int *status, unsigned int num) {
+	if (!kernel.is_open)
+		return -1;
+
+	if (kernel.is_xdp) {
+		for (unsigned int i = 0; i < num; i++) {
+			errno = 0;
+			status[i] = kernel_xdp_msg(&msgs[i]);
+		}
+		return 0;
+	}
+
+	for (unsigned int off = 0; off < num; ) {
+		unsigned int n = MIN(num - off, RTPE_MAX_BATCH);
+		size_t len = sizeof(*msgs) * (n + 1) + sizeof(*status) * n;
+		struct rtpengine_message *buf = g_malloc0(len);
+
+		buf->cmd = REMG_BATCH;
+		buf->u.batch.num = n;
+		memcpy(buf->data, &msgs[off], sizeof(*msgs) * n);
+
+		ssize_t ret = read(kernel.fd, buf, len);
+		if (ret < 0 || (size_t) ret != len) {
+			int err = ret < 0 ? errno : EIO;
+			ilog(LOG_ERROR, "Failed to send batch of %u commands to kernel: %s", n, strerror(err));
+			g_free(buf);
+			for (unsigned int i = off; i < num; i++)
+				status[i] = -err;
+			return -1;
+		}
+
+		memcpy(&msgs[off], buf->data, sizeof(*msgs) * n);
+		memcpy(&status[off], buf->data + sizeof(*msgs) * n, sizeof(*status) * n);
+		g_free(buf);
+
+		off += n;
+	}
+
+	return 0;
+}
+
+// starts collecting kernel_queue_target(), kernel_queue_destination() and kernel_del_stream()
+// in the current thread, to be sent as one batch. can be nested. nothing must kernelize the
+// affected streams again before the batch ends, so this is done under the call's master lock
+void kernel_batch_begin(void) {
+	if (!kernel_queue) {
+		kernel_queue = g_slice_alloc0(sizeof(*kernel_queue));
+		kernel_queue->msgs = g_array_new(false, false, sizeof(struct rtpengine_message));
+		kernel_queue->refs = g_ptr_array_new();
+	}
+	kernel_queue->depth++;
+}
+
+static const char *kernel_cmd_desc(const struct rtpengine_message *msg) {
+	switch (msg->cmd) {
+		case REMG_ADD_TARGET:
+			return "push relay stream to";
+		case REMG_ADD_DESTINATION:
+			return "push relay stream destination to";
+		case REMG_DEL_TARGET:
+			return "delete relay stream from";
+		default:
+			return "send command to";
+	}
+}
+
+// sends the collected commands when the outermost batch ends
+void kernel_batch_end(void) {
+	struct kernel_queue *q = kernel_queue;
+	if (!q || !q->depth)
+		return;
+	if (--q->depth)
+		return;
+
+	unsigned int num = q->msgs->len;
+	if (!num)
+		return;
+
+	struct rtpengine_message *msgs = (void *) q->msgs->data;
+	int *status = g_new0(int, num);
+
+	if (!kernel_batch(msgs, status, num)) {
+		for (unsigned int i = 0; i < num; i++) {
+			if (status[i]) {
+				ilog(LOG_ERROR, "Failed to %s kernel: %s", kernel_cmd_desc(&msgs[i]),
+						strerror(-status[i]));
+				continue;
+			}
+			struct kernel_stats_ref *ref = q->refs->pdata[i];
+			if (ref && msgs[i].cmd == REMG_ADD_TARGET)
+				ref->idx = msgs[i].u.target.stats_idx;
+		}
+	}
+
+	g_free(status);
+	g_array_set_size(q->msgs, 0);
+	g_ptr_array_set_size(q->refs, 0);
+}
+
+// adds a target to the kernel, right away unless a batch is open. `ref` receives its
+// stats slot and must remain valid until the batch is done
+void kernel_queue_target(const struct rtpengine_target_info *reti, struct kernel_stats_ref *ref) {
+	struct rtpengine_message msg;
+
+	ZERO(msg);
+	msg.cmd = REMG_ADD_TARGET;
+	msg.u.target = *reti;
+
+	kernel_batch_begin();
+	kernel_queue_msg(&msg, ref);
+	kernel_batch_end();
+}
+
+// as above, for a destination of the target queued last
+void kernel_queue_destination(const struct rtpengine_destination_info *redi) {
+	struct rtpengine_message msg;
+
+	ZERO(msg);
+	msg.cmd = REMG_ADD_DESTINATION;
+	msg.u.destination = *redi;
+
+	kernel_batch_begin();
+	kernel_queue_msg(&msg, NULL);
+	kernel_batch_end();
+}
+
 GList *kernel_list() {
 	char str[64];
 	int fd;
@@ -189,6 +463,8 @@ GList *kernel_list() {
 
 	if (!kernel.is_open)
 		return NULL;
+	if (kernel.is_xdp)
+		return xdp_list();
 
 	sprintf(str, PREFIX "/%u/blist", kernel.table);
 	fd = open(str, O_RDONLY);
@@ -214,7 +490,7 @@ unsigned int kernel_add_call(const char *id) {
 	struct rtpengine_message msg;
 	int ret;
 
-	if (!kernel.is_open)
+	if (!kernel.is_open || kernel.is_xdp)
 		return UNINIT_IDX;
 
 	ZERO(msg);
@@ -231,7 +507,7 @@ int kernel_del_call(unsigned int idx) {
 	struct rtpengine_message msg;
 	int ret;
 
-	if (!kernel.is_open)
+	if (!kernel.is_open || kernel.is_xdp)
 		return -1;
 
 	ZERO(msg);
@@ -248,7 +524,7 @@ unsigned int kernel_add_intercept_stream(unsigned int call_idx, const char *id)
 	struct rtpengine_message msg;
 	int ret;
 
-	if (!kernel.is_open)
+	if (!kernel.is_open || kernel.is_xdp)
 		return UNINIT_IDX;
 
 	ZERO(msg);
@@ -262,12 +538,63 @@ unsigned int kernel_add_intercept_stream(unsigned int call_idx, const char *id)
 	return msg.u.stream.stream_idx;
 }
 
-int kernel_update_stats(const struct re_address *a, struct rtpengine_stats_info *out) {
+// lock-free copy, retried while the kernel is updating the slot
+static bool kernel_read_stats_slot(unsigned int idx, struct rtpengine_stats_slot *out) {
+	const struct rtpengine_stats_slot *slot = &kernel.stats[idx];
+
+	for (unsigned int tries = 0; tries < 100; tries++) {
+		uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if ((seq & 1))
+			continue;
+		memcpy(out, slot, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+			return true;
+	}
+	return false;
+}
+
+// counters in the slot are never reset, so the difference to the last read is returned
+static bool kernel_update_stats_slot(const struct re_address *a, struct kernel_stats_ref *ref,
+		struct rtpengine_stats_info *out)
+{
+	struct rtpengine_stats_slot slot;
+
+	if (!kernel.stats || !ref || !ref->idx || ref->idx >= kernel.stats_num_slots)
+		return false;
+	if (!kernel_read_stats_slot(ref->idx, &slot))
+		return false;
+	if (!kernel_address_eq(&slot.local, a))
+		return false;
+
+	out->local = *a;
+	for (unsigned int u = 0; u < RTPE_NUM_SSRC_TRACKING; u++) {
+		struct rtpengine_ssrc_stats *s = &out->ssrc_stats[u];
+		out->ssrc[u] = slot.ssrc[u];
+		*s = slot.ssrc_stats[u];
+		s->basic_stats.packets -= ref->packets[u];
+		s->basic_stats.bytes -= ref->bytes[u];
+		s->total_lost -= ref->total_lost[u];
+		ref->packets[u] = slot.ssrc_stats[u].basic_stats.packets;
+		ref->bytes[u] = slot.ssrc_stats[u].basic_stats.bytes;
+		ref->total_lost[u] = slot.ssrc_stats[u].total_lost;
+	}
+
+	return true;
+}
+
+int kernel_update_stats(const struct re_address *a, struct kernel_stats_ref *ref,
+		struct rtpengine_stats_info *out)
+{
 	struct rtpengine_message msg;
 	int ret;
 
 	if (!kernel.is_open)
 		return -1;
+	if (kernel.is_xdp)
+		return xdp_update_stats(a, out);
+	if (kernel_update_stats_slot(a, ref, out))
+		return 0;
 
 	ZERO(msg);
 	msg.cmd = REMG_GET_RESET_STATS;
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -54,6 +55,8 @@
 #include "codec.h"
 #include "mqtt.h"
 #include "janus.h"
+#include "rcu.h"
+#include "xdp.h"
 
 
 
@@ -85,6 +88,8 @@ struct rtpengine_config rtpe_config = {
 	.redis_allowed_errors = -1,
 	.redis_disable_time = 10,
 	.redis_connect_timeout = 1000,
+	.redis_write_queue = 10000,
+	.redis_snapshot_interval = 300,
 	.media_num_threads = -1,
 	.dtls_rsa_key_size = 2048,
 	.dtls_mtu = 1200, // chrome default mtu
@@ -96,6 +101,7 @@ struct rtpengine_config rtpe_config = {
 	.mqtt_keepalive = 30,
 	.mqtt_publish_interval = 5000,
 	.dtmf_digit_delay = 2500,
+	.xdp_queues = 1,
 	.common = {
 		.log_levels = {
 			[log_level_index_internals] = -1,
@@ -447,7 +453,9 @@ static void options(int *argc, char ***argv) {
 	AUTO_CLEANUP_GBUF(mqtt_publish_scope);
 #endif
 	AUTO_CLEANUP_GBUF(mos);
+	AUTO_CLEANUP_GBUF(poller_method);
 	AUTO_CLEANUP_GBUF(dcc);
+	AUTO_CLEANUP_GBUF(redis_format);
 
 	rwlock_lock_w(&rtpe_config.config_lock);
 
@@ -485,6 +493,11 @@ static void options(int *argc, char ***argv) {
 		{ "redis-connect-timeout", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_connect_timeout, "Sets a timeout in milliseconds for redis connections", "INT" },
 		{ "redis-delete-async", 'y', 0, G_OPTION_ARG_INT, &rtpe_config.redis_delete_async, "Enable asynchronous redis delete", NULL },
 		{ "redis-delete-async-interval", 'y', 0, G_OPTION_ARG_INT, &rtpe_config.redis_delete_async_interval, "Set asynchronous redis delete interval (seconds)", NULL },
+		{ "redis-write-delay", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_write_delay, "Write call updates to redis from a separate thread, coalescing updates within this many milliseconds", "INT" },
+		{ "redis-write-queue", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_write_queue, "Maximum number of calls waiting to be written to redis", "INT" },
+		{ "redis-format", 0, 0, G_OPTION_ARG_STRING, &redis_format, "Format to write call data to redis in", "json|binary" },
+		{ "redis-delta", 0, 0, G_OPTION_ARG_NONE, &rtpe_config.redis_delta, "Store calls in redis as hashes and write only the parts that changed", NULL },
+		{ "redis-snapshot-interval", 0, 0, G_OPTION_ARG_INT, &rtpe_config.redis_snapshot_interval, "Rewrite complete calls to redis at least this often with --redis-delta (seconds)", "INT" },
 		{ "active-switchover", 0,0,G_OPTION_ARG_NONE,	&rtpe_config.active_switchover, "Use call activity as indicator of active/standby state", NULL },
 		{ "b2b-url",	'b', 0, G_OPTION_ARG_STRING,	&rtpe_config.b2b_url,	"XMLRPC URL of B2B UA"	,	"STRING"	},
 		{ "log-facility-cdr",0,  0, G_OPTION_ARG_STRING, &log_facility_cdr_s, "Syslog facility to use for logging CDRs", "daemon|local0|...|local7"},
@@ -500,6 +513,7 @@ static void options(int *argc, char ***argv) {
 		{ "xmlrpc-format",'x', 0, G_OPTION_ARG_INT,	&rtpe_config.fmt,	"XMLRPC timeout request format to use. 0: SEMS DI, 1: call-id only, 2: Kamailio",	"INT"	},
 		{ "num-threads",  0, 0, G_OPTION_ARG_INT,	&rtpe_config.num_threads,	"Number of worker threads to create",	"INT"	},
 		{ "media-num-threads",  0, 0, G_OPTION_ARG_INT,	&rtpe_config.media_num_threads,	"Number of worker threads for media playback",	"INT"	},
+		{ "timer-sweep-threads",0, 0, G_OPTION_ARG_INT,	&rtpe_config.timer_sweep_threads,"Number of threads checking calls for timeouts and kernel stats",	"INT"	},
 		{ "delete-delay",  'd', 0, G_OPTION_ARG_INT,    &rtpe_config.delete_delay,  "Delay for deleting a session from memory.",    "INT"   },
 		{ "sip-source",  0,  0, G_OPTION_ARG_NONE,	&sip_source,	"Use SIP source address by default",	NULL	},
 		{ "dtls-passive", 0, 0, G_OPTION_ARG_NONE,	&dtls_passive_def,"Always prefer DTLS passive role",	NULL	},
@@ -544,6 +558,8 @@ static void options(int *argc, char ***argv) {
 		{ "http-threads", 0,0,	G_OPTION_ARG_INT,	&rtpe_config.http_threads,"Number of worker threads for HTTP and WS","INT"},
 		{ "software-id", 0,0,	G_OPTION_ARG_STRING,	&rtpe_config.software_id,"Identification string of this software presented to external systems","STRING"},
 		{ "poller-per-thread", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.poller_per_thread,	"Use poller per thread",	NULL },
+		{ "poller-cpu-affinity", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.poller_cpu_affinity,"Pin poller threads to CPUs and keep each call on one poller",NULL},
+		{ "poller-method", 0,0,	G_OPTION_ARG_STRING,	&poller_method,	"Backend for socket event notification","epoll|io_uring"},
 #ifdef WITH_TRANSCODING
 		{ "dtx-delay",	0,0,	G_OPTION_ARG_INT,	&rtpe_config.dtx_delay,	"Delay in milliseconds to trigger DTX handling","INT"},
 		{ "max-dtx",	0,0,	G_OPTION_ARG_INT,	&rtpe_config.max_dtx,	"Maximum duration of DTX handling",	"INT"},
@@ -579,6 +595,17 @@ static void options(int *argc, char ***argv) {
 		{ "socket-cpu-affinity",0,0,G_OPTION_ARG_INT,	&rtpe_config.cpu_affinity,"CPU affinity for media sockets","INT"},
 #endif
 		{ "janus-secret", 0,0,	G_OPTION_ARG_STRING,	&rtpe_config.janus_secret,"Admin secret for Janus protocol","STRING"},
+		{ "recv-batch", 0,0,	G_OPTION_ARG_INT,	&rtpe_config.recv_batch,"Maximum number of media packets to receive per system call","INT"},
+		{ "send-batch", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.send_batch,"Send media packets to multiple sinks in batches",NULL},
+#ifdef UDP_SEGMENT
+		{ "udp-gso", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.udp_gso,	"Use UDP segmentation offload for batched sends",NULL},
+#endif
+		{ "media-fast-path", 0,0,G_OPTION_ARG_NONE,	&rtpe_config.media_fast_path,"Forward plain RTP passthrough streams (no SRTP) without locking the call",NULL},
+		{ "buffer-pool", 0,0,	G_OPTION_ARG_INT,	&rtpe_config.buffer_pool,"Number of free packet buffers to cache per thread and size class","INT"},
+		{ "xdp-interface", 0,0,	G_OPTION_ARG_STRING_ARRAY,&rtpe_config.xdp_interfaces,"Network interface to use for AF_XDP forwarding if the kernel module is unavailable","NAME"},
+		{ "xdp-queues", 0,0,	G_OPTION_ARG_INT,	&rtpe_config.xdp_queues,"Number of receive queues per XDP interface","INT"},
+		{ "xdp-generic", 0,0,	G_OPTION_ARG_NONE,	&rtpe_config.xdp_generic,"Use generic (SKB) mode for XDP",NULL},
+		{ "xdp-program", 0,0,	G_OPTION_ARG_FILENAME,	&rtpe_config.xdp_program,"Compiled XDP filter program","FILE"},
 
 		{ NULL, }
 	};
@@ -816,6 +843,26 @@ static void options(int *argc, char ***argv) {
 	if (rtpe_config.jb_length < 0)
 		die("Invalid negative jitter buffer size");
 
+	if (rtpe_config.recv_batch < 0)
+		die("Invalid --recv-batch (%i)", rtpe_config.recv_batch);
+	if (rtpe_config.recv_batch > MAX_MMSG_BATCH)
+		rtpe_config.recv_batch = MAX_MMSG_BATCH;
+
+	if (rtpe_config.redis_write_delay < 0)
+		die("Invalid --redis-write-delay (%i)", rtpe_config.redis_write_delay);
+	if (rtpe_config.redis_write_queue < 1)
+		die("Invalid --redis-write-queue (%i)", rtpe_config.redis_write_queue);
+	if (rtpe_config.redis_snapshot_interval < 0)
+		die("Invalid --redis-snapshot-interval (%i)", rtpe_config.redis_snapshot_interval);
+
+	if (rtpe_config.buffer_pool < 0)
+		die("Invalid --buffer-pool (%i)", rtpe_config.buffer_pool);
+
+	if (rtpe_config.xdp_queues < 1 || rtpe_config.xdp_queues > 64)
+		die("Invalid --xdp-queues (%i)", rtpe_config.xdp_queues);
+	if (!rtpe_config.xdp_program)
+		rtpe_config.xdp_program = g_strdup("/usr/lib/rtpengine/xdp_filter.bpf.o");
+
 	if (silence_detect > 0) {
 		rtpe_config.silence_detect_double = silence_detect / 100.0;
 		rtpe_config.silence_detect_int = (int) ((silence_detect / 100.0) * UINT32_MAX);
@@ -850,6 +897,32 @@ static void options(int *argc, char ***argv) {
 			die("Invalid --mqtt-publish-scope option ('%s')", mqtt_publish_scope);
 	}
 #endif
+	if (rtpe_config.poller_cpu_affinity)
+		rtpe_config.poller_per_thread = 1;
+
+	if (poller_method) {
+		if (!strcasecmp(poller_method, "epoll"))
+			rtpe_config.poller_method = POLLER_EPOLL;
+		else if (!strcasecmp(poller_method, "io_uring") || !strcasecmp(poller_method, "io-uring")) {
+#ifdef HAVE_LIBURING
+			rtpe_config.poller_method = POLLER_IO_URING;
+#else
+			die("io_uring support not compiled in");
+#endif
+		}
+		else
+			die("Invalid --poller-method option ('%s')", poller_method);
+	}
+
+	if (redis_format) {
+		if (!strcasecmp(redis_format, "json"))
+			rtpe_config.redis_format = REDIS_FORMAT_JSON;
+		else if (!strcasecmp(redis_format, "binary"))
+			rtpe_config.redis_format = REDIS_FORMAT_BINARY;
+		else
+			die("Invalid --redis-format option ('%s')", redis_format);
+	}
+
 	if (mos) {
 		if (!strcasecmp(mos, "cq"))
 			rtpe_config.mos = MOS_CQ;
@@ -1015,6 +1088,8 @@ static void options_free(void) {
 	g_free(rtpe_config.mqtt_keyfile);
 	g_free(rtpe_config.mqtt_publish_topic);
 	g_free(rtpe_config.janus_secret);
+	g_strfreev(rtpe_config.xdp_interfaces);
+	g_free(rtpe_config.xdp_program);
 
 	// free common config options
 	config_load_free(&rtpe_config.common);
@@ -1045,7 +1120,15 @@ static void init_everything(void) {
 
 	signals();
 	resources();
+
+	// timer threads are sharded by the number of media threads
+	if (rtpe_config.num_threads < 1)
+		rtpe_config.num_threads = num_cpu_cores(4);
+	if (rtpe_config.media_num_threads < 0)
+		rtpe_config.media_num_threads = rtpe_config.num_threads;
+
 	sdp_init();
+	rcu_init();
 	dtls_init();
 	ice_init();
 	crypto_init_main();
@@ -1073,7 +1156,7 @@ static void create_everything(void) {
 	if (rtpe_config.kernel_table < 0)
 		goto no_kernel;
 	if (kernel_setup_table(rtpe_config.kernel_table)) {
-		if (rtpe_config.no_fallback) {
+		if (rtpe_config.no_fallback && !rtpe_config.xdp_interfaces) {
 			ilog(LOG_CRIT, "Userspace fallback disallowed - exiting");
 			exit(-1);
 		}
@@ -1081,6 +1164,13 @@ static void create_everything(void) {
 	}
 
 no_kernel:
+	if (!kernel.is_open && rtpe_config.xdp_interfaces) {
+		if (kernel_setup_xdp() && rtpe_config.no_fallback) {
+			ilog(LOG_CRIT, "Userspace fallback disallowed - exiting");
+			exit(-1);
+		}
+	}
+
 	rtpe_poller = poller_new();
 	if (!rtpe_poller)
 		die("poller creation failed");
@@ -1090,6 +1180,10 @@ no_kernel:
 		die("poller map creation failed");
 
 	dtls_timer(rtpe_poller);
+	rcu_timer(rtpe_poller);
+
+	if (rtpe_config.timer_sweep_threads < 1)
+		rtpe_config.timer_sweep_threads = num_cpu_cores(1);
 
 	if (call_init())
 		abort();
@@ -1210,9 +1304,6 @@ no_kernel:
 			rtpe_redis_write = rtpe_redis;
 	}
 
-	if (rtpe_config.num_threads < 1)
-		rtpe_config.num_threads = num_cpu_cores(4);
-
 	if (rtpe_config.cpu_affinity < 0) {
 		rtpe_config.cpu_affinity = num_cpu_cores(0);
 		if (rtpe_config.cpu_affinity <= 0)
@@ -1293,6 +1384,7 @@ int main(int argc, char **argv) {
 	thread_create_detach_prio(poller_timer_loop, rtpe_poller, rtpe_config.idle_scheduling,
 			rtpe_config.idle_priority, "poller timer");
 	thread_create_detach_prio(load_thread, NULL, rtpe_config.idle_scheduling, rtpe_config.idle_priority, "load monitor");
+	thread_create_detach(socket_reaper_loop, NULL, "socket reaper");
 
 	if (!is_addr_unspecified(&rtpe_config.redis_ep.address) && initial_rtpe_config.redis_delete_async)
 		thread_create_detach(redis_delete_async_loop, NULL, "redis async");
@@ -1300,6 +1392,9 @@ int main(int argc, char **argv) {
 	if (!is_addr_unspecified(&rtpe_config.redis_ep.address) && rtpe_redis_notify)
 		thread_create_detach(redis_notify_loop, NULL, "redis notify");
 
+	if (rtpe_redis_write && rtpe_config.redis_write_delay)
+		thread_create_detach(redis_write_loop, NULL, "redis writer");
+
 	do_redis_restore();
 
 	if (graphite_is_enabled())
@@ -1314,6 +1409,9 @@ int main(int argc, char **argv) {
 
 	websocket_start();
 
+	if (kernel.is_xdp)
+		xdp_start();
+
 	service_notify("READY=1\n");
 
 	for (idx = 0; idx < rtpe_config.num_threads; ++idx) {
@@ -1326,19 +1424,17 @@ int main(int argc, char **argv) {
 	if (rtpe_config.poller_per_thread)
 		thread_create_detach_prio(poller_loop2, rtpe_poller, rtpe_config.scheduling, rtpe_config.priority, "poller");
 
-	if (rtpe_config.media_num_threads < 0)
-		rtpe_config.media_num_threads = rtpe_config.num_threads;
 	for (idx = 0; idx < rtpe_config.media_num_threads; ++idx) {
 #ifdef WITH_TRANSCODING
-		thread_create_detach_prio(media_player_loop, NULL, rtpe_config.scheduling,
+		thread_create_detach_prio(media_player_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
 				rtpe_config.priority, "media player");
 #endif
-		thread_create_detach_prio(send_timer_loop, NULL, rtpe_config.scheduling,
+		thread_create_detach_prio(send_timer_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
 				rtpe_config.priority, "send timer");
 		if (rtpe_config.jb_length > 0)
-			thread_create_detach_prio(jitter_buffer_loop, NULL, rtpe_config.scheduling,
+			thread_create_detach_prio(jitter_buffer_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
 					rtpe_config.priority, "jitter buffer");
-		thread_create_detach_prio(codec_timers_loop, NULL, rtpe_config.scheduling,
+		thread_create_detach_prio(codec_timers_loop, GUINT_TO_POINTER(idx), rtpe_config.scheduling,
 				rtpe_config.priority, "codec timer");
 	}
 
@@ -1363,6 +1459,9 @@ int main(int argc, char **argv) {
 
 	threads_join_all(true);
 
+	if (kernel.is_xdp)
+		xdp_free();
+
 	if (!is_addr_unspecified(&rtpe_config.redis_ep.address) && initial_rtpe_config.redis_delete_async)
 		redis_async_event_base_action(rtpe_redis_write, EVENT_BASE_FREE);
 
@@ -1377,6 +1476,8 @@ int main(int argc, char **argv) {
 
 	call_free();
 
+	kernel_shutdown_table();
+
 	jitter_buffer_init_free();
 	media_player_free();
 	codeclib_free();
@@ -1409,6 +1510,7 @@ int main(int argc, char **argv) {
 	obj_release(rtpe_control_ng_tcp[1]);
 	poller_free(&rtpe_poller);
 	poller_map_free(&rtpe_poller_map);
+	rcu_free();
 	interfaces_free();
 
 	return 0;
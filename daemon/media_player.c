@@ -16,6 +16,7 @@
 #include "log_funcs.h"
 #include "main.h"
 #include "rtcp.h"
+#include "pktbuf.h"
 #ifdef WITH_TRANSCODING
 #include "fix_frame_channel_layout.h"
 #endif
@@ -163,7 +164,7 @@ struct media_player *media_player_new(struct call_monologue *ml) {
 
 	struct media_player *mp = obj_alloc0("media_player", sizeof(*mp), __media_player_free);
 
-	mp->tt_obj.tt = &media_player_thread;
+	timerthread_obj_bind(&mp->tt_obj, &media_player_thread, ml->call);
 	mutex_init(&mp->lock);
 
 	mp->run_func = media_player_read_packet; // default
@@ -200,7 +201,7 @@ static void __send_timer_send_later(struct timerthread_queue *ttq, void *p) {
 // call->master_lock held in W
 struct send_timer *send_timer_new(struct packet_stream *ps) {
 	struct send_timer *st = timerthread_queue_new("send_timer", sizeof(*st),
-			&send_timer_thread,
+			&send_timer_thread, ps->call,
 			__send_timer_send_now,
 			__send_timer_send_later,
 			__send_timer_free, codec_packet_free);
@@ -247,8 +248,7 @@ static bool __send_timer_send_1(struct rtp_header *rh, struct packet_stream *sin
 				endpoint_print_buf(&sink_fd->socket.local),
 				FMT_M(endpoint_print_buf(&sink->endpoint)));
 
-	socket_sendto(&sink_fd->socket,
-			cp->s.s, cp->s.len, &sink->endpoint);
+	media_socket_sendto(sink_fd, &cp->s, &sink->endpoint);
 
 	atomic64_inc(&sink->stats_out.packets);
 	atomic64_add(&sink->stats_out.bytes, cp->s.len);
@@ -409,7 +409,7 @@ retry:;
 
 	// make a copy to send out
 	size_t len = pkt->s.len + sizeof(struct rtp_header) + RTP_BUFFER_TAIL_ROOM;
-	char *buf = g_malloc(len);
+	char *buf = pktbuf_alloc(len);
 	memcpy(buf, pkt->buf, len);
 
 	struct media_packet packet = {
@@ -470,7 +470,7 @@ static void media_player_cached_reader_start(struct media_player *mp, const stru
 
 static void cache_packet_free(void *ptr) {
 	struct media_player_cache_packet *p = ptr;
-	g_free(p->buf);
+	pktbuf_free(p->buf);
 	g_slice_free1(sizeof(*p), p);
 }
 
@@ -1209,9 +1209,11 @@ void media_player_init(void) {
 		mutex_init(&media_player_cache_lock);
 	}
 
-	timerthread_init(&media_player_thread, media_player_run);
+	timerthread_init(&media_player_thread, "media player", rtpe_config.media_num_threads,
+			media_player_run);
 #endif
-	timerthread_init(&send_timer_thread, timerthread_queue_run);
+	timerthread_init(&send_timer_thread, "send timer", rtpe_config.media_num_threads,
+			timerthread_queue_run);
 }
 
 void media_player_free(void) {
@@ -1229,10 +1231,10 @@ void media_player_free(void) {
 
 #ifdef WITH_TRANSCODING
 void media_player_loop(void *p) {
-	timerthread_run(&media_player_thread);
+	timerthread_run(&media_player_thread, GPOINTER_TO_UINT(p));
 }
 #endif
 void send_timer_loop(void *p) {
 	//ilog(LOG_DEBUG, "send_timer_loop");
-	timerthread_run(&send_timer_thread);
+	timerthread_run(&send_timer_thread, GPOINTER_TO_UINT(p));
 }
@@ -4,6 +4,7 @@
 #include <glib.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include "str.h"
 #include "ice.h"
 #include "socket.h"
@@ -30,6 +31,8 @@
 #include "dtmf.h"
 #include "mqtt.h"
 #include "janus.h"
+#include "rcu.h"
+#include "pktbuf.h"
 
 
 #ifndef PORT_RANDOM_MIN
@@ -37,6 +40,10 @@
 #define PORT_RANDOM_MAX 20
 #endif
 
+#ifndef PORT_PAIR_TRIES
+#define PORT_PAIR_TRIES 8
+#endif
+
 #ifndef MAX_RECV_ITERS
 #define MAX_RECV_ITERS 50
 #endif
@@ -45,6 +52,12 @@
 #define MAX_RECV_LOOP_STRIKES 5
 #endif
 
+#ifndef SEND_BATCH_BUF_SIZE
+#define SEND_BATCH_BUF_SIZE (MAX_MMSG_BATCH * 2048)
+#endif
+
+#define MAX_GSO_SIZE 65000
+
 
 
 struct intf_rr {
@@ -75,11 +88,49 @@ struct packet_handler_ctx {
 
 	// output:
 	struct media_packet mp; // passed to handlers
+
+	// temporary buffers, released together with the context
+	GQueue free_list;
 };
 struct late_port_release {
 	socket_t socket;
 	struct intf_spec *spec;
 };
+struct recv_batch {
+	struct socket_mmsg msgs[MAX_MMSG_BATCH];
+	struct packet_handler_ctx phcs[MAX_MMSG_BATCH];
+	char bufs[MAX_MMSG_BATCH][RTP_BUFFER_SIZE];
+};
+struct send_batch_entry {
+	struct stream_fd *sfd; // holds a reference
+	endpoint_t dst;
+	unsigned int offset, len; // into send_batch->buf
+};
+struct send_batch {
+	unsigned int depth; // nesting level of media_socket_batch_begin()
+	unsigned int num;
+	unsigned int buf_used;
+	struct send_batch_entry entries[MAX_MMSG_BATCH];
+	char buf[SEND_BATCH_BUF_SIZE];
+};
+
+// forwarding state of a plain RTP passthrough stream, published through RCU so that
+// packets can be forwarded without taking call->master_lock. see media_fwd_publish()
+struct media_fwd_output {
+	struct packet_stream *sink;
+	struct stream_fd *sfd; // holds a reference
+	endpoint_t dst;
+	struct ssrc_ctx *ssrc_out; // holds a reference
+};
+struct media_fwd {
+	const struct stream_fd *sfd; // receiving socket, not a reference
+	endpoint_t src;
+	uint32_t ssrc; // network byte order
+	struct ssrc_ctx *ssrc_in; // holds a reference
+	struct rtp_stats *pt_stats[128]; // NULL if the payload type isn't plain passthrough
+	unsigned int num_outputs;
+	struct media_fwd_output outputs[];
+};
 struct interface_stats_interval {
 	struct interface_stats_block stats;
 	struct timeval last_run;
@@ -87,6 +138,14 @@ struct interface_stats_interval {
 
 
 static __thread GQueue ports_to_release = G_QUEUE_INIT;
+// sockets handed over to socket_reaper_loop() for closing
+static mutex_t socket_reaper_lock = MUTEX_STATIC_INIT;
+static cond_t socket_reaper_cond = COND_STATIC_INIT;
+static GQueue socket_reaper_queue = G_QUEUE_INIT;
+static bool socket_reaper_running;
+static uint64_t socket_reaper_closed, socket_reaper_batches;
+static __thread struct recv_batch *recv_batch; // allocated on first use, lives as long as the thread
+static __thread struct send_batch *send_batch; // same
 
 
 static const struct streamhandler *__determine_handler(struct packet_stream *in, struct sink_handler *);
@@ -429,7 +488,9 @@ static int has_free_ports_loc(struct local_intf *loc, unsigned int num_ports) {
 		return 0;
 	}
 
-	if (num_ports > g_atomic_int_get(&loc->spec->port_pool.free_ports)) {
+	if (num_ports > g_atomic_int_get(&loc->spec->port_pool.free_ports)
+			|| num_ports / 2 > port_pool_free_pairs(&loc->spec->port_pool))
+	{
 		ilog(LOG_ERR, "Didn't find %d ports available for " STR_FORMAT "/%s",
 			num_ports, STR_FMT(&loc->logical->name),
 			sockaddr_print_buf(&loc->spec->local_address.addr));
@@ -714,10 +775,7 @@ static void __interface_append(struct intf_config *ifa, sockfamily_t *fam, bool
 	if (!spec) {
 		spec = g_slice_alloc0(sizeof(*spec));
 		spec->local_address = ifa->local_address;
-		spec->port_pool.min = ifa->port_min;
-		spec->port_pool.max = ifa->port_max;
-		spec->port_pool.free_ports = spec->port_pool.max - spec->port_pool.min + 1;
-		mutex_init(&spec->port_pool.free_list_lock);
+		port_pool_init(&spec->port_pool, ifa->port_min, ifa->port_max);
 		g_hash_table_insert(__intf_spec_addr_type_hash, &spec->local_address, spec);
 	}
 
@@ -778,7 +836,7 @@ void interfaces_exclude_port(unsigned int port) {
 
 	for (l = vals; l; l = l->next) {
 		spec = l->data;
-		bit_array_set(spec->port_pool.ports_used, port);
+		port_pool_exclude(&spec->port_pool, port);
 	}
 
 	g_list_free(vals);
@@ -817,7 +875,7 @@ static int get_port(socket_t *r, unsigned int port, struct intf_spec *spec, cons
 
 	pp = &spec->port_pool;
 
-	if (bit_array_set(pp->ports_used, port)) {
+	if (!port_pool_take(pp, port)) {
 		__C_DBG("port %d in use", port);
 		return -1;
 	}
@@ -825,14 +883,13 @@ static int get_port(socket_t *r, unsigned int port, struct intf_spec *spec, cons
 
 	if (open_socket(r, SOCK_DGRAM, port, &spec->local_address.addr)) {
 		__C_DBG("couldn't open port %d", port);
-		bit_array_clear(pp->ports_used, port);
+		port_pool_put(pp, port);
 		return -1;
 	}
 
 	iptables_add_rule(r, label);
 	socket_timestamping(r);
 
-	g_atomic_int_dec_and_test(&pp->free_ports);
 	__C_DBG("%d free ports remaining on interface %s", pp->free_ports,
 			sockaddr_print_buf(&spec->local_address.addr));
 
@@ -848,16 +905,7 @@ static void release_port_now(socket_t *r, struct intf_spec *spec) {
 	if (close_socket(r) == 0) {
 		__C_DBG("port %u is released", port);
 		iptables_del_rule(r);
-		bit_array_clear(pp->ports_used, port);
-		g_atomic_int_inc(&pp->free_ports);
-		if ((port & 1) == 0) {
-			mutex_lock(&pp->free_list_lock);
-			if (!bit_array_isset(pp->free_list_used, port)) {
-				g_queue_push_tail(&pp->free_list, GUINT_TO_POINTER(port));
-				bit_array_set(pp->free_list_used, port);
-			}
-			mutex_unlock(&pp->free_list_lock);
-		}
+		port_pool_put(pp, port);
 	} else {
 		__C_DBG("port %u is NOT released", port);
 	}
@@ -875,23 +923,124 @@ static void free_port(socket_t *r, struct intf_spec *spec) {
 	release_port(r, spec);
 	g_slice_free1(sizeof(*r), r);
 }
+static void late_port_release_now(void *p) {
+	struct late_port_release *lpr = p;
+	release_port_now(&lpr->socket, lpr->spec);
+	g_slice_free1(sizeof(*lpr), lpr);
+}
+// closes the sockets right away if the reaper isn't running (yet or any more)
+static void socket_reaper_add(GQueue *q) {
+	struct late_port_release *lpr;
+
+	mutex_lock(&socket_reaper_lock);
+	if (socket_reaper_running) {
+		g_queue_move(&socket_reaper_queue, q);
+		cond_signal(&socket_reaper_cond);
+		mutex_unlock(&socket_reaper_lock);
+		return;
+	}
+	mutex_unlock(&socket_reaper_lock);
+
+	while ((lpr = g_queue_pop_head(q)))
+		late_port_release_now(lpr);
+}
+static void socket_reaper_add_one(void *p) {
+	GQueue q = G_QUEUE_INIT;
+	g_queue_push_tail(&q, p);
+	socket_reaper_add(&q);
+}
 void release_closed_sockets(void) {
 	struct late_port_release *lpr;
-	while ((lpr = g_queue_pop_head(&ports_to_release))) {
-		release_port_now(&lpr->socket, lpr->spec);
-		g_slice_free1(sizeof(*lpr), lpr);
+
+	if (!ports_to_release.length)
+		return;
+
+	if (!rtpe_config.media_fast_path && !rtpe_config.send_batch) {
+		socket_reaper_add(&ports_to_release);
+		return;
 	}
+
+	// lock-free readers (media_fwd_packet(), send_batch_flush()) may still be using the sockets
+	while ((lpr = g_queue_pop_head(&ports_to_release)))
+		rcu_call(socket_reaper_add_one, lpr);
 }
 
+// closes sockets and returns their ports in batches, off the signalling threads
+void socket_reaper_loop(void *dummy) {
+	GQueue batch = G_QUEUE_INIT;
+	struct late_port_release *lpr;
+
+	mutex_lock(&socket_reaper_lock);
+	socket_reaper_running = true;
 
+	while (!rtpe_shutdown || socket_reaper_queue.length) {
+		if (!socket_reaper_queue.length) {
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			timeval_add_usec(&tv, 100000);
+			cond_timedwait(&socket_reaper_cond, &socket_reaper_lock, &tv);
+			continue;
+		}
+
+		g_queue_move(&batch, &socket_reaper_queue);
+		mutex_unlock(&socket_reaper_lock);
+
+		uint64_t num = batch.length;
+		while ((lpr = g_queue_pop_head(&batch)))
+			late_port_release_now(lpr);
+
+		mutex_lock(&socket_reaper_lock);
+		socket_reaper_closed += num;
+		socket_reaper_batches++;
+	}
+
+	socket_reaper_running = false;
+	mutex_unlock(&socket_reaper_lock);
+}
+
+bool socket_reaper_get_stats(struct socket_reaper_stats *out) {
+	mutex_lock(&socket_reaper_lock);
+	out->queued = socket_reaper_queue.length;
+	out->closed = socket_reaper_closed;
+	out->batches = socket_reaper_batches;
+	bool ret = socket_reaper_running;
+	mutex_unlock(&socket_reaper_lock);
+	return ret;
+}
+
+
+
+// opens the given number of ports starting at the given one, all or nothing
+static int __get_port_range(GQueue *out, unsigned int num_ports, unsigned int port,
+		struct intf_spec *spec, const str *label)
+{
+	socket_t *sk;
+
+	for (unsigned int i = 0; i < num_ports; i++) {
+		sk = g_slice_alloc0(sizeof(*sk));
+		// fd=0 is a valid file descriptor that may be closed
+		// accidentally by free_port if previously bounded
+		sk->fd = -1;
+		g_queue_push_tail(out, sk);
+
+		if (port + i > 0xffff || get_port(sk, port + i, spec, label))
+			goto release;
+	}
+
+	return 0;
+
+release:
+	while ((sk = g_queue_pop_head(out)))
+		free_port(sk, spec);
+	return -1;
+}
 
 /* puts list of socket_t into "out" */
 int __get_consecutive_ports(GQueue *out, unsigned int num_ports, unsigned int wanted_start_port,
 		struct intf_spec *spec, const str *label)
 {
-	int i, cycle = 0;
-	socket_t *sk;
-	int port;
+	int cycle = 0;
+	unsigned int port;
 	struct port_pool *pp;
 
 	if (num_ports == 0)
@@ -904,68 +1053,52 @@ int __get_consecutive_ports(GQueue *out, unsigned int num_ports, unsigned int wa
 	if (wanted_start_port > 0) {
 		port = wanted_start_port;
 		__C_DBG("port=%d", port);
-	} else {
-		port = g_atomic_int_get(&pp->last_used);
-		__C_DBG("before randomization port=%d", port);
-#if PORT_RANDOM_MIN && PORT_RANDOM_MAX
-		port += PORT_RANDOM_MIN + (ssl_random() % (PORT_RANDOM_MAX - PORT_RANDOM_MIN));
-#endif
-		__C_DBG("after  randomization port=%d", port);
-
-		// debug msg if port is in the given interval
-		if (bit_array_isset(pp->ports_used, port)) {
-			__C_DBG("port %d is USED in port pool", port);
-			mutex_lock(&pp->free_list_lock);
-			unsigned int fport = GPOINTER_TO_UINT(g_queue_pop_head(&pp->free_list));
-			if (fport)
-				bit_array_clear(pp->free_list_used, fport);
-			mutex_unlock(&pp->free_list_lock);
-			if (fport) {
-				port = fport;
-				__C_DBG("Picked port %u from free list", port);
-			}
-		} else {
-			__C_DBG("port %d is NOT USED in port pool", port);
-		}
+		if (__get_port_range(out, num_ports, port, spec, label))
+			goto fail;
+		goto success;
 	}
 
-	while (1) {
-		__C_DBG("cycle=%d, port=%d", cycle, port);
-		if (!wanted_start_port) {
-			if (port < pp->min)
-				port = pp->min;
-			if (num_ports > 1 && (port & 1))
-				port++;
+	// the usual case of one RTP/RTCP pair: take the next free one without searching
+	if (num_ports <= 2) {
+		for (unsigned int tries = 0; tries < PORT_PAIR_TRIES; tries++) {
+			port = port_pool_get_pair(pp);
+			if (!port)
+				break;
+			__C_DBG("Picked port pair %u from free list", port);
+			// if this fails, the pair is queued again if it's still free
+			if (!__get_port_range(out, num_ports, port, spec, label))
+				goto success;
 		}
+	}
 
-		for (i = 0; i < num_ports; i++) {
-			sk = g_slice_alloc0(sizeof(*sk));
-			// fd=0 is a valid file descriptor that may be closed
-			// accidentally by free_port if previously bounded
-			sk->fd = -1;
-			g_queue_push_tail(out, sk);
-
-			if (!wanted_start_port && port > pp->max) {
-				port = 0;
-				cycle++;
-				goto release_restart;
-			}
+	// otherwise search the range
+	port = g_atomic_int_get(&pp->last_used);
+	__C_DBG("before randomization port=%d", port);
+#if PORT_RANDOM_MIN && PORT_RANDOM_MAX
+	port += PORT_RANDOM_MIN + (ssl_random() % (PORT_RANDOM_MAX - PORT_RANDOM_MIN));
+#endif
+	__C_DBG("after  randomization port=%d", port);
 
-			if (get_port(sk, port++, spec, label))
-				goto release_restart;
+	while (1) {
+		__C_DBG("cycle=%d, port=%d", cycle, port);
+		if (port < pp->min)
+			port = pp->min;
+		if (num_ports > 1 && (port & 1))
+			port++;
+		if (port + num_ports - 1 > pp->max) {
+			port = 0;
+			if (++cycle >= 2)
+				goto fail;
+			continue;
 		}
-		break;
-
-release_restart:
-		while ((sk = g_queue_pop_head(out)))
-			free_port(sk, spec);
 
-		if (cycle >= 2 || wanted_start_port > 0)
-			goto fail;
+		if (!__get_port_range(out, num_ports, port, spec, label))
+			break;
+		port++;
 	}
 
-	/* success */
-	g_atomic_int_set(&pp->last_used, port);
+success:
+	g_atomic_int_set(&pp->last_used, port + num_ports);
 
 	__C_DBG("Opened ports %u.. on interface %s for media relay",
 		((socket_t *) out->head->data)->local.port, sockaddr_print_buf(&spec->local_address.addr));
@@ -1166,6 +1299,144 @@ static void reset_ps_kernel_stats(struct packet_stream *ps) {
 }
 
 
+static void media_fwd_free(void *p) {
+	struct media_fwd *fwd = p;
+	for (unsigned int i = 0; i < fwd->num_outputs; i++) {
+		obj_put(fwd->outputs[i].sfd);
+		ssrc_ctx_put(&fwd->outputs[i].ssrc_out);
+	}
+	ssrc_ctx_put(&fwd->ssrc_in);
+	g_free(fwd);
+}
+
+/* called with in_lock held, or master_lock in W */
+static void media_fwd_retract(struct packet_stream *ps) {
+	struct media_fwd *fwd = ps->fwd;
+	if (!fwd)
+		return;
+	rcu_assign_pointer(ps->fwd, NULL);
+	rcu_call(media_fwd_free, fwd);
+}
+
+/**
+ * Userspace counterpart to kernelize(): if the stream is plain RTP passthrough
+ * towards all of its sinks, publish everything needed to forward its packets
+ * so that media_fwd_packet() can do so without call->master_lock. Anything that
+ * requires looking at the packet in more detail (crypto, transcoding, ICE/DTLS,
+ * recording, RTP stats, ...) keeps the stream on the regular path. The snapshot
+ * is withdrawn by __unkernelize(), which signalling and the packet path already
+ * call whenever any of the relevant state changes.
+ *
+ * Called with in_lock held.
+ */
+static void media_fwd_publish(struct packet_stream *stream) {
+	struct call *call = stream->call;
+	struct call_media *media = stream->media;
+	GQueue *sinks = &stream->rtp_sinks;
+
+	media_fwd_retract(stream);
+
+	if (!rtpe_config.media_fast_path)
+		return;
+	if (!PS_ISSET(stream, RTP) || !PS_ISSET(stream, CONFIRMED) || !proto_is_rtp(media->protocol))
+		return;
+	if (!stream->selected_sfd || !stream->endpoint.address.family || !sinks->length)
+		return;
+	if (MEDIA_ISSET(media, DTLS) || media->ice_agent || MEDIA_ISSET(media, GENERATOR)
+			|| MEDIA_ISSET(media, ECHO) || MEDIA_ISSET(media, BLACKHOLE)
+			|| MEDIA_ISSET(media, LOOP_CHECK) || MEDIA_ISSET(media, RTCP_GEN))
+		return;
+	if (call->recording || call->block_media || call->silence_media || IS_FOREIGN_CALL(call))
+		return;
+	if (media->monologue->block_media || media->monologue->silence_media)
+		return;
+	if (media->buffer_delay || stream->jb || stream->rtp_mirrors.length)
+		return;
+	if (rtpe_config.measure_rtp || mqtt_publish_scope() != MPS_NONE)
+		return;
+	if (!stream->ssrc_in[0])
+		return;
+
+	struct media_fwd *fwd = g_malloc0(sizeof(*fwd) + sinks->length * sizeof(*fwd->outputs));
+	fwd->sfd = stream->selected_sfd;
+	fwd->ssrc_in = stream->ssrc_in[0];
+	ssrc_ctx_hold(fwd->ssrc_in);
+	fwd->ssrc = htonl(fwd->ssrc_in->parent->h.ssrc);
+
+	mutex_lock(&stream->out_lock);
+	fwd->src = stream->endpoint;
+	mutex_unlock(&stream->out_lock);
+
+	for (GList *l = sinks->head; l; l = l->next) {
+		struct sink_handler *sh = l->data;
+		struct packet_stream *sink = sh->sink;
+
+		if (sh->attrs.block_media || sh->attrs.silence_media || sh->attrs.transcoding
+				|| sh->attrs.rtcp_only)
+			goto fail;
+		if (__determine_handler(stream, sh) != &__sh_noop_rtp)
+			goto fail;
+		if (!sink->selected_sfd || !PS_ISSET(sink, FILLED))
+			goto fail;
+		if (PS_ISSET(sink, NAT_WAIT) && !PS_ISSET(sink, RECEIVED))
+			goto fail;
+		if (MEDIA_ISSET(sink->media, BLACKHOLE))
+			goto fail;
+
+		struct media_fwd_output *o = &fwd->outputs[fwd->num_outputs++];
+		o->sink = sink;
+		o->sfd = obj_get(sink->selected_sfd);
+
+		mutex_lock(&sink->out_lock);
+		o->dst = sink->endpoint;
+		struct ssrc_ctx *ssrc_out = __hunt_ssrc_ctx(fwd->ssrc_in->ssrc_map_out, sink->ssrc_out, 0);
+		ssrc_ctx_hold(ssrc_out);
+		o->ssrc_out = ssrc_out;
+		mutex_unlock(&sink->out_lock);
+
+		if (!o->dst.address.family || !o->dst.port || !sink->advertised_endpoint.port || !o->ssrc_out)
+			goto fail;
+	}
+
+	// same as in kernelize_one(): only payload types that are passthrough for all sinks
+	unsigned int num_pts = 0;
+	GList *pts = g_hash_table_get_values(stream->rtp_stats);
+	for (GList *l = pts; l; l = l->next) {
+		struct rtp_stats *rs = l->data;
+		if (rs->payload_type < 0 || rs->payload_type >= G_N_ELEMENTS(fwd->pt_stats))
+			continue;
+		bool passthrough = true;
+		for (GList *k = sinks->head; k; k = k->next) {
+			struct sink_handler *sh = k->data;
+			struct codec_handler *ch = codec_handler_get(media, rs->payload_type,
+					sh->sink->media, sh);
+			if (ch->kernelize)
+				continue;
+			passthrough = false;
+			break;
+		}
+		if (!passthrough)
+			continue;
+		fwd->pt_stats[rs->payload_type] = rs;
+		num_pts++;
+	}
+	g_list_free(pts);
+	if (!num_pts)
+		goto fail;
+
+	ilog(LOG_DEBUG, "Forwarding media stream %s%s%s -> %s through userspace fast path (%u sinks)",
+			FMT_M(endpoint_print_buf(&fwd->src)),
+			endpoint_print_buf(&stream->selected_sfd->socket.local),
+			fwd->num_outputs);
+
+	rcu_assign_pointer(stream->fwd, fwd);
+	return;
+
+fail:
+	media_fwd_free(fwd);
+}
+
+
 /**
  * The linkage between userspace and kernel module is in the kernelize_one().
  * 
@@ -1396,6 +1667,8 @@ void kernelize(struct packet_stream *stream) {
 
 	if (call->recording != NULL && !selected_recording_method->kernel_support)
 		goto no_kernel;
+	if (call->recording != NULL && kernel.is_xdp) // no intercept support
+		goto no_kernel;
 	if (!kernel.is_wanted)
 		goto no_kernel;
 	nk_warn_msg = "interface to kernel module not open";
@@ -1447,12 +1720,17 @@ void kernelize(struct packet_stream *stream) {
 				"lack of sinks");
 	}
 
-	kernel_add_stream(&reti);
+	// the target and all its destinations in one go, or together with other streams if
+	// a batch is open
+	kernel_batch_begin();
+	ZERO(stream->kernel_stats_ref);
+	kernel_queue_target(&reti, &stream->kernel_stats_ref);
 	struct rtpengine_destination_info *redi;
 	while ((redi = g_queue_pop_head(&outputs))) {
-		kernel_add_destination(redi);
+		kernel_queue_destination(redi);
 		g_slice_free1(sizeof(*redi), redi);
 	}
+	kernel_batch_end();
 
 	stream->kernel_time = rtpe_now.tv_sec;
 	PS_SET(stream, KERNELIZED);
@@ -1464,6 +1742,7 @@ no_kernel:
 	PS_SET(stream, KERNELIZED);
 	stream->kernel_time = rtpe_now.tv_sec;
 	PS_SET(stream, NO_KERNEL_SUPPORT);
+	media_fwd_publish(stream);
 }
 
 // must be called with appropriate locks (master lock and/or in/out_lock)
@@ -1500,7 +1779,7 @@ static void __stream_update_stats(struct packet_stream *ps, int have_in_lock) {
 
 	__re_address_translate_ep(&local, &ps->selected_sfd->socket.local);
 	struct rtpengine_stats_info stats_info;
-	if (kernel_update_stats(&local, &stats_info)) {
+	if (kernel_update_stats(&local, &ps->kernel_stats_ref, &stats_info)) {
 		if (!have_in_lock)
 			mutex_unlock(&ps->in_lock);
 		return;
@@ -1563,6 +1842,7 @@ static void __stream_update_stats(struct packet_stream *ps, int have_in_lock) {
 void __unkernelize(struct packet_stream *p) {
 	struct re_address rea;
 
+	media_fwd_retract(p);
 	reset_ps_kernel_stats(p);
 
 	if (!p->selected_sfd)
@@ -1577,6 +1857,7 @@ void __unkernelize(struct packet_stream *p) {
 		__stream_update_stats(p, 1);
 		__re_address_translate_ep(&rea, &p->selected_sfd->socket.local);
 		kernel_del_stream(&rea);
+		p->kernel_stats_ref.idx = 0;
 	}
 
 	PS_CLEAR(p, KERNELIZED);
@@ -2287,6 +2568,166 @@ static int do_rtcp_output(struct packet_handler_ctx *phc) {
 }
 
 
+// sends out all packets of one socket from the batch, using as few system calls as possible
+static void send_batch_flush_sfd(struct send_batch *sb, struct stream_fd *sfd, unsigned int *idx,
+		unsigned int num)
+{
+	struct mmsghdr msgs[MAX_MMSG_BATCH];
+	struct iovec iov[MAX_MMSG_BATCH];
+	struct sockaddr_storage sin[MAX_MMSG_BATCH];
+#ifdef UDP_SEGMENT
+	char ctrl[MAX_MMSG_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+	unsigned int num_msgs = 0;
+
+	RTPE_STATS_INC(send_batches);
+	RTPE_STATS_ADD(send_batch_packets, num);
+	RTPE_STATS_HIST(send_batch_sizes, num);
+	STAT_HIST_ADD(sfd->local_intf->send_batch_sizes, num);
+	STAT_HIST_ADD(sfd->send_batch_sizes, num);
+
+	// sockets are closed only after a grace period, so a copy is safe to use
+	socket_t sock = sfd->socket;
+	if (sock.fd == -1)
+		return;
+
+	memset(msgs, 0, sizeof(*msgs) * num);
+
+	for (unsigned int i = 0; i < num; ) {
+		struct send_batch_entry *e = &sb->entries[idx[i]];
+		unsigned int segs = 1;
+
+#ifdef UDP_SEGMENT
+		// consecutive packets of the same size to the same destination can go out
+		// as a single GSO super-packet
+		if (rtpe_config.udp_gso) {
+			while (i + segs < num) {
+				struct send_batch_entry *f = &sb->entries[idx[i + segs]];
+				if (f->len != e->len || !endpoint_eq(&f->dst, &e->dst))
+					break;
+				if ((segs + 1) * e->len > MAX_GSO_SIZE)
+					break;
+				segs++;
+			}
+		}
+#endif
+
+		struct msghdr *mh = &msgs[num_msgs].msg_hdr;
+		for (unsigned int j = 0; j < segs; j++) {
+			struct send_batch_entry *f = &sb->entries[idx[i + j]];
+			iov[i + j].iov_base = sb->buf + f->offset;
+			iov[i + j].iov_len = f->len;
+		}
+		sock.family->endpoint2sockaddr(&sin[num_msgs], &e->dst);
+		mh->msg_name = &sin[num_msgs];
+		mh->msg_namelen = sock.family->sockaddr_size;
+		mh->msg_iov = &iov[i];
+		mh->msg_iovlen = segs;
+
+#ifdef UDP_SEGMENT
+		if (segs > 1) {
+			mh->msg_control = ctrl[num_msgs];
+			mh->msg_controllen = sizeof(ctrl[num_msgs]);
+			struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*((uint16_t *) CMSG_DATA(cm)) = e->len;
+			RTPE_STATS_ADD(send_gso_segments, segs);
+		}
+#endif
+
+		num_msgs++;
+		i += segs;
+	}
+
+	// sendmmsg() stops at the first message that fails: skip over that one only, so that
+	// one bad destination doesn't take the packets to all others with it
+	unsigned int sent = 0;
+	while (sent < num_msgs) {
+		int ret = sendmmsg(sock.fd, msgs + sent, num_msgs - sent, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ilog(LOG_DEBUG | LOG_FLAG_LIMIT, "Error sending batched packet: %s", strerror(errno));
+			ret = 1;
+		}
+		sent += ret;
+	}
+}
+
+static void send_batch_flush(struct send_batch *sb) {
+	bool done[MAX_MMSG_BATCH] = {0,};
+	unsigned int idx[MAX_MMSG_BATCH];
+
+	// the call's lock isn't held any more: a socket may get closed while sending, but its
+	// fd isn't closed or reused before the grace period is over. see release_closed_sockets()
+	rcu_read_lock();
+
+	// group packets by socket, retaining their order
+	for (unsigned int i = 0; i < sb->num; i++) {
+		if (done[i])
+			continue;
+		struct stream_fd *sfd = sb->entries[i].sfd;
+		unsigned int num = 0;
+		for (unsigned int j = i; j < sb->num; j++) {
+			if (done[j] || sb->entries[j].sfd != sfd)
+				continue;
+			done[j] = true;
+			idx[num++] = j;
+		}
+		send_batch_flush_sfd(sb, sfd, idx, num);
+	}
+
+	rcu_read_unlock();
+
+	for (unsigned int i = 0; i < sb->num; i++)
+		obj_put(sb->entries[i].sfd);
+	sb->num = 0;
+	sb->buf_used = 0;
+}
+
+// starts collecting outgoing packets in the current thread. can be nested.
+void media_socket_batch_begin(void) {
+	if (!rtpe_config.send_batch)
+		return;
+	if (!send_batch)
+		send_batch = g_malloc0(sizeof(*send_batch));
+	send_batch->depth++;
+}
+
+// flushes collected packets when the outermost batch ends
+void media_socket_batch_end(void) {
+	struct send_batch *sb = send_batch;
+	if (!sb || !sb->depth)
+		return;
+	if (--sb->depth)
+		return;
+	send_batch_flush(sb);
+}
+
+// sends immediately unless a batch is open in the current thread
+void media_socket_sendto(struct stream_fd *sfd, const str *s, const endpoint_t *dst) {
+	struct send_batch *sb = send_batch;
+
+	if (!sb || !sb->depth || s->len > sizeof(sb->buf)) {
+		socket_sendto(&sfd->socket, s->s, s->len, dst);
+		return;
+	}
+
+	if (sb->num >= MAX_MMSG_BATCH || sb->buf_used + s->len > sizeof(sb->buf))
+		send_batch_flush(sb);
+
+	struct send_batch_entry *e = &sb->entries[sb->num++];
+	e->sfd = obj_get(sfd);
+	e->dst = *dst;
+	e->offset = sb->buf_used;
+	e->len = s->len;
+	memcpy(sb->buf + sb->buf_used, s->s, s->len);
+	sb->buf_used += s->len;
+}
+
+
 // appropriate locks must be held
 // only frees the output queue if no `sink` is given
 int media_socket_dequeue(struct media_packet *mp, struct packet_stream *sink) {
@@ -2313,6 +2754,7 @@ void media_packet_copy(struct media_packet *dst, const struct media_packet *src)
 	dst->rtcp = __g_memdup(src->rtcp, sizeof(*src->rtcp));
 	dst->payload = STR_NULL;
 	dst->raw = STR_NULL;
+	dst->pktbuf = NULL;
 }
 void media_packet_release(struct media_packet *mp) {
 	if (mp->sfd)
@@ -2363,6 +2805,87 @@ static void count_stream_stats_userspace(struct packet_stream *ps) {
 }
 
 
+static void ssrc_in_stats(struct ssrc_ctx *ssrc_in, const struct rtp_header *rtp, unsigned int len) {
+	atomic64_inc(&ssrc_in->packets);
+	atomic64_add(&ssrc_in->octets, len);
+	// no real sequencing, so this is rudimentary
+	uint64_t old_seq = atomic64_get(&ssrc_in->last_seq);
+	uint64_t new_seq = ntohs(rtp->seq_num) | (old_seq & 0xffff0000UL);
+	// XXX combine this with similar code elsewhere
+	long seq_diff = new_seq - old_seq;
+	while (seq_diff < -60000) {
+		new_seq += 0x10000;
+		seq_diff += 0x10000;
+	}
+	if (seq_diff > 0 || seq_diff < -10) {
+		atomic64_set(&ssrc_in->last_seq, new_seq);
+		atomic64_set(&ssrc_in->last_ts, ntohl(rtp->timestamp));
+	}
+}
+
+
+/**
+ * Lock-free counterpart to stream_packet() for streams with a published
+ * struct media_fwd. Returns true if the packet was forwarded, or false if it
+ * must take the regular path, which is the case for anything that doesn't match
+ * the snapshot exactly (unexpected source, SSRC or payload type, RTCP, ...).
+ *
+ * Called with rcu_read_lock() held.
+ */
+static bool media_fwd_packet(struct stream_fd *sfd, const str *s, const endpoint_t *src) {
+	struct packet_stream *ps = sfd->stream; // changes only under master_lock/W, always valid
+	if (!ps)
+		return false;
+	struct media_fwd *fwd = rcu_dereference(ps->fwd);
+	if (!fwd || fwd->sfd != sfd)
+		return false;
+	if (sfd->call->drop_traffic)
+		return false;
+	if (!endpoint_eq(src, &fwd->src))
+		return false;
+	if (rtcp_demux_is_rtcp(s))
+		return false;
+
+	struct rtp_header *rtp;
+	str payload;
+	if (rtp_payload(&rtp, &payload, s))
+		return false;
+	if (rtp->ssrc != fwd->ssrc)
+		return false;
+	struct rtp_stats *rtp_s = fwd->pt_stats[rtp->m_pt & 0x7f];
+	if (!rtp_s)
+		return false;
+
+	// same accounting as the regular path does
+	ssrc_in_stats(fwd->ssrc_in, rtp, s->len);
+	atomic64_inc(&rtp_s->packets);
+	atomic64_add(&rtp_s->bytes, s->len);
+	atomic64_inc(&ps->stats_in.packets);
+	atomic64_add(&ps->stats_in.bytes, s->len);
+	atomic64_inc(&sfd->local_intf->stats.in.packets);
+	atomic64_add(&sfd->local_intf->stats.in.bytes, s->len);
+	atomic64_set(&ps->last_packet, rtpe_now.tv_sec);
+	RTPE_STATS_INC(packets_user);
+	RTPE_STATS_ADD(bytes_user, s->len);
+
+	for (unsigned int i = 0; i < fwd->num_outputs; i++) {
+		struct media_fwd_output *o = &fwd->outputs[i];
+
+		media_socket_sendto(o->sfd, s, &o->dst);
+
+		atomic64_inc(&o->sink->stats_out.packets);
+		atomic64_add(&o->sink->stats_out.bytes, s->len);
+		atomic64_inc(&o->sfd->local_intf->stats.out.packets);
+		atomic64_add(&o->sfd->local_intf->stats.out.bytes, s->len);
+		atomic64_inc(&o->ssrc_out->packets);
+		atomic64_add(&o->ssrc_out->octets, s->len);
+		atomic64_set(&o->ssrc_out->last_ts, ntohl(rtp->timestamp));
+	}
+
+	return true;
+}
+
+
 /**
  * Packet handling starts in stream_packet().
  * 
@@ -2372,9 +2895,10 @@ static void count_stream_stats_userspace(struct packet_stream *ps) {
  * Eventually proceeds to going through the list of sinks,
  * either rtp_sinks or rtcp_sinks (egress handling).
  *
- * called lock-free.
+ * call->master_lock held in R. The context must be released through
+ * stream_packet_release() after the lock has been dropped.
  */
-static int stream_packet(struct packet_handler_ctx *phc) {
+static int __stream_packet(struct packet_handler_ctx *phc) {
 /**
  * Incoming packets (ingress):
  * - phc->mp.sfd->socket.local: the local IP/port on which the packet arrived
@@ -2398,11 +2922,6 @@ static int stream_packet(struct packet_handler_ctx *phc) {
  * TODO: move the above comments to the data structure definitions, if the above
  * always holds true */
 	int ret = 0, handler_ret = 0;
-	GQueue free_list = G_QUEUE_INIT;
-
-	phc->mp.call = phc->mp.sfd->call;
-
-	rwlock_lock_r(&phc->mp.call->master_lock);
 
 	phc->mp.stream = phc->mp.sfd->stream;
 	if (G_UNLIKELY(!phc->mp.stream))
@@ -2464,23 +2983,8 @@ static int stream_packet(struct packet_handler_ctx *phc) {
 				endpoint_print_buf(&phc->mp.sfd->socket.local));
 
 	// SSRC receive stats
-	if (phc->mp.ssrc_in && phc->mp.rtp) {
-		atomic64_inc(&phc->mp.ssrc_in->packets);
-		atomic64_add(&phc->mp.ssrc_in->octets, phc->s.len);
-		// no real sequencing, so this is rudimentary
-		uint64_t old_seq = atomic64_get(&phc->mp.ssrc_in->last_seq);
-		uint64_t new_seq = ntohs(phc->mp.rtp->seq_num) | (old_seq & 0xffff0000UL);
-		// XXX combine this with similar code elsewhere
-		long seq_diff = new_seq - old_seq;
-		while (seq_diff < -60000) {
-			new_seq += 0x10000;
-			seq_diff += 0x10000;
-		}
-		if (seq_diff > 0 || seq_diff < -10) {
-			atomic64_set(&phc->mp.ssrc_in->last_seq, new_seq);
-			atomic64_set(&phc->mp.ssrc_in->last_ts, ntohl(phc->mp.rtp->timestamp));
-		}
-	}
+	if (phc->mp.ssrc_in && phc->mp.rtp)
+		ssrc_in_stats(phc->mp.ssrc_in, phc->mp.rtp, phc->s.len);
 
 	// decrypt in place
 	// XXX check handler_ret along the paths
@@ -2541,10 +3045,10 @@ static int stream_packet(struct packet_handler_ctx *phc) {
 			if (sh_link->next) {
 				if (!orig_raw.s)
 					orig_raw = phc->mp.raw;
-				char *buf = g_malloc(orig_raw.len + RTP_BUFFER_TAIL_ROOM);
+				char *buf = pktbuf_alloc(orig_raw.len + RTP_BUFFER_TAIL_ROOM);
 				memcpy(buf, orig_raw.s, orig_raw.len);
 				phc->mp.raw.s = buf;
-				g_queue_push_tail(&free_list, buf);
+				g_queue_push_tail(&phc->free_list, buf);
 			}
 			if (do_rtcp_parse(phc))
 				goto out;
@@ -2696,6 +3200,7 @@ out:
 		unconfirm_sinks(&phc->mp.stream->rtcp_sinks);
 	}
 	if (phc->unkernelize_subscriptions) {
+		kernel_batch_begin();
 		// XXX optimise this triple loop?
 		for (GList *l = phc->mp.media->monologue->subscriptions.head; l; l = l->next) {
 			struct call_subscription *cs = l->data;
@@ -2708,6 +3213,7 @@ out:
 				}
 			}
 		}
+		kernel_batch_end();
 	}
 
 	if (handler_ret < 0) {
@@ -2716,22 +3222,157 @@ out:
 		RTPE_STATS_INC(errors_user);
 	}
 
-	rwlock_unlock_r(&phc->mp.call->master_lock);
+	return ret;
+}
 
+// called lock-free
+static void stream_packet_release(struct packet_handler_ctx *phc) {
 	media_socket_dequeue(&phc->mp, NULL); // just free
 	ssrc_ctx_put(&phc->mp.ssrc_out);
 
 	ssrc_ctx_put(&phc->mp.ssrc_in);
 	rtcp_list_free(&phc->rtcp_list);
-	g_queue_clear_full(&free_list, g_free);
+	g_queue_clear_full(&phc->free_list, pktbuf_free);
+}
+
+// called lock-free
+static int stream_packet(struct packet_handler_ctx *phc) {
+	phc->mp.call = phc->mp.sfd->call;
+
+	rwlock_lock_r(&phc->mp.call->master_lock);
+	int ret = __stream_packet(phc);
+	rwlock_unlock_r(&phc->mp.call->master_lock);
+
+	stream_packet_release(phc);
 
 	return ret;
 }
 
 
+static void stream_fd_packet_done(int ret, struct packet_handler_ctx *phc, bool *update) {
+	if (G_UNLIKELY(ret < 0))
+		ilog(LOG_WARNING | LOG_FLAG_LIMIT, "Write error on media socket: %s", strerror(-ret));
+	else if (phc->update)
+		*update = true;
+}
+
+// called lock-free, takes and releases call->master_lock once per batch, or only for
+// the packets that media_fwd_packet() couldn't forward with --media-fast-path
+// returns the number of packets received, 0 if the socket was drained, or -1 if the socket is gone
+static int stream_fd_recv_batch(struct stream_fd *sfd, int fd, bool *update) {
+	struct call *ca = sfd->call;
+	bool fast_path = rtpe_config.media_fast_path;
+	int ret;
+
+	if (!recv_batch)
+		recv_batch = g_malloc(sizeof(*recv_batch));
+	struct recv_batch *rb = recv_batch;
+
+	unsigned int num = rtpe_config.recv_batch;
+	for (unsigned int i = 0; i < num; i++) {
+		rb->msgs[i].buf = rb->bufs[i] + RTP_BUFFER_HEAD_ROOM;
+		rb->msgs[i].len = MAX_RTP_PACKET_SIZE;
+	}
+
+	if (fast_path) {
+		// sockets are closed only after a grace period, so a copy is safe to use
+		rcu_read_lock();
+		socket_t sock = sfd->socket;
+		if (sock.fd != fd) {
+			rcu_read_unlock();
+			return -1;
+		}
+		do
+			ret = socket_recvmmsg_ts(&sock, rb->msgs, num);
+		while (ret < 0 && errno == EINTR);
+	}
+	else {
+		rwlock_lock_r(&ca->master_lock);
+		if (sfd->socket.fd != fd) {
+			rwlock_unlock_r(&ca->master_lock);
+			return -1;
+		}
+		do
+			ret = socket_recvmmsg_ts(&sfd->socket, rb->msgs, num);
+		while (ret < 0 && errno == EINTR);
+	}
+	if (ret <= 0) {
+		if (fast_path)
+			rcu_read_unlock();
+		else
+			rwlock_unlock_r(&ca->master_lock);
+		if (ret == 0)
+			return 0;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		stream_fd_closed(fd, sfd, 0);
+		return -1;
+	}
+
+	RTPE_STATS_INC(recv_batches);
+	RTPE_STATS_ADD(recv_batch_packets, ret);
+	RTPE_STATS_HIST(recv_batch_sizes, ret);
+
+	// packets left for the regular path
+	int num_phcs = 0;
+
+	for (int i = 0; i < ret; i++) {
+		if (rb->msgs[i].len >= MAX_RTP_PACKET_SIZE)
+			ilog(LOG_WARNING | LOG_FLAG_LIMIT, "UDP packet possibly truncated");
+		// once a packet takes the regular path, so do all after it, to keep them in order
+		else if (fast_path && !num_phcs) {
+			str s;
+			str_init_len(&s, rb->msgs[i].buf, rb->msgs[i].len);
+			if (media_fwd_packet(sfd, &s, &rb->msgs[i].ep))
+				continue;
+		}
+
+		struct packet_handler_ctx *phc = &rb->phcs[num_phcs++];
+		ZERO(*phc);
+		phc->mp.sfd = sfd;
+		phc->mp.call = ca;
+		phc->mp.fsin = rb->msgs[i].ep;
+		phc->mp.tv = rb->msgs[i].tv;
+		str_init_len(&phc->s, rb->msgs[i].buf, rb->msgs[i].len);
+	}
+
+	if (fast_path) {
+		rcu_read_unlock();
+		if (!num_phcs)
+			return ret;
+		rwlock_lock_r(&ca->master_lock);
+	}
+
+	// the jitter buffer does its own locking: fall back to handling packets one by one
+	if (sfd->stream && sfd->stream->jb) {
+		rwlock_unlock_r(&ca->master_lock);
+		for (int i = 0; i < num_phcs; i++) {
+			struct packet_handler_ctx *phc = &rb->phcs[i];
+			int pret = buffer_packet(&phc->mp, &phc->s);
+			if (pret == 1)
+				pret = stream_packet(phc);
+			stream_fd_packet_done(pret, phc, update);
+		}
+		return ret;
+	}
+
+	int rets[MAX_MMSG_BATCH];
+	for (int i = 0; i < num_phcs; i++)
+		rets[i] = __stream_packet(&rb->phcs[i]);
+
+	rwlock_unlock_r(&ca->master_lock);
+
+	for (int i = 0; i < num_phcs; i++) {
+		stream_packet_release(&rb->phcs[i]);
+		stream_fd_packet_done(rets[i], &rb->phcs[i], update);
+	}
+
+	return ret;
+}
+
 static void stream_fd_readable(int fd, void *p, uintptr_t u) {
 	struct stream_fd *sfd = p;
-	char buf[RTP_BUFFER_SIZE];
+	char *buf = NULL;
 	int ret, iters;
 	bool update = false;
 	struct call *ca;
@@ -2740,6 +3381,7 @@ static void stream_fd_readable(int fd, void *p, uintptr_t u) {
 		return;
 
 	ca = sfd->call ? : NULL;
+	bool fast_path = ca && rtpe_config.media_fast_path;
 
 	log_info_stream_fd(sfd);
 	int strikes = g_atomic_int_get(&sfd->error_strikes);
@@ -2752,6 +3394,29 @@ static void stream_fd_readable(int fd, void *p, uintptr_t u) {
 		return;
 	}
 
+	media_socket_batch_begin();
+
+	if (ca && rtpe_config.recv_batch > 1) {
+		for (iters = 0; ; iters += ret) {
+#if MAX_RECV_ITERS
+			if (iters >= MAX_RECV_ITERS) {
+				ilog(LOG_ERROR | LOG_FLAG_LIMIT, "Too many packets in UDP receive queue (more than %d), "
+						"aborting loop. Dropped packets possible", iters);
+				g_atomic_int_inc(&sfd->error_strikes);
+				goto strike;
+			}
+#endif
+			ret = stream_fd_recv_batch(sfd, fd, &update);
+			if (ret < 0)
+				goto done;
+			if (ret == 0)
+				break;
+		}
+		goto no_strike;
+	}
+
+	buf = pktbuf_alloc(RTP_BUFFER_SIZE);
+
 	for (iters = 0; ; iters++) {
 #if MAX_RECV_ITERS
 		if (iters >= MAX_RECV_ITERS) {
@@ -2765,18 +3430,40 @@ static void stream_fd_readable(int fd, void *p, uintptr_t u) {
 		struct packet_handler_ctx phc;
 		ZERO(phc);
 		phc.mp.sfd = sfd;
-
-		if (ca) {
-			rwlock_lock_r(&ca->master_lock);
-			if (sfd->socket.fd != fd) {
-				rwlock_unlock_r(&ca->master_lock);
+		phc.mp.pktbuf = buf;
+
+		if (fast_path) {
+			// sockets are closed only after a grace period, so a copy is safe to use
+			rcu_read_lock();
+			socket_t sock = sfd->socket;
+			if (sock.fd != fd) {
+				rcu_read_unlock();
 				goto done;
 			}
+			ret = socket_recvfrom_ts(&sock, buf + RTP_BUFFER_HEAD_ROOM, MAX_RTP_PACKET_SIZE,
+					&phc.mp.fsin, &phc.mp.tv);
+			bool forwarded = false;
+			if (ret > 0 && ret < MAX_RTP_PACKET_SIZE) {
+				str_init_len(&phc.s, buf + RTP_BUFFER_HEAD_ROOM, ret);
+				forwarded = media_fwd_packet(sfd, &phc.s, &phc.mp.fsin);
+			}
+			rcu_read_unlock();
+			if (forwarded)
+				continue;
+		}
+		else {
+			if (ca) {
+				rwlock_lock_r(&ca->master_lock);
+				if (sfd->socket.fd != fd) {
+					rwlock_unlock_r(&ca->master_lock);
+					goto done;
+				}
+			}
+			ret = socket_recvfrom_ts(&sfd->socket, buf + RTP_BUFFER_HEAD_ROOM, MAX_RTP_PACKET_SIZE,
+					&phc.mp.fsin, &phc.mp.tv);
+			if (ca)
+				rwlock_unlock_r(&ca->master_lock);
 		}
-		ret = socket_recvfrom_ts(&sfd->socket, buf + RTP_BUFFER_HEAD_ROOM, MAX_RTP_PACKET_SIZE,
-				&phc.mp.fsin, &phc.mp.tv);
-		if (ca)
-			rwlock_unlock_r(&ca->master_lock);
 
 		if (ret < 0) {
 			if (errno == EINTR)
@@ -2799,22 +3486,31 @@ static void stream_fd_readable(int fd, void *p, uintptr_t u) {
 		else
 			ret = stream_packet(&phc);
 
-		if (G_UNLIKELY(ret < 0))
-			ilog(LOG_WARNING | LOG_FLAG_LIMIT, "Write error on media socket: %s", strerror(-ret));
-		else if (phc.update)
-			update = true;
+		stream_fd_packet_done(ret, &phc, &update);
+
+		// the jitter buffer may have taken over the buffer
+		if (pktbuf_shared(buf)) {
+			pktbuf_free(buf);
+			buf = pktbuf_alloc(RTP_BUFFER_SIZE);
+		}
 	}
 
-	// no strike
+no_strike:
 	if (strikes > 0)
 		g_atomic_int_compare_and_exchange(&sfd->error_strikes, strikes, strikes - 1);
 
 strike:
+	media_socket_batch_end();
 
 	if (ca && update) {
 		redis_update_onekey(ca, rtpe_redis_write);
 	}
+	goto out;
+
 done:
+	media_socket_batch_end();
+out:
+	pktbuf_free(buf);
 	log_info_pop();
 }
 
@@ -2851,9 +3547,12 @@ struct stream_fd *stream_fd_new(socket_t *fd, struct call *call, struct local_in
 	pi.obj = &sfd->obj;
 	pi.readable = stream_fd_readable;
 	pi.closed = stream_fd_closed;
+	pi.recv = 1;
 
 	if (sfd->socket.fd != -1) {
-		if (rtpe_config.poller_per_thread)
+		if (call->poller)
+			p = call->poller;
+		else if (rtpe_config.poller_per_thread)
 			p = poller_map_get(rtpe_poller_map);
 		if (p) {
 			if (poller_add_item(p, &pi))
@@ -2959,8 +3658,7 @@ void interfaces_free(void) {
 	ll = g_hash_table_get_values(__intf_spec_addr_type_hash);
 	for (GList *l = ll; l; l = l->next) {
 		struct intf_spec *spec = l->data;
-		struct port_pool *pp = &spec->port_pool;
-		g_queue_clear(&pp->free_list);
+		port_pool_cleanup(&spec->port_pool);
 		g_slice_free1(sizeof(*spec), spec);
 	}
 	g_list_free(ll);
@@ -0,0 +1,178 @@
+#include "pktbuf.h"
+#include <glib.h>
+#include "aux.h"
+#include "main.h"
+#include "call.h"
+
+// sizes are of the usable data area, the header comes on top
+static const size_t pktbuf_class_sizes[] = {
+	512,
+	2048,
+	RTP_BUFFER_SIZE,
+};
+#define PKTBUF_CLASSES G_N_ELEMENTS(pktbuf_class_sizes)
+#define PKTBUF_NO_CLASS ((unsigned int) -1)
+
+struct pktbuf {
+	struct pktbuf *next; // in a free list
+	int refs;
+	unsigned int cls;
+	char data[];
+};
+
+struct pktbuf_cache {
+	struct pktbuf *free[PKTBUF_CLASSES];
+	unsigned int count[PKTBUF_CLASSES];
+	atomic64 hits,
+		 misses;
+};
+
+static atomic64 pktbuf_in_use;
+static atomic64 pktbuf_high_water;
+
+// totals of caches from threads that have exited
+static atomic64 pktbuf_hits_done,
+		pktbuf_misses_done;
+
+static mutex_t pktbuf_caches_lock = MUTEX_STATIC_INIT;
+static GQueue pktbuf_caches = G_QUEUE_INIT;
+
+static void pktbuf_cache_free(void *);
+
+static __thread struct pktbuf_cache *pktbuf_cache;
+static GPrivate pktbuf_cache_key = G_PRIVATE_INIT(pktbuf_cache_free);
+
+
+static void pktbuf_cache_free(void *p) {
+	struct pktbuf_cache *c = p;
+
+	mutex_lock(&pktbuf_caches_lock);
+	g_queue_remove(&pktbuf_caches, c);
+	atomic64_add(&pktbuf_hits_done, atomic64_get(&c->hits));
+	atomic64_add(&pktbuf_misses_done, atomic64_get(&c->misses));
+	mutex_unlock(&pktbuf_caches_lock);
+
+	for (unsigned int i = 0; i < PKTBUF_CLASSES; i++) {
+		struct pktbuf *b;
+		while ((b = c->free[i])) {
+			c->free[i] = b->next;
+			g_free(b);
+		}
+	}
+	g_slice_free1(sizeof(*c), c);
+	pktbuf_cache = NULL;
+}
+
+static struct pktbuf_cache *pktbuf_get_cache(void) {
+	struct pktbuf_cache *c = pktbuf_cache;
+	if (G_LIKELY(c))
+		return c;
+	c = pktbuf_cache = g_slice_alloc0(sizeof(*c));
+	g_private_set(&pktbuf_cache_key, c);
+	mutex_lock(&pktbuf_caches_lock);
+	g_queue_push_tail(&pktbuf_caches, c);
+	mutex_unlock(&pktbuf_caches_lock);
+	return c;
+}
+
+INLINE unsigned int pktbuf_class(size_t len) {
+	for (unsigned int i = 0; i < PKTBUF_CLASSES; i++) {
+		if (len <= pktbuf_class_sizes[i])
+			return i;
+	}
+	return PKTBUF_NO_CLASS;
+}
+
+INLINE struct pktbuf *pktbuf_header(void *p) {
+	return (struct pktbuf *) ((char *) p - G_STRUCT_OFFSET(struct pktbuf, data));
+}
+
+
+void *pktbuf_alloc(size_t len) {
+	struct pktbuf *b = NULL;
+	unsigned int cls = pktbuf_class(len);
+
+	if (!rtpe_config.buffer_pool) {
+		// no caching, but keep the same layout so that pktbuf_free() works
+		b = g_malloc(sizeof(*b) + (cls == PKTBUF_NO_CLASS ? len : pktbuf_class_sizes[cls]));
+		b->cls = PKTBUF_NO_CLASS;
+		b->refs = 1;
+		return b->data;
+	}
+
+	struct pktbuf_cache *c = pktbuf_get_cache();
+
+	if (cls != PKTBUF_NO_CLASS && (b = c->free[cls])) {
+		c->free[cls] = b->next;
+		c->count[cls]--;
+		atomic64_inc(&c->hits);
+	}
+	else {
+		b = g_malloc(sizeof(*b) + (cls == PKTBUF_NO_CLASS ? len : pktbuf_class_sizes[cls]));
+		b->cls = cls;
+		atomic64_inc(&c->misses);
+	}
+
+	b->refs = 1;
+	b->next = NULL;
+
+	atomic64_max(&pktbuf_high_water, atomic64_add(&pktbuf_in_use, 1) + 1);
+
+	return b->data;
+}
+
+void *pktbuf_hold(void *p) {
+	struct pktbuf *b = pktbuf_header(p);
+	g_atomic_int_inc(&b->refs);
+	return p;
+}
+
+void pktbuf_free(void *p) {
+	if (!p)
+		return;
+
+	struct pktbuf *b = pktbuf_header(p);
+	if (!g_atomic_int_dec_and_test(&b->refs))
+		return;
+
+	if (!rtpe_config.buffer_pool) {
+		g_free(b);
+		return;
+	}
+
+	atomic64_dec(&pktbuf_in_use);
+
+	// buffers go back to whichever thread releases them last
+	struct pktbuf_cache *c = pktbuf_get_cache();
+	if (b->cls == PKTBUF_NO_CLASS || c->count[b->cls] >= rtpe_config.buffer_pool) {
+		g_free(b);
+		return;
+	}
+
+	b->next = c->free[b->cls];
+	c->free[b->cls] = b;
+	c->count[b->cls]++;
+}
+
+bool pktbuf_shared(void *p) {
+	struct pktbuf *b = pktbuf_header(p);
+	return g_atomic_int_get(&b->refs) > 1;
+}
+
+
+void pktbuf_get_stats(struct pktbuf_stats *s) {
+	ZERO(*s);
+
+	mutex_lock(&pktbuf_caches_lock);
+	s->hits = atomic64_get(&pktbuf_hits_done);
+	s->misses = atomic64_get(&pktbuf_misses_done);
+	for (GList *l = pktbuf_caches.head; l; l = l->next) {
+		struct pktbuf_cache *c = l->data;
+		s->hits += atomic64_get(&c->hits);
+		s->misses += atomic64_get(&c->misses);
+	}
+	mutex_unlock(&pktbuf_caches_lock);
+
+	s->in_use = atomic64_get(&pktbuf_in_use);
+	s->high_water = atomic64_get(&pktbuf_high_water);
+}
@@ -12,14 +12,22 @@
 #include <sys/epoll.h>
 #include <glib.h>
 #include <sys/time.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <pthread.h>
 #include <main.h>
 #include <redis.h>
 #include <hiredis/adapters/libevent.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 
 #include "aux.h"
 #include "obj.h"
 #include "log_funcs.h"
+#include "socket.h"
+#include "call.h"
 
 
 
@@ -36,6 +44,17 @@ struct poller_item_int {
 
 	unsigned int			blocked:1;
 	unsigned int			error:1;
+
+	unsigned int			gen; /* io_uring: tags completions belonging to this item */
+	unsigned int			recv_mode:1; /* io_uring: datagrams are received by the poller */
+	unsigned int			fixed_file:1; /* io_uring: fd is registered under its own number */
+
+	/* io_uring: received datagrams not yet read by the readable callback */
+	mutex_t				recv_lock;
+	struct poller_recv_entry	*recv_queue; /* POLLER_URING_ITEM_BUFS entries, or NULL */
+	unsigned int			recv_head;
+	unsigned int			recv_len;
+	bool				recv_ended; /* multishot receive needs to be rearmed */
 };
 
 struct poller {
@@ -49,11 +68,259 @@ struct poller {
 	mutex_t				timers_add_del_lock; /* nested below timers_lock */
 	GSList				*timers_add;
 	GSList				*timers_del;
+
+	int				cpu; /* -1 if the thread isn't pinned */
+	int				numa_node;
+	volatile gint			num_items;
+	volatile gint			num_calls; /* calls assigned via poller_map_assign_call() */
+
+#ifdef HAVE_LIBURING
+	bool				uring_active;
+	struct io_uring			uring;
+	mutex_t				uring_sq_lock; /* nested below lock */
+	mutex_t				uring_cq_lock;
+	unsigned int			uring_gen;
+
+	struct io_uring_buf_ring	*uring_br; /* provided buffers for multishot receive, or NULL */
+	char				*uring_bufs;
+	mutex_t				uring_buf_lock;
+	struct msghdr			uring_msg; /* layout of the received buffers */
+	bool				uring_files; /* sparse table of registered fds set up */
+	bool				uring_no_recv; /* kernel lacks multishot receive */
+#endif
+};
+
+struct poller_recv_entry {
+	int				bid; /* provided buffer, or -1 for an error */
+	unsigned int			res; /* length of the buffer, or errno */
+};
+
+
+#ifdef HAVE_LIBURING
+
+#define POLLER_URING_ENTRIES		1024
+#define POLLER_URING_BATCH		128
+
+/* provided buffers for multishot receive, shared by all sockets of the poller. each holds
+ * a struct io_uring_recvmsg_out, the source address, control data and the datagram */
+#define POLLER_URING_BUFS		512 /* power of two */
+#define POLLER_URING_BUF_GROUP		0
+#define POLLER_URING_NAME_LEN		sizeof(struct sockaddr_storage)
+#define POLLER_URING_CTRL_LEN		64
+#define POLLER_URING_BUF_SIZE		(sizeof(struct io_uring_recvmsg_out) + POLLER_URING_NAME_LEN \
+						+ POLLER_URING_CTRL_LEN + MAX_RTP_PACKET_SIZE)
+/* buffers a socket may hold before its readable callback gets to them. more are dropped,
+ * as if the socket's receive queue had overflown */
+#define POLLER_URING_ITEM_BUFS		64
+/* fds below this are registered with the ring, under their own number */
+#define POLLER_URING_FILES		65536
+
+enum poller_uring_op {
+	URING_POLL_IN = 0,
+	URING_POLL_OUT,
+	URING_RECV,
 };
 
+/* completion tags: fd in the lower 32 bits, two bits for the operation, and the item
+ * generation above, so that completions for a removed or replaced item can be told apart.
+ * a generation of zero is never used, which makes tag zero suitable for requests
+ * whose completion is to be ignored. */
+#define URING_TAG(fd, gen, op)		(((uint64_t) (gen) << 34) | ((uint64_t) (op) << 32) \
+						| (uint32_t) (fd))
+#define URING_TAG_FD(t)			((int) ((t) & 0xffffffffULL))
+#define URING_TAG_OP(t)			((enum poller_uring_op) (((t) >> 32) & 3))
+#define URING_TAG_GEN(t)		((unsigned int) ((t) >> 34))
+#define URING_GEN_MASK			0x3fffffff
+
+static char *poller_uring_buf(struct poller *p, unsigned int bid) {
+	return p->uring_bufs + (size_t) bid * POLLER_URING_BUF_SIZE;
+}
+
+/* hands a provided buffer back to the kernel */
+static void poller_uring_buf_put(struct poller *p, unsigned int bid) {
+	mutex_lock(&p->uring_buf_lock);
+	io_uring_buf_ring_add(p->uring_br, poller_uring_buf(p, bid), POLLER_URING_BUF_SIZE, bid,
+			io_uring_buf_ring_mask(POLLER_URING_BUFS), 0);
+	io_uring_buf_ring_advance(p->uring_br, 1);
+	mutex_unlock(&p->uring_buf_lock);
+}
+
+/* without provided buffers (kernel older than 5.19), sockets are only polled */
+static void poller_uring_init_recv(struct poller *p) {
+	int ret;
+
+	p->uring_br = io_uring_setup_buf_ring(&p->uring, POLLER_URING_BUFS, POLLER_URING_BUF_GROUP,
+			0, &ret);
+	if (!p->uring_br) {
+		ilog(LOG_INFO, "No io_uring provided buffer support (%s), not using multishot receive",
+				strerror(-ret));
+		return;
+	}
+
+	p->uring_bufs = g_malloc(POLLER_URING_BUFS * POLLER_URING_BUF_SIZE);
+	for (unsigned int i = 0; i < POLLER_URING_BUFS; i++)
+		io_uring_buf_ring_add(p->uring_br, poller_uring_buf(p, i), POLLER_URING_BUF_SIZE, i,
+				io_uring_buf_ring_mask(POLLER_URING_BUFS), i);
+	io_uring_buf_ring_advance(p->uring_br, POLLER_URING_BUFS);
+	mutex_init(&p->uring_buf_lock);
+
+	p->uring_msg.msg_namelen = POLLER_URING_NAME_LEN;
+	p->uring_msg.msg_controllen = POLLER_URING_CTRL_LEN;
+
+	ret = io_uring_register_files_sparse(&p->uring, POLLER_URING_FILES);
+	if (ret)
+		ilog(LOG_INFO, "Failed to register io_uring file table (%s)", strerror(-ret));
+	else
+		p->uring_files = true;
+}
+
+static bool poller_uring_init(struct poller *p) {
+	struct io_uring_params params;
+
+	ZERO(params);
+	int ret = io_uring_queue_init_params(POLLER_URING_ENTRIES, &p->uring, &params);
+	if (ret) {
+		ilog(LOG_WARN, "Failed to set up io_uring poller (%s), falling back to epoll",
+				strerror(-ret));
+		return false;
+	}
+	/* required to wait for completions without touching the submission queue */
+	if (!(params.features & IORING_FEAT_EXT_ARG)) {
+		ilog(LOG_WARN, "Kernel io_uring support is too old, falling back to epoll");
+		io_uring_queue_exit(&p->uring);
+		return false;
+	}
+
+	mutex_init(&p->uring_sq_lock);
+	mutex_init(&p->uring_cq_lock);
+	poller_uring_init_recv(p);
+	p->uring_active = true;
+	return true;
+}
+
+static void poller_uring_cleanup(struct poller *p) {
+	if (p->uring_br)
+		io_uring_free_buf_ring(&p->uring, p->uring_br, POLLER_URING_BUFS, POLLER_URING_BUF_GROUP);
+	io_uring_queue_exit(&p->uring);
+	g_free(p->uring_bufs);
+}
+
+/* uring_sq_lock must be held */
+static struct io_uring_sqe *poller_uring_sqe(struct poller *p) {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&p->uring);
+	if (sqe)
+		return sqe;
+	/* submission queue full: flush it and try again */
+	io_uring_submit(&p->uring);
+	sqe = io_uring_get_sqe(&p->uring);
+	if (!sqe)
+		abort();
+	return sqe;
+}
+
+static void poller_uring_arm(struct poller *p, struct poller_item_int *it, enum poller_uring_op op) {
+	mutex_lock(&p->uring_sq_lock);
+	struct io_uring_sqe *sqe = poller_uring_sqe(p);
+	switch (op) {
+		case URING_POLL_IN:
+			io_uring_prep_poll_multishot(sqe, it->item.fd, POLLIN);
+			break;
+		case URING_POLL_OUT:
+			io_uring_prep_poll_add(sqe, it->item.fd, POLLOUT);
+			break;
+		case URING_RECV:
+			/* the fd doubles as index into the table of registered files */
+			io_uring_prep_recvmsg_multishot(sqe, it->item.fd, &p->uring_msg, 0);
+			sqe->flags |= IOSQE_BUFFER_SELECT;
+			if (it->fixed_file)
+				sqe->flags |= IOSQE_FIXED_FILE;
+			sqe->buf_group = POLLER_URING_BUF_GROUP;
+			/* don't pick a buffer until there's something to receive */
+			sqe->ioprio |= IORING_RECVSEND_POLL_FIRST;
+			break;
+	}
+	io_uring_sqe_set_data64(sqe, URING_TAG(it->item.fd, it->gen, op));
+	io_uring_submit(&p->uring);
+	mutex_unlock(&p->uring_sq_lock);
+}
+
+/* lock must be held */
+static void poller_uring_add(struct poller *p, struct poller_item_int *it) {
+	p->uring_gen = (p->uring_gen + 1) & URING_GEN_MASK;
+	if (!p->uring_gen)
+		p->uring_gen = 1;
+	it->gen = p->uring_gen;
+
+	if (!it->item.readable)
+		return;
+
+	if (!it->item.recv || !p->uring_br || p->uring_no_recv) {
+		poller_uring_arm(p, it, URING_POLL_IN);
+		return;
+	}
+
+	it->recv_mode = 1;
+	mutex_init(&it->recv_lock);
+	it->recv_queue = g_new(struct poller_recv_entry, POLLER_URING_ITEM_BUFS);
+
+	if (p->uring_files && it->item.fd < POLLER_URING_FILES) {
+		int fd = it->item.fd;
+		if (io_uring_register_files_update(&p->uring, fd, &fd, 1) == 1)
+			it->fixed_file = 1;
+	}
+
+	poller_uring_arm(p, it, URING_RECV);
+}
+
+/* lock must be held */
+static void poller_uring_del(struct poller *p, struct poller_item_int *it) {
+	mutex_lock(&p->uring_sq_lock);
+	struct io_uring_sqe *sqe;
+	if (it->item.readable) {
+		sqe = poller_uring_sqe(p);
+		if (it->recv_mode)
+			io_uring_prep_cancel64(sqe, URING_TAG(it->item.fd, it->gen, URING_RECV), 0);
+		else
+			io_uring_prep_poll_remove(sqe, URING_TAG(it->item.fd, it->gen, URING_POLL_IN));
+		io_uring_sqe_set_data64(sqe, 0);
+	}
+	if (it->blocked) {
+		sqe = poller_uring_sqe(p);
+		io_uring_prep_poll_remove(sqe, URING_TAG(it->item.fd, it->gen, URING_POLL_OUT));
+		io_uring_sqe_set_data64(sqe, 0);
+	}
+	io_uring_submit(&p->uring);
+	mutex_unlock(&p->uring_sq_lock);
+
+	/* a request still in flight holds its own reference to the file */
+	if (it->fixed_file) {
+		int fd = -1;
+		io_uring_register_files_update(&p->uring, it->item.fd, &fd, 1);
+		it->fixed_file = 0;
+	}
+
+	if (!it->recv_mode)
+		return;
+
+	/* whatever the readable callback didn't get to */
+	mutex_lock(&it->recv_lock);
+	for (; it->recv_len; it->recv_len--) {
+		struct poller_recv_entry *e = &it->recv_queue[it->recv_head];
+		it->recv_head = (it->recv_head + 1) % POLLER_URING_ITEM_BUFS;
+		if (e->bid >= 0)
+			poller_uring_buf_put(p, e->bid);
+	}
+	mutex_unlock(&it->recv_lock);
+}
+
+#endif
+
 struct poller_map {
 	mutex_t				lock;
 	GHashTable			*table;
+	GPtrArray			*pollers; /* in order of creation */
+	cpu_set_t			cpus; /* CPUs the process may run on, for pinning */
+	int				num_cpus;
 };
 
 struct poller_map *poller_map_new(void) {
@@ -63,10 +330,63 @@ struct poller_map *poller_map_new(void) {
 	memset(p, 0, sizeof(*p));
 	mutex_init(&p->lock);
 	p->table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	p->pollers = g_ptr_array_new();
+
+	/* taken before any thread is pinned */
+	if (sched_getaffinity(0, sizeof(p->cpus), &p->cpus) == 0)
+		p->num_cpus = CPU_COUNT(&p->cpus);
+	else
+		ilog(LOG_WARN, "Failed to get CPU affinity: %s", strerror(errno));
 
 	return p;
 }
 
+/* returns the n-th CPU of the affinity mask, wrapping around, or -1 */
+static int poller_map_cpu(struct poller_map *map, unsigned int n) {
+	if (!map->num_cpus)
+		return -1;
+	n %= map->num_cpus;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &map->cpus))
+			continue;
+		if (!n--)
+			return cpu;
+	}
+	return -1;
+}
+
+static int cpu_numa_node(int cpu) {
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i", cpu);
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if (!dir)
+		return -1;
+	int ret = -1;
+	const char *name;
+	while ((name = g_dir_read_name(dir))) {
+		if (strncmp(name, "node", 4) || !name[4])
+			continue;
+		ret = atoi(name + 4);
+		break;
+	}
+	g_dir_close(dir);
+	return ret;
+}
+
+/* pins the running thread to the given CPU */
+static bool poller_pin_thread(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret) {
+		ilog(LOG_WARN, "Failed to set CPU affinity of poller thread to CPU %i: %s",
+				cpu, strerror(ret));
+		return false;
+	}
+	return true;
+}
+
 void poller_map_add(struct poller_map *map) {
 	pthread_t tid = -1;
 	struct poller *p;
@@ -76,8 +396,70 @@ void poller_map_add(struct poller_map *map) {
 
 	mutex_lock(&map->lock);
 	p = poller_new();
+	if (rtpe_config.poller_cpu_affinity) {
+		int cpu = poller_map_cpu(map, map->pollers->len);
+		if (cpu >= 0 && poller_pin_thread(cpu)) {
+			p->cpu = cpu;
+			p->numa_node = cpu_numa_node(cpu);
+		}
+	}
 	g_hash_table_insert(map->table, (gpointer)tid, p);
+	g_ptr_array_add(map->pollers, p);
+	mutex_unlock(&map->lock);
+}
+
+/* picks the poller with the least number of calls and accounts a new call to it.
+ * must be balanced by poller_release_call() */
+struct poller *poller_map_assign_call(struct poller_map *map) {
+	if (!map)
+		return NULL;
+
+	struct poller *ret = NULL;
+	int min = 0;
+	mutex_lock(&map->lock);
+	for (unsigned int i = 0; i < map->pollers->len; i++) {
+		struct poller *p = g_ptr_array_index(map->pollers, i);
+		int calls = g_atomic_int_get(&p->num_calls);
+		if (ret && calls >= min)
+			continue;
+		ret = p;
+		min = calls;
+	}
+	if (ret)
+		g_atomic_int_inc(&ret->num_calls);
 	mutex_unlock(&map->lock);
+	return ret;
+}
+
+void poller_release_call(struct poller *p) {
+	if (!p)
+		return;
+	g_atomic_int_add(&p->num_calls, -1);
+}
+
+int poller_cpu(struct poller *p) {
+	return p ? p->cpu : -1;
+}
+
+/* returns a GArray of struct poller_load, one per poller. caller must free */
+GArray *poller_map_load(struct poller_map *map) {
+	GArray *ret = g_array_new(FALSE, TRUE, sizeof(struct poller_load));
+	if (!map)
+		return ret;
+
+	mutex_lock(&map->lock);
+	for (unsigned int i = 0; i < map->pollers->len; i++) {
+		struct poller *p = g_ptr_array_index(map->pollers, i);
+		struct poller_load l = {
+			.cpu = p->cpu,
+			.numa_node = p->numa_node,
+			.calls = g_atomic_int_get(&p->num_calls),
+			.sockets = g_atomic_int_get(&p->num_items),
+		};
+		g_array_append_val(ret, l);
+	}
+	mutex_unlock(&map->lock);
+	return ret;
 }
 
 struct poller *poller_map_get(struct poller_map *map) {
@@ -109,6 +491,7 @@ void poller_map_free(struct poller_map **map) {
 	mutex_lock(&m->lock);
 	g_hash_table_foreach(m->table, poller_map_free_poller, NULL);
 	g_hash_table_destroy(m->table);
+	g_ptr_array_free(m->pollers, TRUE);
 	mutex_unlock(&m->lock);
 	mutex_destroy(&m->lock);
 	free(m);
@@ -121,9 +504,17 @@ struct poller *poller_new(void) {
 	p = malloc(sizeof(*p));
 	memset(p, 0, sizeof(*p));
 	gettimeofday(&rtpe_now, NULL);
-	p->fd = epoll_create1(0);
-	if (p->fd == -1)
-		abort();
+	p->fd = -1;
+	p->cpu = -1;
+	p->numa_node = -1;
+#ifdef HAVE_LIBURING
+	if (rtpe_config.poller_method != POLLER_IO_URING || !poller_uring_init(p))
+#endif
+	{
+		p->fd = epoll_create1(0);
+		if (p->fd == -1)
+			abort();
+	}
 	mutex_init(&p->lock);
 	mutex_init(&p->timers_lock);
 	mutex_init(&p->timers_add_del_lock);
@@ -150,6 +541,10 @@ void poller_free(struct poller **pp) {
 	if (p->fd != -1)
 		close(p->fd);
 	p->fd = -1;
+#ifdef HAVE_LIBURING
+	if (p->uring_active)
+		poller_uring_cleanup(p);
+#endif
 	if (p->items)
 		free(p->items);
 	free(p);
@@ -177,6 +572,10 @@ static void poller_fd_timer(void *p) {
 static void poller_item_free(void *p) {
 	struct poller_item_int *i = p;
 	obj_put_o(i->item.obj);
+	if (i->recv_queue) {
+		mutex_destroy(&i->recv_lock);
+		g_free(i->recv_queue);
+	}
 }
 
 
@@ -203,11 +602,13 @@ static int __poller_add_item(struct poller *p, struct poller_item *i, int has_lo
 	if (i->fd < p->items_size && p->items[i->fd])
 		goto fail;
 
-	ZERO(e);
-	e.events = epoll_events(i, NULL);
-	e.data.fd = i->fd;
-	if (epoll_ctl(p->fd, EPOLL_CTL_ADD, i->fd, &e))
-		abort();
+	if (p->fd != -1) {
+		ZERO(e);
+		e.events = epoll_events(i, NULL);
+		e.data.fd = i->fd;
+		if (epoll_ctl(p->fd, EPOLL_CTL_ADD, i->fd, &e))
+			abort();
+	}
 
 	if (i->fd >= p->items_size) {
 		u = p->items_size;
@@ -220,6 +621,12 @@ static int __poller_add_item(struct poller *p, struct poller_item *i, int has_lo
 	memcpy(&ip->item, i, sizeof(*i));
 	obj_hold_o(ip->item.obj); /* new ref in *ip */
 	p->items[i->fd] = obj_get(ip);
+	g_atomic_int_inc(&p->num_items);
+
+#ifdef HAVE_LIBURING
+	if (p->uring_active)
+		poller_uring_add(p, ip);
+#endif
 
 	mutex_unlock(&p->lock);
 
@@ -258,10 +665,17 @@ int poller_del_item(struct poller *p, int fd) {
 	if (!p->items || !(it = p->items[fd]))
 		goto fail;
 
-	if (epoll_ctl(p->fd, EPOLL_CTL_DEL, fd, NULL))
-		abort();
+	if (p->fd != -1) {
+		if (epoll_ctl(p->fd, EPOLL_CTL_DEL, fd, NULL))
+			abort();
+	}
+#ifdef HAVE_LIBURING
+	else if (p->uring_active)
+		poller_uring_del(p, it);
+#endif
 
 	p->items[fd] = NULL; /* stealing the ref */
+	g_atomic_int_add(&p->num_items, -1);
 
 	mutex_unlock(&p->lock);
 
@@ -376,6 +790,304 @@ static void poller_timers_run(struct poller *p) {
 }
 
 
+#ifdef HAVE_LIBURING
+
+struct poller_uring_event {
+	uint64_t			tag;
+	int				res;
+	unsigned int			flags;
+};
+
+static void poller_uring_cq_unlock(void *p) {
+	struct poller *poller = p;
+	mutex_unlock(&poller->uring_cq_lock);
+}
+
+static void poller_uring_event(struct poller *p, struct poller_uring_event *ev) {
+	unsigned int gen = URING_TAG_GEN(ev->tag);
+	int fd = URING_TAG_FD(ev->tag);
+	bool out = URING_TAG_OP(ev->tag) == URING_POLL_OUT;
+	struct poller_item_int *it;
+
+	if (!gen)
+		return;
+
+	mutex_lock(&p->lock);
+	it = (fd >= 0 && fd < p->items_size) ? p->items[fd] : NULL;
+	if (!it || it->gen != gen) {
+		/* stale completion for an item that was removed in the meantime */
+		mutex_unlock(&p->lock);
+		return;
+	}
+	obj_hold(it);
+
+	/* the kernel may terminate a multishot poll at any time, which is signalled
+	 * by the absence of the MORE flag */
+	bool rearm = !out && ev->res >= 0 && !(ev->flags & IORING_CQE_F_MORE);
+	if (out)
+		it->blocked = 0;
+	mutex_unlock(&p->lock);
+
+	if (it->error || ev->res < 0 || (ev->res & (POLLERR | POLLHUP))) {
+		it->item.closed(it->item.fd, it->item.obj, it->item.uintp);
+		goto out;
+	}
+
+	if (out) {
+		if (it->item.writeable)
+			it->item.writeable(it->item.fd, it->item.obj, it->item.uintp);
+	}
+	else if ((ev->res & POLLIN))
+		it->item.readable(it->item.fd, it->item.obj, it->item.uintp);
+
+	if (rearm) {
+		mutex_lock(&p->lock);
+		if (p->items[fd] == it)
+			poller_uring_arm(p, it, URING_POLL_IN);
+		mutex_unlock(&p->lock);
+	}
+
+out:
+	obj_put(it);
+	log_info_reset();
+}
+
+/* recv_lock must be held */
+static bool poller_uring_recv_push(struct poller_item_int *it, int bid, unsigned int res) {
+	if (it->recv_len >= POLLER_URING_ITEM_BUFS)
+		return false;
+	struct poller_recv_entry *e = &it->recv_queue[(it->recv_head + it->recv_len) % POLLER_URING_ITEM_BUFS];
+	e->bid = bid;
+	e->res = res;
+	it->recv_len++;
+	return true;
+}
+
+/* queues a completed receive for the readable callback. returns the item, with a reference
+ * held, if the callback is to be run */
+static struct poller_item_int *poller_uring_recv_event(struct poller *p, struct poller_uring_event *ev) {
+	unsigned int gen = URING_TAG_GEN(ev->tag);
+	int fd = URING_TAG_FD(ev->tag);
+	bool more = ev->flags & IORING_CQE_F_MORE;
+	bool has_buf = ev->flags & IORING_CQE_F_BUFFER;
+	unsigned int bid = ev->flags >> IORING_CQE_BUFFER_SHIFT;
+	struct poller_item_int *it;
+
+	mutex_lock(&p->lock);
+	it = (fd >= 0 && fd < p->items_size) ? p->items[fd] : NULL;
+	if (!it || it->gen != gen || !it->recv_mode) {
+		/* stale completion for an item that was removed in the meantime */
+		mutex_unlock(&p->lock);
+		if (has_buf)
+			poller_uring_buf_put(p, bid);
+		return NULL;
+	}
+
+	if (!has_buf && ev->res == -EINVAL && !more) {
+		/* kernel older than 6.0: poll the socket instead */
+		if (!p->uring_no_recv)
+			ilog(LOG_INFO, "No io_uring multishot receive support, polling sockets instead");
+		p->uring_no_recv = true;
+		it->recv_mode = 0;
+		poller_uring_arm(p, it, URING_POLL_IN);
+		mutex_unlock(&p->lock);
+		return NULL;
+	}
+
+	mutex_lock(&it->recv_lock);
+	if (has_buf) {
+		if (!poller_uring_recv_push(it, bid, ev->res)) {
+			ilog(LOG_WARN | LOG_FLAG_LIMIT, "Too many packets queued on socket, dropping packet");
+			poller_uring_buf_put(p, bid);
+		}
+	}
+	else if (ev->res < 0 && ev->res != -ENOBUFS && ev->res != -ECANCELED)
+		poller_uring_recv_push(it, -1, -ev->res);
+	/* the request also ends when the provided buffers run out. the socket is then read
+	 * directly until it's rearmed */
+	if (!more)
+		it->recv_ended = true;
+	mutex_unlock(&it->recv_lock);
+
+	obj_hold(it);
+	mutex_unlock(&p->lock);
+	return it;
+}
+
+struct poller_recv_queue {
+	struct socket_recv_queue	q;
+	struct poller			*p;
+	struct poller_item_int		*it;
+};
+
+/* hands the next queued datagram to the socket code, as recvmsg() would */
+static ssize_t poller_uring_recvmsg(struct socket_recv_queue *q, struct msghdr *msg) {
+	struct poller_recv_queue *rq = (void *) q;
+	struct poller *p = rq->p;
+	struct poller_item_int *it = rq->it;
+	struct poller_recv_entry e;
+
+	mutex_lock(&it->recv_lock);
+	if (!it->recv_len) {
+		bool ended = it->recv_ended;
+		mutex_unlock(&it->recv_lock);
+		if (ended)
+			return recvmsg(q->fd, msg, 0);
+		errno = EAGAIN;
+		return -1;
+	}
+	e = it->recv_queue[it->recv_head];
+	it->recv_head = (it->recv_head + 1) % POLLER_URING_ITEM_BUFS;
+	it->recv_len--;
+	mutex_unlock(&it->recv_lock);
+
+	if (e.bid < 0) {
+		errno = e.res;
+		return -1;
+	}
+
+	char *buf = poller_uring_buf(p, e.bid);
+	struct io_uring_recvmsg_out *o = io_uring_recvmsg_validate(buf, e.res, &p->uring_msg);
+	if (!o) {
+		poller_uring_buf_put(p, e.bid);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	if (msg->msg_name) {
+		memcpy(msg->msg_name, io_uring_recvmsg_name(o), MIN(msg->msg_namelen, o->namelen));
+		msg->msg_namelen = o->namelen;
+	}
+
+	msg->msg_flags = o->flags;
+
+	if (msg->msg_control) {
+		size_t len = o->controllen;
+		if (len > msg->msg_controllen) {
+			len = msg->msg_controllen;
+			msg->msg_flags |= MSG_CTRUNC;
+		}
+		memcpy(msg->msg_control, (char *) io_uring_recvmsg_name(o) + p->uring_msg.msg_namelen, len);
+		msg->msg_controllen = len;
+	}
+
+	const char *payload = io_uring_recvmsg_payload(o, &p->uring_msg);
+	size_t left = io_uring_recvmsg_payload_length(o, e.res, &p->uring_msg);
+	ssize_t ret = 0;
+	for (size_t i = 0; i < msg->msg_iovlen && left; i++) {
+		size_t len = MIN(msg->msg_iov[i].iov_len, left);
+		memcpy(msg->msg_iov[i].iov_base, payload + ret, len);
+		ret += len;
+		left -= len;
+	}
+	if (left)
+		msg->msg_flags |= MSG_TRUNC;
+
+	poller_uring_buf_put(p, e.bid);
+
+	return ret;
+}
+
+/* runs the readable callback for the datagrams queued by poller_uring_recv_event() */
+static void poller_uring_recv_dispatch(struct poller *p, struct poller_item_int *it) {
+	struct poller_recv_queue rq = {
+		.q = {
+			.fd = it->item.fd,
+			.recvmsg = poller_uring_recvmsg,
+		},
+		.p = p,
+		.it = it,
+	};
+
+	socket_recv_queue = &rq.q;
+	it->item.readable(it->item.fd, it->item.obj, it->item.uintp);
+	socket_recv_queue = NULL;
+
+	mutex_lock(&p->lock);
+	if (p->items[it->item.fd] == it) {
+		mutex_lock(&it->recv_lock);
+		bool rearm = it->recv_ended;
+		it->recv_ended = false;
+		mutex_unlock(&it->recv_lock);
+		if (rearm)
+			poller_uring_arm(p, it, URING_RECV);
+	}
+	mutex_unlock(&p->lock);
+
+	obj_put(it);
+	log_info_reset();
+}
+
+static int poller_uring_poll(struct poller *p, int timeout) {
+	struct poller_uring_event evs[POLLER_URING_BATCH];
+	struct poller_item_int *recv_items[POLLER_URING_BATCH];
+	struct io_uring_cqe *cqe;
+	struct __kernel_timespec ts = {
+		.tv_sec = timeout / 1000,
+		.tv_nsec = (timeout % 1000) * 1000000LL,
+	};
+	unsigned int head, num = 0, num_recv = 0;
+	int ret;
+
+	/* only one thread at a time reaps completions, but their handlers run in parallel */
+	mutex_lock(&p->uring_cq_lock);
+	pthread_cleanup_push(poller_uring_cq_unlock, p);
+	thread_cancel_enable();
+	ret = io_uring_wait_cqe_timeout(&p->uring, &cqe, timeout >= 0 ? &ts : NULL);
+	thread_cancel_disable();
+	if (ret == 0) {
+		io_uring_for_each_cqe(&p->uring, head, cqe) {
+			if (num >= G_N_ELEMENTS(evs))
+				break;
+			evs[num].tag = io_uring_cqe_get_data64(cqe);
+			evs[num].res = cqe->res;
+			evs[num].flags = cqe->flags;
+			num++;
+		}
+		io_uring_cq_advance(&p->uring, num);
+	}
+	pthread_cleanup_pop(1);
+
+	if (ret == -ETIME || ret == -EINTR)
+		return 0;
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	gettimeofday(&rtpe_now, NULL);
+
+	for (unsigned int i = 0; i < num; i++) {
+		if (URING_TAG_OP(evs[i].tag) != URING_RECV) {
+			poller_uring_event(p, &evs[i]);
+			continue;
+		}
+
+		struct poller_item_int *it = poller_uring_recv_event(p, &evs[i]);
+		if (!it)
+			continue;
+
+		/* each socket's callback runs once, after all of its datagrams are queued */
+		unsigned int j;
+		for (j = 0; j < num_recv; j++) {
+			if (recv_items[j] == it)
+				break;
+		}
+		if (j < num_recv)
+			obj_put(it);
+		else
+			recv_items[num_recv++] = it;
+	}
+
+	for (unsigned int i = 0; i < num_recv; i++)
+		poller_uring_recv_dispatch(p, recv_items[i]);
+
+	return num;
+}
+
+#endif
+
+
 int poller_poll(struct poller *p, int timeout) {
 	int ret, i;
 	struct poller_item_int *it;
@@ -384,6 +1096,11 @@ int poller_poll(struct poller *p, int timeout) {
 	if (!p)
 		return -1;
 
+#ifdef HAVE_LIBURING
+	if (p->uring_active)
+		return poller_uring_poll(p, timeout);
+#endif
+
 	mutex_lock(&p->lock);
 
 	mutex_unlock(&p->lock);
@@ -472,6 +1189,16 @@ void poller_blocked(struct poller *p, void *fdp) {
 	if (!p->items[fd]->item.writeable)
 		goto fail;
 
+#ifdef HAVE_LIBURING
+	if (p->uring_active) {
+		if (!p->items[fd]->blocked) {
+			p->items[fd]->blocked = 1;
+			poller_uring_arm(p, p->items[fd], URING_POLL_OUT);
+		}
+		goto fail;
+	}
+#endif
+
 	p->items[fd]->blocked = 1;
 
 	ZERO(e);
@@ -0,0 +1,133 @@
+#include "port_pool.h"
+
+
+static bool pp_pair_in_range(struct port_pool *pp, unsigned int port) {
+	return port && port >= pp->min && port + 1 <= pp->max;
+}
+
+static bool pp_pair_free(struct port_pool *pp, unsigned int port) {
+	return !bit_array_isset(pp->ports_used, port) && !bit_array_isset(pp->ports_used, port + 1);
+}
+
+// must hold the lock
+static void pp_push(struct port_pool *pp, unsigned int port) {
+	if (bit_array_set(pp->free_list_used, port))
+		return; // already queued
+	unsigned int len = pp->free_list_len;
+	unsigned int idx = (pp->free_list_head + len) % pp->free_list_size;
+	pp->free_list[idx] = port;
+	g_atomic_int_inc(&pp->free_list_len);
+
+	// Swap it with a random pair from the back half of the queue, so that the
+	// order in which pairs are handed out can't be predicted, while a pair
+	// just released still isn't reused before half the queue has been.
+	if (len < 2)
+		return;
+	unsigned int swap = (pp->free_list_head + len / 2 + ssl_random() % (len - len / 2))
+		% pp->free_list_size;
+	pp->free_list[idx] = pp->free_list[swap];
+	pp->free_list[swap] = port;
+}
+
+// must hold the lock
+static unsigned int pp_pop(struct port_pool *pp) {
+	if (!pp->free_list_len)
+		return 0;
+	unsigned int port = pp->free_list[pp->free_list_head];
+	pp->free_list_head = (pp->free_list_head + 1) % pp->free_list_size;
+	g_atomic_int_add(&pp->free_list_len, -1);
+	bit_array_clear(pp->free_list_used, port);
+	return port;
+}
+
+void port_pool_init(struct port_pool *pp, unsigned int min, unsigned int max) {
+	pp->min = min;
+	pp->max = max;
+	pp->free_ports = max - min + 1;
+	mutex_init(&pp->free_list_lock);
+
+	unsigned int first = MAX((min + 1) & ~1U, 2); // 0 means none
+	pp->free_list_size = first + 1 <= max ? (max - 1 - first) / 2 + 1 : 0;
+	if (!pp->free_list_size)
+		return;
+	pp->free_list = g_new(uint16_t, pp->free_list_size);
+
+	for (unsigned int port = first; port + 1 <= max; port += 2)
+		pp_push(pp, port);
+	pp->free_pairs = pp->free_list_size;
+
+	// start out in random order, as searching the range from a random offset did
+	for (unsigned int i = pp->free_list_size - 1; i > 0; i--) {
+		unsigned int j = ssl_random() % (i + 1);
+		uint16_t tmp = pp->free_list[i];
+		pp->free_list[i] = pp->free_list[j];
+		pp->free_list[j] = tmp;
+	}
+}
+
+void port_pool_cleanup(struct port_pool *pp) {
+	g_free(pp->free_list);
+	pp->free_list = NULL;
+	pp->free_list_size = pp->free_list_head = pp->free_list_len = pp->free_pairs = 0;
+	mutex_destroy(&pp->free_list_lock);
+}
+
+// must hold the lock. the port has just been marked as used
+static void pp_taken(struct port_pool *pp, unsigned int port) {
+	if (pp_pair_in_range(pp, port & ~1U) && !bit_array_isset(pp->ports_used, port ^ 1))
+		g_atomic_int_add(&pp->free_pairs, -1);
+}
+
+bool port_pool_take(struct port_pool *pp, unsigned int port) {
+	mutex_lock(&pp->free_list_lock);
+	bool ret = !bit_array_set(pp->ports_used, port);
+	if (ret) {
+		g_atomic_int_add(&pp->free_ports, -1);
+		pp_taken(pp, port);
+	}
+	mutex_unlock(&pp->free_list_lock);
+	return ret;
+}
+
+void port_pool_put(struct port_pool *pp, unsigned int port) {
+	mutex_lock(&pp->free_list_lock);
+	if (!bit_array_clear(pp->ports_used, port))
+		goto out;
+	g_atomic_int_inc(&pp->free_ports);
+
+	port &= ~1U;
+	if (!pp_pair_in_range(pp, port) || !pp_pair_free(pp, port))
+		goto out;
+
+	g_atomic_int_inc(&pp->free_pairs);
+	if (pp->free_list_size)
+		pp_push(pp, port);
+out:
+	mutex_unlock(&pp->free_list_lock);
+}
+
+void port_pool_exclude(struct port_pool *pp, unsigned int port) {
+	mutex_lock(&pp->free_list_lock);
+	if (!bit_array_set(pp->ports_used, port) && port >= pp->min && port <= pp->max) {
+		g_atomic_int_add(&pp->free_ports, -1);
+		pp_taken(pp, port);
+	}
+	mutex_unlock(&pp->free_list_lock);
+}
+
+unsigned int port_pool_get_pair(struct port_pool *pp) {
+	unsigned int port;
+
+	if (!port_pool_free_pairs(pp))
+		return 0;
+
+	mutex_lock(&pp->free_list_lock);
+	// drop what has been taken since it was queued
+	while ((port = pp_pop(pp))) {
+		if (pp_pair_free(pp, port))
+			break;
+	}
+	mutex_unlock(&pp->free_list_lock);
+
+	return port;
+}
@@ -0,0 +1,125 @@
+#include "rcu.h"
+#include <glib.h>
+#include "aux.h"
+#include "poller.h"
+
+struct rcu_thread {
+	atomic64 epoch; // 0 while outside of a read-side section
+	unsigned int nesting;
+};
+
+struct rcu_head {
+	void (*func)(void *);
+	void *ptr;
+	uint64_t epoch;
+};
+
+static atomic64 rcu_epoch;
+
+static mutex_t rcu_threads_lock = MUTEX_STATIC_INIT;
+static GQueue rcu_threads = G_QUEUE_INIT;
+
+static mutex_t rcu_retired_lock = MUTEX_STATIC_INIT;
+static GQueue rcu_retired = G_QUEUE_INIT;
+
+static __thread struct rcu_thread *rcu_self;
+
+
+void rcu_init(void) {
+	atomic64_set(&rcu_epoch, 1);
+}
+
+void rcu_read_lock(void) {
+	struct rcu_thread *t = rcu_self;
+	if (G_UNLIKELY(!t)) {
+		t = rcu_self = g_slice_alloc0(sizeof(*t));
+		mutex_lock(&rcu_threads_lock);
+		g_queue_push_tail(&rcu_threads, t);
+		mutex_unlock(&rcu_threads_lock);
+	}
+	if (t->nesting++)
+		return;
+	atomic64_set(&t->epoch, atomic64_get(&rcu_epoch));
+	// the epoch must be visible before any protected pointer is loaded
+	__sync_synchronize();
+}
+
+void rcu_read_unlock(void) {
+	struct rcu_thread *t = rcu_self;
+	if (--t->nesting)
+		return;
+	__sync_synchronize();
+	atomic64_set(&t->epoch, 0);
+}
+
+// oldest epoch any reader may still be in, or 0 if there are no active readers
+static uint64_t rcu_min_epoch(void) {
+	uint64_t min = 0;
+	mutex_lock(&rcu_threads_lock);
+	for (GList *l = rcu_threads.head; l; l = l->next) {
+		struct rcu_thread *t = l->data;
+		uint64_t e = atomic64_get(&t->epoch);
+		if (e && (!min || e < min))
+			min = e;
+	}
+	mutex_unlock(&rcu_threads_lock);
+	return min;
+}
+
+void rcu_reclaim(void) {
+	GQueue done = G_QUEUE_INIT;
+
+	__sync_synchronize();
+	uint64_t min = rcu_min_epoch();
+
+	mutex_lock(&rcu_retired_lock);
+	// list is ordered by epoch
+	while (rcu_retired.head) {
+		struct rcu_head *h = rcu_retired.head->data;
+		if (min && h->epoch > min)
+			break;
+		g_queue_push_tail(&done, g_queue_pop_head(&rcu_retired));
+	}
+	mutex_unlock(&rcu_retired_lock);
+
+	struct rcu_head *h;
+	while ((h = g_queue_pop_head(&done))) {
+		h->func(h->ptr);
+		g_slice_free1(sizeof(*h), h);
+	}
+}
+
+// the pointer must have been unpublished already
+void rcu_call(void (*func)(void *), void *ptr) {
+	struct rcu_head *h = g_slice_alloc(sizeof(*h));
+	h->func = func;
+	h->ptr = ptr;
+
+	mutex_lock(&rcu_retired_lock);
+	// readers that entered before this point have an epoch lower than this one
+	h->epoch = atomic64_add(&rcu_epoch, 1) + 1;
+	g_queue_push_tail(&rcu_retired, h);
+	mutex_unlock(&rcu_retired_lock);
+
+	rcu_reclaim();
+}
+
+static void __rcu_timer(void *dummy) {
+	rcu_reclaim();
+}
+
+void rcu_timer(struct poller *p) {
+	poller_add_timer(p, __rcu_timer, NULL);
+}
+
+// no readers must be left
+void rcu_free(void) {
+	struct rcu_head *h;
+	while ((h = g_queue_pop_head(&rcu_retired))) {
+		h->func(h->ptr);
+		g_slice_free1(sizeof(*h), h);
+	}
+	struct rcu_thread *t;
+	while ((t = g_queue_pop_head(&rcu_threads)))
+		g_slice_free1(sizeof(*t), t);
+}
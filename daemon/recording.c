@@ -785,7 +785,7 @@ static void proc_init(struct call *call) {
 	struct recording *recording = call->recording;
 
 	recording->u.proc.call_idx = UNINIT_IDX;
-	if (!kernel.is_open) {
+	if (!kernel.is_open || kernel.is_xdp) {
 		ilog(LOG_WARN, "Call recording through /proc interface requested, but kernel table not open");
 		return;
 	}
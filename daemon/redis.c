@@ -93,9 +93,9 @@ static cond_t redis_ports_release_cond = COND_STATIC_INIT;
 static int redis_ports_release_balance = 0; // negative = releasers, positive = allocators
 
 static int redis_check_conn(struct redis *r);
-static void json_restore_call(struct redis *r, const str *id, bool foreign);
+static void redis_restore_call(struct redis *r, const str *id, bool foreign);
 static int redis_connect(struct redis *r, int wait);
-static int json_build_ssrc(struct call_monologue *ml, JsonReader *root_reader);
+static int redis_build_ssrc(struct call_monologue *ml, struct redis_doc *doc);
 
 
 // mutually exclusive multi-A multi-B lock
@@ -131,6 +131,14 @@ static void redis_pipe(struct redis *r, const char *fmt, ...) {
 	va_end(ap);
 	r->pipeline++;
 }
+static void redis_pipe_argv(struct redis *r, int argc, const char **argv, const size_t *argvlen) {
+	if (!r->ctx) {
+		ilog(LOG_ERROR, "Unable to pipe redis command. No redis context");
+		return;
+	}
+	redisAppendCommandArgv(r->ctx, argc, argv, argvlen);
+	r->pipeline++;
+}
 static redisReply *redis_get(struct redis *r, int type, const char *fmt, ...) {
 	va_list ap;
 	redisReply *ret;
@@ -194,20 +202,44 @@ static int redis_check_type(struct redis *r, char *key, char *suffix, char *type
 }
 
 
-/* called with r->lock held */
-static void redis_consume(struct redis *r) {
+static bool redis_reply_failed(const redisReply *rp) {
+	if (rp->type == REDIS_REPLY_ERROR)
+		return true;
+	// results of a MULTI/EXEC transaction
+	if (rp->type == REDIS_REPLY_ARRAY) {
+		for (size_t i = 0; i < rp->elements; i++) {
+			if (rp->element[i] && rp->element[i]->type == REDIS_REPLY_ERROR)
+				return true;
+		}
+	}
+	return false;
+}
+
+/* called with r->lock held. Returns the number of failed commands. */
+static unsigned int redis_consume(struct redis *r) {
 	redisReply *rp;
+	unsigned int failed = 0;
 
 	if (!r->ctx) {
 		ilog(LOG_ERROR, "Unable to consume pipelined replies. No redis context");
+		failed = r->pipeline;
 		r->pipeline = 0;
-		return;
+		return failed;
 	}
 	while (r->pipeline) {
-		if (redisGetReply(r->ctx, (void **) &rp) == REDIS_OK)
+		if (redisGetReply(r->ctx, (void **) &rp) != REDIS_OK)
+			failed++;
+		else {
+			if (redis_reply_failed(rp)) {
+				rlog(LOG_WARN, "Pipelined Redis command failed: %s",
+						rp->type == REDIS_REPLY_ERROR ? rp->str : "error in transaction");
+				failed++;
+			}
 			freeReplyObject(rp);
+		}
 		r->pipeline--;
 	}
+	return failed;
 }
 
 int redis_set_timeout(struct redis* r, int timeout) {
@@ -254,6 +286,7 @@ static int redis_connect(struct redis *r, int wait) {
 		redisFree(r->ctx);
 	r->ctx = NULL;
 	r->current_db = -1;
+	r->conn_id++;
 
 	rwlock_lock_r(&rtpe_config.config_lock);
 	connect_timeout = rtpe_config.redis_connect_timeout;
@@ -407,7 +440,7 @@ void on_redis_notification(redisAsyncContext *actx, void *reply, void *privdata)
 		goto err;
 	}
 
-	if (strncmp(rr->element[3]->str,"set",3)==0) {
+	if (strncmp(rr->element[3]->str,"set",3)==0 || strncmp(rr->element[3]->str,"hset",4)==0) {
 		c = call_get(&callid);
 		if (c) {
 			rwlock_unlock_w(&c->master_lock);
@@ -429,7 +462,7 @@ void on_redis_notification(redisAsyncContext *actx, void *reply, void *privdata)
 	        mutex_unlock(&r->lock);
 
 		// unlock before restoring calls to avoid deadlock in case err happens
-		json_restore_call(r, &callid, true);
+		redis_restore_call(r, &callid, true);
 
 	        mutex_lock(&r->lock);
 	}
@@ -994,97 +1027,11 @@ static void redis_delete_async_call_json(struct call *c, struct redis *r) {
 	g_queue_push_tail(&r->async_queue, redis_command);
 }
 
-INLINE void json_builder_add_string_value_uri_enc(JsonBuilder *builder, const char* tmp, int len) {
-	char enc[len * 3 + 1];
-	str_uri_encode_len(enc, tmp, len);
-	json_builder_add_string_value(builder,enc);
-}
-INLINE str *json_reader_get_string_value_uri_enc(JsonReader *root_reader) {
-	const char *s = json_reader_get_string_value(root_reader);
-	if (!s)
-		return NULL;
-	str *out = str_uri_decode_len(s, strlen(s));
-	return out; // must be free'd
-}
-// XXX rework restore procedure to use functions like this everywhere and eliminate the GHashTable
-INLINE long long json_reader_get_ll(JsonReader *root_reader, const char *key) {
-	if (!json_reader_read_member(root_reader, key))
-		return -1;
-	str *ret = json_reader_get_string_value_uri_enc(root_reader);
-	long long r = strtoll(ret->s, NULL, 10);
-	free(ret);
-	json_reader_end_member(root_reader);
-	return r;
-}
-
-static int json_get_hash(struct redis_hash *out,
-		const char *key, unsigned int id, JsonReader *root_reader)
-{
-	static unsigned int MAXKEYLENGTH = 512;
-	char key_concatted[MAXKEYLENGTH];
-	int rc=0;
-	__attribute__((unused)) AUTO_CLEANUP_GVBUF(orig_members);
-
-	if (id == -1) {
-		rc = snprintf(key_concatted, MAXKEYLENGTH, "%s",key);
-	} else {
-		rc = snprintf(key_concatted, MAXKEYLENGTH, "%s-%u",key,id);
-	}
-	if (rc>=MAXKEYLENGTH) {
-		rlog(LOG_ERROR,"Json key too long.");
-		goto err;
-	}
-
-	if (!json_reader_read_member(root_reader, key_concatted)) {
-		rlog(LOG_ERROR, "Could not read json member: %s",key_concatted);
-		goto err;
-	}
-
-	out->ht = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
-	if (!out->ht)
-		goto err;
-
-	gchar **members = json_reader_list_members(root_reader);
-	orig_members = members;
-	int nmemb = json_reader_count_members (root_reader);
-
-	for (int i=0; i < nmemb; ++i) {
-
-		if (!json_reader_read_member(root_reader, *members)) {
-			rlog(LOG_ERROR, "Could not read json member: %s",*members);
-			goto err3;
-		}
-		str *val = json_reader_get_string_value_uri_enc(root_reader);
-		char* tmp = strdup(*members);
-
-		if (g_hash_table_insert_check(out->ht, tmp, val) != TRUE) {
-			rlog(LOG_WARNING,"Key %s already exists", tmp);
-			goto err3;
-		}
-
-		json_reader_end_member(root_reader);
-
-		++members;
-	} // for
-	json_reader_end_member (root_reader);
-
-	return 0;
-
-err3:
-	g_hash_table_destroy(out->ht);
-err:
-	return -1;
-}
-
-static void json_destroy_hash(struct redis_hash *rh) {
-        g_hash_table_destroy(rh->ht);
-}
-
-static void json_destroy_list(struct redis_list *rl) {
+static void redis_destroy_list(struct redis_list *rl) {
         unsigned int i;
 
         for (i = 0; i < rl->len; i++) {
-                json_destroy_hash(&rl->rh[i]);
+                redis_doc_destroy_hash(&rl->rh[i]);
         }
         free(rl->rh);
         free(rl->ptrs);
@@ -1124,7 +1071,7 @@ define_get_int_type(timeval, struct timeval, strtotimeval);
 define_get_int_type(int, int, strtol);
 define_get_int_type(unsigned, unsigned int, strtol);
 //define_get_int_type(u16, uint16_t, strtol);
-//define_get_int_type(u64, uint64_t, strtoull);
+define_get_int_type(u64, uint64_t, strtoull);
 define_get_int_type(a64, atomic64, strtoa64);
 
 define_get_type_format(str, str);
@@ -1198,39 +1145,29 @@ static void *redis_list_get_ptr(struct redis_list *list, struct redis_hash *rh,
 	return redis_list_get_idx_ptr(list, idx);
 }
 
-static int json_build_list_cb(GQueue *q, struct call *c, const char *key,
-		unsigned int idx, struct redis_list *list,
-		int (*cb)(str *, GQueue *, struct redis_list *, void *), void *ptr, JsonReader *root_reader)
-{
-	char key_concatted[256];
-
-	snprintf(key_concatted, 256, "%s-%u", key, idx);
+struct redis_build_list {
+	GQueue *q;
+	struct redis_list *list;
+	int (*cb)(str *, GQueue *, struct redis_list *, void *);
+	void *ptr;
+};
 
-	if (!json_reader_read_member(root_reader, key_concatted)) {
-		rlog(LOG_ERROR,"Key in json not found:%s",key_concatted);
-		return -1;
-	}
-	int nmemb = json_reader_count_elements(root_reader);
-	for (int jidx=0; jidx < nmemb; ++jidx) {
-		if (!json_reader_read_element(root_reader,jidx)) {
-			rlog(LOG_ERROR,"Element in array not found.");
-			return -1;
-		}
-		str *s = json_reader_get_string_value_uri_enc(root_reader);
-		if (!s) {
-			rlog(LOG_ERROR,"String in json not found.");
-			return -1;
-		}
-		if (cb(s, q, list, ptr)) {
-			free(s);
-			return -1;
-		}
-		free(s);
-		json_reader_end_element(root_reader);
-	}
-	json_reader_end_member (root_reader);
+static int redis_build_list_item(str *s, void *p) {
+	struct redis_build_list *bl = p;
+	return bl->cb(s, bl->q, bl->list, bl->ptr);
+}
 
-	return 0;
+static int redis_build_list_cb(GQueue *q, struct call *c, const char *key,
+		unsigned int idx, struct redis_list *list,
+		int (*cb)(str *, GQueue *, struct redis_list *, void *), void *ptr, struct redis_doc *doc)
+{
+	struct redis_build_list bl = {
+		.q = q,
+		.list = list,
+		.cb = cb,
+		.ptr = ptr,
+	};
+	return redis_doc_get_list(doc, key, idx, redis_build_list_item, &bl);
 }
 
 static int rbl_cb_simple(str *s, GQueue *q, struct redis_list *list, void *ptr) {
@@ -1240,15 +1177,15 @@ static int rbl_cb_simple(str *s, GQueue *q, struct redis_list *list, void *ptr)
 	return 0;
 }
 
-static int json_build_list(GQueue *q, struct call *c, const char *key,
-		unsigned int idx, struct redis_list *list, JsonReader *root_reader)
+static int redis_build_list(GQueue *q, struct call *c, const char *key,
+		unsigned int idx, struct redis_list *list, struct redis_doc *doc)
 {
-	return json_build_list_cb(q, c, key, idx, list, rbl_cb_simple, NULL, root_reader);
+	return redis_build_list_cb(q, c, key, idx, list, rbl_cb_simple, NULL, doc);
 }
 
-static int json_get_list_hash(struct redis_list *out,
+static int redis_get_list_hash(struct redis_list *out,
 		const char *key,
-		const struct redis_hash *rh, const char *rh_num_key, JsonReader *root_reader)
+		const struct redis_hash *rh, const char *rh_num_key, struct redis_doc *doc)
 {
 	unsigned int i;
 
@@ -1262,7 +1199,7 @@ static int json_get_list_hash(struct redis_list *out,
 		goto err1;
 
 	for (i = 0; i < out->len; i++) {
-		if (json_get_hash(&out->rh[i], key, i, root_reader))
+		if (redis_doc_get_hash(doc, &out->rh[i], key, i))
 			goto err2;
 	}
 
@@ -1272,7 +1209,7 @@ err2:
 	free(out->ptrs);
 	while (i) {
 		i--;
-		json_destroy_hash(&out->rh[i]);
+		redis_doc_destroy_hash(&out->rh[i]);
 	}
 err1:
 	free(out->rh);
@@ -1454,7 +1391,7 @@ static int redis_streams(struct call *c, struct redis_list *streams) {
 	return 0;
 }
 
-static int redis_tags(struct call *c, struct redis_list *tags, JsonReader *root_reader) {
+static int redis_tags(struct call *c, struct redis_list *tags, struct redis_doc *doc) {
 	unsigned int i;
 	int ii;
 	struct redis_hash *rh;
@@ -1491,7 +1428,7 @@ static int redis_tags(struct call *c, struct redis_list *tags, JsonReader *root_
 			ml->logical_intf = get_logical_interface(NULL, NULL, 0);
 		}
 
-		if (json_build_ssrc(ml, root_reader))
+		if (redis_build_ssrc(ml, doc))
 			return -1;
 
 		tags->ptrs[i] = ml;
@@ -1520,7 +1457,7 @@ static int rbl_cb_plts_r(str *s, GQueue *q, struct redis_list *list, void *ptr)
 	codec_store_add_raw(&med->codecs, rbl_cb_plts_g(s, q, list, ptr));
 	return 0;
 }
-static int json_medias(struct call *c, struct redis_list *medias, JsonReader *root_reader) {
+static int redis_medias(struct call *c, struct redis_list *medias, struct redis_doc *doc) {
 	unsigned int i;
 	struct redis_hash *rh;
 	struct call_media *med;
@@ -1567,7 +1504,7 @@ static int json_medias(struct call *c, struct redis_list *medias, JsonReader *ro
 		if (redis_hash_get_sdes_params(&med->sdes_out, rh, "sdes_out") < 0)
 			return -1;
 
-		json_build_list_cb(NULL, c, "payload_types", i, NULL, rbl_cb_plts_r, med, root_reader);
+		redis_build_list_cb(NULL, c, "payload_types", i, NULL, rbl_cb_plts_r, med, doc);
 		/* XXX dtls */
 
 		medias->ptrs[i] = med;
@@ -1587,7 +1524,7 @@ static int redis_maps(struct call *c, struct redis_list *maps) {
 		rh = &maps->rh[i];
 
 		/* from call.c:__get_endpoint_map() */
-		em = uid_slice_alloc0(em, &c->endpoint_maps);
+		em = call_uid_alloc0(c, em, &c->endpoint_maps);
 		g_queue_init(&em->intf_sfds);
 
 		em->wildcard = redis_hash_get_bool_flag(rh, "wildcard");
@@ -1667,7 +1604,7 @@ static int rbl_subs_cb(str *s, GQueue *q, struct redis_list *list, void *ptr) {
 	return 0;
 }
 
-static int json_link_tags(struct call *c, struct redis_list *tags, struct redis_list *medias, JsonReader *root_reader)
+static int redis_link_tags(struct call *c, struct redis_list *tags, struct redis_list *medias, struct redis_doc *doc)
 {
 	unsigned int i;
 	struct call_monologue *ml, *other_ml;
@@ -1677,11 +1614,11 @@ static int json_link_tags(struct call *c, struct redis_list *tags, struct redis_
 	for (i = 0; i < tags->len; i++) {
 		ml = tags->ptrs[i];
 
-		if (!json_build_list_cb(NULL, c, "subscriptions", i, tags, rbl_subs_cb, ml, root_reader)) {
+		if (!redis_build_list_cb(NULL, c, "subscriptions", i, tags, rbl_subs_cb, ml, doc)) {
 			// new format, ok
 			;
 		}
-		else if (!json_build_list(&q, c, "subscriptions-oa", i, tags, root_reader)) {
+		else if (!redis_build_list(&q, c, "subscriptions-oa", i, tags, doc)) {
 			// legacy format
 			for (l = q.head; l; l = l->next) {
 				other_ml = l->data;
@@ -1692,7 +1629,7 @@ static int json_link_tags(struct call *c, struct redis_list *tags, struct redis_
 			}
 			g_queue_clear(&q);
 
-			if (json_build_list(&q, c, "subscriptions-noa", i, tags, root_reader))
+			if (redis_build_list(&q, c, "subscriptions-noa", i, tags, doc))
 				return -1;
 			for (l = q.head; l; l = l->next) {
 				other_ml = l->data;
@@ -1711,7 +1648,7 @@ static int json_link_tags(struct call *c, struct redis_list *tags, struct redis_
 						&(struct sink_attrs) { .offer_answer = true });
 		}
 
-		if (json_build_list(&q, c, "associated_tags", i, tags, root_reader))
+		if (redis_build_list(&q, c, "associated_tags", i, tags, doc))
 			return -1;
 		for (l = q.head; l; l = l->next) {
 			other_ml = l->data;
@@ -1721,7 +1658,7 @@ static int json_link_tags(struct call *c, struct redis_list *tags, struct redis_
 		}
 		g_queue_clear(&q);
 
-		if (json_build_list(&ml->medias, c, "medias", i, medias, root_reader))
+		if (redis_build_list(&ml->medias, c, "medias", i, medias, doc))
 			return -1;
 	}
 
@@ -1742,8 +1679,8 @@ static struct call_subscription *__find_subscriber(struct call_monologue *ml, st
 	return NULL;
 }
 
-static int json_link_streams(struct call *c, struct redis_list *streams,
-		struct redis_list *sfds, struct redis_list *medias, JsonReader *root_reader)
+static int redis_link_streams(struct call *c, struct redis_list *streams,
+		struct redis_list *sfds, struct redis_list *medias, struct redis_doc *doc)
 {
 	unsigned int i;
 	struct packet_stream *ps;
@@ -1758,10 +1695,10 @@ static int json_link_streams(struct call *c, struct redis_list *streams,
 		ps->selected_sfd = redis_list_get_ptr(sfds, &streams->rh[i], "sfd");
 		ps->rtcp_sibling = redis_list_get_ptr(streams, &streams->rh[i], "rtcp_sibling");
 
-		if (json_build_list(&ps->sfds, c, "stream_sfds", i, sfds, root_reader))
+		if (redis_build_list(&ps->sfds, c, "stream_sfds", i, sfds, doc))
 			return -1;
 
-		if (json_build_list(&q, c, "rtp_sinks", i, streams, root_reader))
+		if (redis_build_list(&q, c, "rtp_sinks", i, streams, doc))
 			return -1;
 		for (l = q.head; l; l = l->next) {
 			struct packet_stream *sink = l->data;
@@ -1782,7 +1719,7 @@ static int json_link_streams(struct call *c, struct redis_list *streams,
 				__add_sink_handler(&ps->rtp_sinks, sink, NULL);
 		}
 
-		if (json_build_list(&q, c, "rtcp_sinks", i, streams, root_reader))
+		if (redis_build_list(&q, c, "rtcp_sinks", i, streams, doc))
 			return -1;
 		for (l = q.head; l; l = l->next) {
 			struct packet_stream *sink = l->data;
@@ -1808,8 +1745,8 @@ static int json_link_streams(struct call *c, struct redis_list *streams,
 	return 0;
 }
 
-static int json_link_medias(struct call *c, struct redis_list *medias,
-		struct redis_list *streams, struct redis_list *maps, struct redis_list *tags, JsonReader *root_reader)
+static int redis_link_medias(struct call *c, struct redis_list *medias,
+		struct redis_list *streams, struct redis_list *maps, struct redis_list *tags, struct redis_doc *doc)
 {
 	unsigned int i;
 	struct call_media *med;
@@ -1820,9 +1757,9 @@ static int json_link_medias(struct call *c, struct redis_list *medias,
 		med->monologue = redis_list_get_ptr(tags, &medias->rh[i], "tag");
 		if (!med->monologue)
 			return -1;
-		if (json_build_list(&med->streams, c, "streams", i, streams, root_reader))
+		if (redis_build_list(&med->streams, c, "streams", i, streams, doc))
 			return -1;
-		if (json_build_list(&med->endpoint_maps, c, "maps", i, maps, root_reader))
+		if (redis_build_list(&med->endpoint_maps, c, "maps", i, maps, doc))
 			return -1;
 
 		if (med->media_id.s)
@@ -1875,8 +1812,8 @@ static int rbl_cb_intf_sfds(str *s, GQueue *q, struct redis_list *list, void *pt
 	return 0;
 }
 
-static int json_link_maps(struct call *c, struct redis_list *maps,
-		struct redis_list *sfds, JsonReader *root_reader)
+static int redis_link_maps(struct call *c, struct redis_list *maps,
+		struct redis_list *sfds, struct redis_doc *doc)
 {
 	unsigned int i;
 	struct endpoint_map *em;
@@ -1884,47 +1821,92 @@ static int json_link_maps(struct call *c, struct redis_list *maps,
 	for (i = 0; i < maps->len; i++) {
 		em = maps->ptrs[i];
 
-		if (json_build_list_cb(&em->intf_sfds, c, "map_sfds", em->unique_id, sfds,
-				rbl_cb_intf_sfds, em, root_reader))
+		if (redis_build_list_cb(&em->intf_sfds, c, "map_sfds", em->unique_id, sfds,
+				rbl_cb_intf_sfds, em, doc))
 			return -1;
 	}
 	return 0;
 }
 
-static int json_build_ssrc(struct call_monologue *ml, JsonReader *root_reader) {
-	char tmp[2048];
-	snprintf(tmp, sizeof(tmp), "ssrc_table-%u", ml->unique_id);
-	if (!json_reader_read_member(root_reader, "ssrc_table")) {
-		// non-fatal for backwards compatibility
-		json_reader_end_member(root_reader);
+static int redis_build_ssrc_entry(struct redis_hash *rh, void *p) {
+	struct call_monologue *ml = p;
+	uint64_t u;
+	int i;
+
+	if (redis_hash_get_u64(&u, rh, "ssrc"))
 		return 0;
+	struct ssrc_entry_call *se = get_ssrc(u, ml->ssrc_hash);
+	if (!se)
+		return 0;
+	if (!redis_hash_get_u64(&u, rh, "in_srtp_index"))
+		se->input_ctx.srtp_index = u;
+	if (!redis_hash_get_u64(&u, rh, "in_srtcp_index"))
+		se->input_ctx.srtcp_index = u;
+	if (!redis_hash_get_int(&i, rh, "in_payload_type"))
+		payload_tracker_add(&se->input_ctx.tracker, i);
+	if (!redis_hash_get_u64(&u, rh, "out_srtp_index"))
+		se->output_ctx.srtp_index = u;
+	if (!redis_hash_get_u64(&u, rh, "out_srtcp_index"))
+		se->output_ctx.srtcp_index = u;
+	if (!redis_hash_get_int(&i, rh, "out_payload_type"))
+		payload_tracker_add(&se->output_ctx.tracker, i);
+
+	obj_put(&se->h);
+	return 0;
+}
+
+static int redis_build_ssrc(struct call_monologue *ml, struct redis_doc *doc) {
+	// non-fatal for backwards compatibility
+	redis_doc_get_object_list(doc, "ssrc_table", ml->unique_id, redis_build_ssrc_entry, ml);
+	return 0;
+}
+
+static redisReply *redis_get_call_hash(struct redis *r, const str *callid) {
+	redisReply *rr = redis_get(r, REDIS_REPLY_ARRAY, "HGETALL " PB, STR(callid));
+	if (rr && !rr->elements) {
+		freeReplyObject(rr);
+		return NULL;
 	}
-	int nmemb = json_reader_count_elements(root_reader);
-	for (int jidx=0; jidx < nmemb; ++jidx) {
-		if (!json_reader_read_element(root_reader, jidx))
-			return -1;
+	return rr;
+}
 
-		uint32_t ssrc = json_reader_get_ll(root_reader, "ssrc");
-		struct ssrc_entry_call *se = get_ssrc(ssrc, ml->ssrc_hash);
-		if (!se)
-			goto next;
-		se->input_ctx.srtp_index = json_reader_get_ll(root_reader, "in_srtp_index");
-		se->input_ctx.srtcp_index = json_reader_get_ll(root_reader, "in_srtcp_index");
-		payload_tracker_add(&se->input_ctx.tracker, json_reader_get_ll(root_reader, "in_payload_type"));
-		se->output_ctx.srtp_index = json_reader_get_ll(root_reader, "out_srtp_index");
-		se->output_ctx.srtcp_index = json_reader_get_ll(root_reader, "out_srtcp_index");
-		payload_tracker_add(&se->output_ctx.tracker, json_reader_get_ll(root_reader, "out_payload_type"));
-
-		obj_put(&se->h);
-next:
-		json_reader_end_element(root_reader);
+/* called with r->lock held. Calls are stored as a single string, or as a hash
+ * of their sections with --redis-delta. Try the format we write first. */
+static redisReply *redis_get_call(struct redis *r, const str *callid) {
+	redisReply *rr;
+
+	if (rtpe_config.redis_delta) {
+		rr = redis_get_call_hash(r, callid);
+		if (!rr)
+			rr = redis_get(r, REDIS_REPLY_STRING, "GET " PB, STR(callid));
 	}
-	json_reader_end_member (root_reader);
-	return 0;
+	else {
+		rr = redis_get(r, REDIS_REPLY_STRING, "GET " PB, STR(callid));
+		if (!rr)
+			rr = redis_get_call_hash(r, callid);
+	}
+	return rr;
+}
+
+// the reply must be kept until the doc is freed
+static int redis_doc_load_reply(struct redis_doc *doc, redisReply *rr) {
+	if (rr->type == REDIS_REPLY_STRING)
+		return redis_doc_load(doc, rr->str, rr->len);
+
+	// field names and values, alternating
+	unsigned int num = rr->elements / 2;
+	str parts[num ? : 1];
+	for (unsigned int i = 0; i < num; i++) {
+		redisReply *v = rr->element[i * 2 + 1];
+		if (v->type != REDIS_REPLY_STRING)
+			return -1;
+		str_init_len(&parts[i], v->str, v->len);
+	}
+	return redis_doc_load_parts(doc, parts, num);
 }
 
-static void json_restore_call(struct redis *r, const str *callid, bool foreign) {
-	redisReply* rr_jsonStr;
+static void redis_restore_call(struct redis *r, const str *callid, bool foreign) {
+	redisReply* rr_data;
 	struct redis_hash call;
 	struct redis_list tags, sfds, streams, medias, maps;
 	struct call *c = NULL;
@@ -1933,27 +1915,21 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 
 	const char *err = 0;
 	int i;
-	JsonReader *root_reader =0;
-	JsonParser *parser =0;
+	struct redis_doc doc = {0,};
 
 	mutex_lock(&r->lock);
-	rr_jsonStr = redis_get(r, REDIS_REPLY_STRING, "GET " PB, STR(callid));
+	rr_data = redis_get_call(r, callid);
 	mutex_unlock(&r->lock);
 
 	bool must_release_pop = true;
 	redis_ports_release_push(false);
 
-	err = "could not retrieve JSON data from redis";
-	if (!rr_jsonStr)
+	err = "could not retrieve call data from redis";
+	if (!rr_data)
 		goto err1;
 
-	parser = json_parser_new();
-	err = "could not parse JSON data";
-	if (!json_parser_load_from_data (parser, rr_jsonStr->str, -1, NULL))
-		goto err1;
-	root_reader = json_reader_new (json_parser_get_root (parser));
-	err = "could not read JSON data";
-	if (!root_reader)
+	err = "could not parse call data";
+	if (redis_doc_load_reply(&doc, rr_data))
 		goto err1;
 
 
@@ -1963,7 +1939,7 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 		goto err1;
 
 	err = "'call' data incomplete";
-	if (json_get_hash(&call, "json", -1, root_reader))
+	if (redis_doc_get_hash(&doc, &call, "json", REDIS_DOC_NO_ID))
 		goto err2;
 
 	err = "missing 'last signal' timestamp";
@@ -1982,19 +1958,19 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 	}
 
 	err = "'tags' incomplete";
-	if (json_get_list_hash(&tags, "tag", &call, "num_tags", root_reader))
+	if (redis_get_list_hash(&tags, "tag", &call, "num_tags", &doc))
 		goto err3;
 	err = "'sfds' incomplete";
-	if (json_get_list_hash(&sfds, "sfd", &call, "num_sfds", root_reader))
+	if (redis_get_list_hash(&sfds, "sfd", &call, "num_sfds", &doc))
 		goto err4;
 	err = "'streams' incomplete";
-	if (json_get_list_hash(&streams, "stream", &call, "num_streams", root_reader))
+	if (redis_get_list_hash(&streams, "stream", &call, "num_streams", &doc))
 		goto err5;
 	err = "'medias' incomplete";
-	if (json_get_list_hash(&medias, "media", &call, "num_medias", root_reader))
+	if (redis_get_list_hash(&medias, "media", &call, "num_medias", &doc))
 		goto err6;
 	err = "'maps' incomplete";
-	if (json_get_list_hash(&maps, "map", &call, "num_maps", root_reader))
+	if (redis_get_list_hash(&maps, "map", &call, "num_maps", &doc))
 		goto err7;
 
 	err = "missing 'created' timestamp";
@@ -2028,10 +2004,10 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 	if (redis_streams(c, &streams))
 		goto err8;
 	err = "failed to create tags";
-	if (redis_tags(c, &tags, root_reader))
+	if (redis_tags(c, &tags, &doc))
 		goto err8;
 	err = "failed to create medias";
-	if (json_medias(c, &medias, root_reader))
+	if (redis_medias(c, &medias, &doc))
 		goto err8;
 	err = "failed to create maps";
 	if (redis_maps(c, &maps))
@@ -2041,16 +2017,16 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 	if (redis_link_sfds(&sfds, &streams))
 		goto err8;
 	err = "failed to link streams";
-	if (json_link_streams(c, &streams, &sfds, &medias, root_reader))
+	if (redis_link_streams(c, &streams, &sfds, &medias, &doc))
 		goto err8;
 	err = "failed to link tags";
-	if (json_link_tags(c, &tags, &medias, root_reader))
+	if (redis_link_tags(c, &tags, &medias, &doc))
 		goto err8;
 	err = "failed to link medias";
-	if (json_link_medias(c, &medias, &streams, &maps, &tags, root_reader))
+	if (redis_link_medias(c, &medias, &streams, &maps, &tags, &doc))
 		goto err8;
 	err = "failed to link maps";
-	if (json_link_maps(c, &maps, &sfds, root_reader))
+	if (redis_link_maps(c, &maps, &sfds, &doc))
 		goto err8;
 
 	// presence of this key determines whether we were recording at all
@@ -2064,26 +2040,23 @@ static void json_restore_call(struct redis *r, const str *callid, bool foreign)
 	err = NULL;
 
 err8:
-	json_destroy_list(&maps);
+	redis_destroy_list(&maps);
 err7:
-	json_destroy_list(&medias);
+	redis_destroy_list(&medias);
 err6:
-	json_destroy_list(&streams);
+	redis_destroy_list(&streams);
 err5:
-	json_destroy_list(&sfds);
+	redis_destroy_list(&sfds);
 err4:
-	json_destroy_list(&tags);
+	redis_destroy_list(&tags);
 err3:
-	json_destroy_hash(&call);
+	redis_doc_destroy_hash(&call);
 err2:
 	rwlock_unlock_w(&c->master_lock);
 err1:
-	if (root_reader)
-		g_object_unref (root_reader);
-	if (parser)
-		g_object_unref (parser);
-	if (rr_jsonStr)
-		freeReplyObject(rr_jsonStr);	
+	redis_doc_free(&doc);
+	if (rr_data)
+		freeReplyObject(rr_data);
 	if (err) {
 		mutex_lock(&r->lock);
 		if (r->ctx && r->ctx->err)
@@ -2140,7 +2113,7 @@ static void restore_thread(void *call_p, void *ctx_p) {
 	mutex_unlock(&ctx->r_m);
 
 	gettimeofday(&rtpe_now, NULL);
-	json_restore_call(r, &callid, ctx->foreign);
+	redis_restore_call(r, &callid, ctx->foreign);
 
 	mutex_lock(&ctx->r_m);
 	g_queue_push_tail(&ctx->r_q, r);
@@ -2225,55 +2198,50 @@ err:
 	return ret;
 }
 
-#define JSON_ADD_STRING(f...) do { \
-		int len = snprintf(tmp,sizeof(tmp), f); \
-		json_builder_add_string_value_uri_enc(builder, tmp, len); \
+#define DOC_ADD_STRING(f...) do { \
+		int len = snprintf(tmp, sizeof(tmp), f); \
+		redis_doc_add(w, tmp, MIN(len, sizeof(tmp) - 1)); \
 	} while (0)
-#define JSON_SET_NSTRING(a,b,c,d) do { \
-		snprintf(tmp,sizeof(tmp), a,b); \
-		json_builder_set_member_name(builder, tmp); \
-		JSON_ADD_STRING(c, d); \
+#define DOC_SET_SIMPLE(a,c,d) do { \
+		int len = snprintf(tmp, sizeof(tmp), c, d); \
+		redis_doc_set(w, a, tmp, MIN(len, sizeof(tmp) - 1)); \
 	} while (0)
-#define JSON_SET_NSTRING_CSTR(a,b,d) JSON_SET_NSTRING_LEN(a, b, strlen(d), d)
-#define JSON_SET_NSTRING_LEN(a,b,l,d) do { \
-		snprintf(tmp,sizeof(tmp), a,b); \
-		json_builder_set_member_name(builder, tmp); \
-		json_builder_add_string_value_uri_enc(builder, d, l); \
+#define DOC_SET_SIMPLE_LEN(a,l,d) redis_doc_set(w, a, d, l)
+#define DOC_SET_SIMPLE_CSTR(a,d) DOC_SET_SIMPLE_LEN(a, (d) ? strlen(d) : 0, (d) ? : "")
+#define DOC_SET_SIMPLE_STR(a,d) DOC_SET_SIMPLE_LEN(a, (d)->len, (d)->s)
+#define DOC_SET_NSTRING(a,b,c,d) do { \
+		snprintf(kbuf, sizeof(kbuf), a, b); \
+		DOC_SET_SIMPLE(kbuf, c, d); \
 	} while (0)
-#define JSON_SET_SIMPLE(a,c,d) do { \
-		json_builder_set_member_name(builder, a); \
-		JSON_ADD_STRING(c, d); \
+#define DOC_SET_NSTRING_LEN(a,b,l,d) do { \
+		snprintf(kbuf, sizeof(kbuf), a, b); \
+		DOC_SET_SIMPLE_LEN(kbuf, l, d); \
 	} while (0)
-#define JSON_SET_SIMPLE_LEN(a,l,d) do { \
-		json_builder_set_member_name(builder, a); \
-		json_builder_add_string_value_uri_enc(builder, d, l); \
-	} while (0)
-#define JSON_SET_SIMPLE_CSTR(a,d) JSON_SET_SIMPLE_LEN(a, (d) ? strlen(d) : 0, (d) ? : "")
-#define JSON_SET_SIMPLE_STR(a,d) JSON_SET_SIMPLE_LEN(a, (d)->len, (d)->s)
+#define DOC_SET_NSTRING_CSTR(a,b,d) DOC_SET_NSTRING_LEN(a, b, strlen(d), d)
 
-static void json_update_crypto_params(JsonBuilder *builder, const char *key, struct crypto_params *p) {
-	char tmp[2048];
+static void redis_update_crypto_params(struct redis_doc_writer *w, const char *key, struct crypto_params *p) {
+	char tmp[2048], kbuf[64];
 
 	if (!p->crypto_suite)
 		return;
 
-	JSON_SET_NSTRING_CSTR("%s-crypto_suite", key, p->crypto_suite->name);
-	JSON_SET_NSTRING_LEN("%s-master_key", key, sizeof(p->master_key), (char *) p->master_key);
-	JSON_SET_NSTRING_LEN("%s-master_salt", key, sizeof(p->master_salt), (char *) p->master_salt);
+	DOC_SET_NSTRING_CSTR("%s-crypto_suite", key, p->crypto_suite->name);
+	DOC_SET_NSTRING_LEN("%s-master_key", key, sizeof(p->master_key), (char *) p->master_key);
+	DOC_SET_NSTRING_LEN("%s-master_salt", key, sizeof(p->master_salt), (char *) p->master_salt);
 
-	JSON_SET_NSTRING("%s-unenc-srtp", key, "%i", p->session_params.unencrypted_srtp);
-	JSON_SET_NSTRING("%s-unenc-srtcp", key, "%i", p->session_params.unencrypted_srtcp);
-	JSON_SET_NSTRING("%s-unauth-srtp", key, "%i", p->session_params.unauthenticated_srtp);
+	DOC_SET_NSTRING("%s-unenc-srtp", key, "%i", p->session_params.unencrypted_srtp);
+	DOC_SET_NSTRING("%s-unenc-srtcp", key, "%i", p->session_params.unencrypted_srtcp);
+	DOC_SET_NSTRING("%s-unauth-srtp", key, "%i", p->session_params.unauthenticated_srtp);
 
 	if (p->mki)
-		JSON_SET_NSTRING_LEN("%s-mki", key, p->mki_len, (char *) p->mki);
+		DOC_SET_NSTRING_LEN("%s-mki", key, p->mki_len, (char *) p->mki);
 }
 
-static int json_update_sdes_params(JsonBuilder *builder, const char *pref,
+static int redis_update_sdes_params(struct redis_doc_writer *w, const char *pref,
 		unsigned int unique_id,
 		const char *k, GQueue *q)
 {
-	char tmp[2048];
+	char tmp[2048], kbuf[64];
 	unsigned int iter = 0;
 	char keybuf[32];
 	const char *key = k;
@@ -2285,8 +2253,8 @@ static int json_update_sdes_params(JsonBuilder *builder, const char *pref,
 		if (!p->crypto_suite)
 			return -1;
 
-		JSON_SET_NSTRING("%s_tag", key, "%u", cps->tag);
-		json_update_crypto_params(builder, key, p);
+		DOC_SET_NSTRING("%s_tag", key, "%u", cps->tag);
+		redis_update_crypto_params(w, key, p);
 
 		snprintf(keybuf, sizeof(keybuf), "%s-%u", k, iter++);
 		key = keybuf;
@@ -2295,22 +2263,23 @@ static int json_update_sdes_params(JsonBuilder *builder, const char *pref,
 	return 0;
 }
 
-static void json_update_dtls_fingerprint(JsonBuilder *builder, const char *pref,
+static void redis_update_dtls_fingerprint(struct redis_doc_writer *w, const char *pref,
 		unsigned int unique_id,
 		const struct dtls_fingerprint *f)
 {
 	if (!f->hash_func)
 		return;
 
-	JSON_SET_SIMPLE_CSTR("hash_func",f->hash_func->name);
-	JSON_SET_SIMPLE_LEN("fingerprint", sizeof(f->digest), (char *) f->digest);
+	DOC_SET_SIMPLE_CSTR("hash_func",f->hash_func->name);
+	DOC_SET_SIMPLE_LEN("fingerprint", sizeof(f->digest), (char *) f->digest);
 }
 
 /**
- * encodes the few (k,v) pairs for one call under one json structure
+ * encodes the few (k,v) pairs for one call under one document, or as one
+ * document per section with the parts writer.
  */
 
-char* redis_encode_json(struct call *c) {
+static void redis_encode_call(struct call *c, struct redis_doc_writer *w) {
 
 	GList *l=0,*k=0, *m=0, *n=0;
 	struct endpoint_map *ep;
@@ -2320,63 +2289,56 @@ char* redis_encode_json(struct call *c) {
 	struct packet_stream *ps;
 	struct intf_list *il;
 	struct call_monologue *ml, *ml2;
-	JsonBuilder *builder = json_builder_new ();
 	struct recording *rec = 0;
 
 	char tmp[2048];
 
-	json_builder_begin_object (builder);
 	{
-		json_builder_set_member_name(builder, "json");
-
-		json_builder_begin_object (builder);
+		redis_doc_begin_object(w, "json", REDIS_DOC_NO_ID);
 
 		{
-			JSON_SET_SIMPLE("created","%lli", timeval_us(&c->created));
-			JSON_SET_SIMPLE("destroyed","%lli", timeval_us(&c->destroyed));
-			JSON_SET_SIMPLE("last_signal","%ld",(long int) c->last_signal);
-			JSON_SET_SIMPLE("tos","%u",(int) c->tos);
-			JSON_SET_SIMPLE("deleted","%ld",(long int) c->deleted);
-			JSON_SET_SIMPLE("num_sfds","%u",g_queue_get_length(&c->stream_fds));
-			JSON_SET_SIMPLE("num_streams","%u",g_queue_get_length(&c->streams));
-			JSON_SET_SIMPLE("num_medias","%u",g_queue_get_length(&c->medias));
-			JSON_SET_SIMPLE("num_tags","%u",g_queue_get_length(&c->monologues));
-			JSON_SET_SIMPLE("num_maps","%u",g_queue_get_length(&c->endpoint_maps));
-			JSON_SET_SIMPLE("ml_deleted","%ld",(long int) c->ml_deleted);
-			JSON_SET_SIMPLE_CSTR("created_from",c->created_from);
-			JSON_SET_SIMPLE_CSTR("created_from_addr",sockaddr_print_buf(&c->created_from_addr));
-			JSON_SET_SIMPLE("redis_hosted_db","%u",c->redis_hosted_db);
-			JSON_SET_SIMPLE_STR("recording_metadata",&c->metadata);
-			JSON_SET_SIMPLE("block_dtmf","%i", c->block_dtmf);
-			JSON_SET_SIMPLE("block_media","%i",c->block_media);
+			DOC_SET_SIMPLE("created","%lli", timeval_us(&c->created));
+			DOC_SET_SIMPLE("destroyed","%lli", timeval_us(&c->destroyed));
+			DOC_SET_SIMPLE("last_signal","%ld",(long int) c->last_signal);
+			DOC_SET_SIMPLE("tos","%u",(int) c->tos);
+			DOC_SET_SIMPLE("deleted","%ld",(long int) c->deleted);
+			DOC_SET_SIMPLE("num_sfds","%u",g_queue_get_length(&c->stream_fds));
+			DOC_SET_SIMPLE("num_streams","%u",g_queue_get_length(&c->streams));
+			DOC_SET_SIMPLE("num_medias","%u",g_queue_get_length(&c->medias));
+			DOC_SET_SIMPLE("num_tags","%u",g_queue_get_length(&c->monologues));
+			DOC_SET_SIMPLE("num_maps","%u",g_queue_get_length(&c->endpoint_maps));
+			DOC_SET_SIMPLE("ml_deleted","%ld",(long int) c->ml_deleted);
+			DOC_SET_SIMPLE_CSTR("created_from",c->created_from);
+			DOC_SET_SIMPLE_CSTR("created_from_addr",sockaddr_print_buf(&c->created_from_addr));
+			DOC_SET_SIMPLE("redis_hosted_db","%u",c->redis_hosted_db);
+			DOC_SET_SIMPLE_STR("recording_metadata",&c->metadata);
+			DOC_SET_SIMPLE("block_dtmf","%i", c->block_dtmf);
+			DOC_SET_SIMPLE("block_media","%i",c->block_media);
 
 			if ((rec = c->recording)) {
-				JSON_SET_SIMPLE_CSTR("recording_meta_prefix",rec->meta_prefix);
+				DOC_SET_SIMPLE_CSTR("recording_meta_prefix",rec->meta_prefix);
 			}
 		}
 
-		json_builder_end_object (builder);
+		redis_doc_end(w);
 
 		for (l = c->stream_fds.head; l; l = l->next) {
 			sfd = l->data;
 
-			snprintf(tmp, sizeof(tmp), "sfd-%u", sfd->unique_id);
-			json_builder_set_member_name(builder, tmp);
-
-			json_builder_begin_object (builder);
+			redis_doc_begin_object(w, "sfd", sfd->unique_id);
 
 			{
-				JSON_SET_SIMPLE_CSTR("pref_family",sfd->local_intf->logical->preferred_family->rfc_name);
-				JSON_SET_SIMPLE("localport","%u",sfd->socket.local.port);
-				JSON_SET_SIMPLE("fd", "%i", sfd->socket.fd);
-				JSON_SET_SIMPLE_STR("logical_intf",&sfd->local_intf->logical->name);
-				JSON_SET_SIMPLE("local_intf_uid","%u",sfd->local_intf->unique_id);
-				JSON_SET_SIMPLE("stream","%u",sfd->stream->unique_id);
+				DOC_SET_SIMPLE_CSTR("pref_family",sfd->local_intf->logical->preferred_family->rfc_name);
+				DOC_SET_SIMPLE("localport","%u",sfd->socket.local.port);
+				DOC_SET_SIMPLE("fd", "%i", sfd->socket.fd);
+				DOC_SET_SIMPLE_STR("logical_intf",&sfd->local_intf->logical->name);
+				DOC_SET_SIMPLE("local_intf_uid","%u",sfd->local_intf->unique_id);
+				DOC_SET_SIMPLE("stream","%u",sfd->stream->unique_id);
 
-				json_update_crypto_params(builder, "", &sfd->crypto.params);
+				redis_update_crypto_params(w, "", &sfd->crypto.params);
 
 			}
-			json_builder_end_object (builder);
+			redis_doc_end(w);
 
 		} // --- for
 
@@ -2386,28 +2348,25 @@ char* redis_encode_json(struct call *c) {
 			mutex_lock(&ps->in_lock);
 			mutex_lock(&ps->out_lock);
 
-			snprintf(tmp, sizeof(tmp), "stream-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-
-			json_builder_begin_object (builder);
+			redis_doc_begin_object(w, "stream", ps->unique_id);
 
 			{
-				JSON_SET_SIMPLE("media","%u",ps->media->unique_id);
-				JSON_SET_SIMPLE("sfd","%u",ps->selected_sfd ? ps->selected_sfd->unique_id : -1);
-				JSON_SET_SIMPLE("rtcp_sibling","%u",ps->rtcp_sibling ? ps->rtcp_sibling->unique_id : -1);
-				JSON_SET_SIMPLE("last_packet",UINT64F,atomic64_get(&ps->last_packet));
-				JSON_SET_SIMPLE("ps_flags","%u",ps->ps_flags);
-				JSON_SET_SIMPLE("component","%u",ps->component);
-				JSON_SET_SIMPLE_CSTR("endpoint",endpoint_print_buf(&ps->endpoint));
-				JSON_SET_SIMPLE_CSTR("advertised_endpoint",endpoint_print_buf(&ps->advertised_endpoint));
-				JSON_SET_SIMPLE("stats-packets","%" PRIu64, atomic64_get(&ps->stats_in.packets));
-				JSON_SET_SIMPLE("stats-bytes","%" PRIu64, atomic64_get(&ps->stats_in.bytes));
-				JSON_SET_SIMPLE("stats-errors","%" PRIu64, atomic64_get(&ps->stats_in.errors));
-
-				json_update_crypto_params(builder, "", &ps->crypto.params);
+				DOC_SET_SIMPLE("media","%u",ps->media->unique_id);
+				DOC_SET_SIMPLE("sfd","%u",ps->selected_sfd ? ps->selected_sfd->unique_id : -1);
+				DOC_SET_SIMPLE("rtcp_sibling","%u",ps->rtcp_sibling ? ps->rtcp_sibling->unique_id : -1);
+				DOC_SET_SIMPLE("last_packet",UINT64F,atomic64_get(&ps->last_packet));
+				DOC_SET_SIMPLE("ps_flags","%u",ps->ps_flags);
+				DOC_SET_SIMPLE("component","%u",ps->component);
+				DOC_SET_SIMPLE_CSTR("endpoint",endpoint_print_buf(&ps->endpoint));
+				DOC_SET_SIMPLE_CSTR("advertised_endpoint",endpoint_print_buf(&ps->advertised_endpoint));
+				DOC_SET_SIMPLE("stats-packets","%" PRIu64, atomic64_get(&ps->stats_in.packets));
+				DOC_SET_SIMPLE("stats-bytes","%" PRIu64, atomic64_get(&ps->stats_in.bytes));
+				DOC_SET_SIMPLE("stats-errors","%" PRIu64, atomic64_get(&ps->stats_in.errors));
+
+				redis_update_crypto_params(w, "", &ps->crypto.params);
 			}
 
-			json_builder_end_object (builder);
+			redis_doc_end(w);
 
 			// stream_sfds was here before
 			mutex_unlock(&ps->in_lock);
@@ -2423,34 +2382,28 @@ char* redis_encode_json(struct call *c) {
 			mutex_lock(&ps->in_lock);
 			mutex_lock(&ps->out_lock);
 
-			snprintf(tmp, sizeof(tmp), "stream_sfds-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "stream_sfds", ps->unique_id);
 			for (k = ps->sfds.head; k; k = k->next) {
 				sfd = k->data;
-				JSON_ADD_STRING("%u",sfd->unique_id);
+				DOC_ADD_STRING("%u",sfd->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
-			snprintf(tmp, sizeof(tmp), "rtp_sinks-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_doc_begin_array(w, "rtp_sinks", ps->unique_id);
 			for (k = ps->rtp_sinks.head; k; k = k->next) {
 				struct sink_handler *sh = k->data;
 				struct packet_stream *sink = sh->sink;
-				JSON_ADD_STRING("%u", sink->unique_id);
+				DOC_ADD_STRING("%u", sink->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
-			snprintf(tmp, sizeof(tmp), "rtcp_sinks-%u", ps->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_doc_begin_array(w, "rtcp_sinks", ps->unique_id);
 			for (k = ps->rtcp_sinks.head; k; k = k->next) {
 				struct sink_handler *sh = k->data;
 				struct packet_stream *sink = sh->sink;
-				JSON_ADD_STRING("%u", sink->unique_id);
+				DOC_ADD_STRING("%u", sink->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
 			mutex_unlock(&ps->in_lock);
 			mutex_unlock(&ps->out_lock);
@@ -2460,29 +2413,26 @@ char* redis_encode_json(struct call *c) {
 		for (l = c->monologues.head; l; l = l->next) {
 			ml = l->data;
 
-			snprintf(tmp, sizeof(tmp), "tag-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-
-			json_builder_begin_object (builder);
+			redis_doc_begin_object(w, "tag", ml->unique_id);
 			{
 
-				JSON_SET_SIMPLE("created","%llu",(long long unsigned) ml->created);
-				JSON_SET_SIMPLE("deleted","%llu",(long long unsigned) ml->deleted);
-				JSON_SET_SIMPLE("block_dtmf","%i", ml->block_dtmf);
-				JSON_SET_SIMPLE("block_media","%i",ml->block_media);
+				DOC_SET_SIMPLE("created","%llu",(long long unsigned) ml->created);
+				DOC_SET_SIMPLE("deleted","%llu",(long long unsigned) ml->deleted);
+				DOC_SET_SIMPLE("block_dtmf","%i", ml->block_dtmf);
+				DOC_SET_SIMPLE("block_media","%i",ml->block_media);
 				if (ml->logical_intf)
-					JSON_SET_SIMPLE_STR("logical_intf", &ml->logical_intf->name);
+					DOC_SET_SIMPLE_STR("logical_intf", &ml->logical_intf->name);
 
 				if (ml->tag.s)
-					JSON_SET_SIMPLE_STR("tag",&ml->tag);
+					DOC_SET_SIMPLE_STR("tag",&ml->tag);
 				if (ml->viabranch.s)
-					JSON_SET_SIMPLE_STR("via-branch",&ml->viabranch);
+					DOC_SET_SIMPLE_STR("via-branch",&ml->viabranch);
 				if (ml->label.s)
-					JSON_SET_SIMPLE_STR("label",&ml->label);
+					DOC_SET_SIMPLE_STR("label",&ml->label);
 				if (ml->metadata.s)
-					JSON_SET_SIMPLE_STR("metadata", &ml->metadata);
+					DOC_SET_SIMPLE_STR("metadata", &ml->metadata);
 			}
-			json_builder_end_object (builder);
+			redis_doc_end(w);
 
 			// other_tags and medias- was here before
 
@@ -2493,97 +2443,86 @@ char* redis_encode_json(struct call *c) {
 			// -- we do it again here since the jsonbuilder is linear straight forward
 			// XXX these should all go into the above loop
 			k = g_hash_table_get_values(ml->associated_tags);
-			snprintf(tmp, sizeof(tmp), "associated_tags-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "associated_tags", ml->unique_id);
 			for (m = k; m; m = m->next) {
 				ml2 = m->data;
-				JSON_ADD_STRING("%u",ml2->unique_id);
+				DOC_ADD_STRING("%u",ml2->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
 			g_list_free(k);
 
-			snprintf(tmp, sizeof(tmp), "medias-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "medias", ml->unique_id);
 			for (k = ml->medias.head; k; k = k->next) {
 				media = k->data;
-				JSON_ADD_STRING("%u",media->unique_id);
+				DOC_ADD_STRING("%u",media->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
 			// SSRC table dump
 			rwlock_lock_r(&ml->ssrc_hash->lock);
 			k = g_hash_table_get_values(ml->ssrc_hash->ht);
-			snprintf(tmp, sizeof(tmp), "ssrc_table-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_object_list(w, "ssrc_table", ml->unique_id);
 			for (m = k; m; m = m->next) {
 				struct ssrc_entry_call *se = m->data;
-				json_builder_begin_object (builder);
+				redis_doc_begin_element(w);
 
-				JSON_SET_SIMPLE("ssrc","%" PRIu32, se->h.ssrc);
+				DOC_SET_SIMPLE("ssrc","%" PRIu32, se->h.ssrc);
 				// XXX use function for in/out
-				JSON_SET_SIMPLE("in_srtp_index","%" PRIu64, se->input_ctx.srtp_index);
-				JSON_SET_SIMPLE("in_srtcp_index","%" PRIu64, se->input_ctx.srtcp_index);
-				JSON_SET_SIMPLE("in_payload_type","%i", se->input_ctx.tracker.most[0]);
-				JSON_SET_SIMPLE("out_srtp_index","%" PRIu64, se->output_ctx.srtp_index);
-				JSON_SET_SIMPLE("out_srtcp_index","%" PRIu64, se->output_ctx.srtcp_index);
-				JSON_SET_SIMPLE("out_payload_type","%i", se->output_ctx.tracker.most[0]);
+				DOC_SET_SIMPLE("in_srtp_index","%" PRIu64, se->input_ctx.srtp_index);
+				DOC_SET_SIMPLE("in_srtcp_index","%" PRIu64, se->input_ctx.srtcp_index);
+				DOC_SET_SIMPLE("in_payload_type","%i", se->input_ctx.tracker.most[0]);
+				DOC_SET_SIMPLE("out_srtp_index","%" PRIu64, se->output_ctx.srtp_index);
+				DOC_SET_SIMPLE("out_srtcp_index","%" PRIu64, se->output_ctx.srtcp_index);
+				DOC_SET_SIMPLE("out_payload_type","%i", se->output_ctx.tracker.most[0]);
 				// XXX add rest of info
 
-				json_builder_end_object (builder);
+				redis_doc_end_element(w);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
 			g_list_free(k);
 			rwlock_unlock_r(&ml->ssrc_hash->lock);
 
-			snprintf(tmp, sizeof(tmp), "subscriptions-%u", ml->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array(builder);
+			redis_doc_begin_array(w, "subscriptions", ml->unique_id);
 			for (k = ml->subscriptions.head; k; k = k->next) {
 				struct call_subscription *cs = k->data;
-				JSON_ADD_STRING("%u/%u/%u/%u/%u",
+				DOC_ADD_STRING("%u/%u/%u/%u/%u",
 						cs->monologue->unique_id,
 						cs->media_offset,
 						cs->attrs.offer_answer,
 						cs->attrs.rtcp_only,
 						cs->attrs.egress);
 			}
-			json_builder_end_array(builder);
+			redis_doc_end(w);
 		}
 
 
 		for (l = c->medias.head; l; l = l->next) {
 			media = l->data;
 
-			snprintf(tmp, sizeof(tmp), "media-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-
-			json_builder_begin_object (builder);
+			redis_doc_begin_object(w, "media", media->unique_id);
 			{
-				JSON_SET_SIMPLE("tag","%u",media->monologue->unique_id);
-				JSON_SET_SIMPLE("index","%u",media->index);
-				JSON_SET_SIMPLE_STR("type",&media->type);
+				DOC_SET_SIMPLE("tag","%u",media->monologue->unique_id);
+				DOC_SET_SIMPLE("index","%u",media->index);
+				DOC_SET_SIMPLE_STR("type",&media->type);
 				if (media->format_str.s)
-					JSON_SET_SIMPLE_STR("format_str",&media->format_str);
+					DOC_SET_SIMPLE_STR("format_str",&media->format_str);
 				if (media->media_id.s)
-					JSON_SET_SIMPLE_STR("media_id",&media->media_id);
-				JSON_SET_SIMPLE_CSTR("protocol",media->protocol ? media->protocol->name : "");
-				JSON_SET_SIMPLE_CSTR("desired_family",media->desired_family ? media->desired_family->rfc_name : "");
-				JSON_SET_SIMPLE_STR("logical_intf",&media->logical_intf->name);
-				JSON_SET_SIMPLE("ptime","%i",media->ptime);
-				JSON_SET_SIMPLE("media_flags","%u",media->media_flags);
-
-				json_update_sdes_params(builder, "media", media->unique_id, "sdes_in",
+					DOC_SET_SIMPLE_STR("media_id",&media->media_id);
+				DOC_SET_SIMPLE_CSTR("protocol",media->protocol ? media->protocol->name : "");
+				DOC_SET_SIMPLE_CSTR("desired_family",media->desired_family ? media->desired_family->rfc_name : "");
+				DOC_SET_SIMPLE_STR("logical_intf",&media->logical_intf->name);
+				DOC_SET_SIMPLE("ptime","%i",media->ptime);
+				DOC_SET_SIMPLE("media_flags","%u",media->media_flags);
+
+				redis_update_sdes_params(w, "media", media->unique_id, "sdes_in",
 						&media->sdes_in);
-				json_update_sdes_params(builder, "media", media->unique_id, "sdes_out",
+				redis_update_sdes_params(w, "media", media->unique_id, "sdes_out",
 						&media->sdes_out);
-				json_update_dtls_fingerprint(builder, "media", media->unique_id, &media->fingerprint);
+				redis_update_dtls_fingerprint(w, "media", media->unique_id, &media->fingerprint);
 			}
-			json_builder_end_object (builder);
+			redis_doc_end(w);
 
 		} // --- for medias.head
 
@@ -2592,53 +2531,44 @@ char* redis_encode_json(struct call *c) {
 		for (l = c->medias.head; l; l = l->next) {
 			media = l->data;
 
-			snprintf(tmp, sizeof(tmp), "streams-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "streams", media->unique_id);
 			for (m = media->streams.head; m; m = m->next) {
 				ps = m->data;
-				JSON_ADD_STRING("%u",ps->unique_id);
+				DOC_ADD_STRING("%u",ps->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
-			snprintf(tmp, sizeof(tmp), "maps-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "maps", media->unique_id);
 			for (m = media->endpoint_maps.head; m; m = m->next) {
 				ep = m->data;
-				JSON_ADD_STRING("%u",ep->unique_id);
+				DOC_ADD_STRING("%u",ep->unique_id);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 
-			snprintf(tmp, sizeof(tmp), "payload_types-%u", media->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "payload_types", media->unique_id);
 			for (m = media->codecs.codec_prefs.head; m; m = m->next) {
 				pt = m->data;
-				JSON_ADD_STRING("%u/" STR_FORMAT "/%u/" STR_FORMAT "/" STR_FORMAT "/%i/%i",
+				DOC_ADD_STRING("%u/" STR_FORMAT "/%u/" STR_FORMAT "/" STR_FORMAT "/%i/%i",
 						pt->payload_type, STR_FMT(&pt->encoding),
 						pt->clock_rate, STR_FMT(&pt->encoding_parameters),
 						STR_FMT(&pt->format_parameters), pt->bitrate, pt->ptime);
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 		}
 
 		for (l = c->endpoint_maps.head; l; l = l->next) {
 			ep = l->data;
 
-			snprintf(tmp, sizeof(tmp), "map-%u", ep->unique_id);
-			json_builder_set_member_name(builder, tmp);
-
-			json_builder_begin_object (builder);
+			redis_doc_begin_object(w, "map", ep->unique_id);
 			{
-				JSON_SET_SIMPLE("wildcard","%i",ep->wildcard);
-				JSON_SET_SIMPLE("num_ports","%u",ep->num_ports);
-				JSON_SET_SIMPLE_CSTR("intf_preferred_family",ep->logical_intf->preferred_family->rfc_name);
-				JSON_SET_SIMPLE_STR("logical_intf",&ep->logical_intf->name);
-				JSON_SET_SIMPLE_CSTR("endpoint",endpoint_print_buf(&ep->endpoint));
+				DOC_SET_SIMPLE("wildcard","%i",ep->wildcard);
+				DOC_SET_SIMPLE("num_ports","%u",ep->num_ports);
+				DOC_SET_SIMPLE_CSTR("intf_preferred_family",ep->logical_intf->preferred_family->rfc_name);
+				DOC_SET_SIMPLE_STR("logical_intf",&ep->logical_intf->name);
+				DOC_SET_SIMPLE_CSTR("endpoint",endpoint_print_buf(&ep->endpoint));
 
 			}
-			json_builder_end_object (builder);
+			redis_doc_end(w);
 
 		} // --- for c->endpoint_maps.head
 
@@ -2646,73 +2576,457 @@ char* redis_encode_json(struct call *c) {
 		for (l = c->endpoint_maps.head; l; l = l->next) {
 			ep = l->data;
 
-			snprintf(tmp, sizeof(tmp), "map_sfds-%u", ep->unique_id);
-			json_builder_set_member_name(builder, tmp);
-			json_builder_begin_array (builder);
+			redis_doc_begin_array(w, "map_sfds", ep->unique_id);
 			for (m = ep->intf_sfds.head; m; m = m->next) {
 				il = m->data;
-				JSON_ADD_STRING("loc-%u",il->local_intf->unique_id);
+				DOC_ADD_STRING("loc-%u",il->local_intf->unique_id);
 				for (n = il->list.head; n; n = n->next) {
 					sfd = n->data;
-					JSON_ADD_STRING("%u",sfd->unique_id);
+					DOC_ADD_STRING("%u",sfd->unique_id);
 				}
 			}
-			json_builder_end_array (builder);
+			redis_doc_end(w);
 		}
 
 	}
-	json_builder_end_object (builder);
+}
 
-	JsonGenerator *gen = json_generator_new ();
-	JsonNode * root = json_builder_get_root (builder);
-	json_generator_set_root (gen, root);
-	char* result = json_generator_to_data (gen, NULL);
 
-	json_node_free (root);
-	g_object_unref (gen);
-	g_object_unref (builder);
+// --redis-delta: what we last wrote for a call, to send only the sections that changed
+struct redis_call_fields {
+	GHashTable *digests; // section name -> digest of its document
+	const struct redis *r;
+	unsigned int conn_id;
+	int db;
+	time_t snapshot; // last time all sections were written
+	bool failed; // last write wasn't confirmed, replace the whole key
+};
 
-	return result;
+// protects the redis_fields of all calls, which writes through different
+// connections may access at the same time
+static mutex_t redis_fields_lock = MUTEX_STATIC_INIT;
+static mutex_t redis_delta_lock = MUTEX_STATIC_INIT;
+static struct redis_delta_stats redis_delta_totals;
 
+void redis_call_fields_free(struct redis_call_fields *f) {
+	if (!f)
+		return;
+	g_hash_table_destroy(f->digests);
+	g_slice_free1(sizeof(*f), f);
 }
 
+// the outcome of the last write is unknown: don't trust the digests
+static void redis_call_fields_failed(struct call *c) {
+	if (!rtpe_config.redis_delta)
+		return;
+	mutex_lock(&redis_fields_lock);
+	if (c->redis_fields)
+		c->redis_fields->failed = true;
+	mutex_unlock(&redis_fields_lock);
+}
+
+// FNV-1a, never zero
+static gsize redis_section_digest(const char *s, size_t len) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char) s[i];
+		h *= 0x100000001b3ULL;
+	}
+	return (gsize) h | 1;
+}
+
+/* Called with r->lock and c->master_lock held. Stores each section of the call
+ * as a field of a hash, writing only the fields whose contents changed and
+ * removing those of deleted objects. All fields are rewritten periodically and
+ * whenever what's in the database can't be trusted to match what we wrote. Such a
+ * snapshot overwrites the fields in place, so that other instances only see an
+ * update, and only replaces the key as a whole after a failed write. */
+static int redis_pipe_call_fields(struct call *c, struct redis *r) {
+	GQueue parts = G_QUEUE_INIT;
+	struct redis_doc_writer w;
+	struct redis_delta_stats st = {0,};
+
+	redis_doc_writer_init_parts(&w, rtpe_config.redis_format == REDIS_FORMAT_BINARY, &parts);
+	redis_encode_call(c, &w);
+	if (redis_doc_writer_finish_parts(&w))
+		return -1;
 
-void redis_update_onekey(struct call *c, struct redis *r) {
-	unsigned int redis_expires_s;
+	mutex_lock(&redis_fields_lock);
+
+	struct redis_call_fields *f = c->redis_fields;
+	if (!f) {
+		f = c->redis_fields = g_slice_alloc0(sizeof(*f));
+		f->digests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	}
+
+	bool snapshot = g_atomic_int_compare_and_exchange(&c->redis_resync, 1, 0);
+	if (!f->snapshot || f->failed || f->r != r || f->conn_id != r->conn_id || f->db != r->db)
+		snapshot = true;
+	else if (rtpe_config.redis_snapshot_interval
+			&& rtpe_now.tv_sec - f->snapshot >= rtpe_config.redis_snapshot_interval)
+		snapshot = true;
+
+	GHashTable *digests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	const char *argv[parts.length * 2 + 2];
+	size_t argvlen[parts.length * 2 + 2];
+	int argc = 2;
+	argv[0] = "HSET";
+	argvlen[0] = 4;
+	argv[1] = c->callid.s;
+	argvlen[1] = c->callid.len;
+
+	for (GList *l = parts.head; l; l = l->next) {
+		struct redis_doc_part *p = l->data;
+		gsize digest = redis_section_digest(p->data, p->len);
+		if (!snapshot && GPOINTER_TO_SIZE(g_hash_table_lookup(f->digests, p->name)) == digest)
+			st.sections_unchanged++;
+		else {
+			argv[argc] = p->name;
+			argvlen[argc++] = strlen(p->name);
+			argv[argc] = p->data;
+			argvlen[argc++] = p->len;
+			st.sections_written++;
+			st.bytes += p->len;
+		}
+		g_hash_table_insert(digests, g_strdup(p->name), GSIZE_TO_POINTER(digest));
+	}
+
+	// sections of objects that are gone
+	const char *dargv[g_hash_table_size(f->digests) + 2];
+	size_t dargvlen[g_hash_table_size(f->digests) + 2];
+	int dargc = 2;
+	dargv[0] = "HDEL";
+	dargvlen[0] = 4;
+	dargv[1] = c->callid.s;
+	dargvlen[1] = c->callid.len;
+
+	GHashTableIter iter;
+	gpointer key;
+	g_hash_table_iter_init(&iter, f->digests);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		if (g_hash_table_contains(digests, key))
+			continue;
+		dargv[dargc] = key;
+		dargvlen[dargc++] = strlen(key);
+		st.sections_removed++;
+	}
+
+	// keep readers from seeing a partial update
+	if (argc > 2 || dargc > 2)
+		redis_pipe(r, "MULTI");
+	// what's there may not even be a hash
+	if (f->failed)
+		redis_pipe(r, "DEL "PB, STR(&c->callid));
+	if (argc > 2)
+		redis_pipe_argv(r, argc, argv, argvlen);
+	if (dargc > 2)
+		redis_pipe_argv(r, dargc, dargv, dargvlen);
+	redis_pipe(r, "EXPIRE "PB" %i", STR(&c->callid), rtpe_config.redis_expires_secs);
+	if (argc > 2 || dargc > 2)
+		redis_pipe(r, "EXEC");
+
+	if (snapshot) {
+		f->r = r;
+		f->conn_id = r->conn_id;
+		f->db = r->db;
+		f->snapshot = rtpe_now.tv_sec;
+		f->failed = false;
+		st.snapshots++;
+	}
+	else
+		st.updates++;
+
+	// after the argument vectors have been used
+	g_hash_table_destroy(f->digests);
+	f->digests = digests;
+	mutex_unlock(&redis_fields_lock);
+	g_queue_clear_full(&parts, redis_doc_part_free);
+
+	mutex_lock(&redis_delta_lock);
+	redis_delta_totals.snapshots += st.snapshots;
+	redis_delta_totals.updates += st.updates;
+	redis_delta_totals.sections_written += st.sections_written;
+	redis_delta_totals.sections_unchanged += st.sections_unchanged;
+	redis_delta_totals.sections_removed += st.sections_removed;
+	redis_delta_totals.bytes += st.bytes;
+	mutex_unlock(&redis_delta_lock);
+
+	return 0;
+}
+
+/* called with r->lock and c->master_lock held */
+static int redis_pipe_call(struct call *c, struct redis *r) {
+	struct redis_doc_writer w;
+	size_t len;
+
+	if (rtpe_config.redis_delta)
+		return redis_pipe_call_fields(c, r);
+
+	redis_doc_writer_init(&w, rtpe_config.redis_format == REDIS_FORMAT_BINARY);
+	redis_encode_call(c, &w);
+	char *result = redis_doc_writer_finish(&w, &len);
+	if (!result)
+		return -1;
+
+	redis_pipe(r, "SET "PB" "PB, STR(&c->callid), S_LEN(result, len));
+	redis_pipe(r, "EXPIRE "PB" %i", STR(&c->callid), rtpe_config.redis_expires_secs);
+	g_free(result);
+	return 0;
+}
+
+void redis_delta_get_stats(struct redis_delta_stats *s) {
+	mutex_lock(&redis_delta_lock);
+	*s = redis_delta_totals;
+	mutex_unlock(&redis_delta_lock);
+}
+
+
+// coalescing write-back, see redis_write_loop()
+struct redis_write_entry {
+	struct call *call; // holds a reference
+	struct redis *r;
+	int64_t due; // monotonic
+	GList *link; // in redis_write_queue while still in redis_write_dirty
+};
+
+#define REDIS_WRITE_BATCH 64 // calls per pipeline
+
+static mutex_t redis_write_lock = MUTEX_STATIC_INIT;
+static cond_t redis_write_cond = COND_STATIC_INIT;
+static mutex_t redis_write_busy = MUTEX_STATIC_INIT; // held while a batch is being written
+static bool redis_write_running;
+static GHashTable *redis_write_dirty; // struct call * -> struct redis_write_entry
+static GQueue redis_write_queue = G_QUEUE_INIT; // same entries, ordered by due time
+static struct redis_write_stats redis_write_totals;
+
+
+static bool redis_write_enqueue(struct call *c, struct redis *r) {
+	mutex_lock(&redis_write_lock);
+
+	if (!redis_write_running) {
+		mutex_unlock(&redis_write_lock);
+		return false;
+	}
+
+	// set before redis_write_cancel() takes the lock
+	if (g_atomic_int_get(&c->redis_deleted))
+		goto out;
+
+	if (g_hash_table_lookup(redis_write_dirty, c)) {
+		// already scheduled, will pick up the latest state
+		redis_write_totals.coalesced++;
+		goto out;
+	}
+
+	if (redis_write_queue.length >= rtpe_config.redis_write_queue) {
+		// too far behind: the caller writes it out itself
+		redis_write_totals.direct++;
+		mutex_unlock(&redis_write_lock);
+		return false;
+	}
+
+	struct redis_write_entry *e = g_slice_alloc(sizeof(*e));
+	e->call = obj_get(c);
+	e->r = r;
+	e->due = g_get_monotonic_time() + rtpe_config.redis_write_delay * 1000LL;
+	g_hash_table_insert(redis_write_dirty, c, e);
+	g_queue_push_tail(&redis_write_queue, e);
+	e->link = redis_write_queue.tail;
+	redis_write_totals.queued++;
+	if (redis_write_queue.length > redis_write_totals.high_water)
+		redis_write_totals.high_water = redis_write_queue.length;
+	if (redis_write_queue.length == 1)
+		cond_signal(&redis_write_cond);
+
+out:
+	mutex_unlock(&redis_write_lock);
+	return true;
+}
+
+// makes sure that no pending or in-progress write of this call can happen after this returns.
+// redis_deleted keeps it from being scheduled again
+static void redis_write_cancel(struct call *c) {
+	struct redis_write_entry *e = NULL;
+
+	mutex_lock(&redis_write_lock);
+	if (redis_write_running) {
+		e = g_hash_table_lookup(redis_write_dirty, c);
+		if (e) {
+			g_hash_table_remove(redis_write_dirty, c);
+			g_queue_delete_link(&redis_write_queue, e->link);
+		}
+	}
+	mutex_unlock(&redis_write_lock);
+
+	if (e) {
+		obj_put(e->call);
+		g_slice_free1(sizeof(*e), e);
+	}
+
+	// wait for a batch possibly containing this call to complete
+	mutex_lock(&redis_write_busy);
+	mutex_unlock(&redis_write_busy);
+}
+
+/* called with r->lock held */
+static int redis_write_pipe(struct call *c, struct redis *r) {
+	rwlock_lock_r(&c->master_lock);
+	c->redis_hosted_db = r->db;
+	int ret = redis_pipe_call(c, r);
+	rwlock_unlock_r(&c->master_lock);
+	return ret;
+}
+
+/* called with redis_write_busy held, releases it */
+static void redis_write_batch(GQueue *batch) {
+	GQueue done = G_QUEUE_INIT;
+	unsigned int written = 0, errors = 0;
+
+	// normally all entries go to the same connection
+	while (batch->length) {
+		struct redis_write_entry *first = batch->head->data;
+		struct redis *r = first->r;
+		unsigned int num = 0;
 
+		mutex_lock(&r->lock);
+		// coverity[sleep : FALSE]
+		bool connected = redis_check_conn(r) == REDIS_STATE_CONNECTED;
+		if (connected && redis_select_db(r, r->db)) {
+			if (r->ctx && r->ctx->err)
+				rlog(LOG_ERR, "Redis error: %s", r->ctx->errstr);
+			redisFree(r->ctx);
+			r->ctx = NULL;
+			connected = false;
+		}
+
+		for (GList *l = batch->head; l; ) {
+			GList *next = l->next;
+			struct redis_write_entry *e = l->data;
+			if (e->r == r) {
+				if (connected && !redis_write_pipe(e->call, r))
+					num++;
+				else
+					errors++;
+				g_queue_delete_link(batch, l);
+				g_queue_push_tail(&done, e);
+			}
+			l = next;
+		}
+
+		if (num && redis_consume(r)) {
+			// can't tell which ones failed
+			for (GList *l = done.head; l; l = l->next) {
+				struct redis_write_entry *e = l->data;
+				if (e->r == r)
+					redis_call_fields_failed(e->call);
+			}
+		}
+		mutex_unlock(&r->lock);
+		written += num;
+	}
+
+	mutex_unlock(&redis_write_busy);
+
+	struct redis_write_entry *e;
+	while ((e = g_queue_pop_head(&done))) {
+		obj_put(e->call);
+		g_slice_free1(sizeof(*e), e);
+	}
+
+	mutex_lock(&redis_write_lock);
+	redis_write_totals.written += written;
+	redis_write_totals.errors += errors;
+	redis_write_totals.batches++;
+	mutex_unlock(&redis_write_lock);
+}
+
+// Writes out updated calls collected by redis_update_onekey() once they've been
+// dirty for --redis-write-delay ms, taking any further updates within that time
+// along. Remaining updates are flushed at shutdown.
+void redis_write_loop(void *d) {
+	GQueue batch = G_QUEUE_INIT;
+
+	mutex_lock(&redis_write_lock);
+	redis_write_dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+	redis_write_running = true;
+
+	while (!rtpe_shutdown || redis_write_queue.length) {
+		int64_t now = g_get_monotonic_time();
+		struct redis_write_entry *e = g_queue_peek_head(&redis_write_queue);
+
+		if (!e || (e->due > now && !rtpe_shutdown)) {
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			timeval_add_usec(&tv, e ? MIN(e->due - now, 100000) : 100000);
+			cond_timedwait(&redis_write_cond, &redis_write_lock, &tv);
+			continue;
+		}
+
+		while ((e = g_queue_peek_head(&redis_write_queue)) && (e->due <= now || rtpe_shutdown)
+				&& batch.length < REDIS_WRITE_BATCH)
+		{
+			g_queue_pop_head(&redis_write_queue);
+			// further updates get scheduled anew
+			g_hash_table_remove(redis_write_dirty, e->call);
+			g_queue_push_tail(&batch, e);
+		}
+
+		// taken before releasing the queue so that redis_write_cancel() can't slip in between
+		mutex_lock(&redis_write_busy);
+		mutex_unlock(&redis_write_lock);
+		redis_write_batch(&batch);
+		mutex_lock(&redis_write_lock);
+	}
+
+	redis_write_running = false;
+	g_hash_table_destroy(redis_write_dirty);
+	redis_write_dirty = NULL;
+	mutex_unlock(&redis_write_lock);
+}
+
+void redis_write_get_stats(struct redis_write_stats *s) {
+	mutex_lock(&redis_write_lock);
+	*s = redis_write_totals;
+	s->pending = redis_write_queue.length;
+	mutex_unlock(&redis_write_lock);
+}
+
+
+void redis_update_onekey(struct call *c, struct redis *r) {
 	if (!r)
 		return;
 	if (c->foreign_call)
 		return;
 
+	if (rtpe_config.redis_write_delay && redis_write_enqueue(c, r))
+		return;
+
 	mutex_lock(&r->lock);
 	// coverity[sleep : FALSE]
 	if (redis_check_conn(r) == REDIS_STATE_DISCONNECTED) {
 		mutex_unlock(&r->lock);
 		return ;
 	}
+	// redis_delete() sets this before taking the lock to delete it
+	if (g_atomic_int_get(&c->redis_deleted)) {
+		mutex_unlock(&r->lock);
+		return;
+	}
 
 	rwlock_lock_r(&c->master_lock);
 
-	redis_expires_s = rtpe_config.redis_expires_secs;
-
 	c->redis_hosted_db = r->db;
 	if (redis_select_db(r, c->redis_hosted_db)) {
 		rlog(LOG_ERR, " >>>>>>>>>>>>>>>>> Redis error.");
 		goto err;
 	}
 
-	char* result = redis_encode_json(c);
-	if (!result)
+	if (redis_pipe_call(c, r))
 		goto err;
 
-	redis_pipe(r, "SET "PB" %s", STR(&c->callid), result);
-	redis_pipe(r, "EXPIRE "PB" %i", STR(&c->callid), redis_expires_s);
+	if (redis_consume(r))
+		redis_call_fields_failed(c);
 
-	redis_consume(r);
-
-	if (result)
-		free(result);
 	mutex_unlock(&r->lock);
 	rwlock_unlock_r(&c->master_lock);
 
@@ -2735,6 +3049,20 @@ void redis_delete(struct call *c, struct redis *r) {
 	if (!r)
 		return;
 
+	// a late update must not write it back
+	g_atomic_int_set(&c->redis_deleted, 1);
+
+	if (rtpe_config.redis_write_delay)
+		redis_write_cancel(c);
+
+	if (rtpe_config.redis_delta) {
+		// anything written after this starts from scratch
+		mutex_lock(&redis_fields_lock);
+		redis_call_fields_free(c->redis_fields);
+		c->redis_fields = NULL;
+		mutex_unlock(&redis_fields_lock);
+	}
+
 	if (delete_async) {
 		mutex_lock(&r->async_lock);
 		rwlock_lock_r(&c->master_lock);
@@ -0,0 +1,832 @@
+#include "redis_doc.h"
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "auxlib.h"
+
+/* Binary format. All integers are little endian.
+ *
+ *   document := "RTPEb" version:u8 section*
+ *   section  := type:u8 name:key id:varint count:u16 member*
+ *     type 'o', object:              member := key value
+ *     type 'a', array:               member := value
+ *     type 'l', array of objects:    member := count:u16 (key value)*
+ *   key      := u8 index into redis_doc_keys[] | 0xff value
+ *   value    := length:varint bytes 0x00
+ *
+ * A section's id is stored incremented by one, with zero meaning that it has
+ * none. Values are NUL terminated so that they can be used in place, without
+ * copying. Keys not found in redis_doc_keys[] are stored literally. */
+
+#define REDIS_DOC_MAGIC		"RTPEb"
+#define REDIS_DOC_MAGIC_LEN	5
+#define REDIS_DOC_VERSION	1
+
+#define REDIS_DOC_KEY_LITERAL	0xff
+
+// must only ever be appended to, index 0 is reserved
+static const char * const redis_doc_keys[] = {
+	NULL,
+	// sections
+	"json",
+	"sfd",
+	"stream",
+	"stream_sfds",
+	"rtp_sinks",
+	"rtcp_sinks",
+	"tag",
+	"associated_tags",
+	"medias",
+	"ssrc_table",
+	"subscriptions",
+	"media",
+	"streams",
+	"maps",
+	"payload_types",
+	"map",
+	"map_sfds",
+	// call
+	"created",
+	"destroyed",
+	"last_signal",
+	"tos",
+	"deleted",
+	"num_sfds",
+	"num_streams",
+	"num_medias",
+	"num_tags",
+	"num_maps",
+	"ml_deleted",
+	"created_from",
+	"created_from_addr",
+	"redis_hosted_db",
+	"recording_metadata",
+	"block_dtmf",
+	"block_media",
+	"recording_meta_prefix",
+	// sfd
+	"pref_family",
+	"localport",
+	"fd",
+	"logical_intf",
+	"local_intf_uid",
+	// crypto params
+	"-crypto_suite",
+	"-master_key",
+	"-master_salt",
+	"-unenc-srtp",
+	"-unenc-srtcp",
+	"-unauth-srtp",
+	"-mki",
+	// stream
+	"rtcp_sibling",
+	"last_packet",
+	"ps_flags",
+	"component",
+	"endpoint",
+	"advertised_endpoint",
+	"stats-packets",
+	"stats-bytes",
+	"stats-errors",
+	// tag
+	"via-branch",
+	"label",
+	"metadata",
+	// ssrc table
+	"ssrc",
+	"in_srtp_index",
+	"in_srtcp_index",
+	"in_payload_type",
+	"out_srtp_index",
+	"out_srtcp_index",
+	"out_payload_type",
+	// media
+	"index",
+	"type",
+	"format_str",
+	"media_id",
+	"protocol",
+	"desired_family",
+	"ptime",
+	"media_flags",
+	"sdes_in_tag",
+	"sdes_in-crypto_suite",
+	"sdes_in-master_key",
+	"sdes_in-master_salt",
+	"sdes_in-unenc-srtp",
+	"sdes_in-unenc-srtcp",
+	"sdes_in-unauth-srtp",
+	"sdes_in-mki",
+	"sdes_out_tag",
+	"sdes_out-crypto_suite",
+	"sdes_out-master_key",
+	"sdes_out-master_salt",
+	"sdes_out-unenc-srtp",
+	"sdes_out-unenc-srtcp",
+	"sdes_out-unauth-srtp",
+	"sdes_out-mki",
+	"hash_func",
+	"fingerprint",
+	// map
+	"wildcard",
+	"num_ports",
+	"intf_preferred_family",
+};
+
+struct bin_section {
+	char type;
+	const unsigned char *start, *end; // starting with the member count
+};
+
+struct bin_reader {
+	const unsigned char *p, *end;
+};
+
+static GHashTable *redis_doc_key_idx; // key -> index
+
+
+static void redis_doc_keys_init(void) {
+	static gsize done;
+
+	if (!g_once_init_enter(&done))
+		return;
+
+	redis_doc_key_idx = g_hash_table_new(g_str_hash, g_str_equal);
+	for (unsigned int i = 1; i < G_N_ELEMENTS(redis_doc_keys); i++)
+		g_hash_table_insert(redis_doc_key_idx, (void *) redis_doc_keys[i], GUINT_TO_POINTER(i));
+
+	g_once_init_leave(&done, 1);
+}
+
+
+static void bin_put_varint(GString *b, uint64_t v) {
+	while (v >= 0x80) {
+		g_string_append_c(b, (char) ((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	g_string_append_c(b, (char) v);
+}
+static void bin_put_value(GString *b, const char *s, size_t len) {
+	bin_put_varint(b, len);
+	g_string_append_len(b, s, len);
+	g_string_append_c(b, '\0');
+}
+static void bin_put_key(GString *b, const char *k) {
+	unsigned int idx = GPOINTER_TO_UINT(g_hash_table_lookup(redis_doc_key_idx, k));
+	if (idx) {
+		g_string_append_c(b, (char) idx);
+		return;
+	}
+	g_string_append_c(b, (char) REDIS_DOC_KEY_LITERAL);
+	bin_put_value(b, k, strlen(k));
+}
+static gsize bin_put_count(GString *b) {
+	gsize pos = b->len;
+	g_string_append_len(b, "\0\0", 2);
+	return pos;
+}
+static void bin_set_count(struct redis_doc_writer *w, gsize pos, unsigned int count) {
+	if (count > 0xffff) {
+		w->error = true;
+		return;
+	}
+	w->buf->str[pos] = count & 0xff;
+	w->buf->str[pos + 1] = count >> 8;
+}
+
+static const char *redis_doc_name(char *buf, size_t len, const char *name, unsigned int id) {
+	if (id == REDIS_DOC_NO_ID)
+		return name;
+	snprintf(buf, len, "%s-%u", name, id);
+	return buf;
+}
+
+static void json_add_uri_enc(JsonBuilder *builder, const char *s, size_t len) {
+	char enc[len * 3 + 1];
+	str_uri_encode_len(enc, s, len);
+	json_builder_add_string_value(builder, enc);
+}
+
+
+void redis_doc_writer_init(struct redis_doc_writer *w, bool binary) {
+	ZERO(*w);
+	w->binary = binary;
+
+	if (binary) {
+		redis_doc_keys_init();
+		w->buf = g_string_sized_new(4096);
+		g_string_append_len(w->buf, REDIS_DOC_MAGIC, REDIS_DOC_MAGIC_LEN);
+		g_string_append_c(w->buf, REDIS_DOC_VERSION);
+		return;
+	}
+
+	w->builder = json_builder_new();
+	json_builder_begin_object(w->builder);
+}
+
+void redis_doc_writer_init_parts(struct redis_doc_writer *w, bool binary, GQueue *parts) {
+	redis_doc_writer_init(w, binary);
+	w->parts = parts;
+	if (binary)
+		w->part_start = w->buf->len;
+}
+
+static char *json_builder_generate(JsonBuilder *builder, size_t *len) {
+	JsonGenerator *gen = json_generator_new();
+	JsonNode *root = json_builder_get_root(builder);
+	json_generator_set_root(gen, root);
+	gsize l = 0;
+	char *result = json_generator_to_data(gen, &l);
+	*len = l;
+
+	json_node_free(root);
+	g_object_unref(gen);
+
+	return result;
+}
+
+static void redis_doc_push_part(struct redis_doc_writer *w, char *data, size_t len) {
+	struct redis_doc_part *p = g_slice_alloc(sizeof(*p));
+	p->name = g_strdup(w->part_name);
+	p->data = data;
+	p->len = len;
+	g_queue_push_tail(w->parts, p);
+}
+
+// completes the current section as a document of its own, resetting the writer
+static void redis_doc_end_part(struct redis_doc_writer *w) {
+	size_t len;
+
+	if (w->binary) {
+		// header followed by just this section
+		char *data = g_malloc(w->buf->len);
+		memcpy(data, w->buf->str, w->buf->len);
+		redis_doc_push_part(w, data, w->buf->len);
+		g_string_truncate(w->buf, w->part_start);
+		return;
+	}
+
+	json_builder_end_object(w->builder);
+	char *data = json_builder_generate(w->builder, &len);
+	redis_doc_push_part(w, data, len);
+	g_object_unref(w->builder);
+	w->builder = json_builder_new();
+	json_builder_begin_object(w->builder);
+}
+
+static void redis_doc_begin(struct redis_doc_writer *w, char type, const char *name, unsigned int id) {
+	w->depth = 1;
+	w->array = type != 'o';
+	w->count[0] = 0;
+
+	if (w->parts) {
+		if (id == REDIS_DOC_NO_ID)
+			g_strlcpy(w->part_name, name, sizeof(w->part_name));
+		else
+			snprintf(w->part_name, sizeof(w->part_name), "%s-%u", name, id);
+	}
+
+	if (w->binary) {
+		g_string_append_c(w->buf, type);
+		bin_put_key(w->buf, name);
+		bin_put_varint(w->buf, id == REDIS_DOC_NO_ID ? 0 : (uint64_t) id + 1);
+		w->count_pos[0] = bin_put_count(w->buf);
+		return;
+	}
+
+	char buf[128];
+	json_builder_set_member_name(w->builder, redis_doc_name(buf, sizeof(buf), name, id));
+	if (w->array)
+		json_builder_begin_array(w->builder);
+	else
+		json_builder_begin_object(w->builder);
+}
+
+void redis_doc_begin_object(struct redis_doc_writer *w, const char *name, unsigned int id) {
+	redis_doc_begin(w, 'o', name, id);
+}
+void redis_doc_begin_array(struct redis_doc_writer *w, const char *name, unsigned int id) {
+	redis_doc_begin(w, 'a', name, id);
+}
+void redis_doc_begin_object_list(struct redis_doc_writer *w, const char *name, unsigned int id) {
+	redis_doc_begin(w, 'l', name, id);
+}
+
+void redis_doc_end(struct redis_doc_writer *w) {
+	w->depth = 0;
+
+	if (w->binary)
+		bin_set_count(w, w->count_pos[0], w->count[0]);
+	else if (w->array)
+		json_builder_end_array(w->builder);
+	else
+		json_builder_end_object(w->builder);
+
+	if (w->parts)
+		redis_doc_end_part(w);
+}
+
+void redis_doc_begin_element(struct redis_doc_writer *w) {
+	w->count[0]++;
+	w->depth = 2;
+	w->count[1] = 0;
+
+	if (w->binary)
+		w->count_pos[1] = bin_put_count(w->buf);
+	else
+		json_builder_begin_object(w->builder);
+}
+
+void redis_doc_end_element(struct redis_doc_writer *w) {
+	w->depth = 1;
+
+	if (w->binary)
+		bin_set_count(w, w->count_pos[1], w->count[1]);
+	else
+		json_builder_end_object(w->builder);
+}
+
+void redis_doc_set(struct redis_doc_writer *w, const char *key, const char *val, size_t len) {
+	w->count[w->depth - 1]++;
+
+	if (w->binary) {
+		bin_put_key(w->buf, key);
+		bin_put_value(w->buf, val, len);
+		return;
+	}
+
+	json_builder_set_member_name(w->builder, key);
+	json_add_uri_enc(w->builder, val, len);
+}
+
+void redis_doc_add(struct redis_doc_writer *w, const char *val, size_t len) {
+	w->count[0]++;
+
+	if (w->binary)
+		bin_put_value(w->buf, val, len);
+	else
+		json_add_uri_enc(w->builder, val, len);
+}
+
+char *redis_doc_writer_finish(struct redis_doc_writer *w, size_t *len) {
+	if (w->binary) {
+		if (w->error) {
+			g_string_free(w->buf, TRUE);
+			return NULL;
+		}
+		*len = w->buf->len;
+		return g_string_free(w->buf, FALSE);
+	}
+
+	json_builder_end_object(w->builder);
+	char *result = json_builder_generate(w->builder, len);
+	g_object_unref(w->builder);
+
+	return result;
+}
+
+int redis_doc_writer_finish_parts(struct redis_doc_writer *w) {
+	bool error = w->error;
+
+	if (w->binary)
+		g_string_free(w->buf, TRUE);
+	else
+		g_object_unref(w->builder);
+
+	if (error) {
+		g_queue_clear_full(w->parts, redis_doc_part_free);
+		return -1;
+	}
+	return 0;
+}
+
+void redis_doc_part_free(void *p) {
+	struct redis_doc_part *part = p;
+	g_free(part->name);
+	g_free(part->data);
+	g_slice_free1(sizeof(*part), part);
+}
+
+
+
+static bool bin_get_varint(struct bin_reader *r, uint64_t *out) {
+	uint64_t v = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (r->p >= r->end)
+			return false;
+		unsigned char c = *r->p++;
+		v |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			*out = v;
+			return true;
+		}
+	}
+	return false;
+}
+static bool bin_get_count(struct bin_reader *r, unsigned int *out) {
+	if (r->end - r->p < 2)
+		return false;
+	*out = r->p[0] | (r->p[1] << 8);
+	r->p += 2;
+	return true;
+}
+static bool bin_get_value(struct bin_reader *r, str *out) {
+	uint64_t len;
+	if (!bin_get_varint(r, &len))
+		return false;
+	if (len >= (uint64_t) (r->end - r->p))
+		return false;
+	if (r->p[len] != '\0')
+		return false;
+	out->s = (char *) r->p;
+	out->len = len;
+	r->p += len + 1;
+	return true;
+}
+static bool bin_get_key(struct bin_reader *r, const char **out) {
+	if (r->p >= r->end)
+		return false;
+	unsigned int idx = *r->p++;
+	if (idx == REDIS_DOC_KEY_LITERAL) {
+		str s;
+		if (!bin_get_value(r, &s))
+			return false;
+		*out = s.s;
+		return true;
+	}
+	if (idx == 0 || idx >= G_N_ELEMENTS(redis_doc_keys))
+		return false;
+	*out = redis_doc_keys[idx];
+	return true;
+}
+// `keys` is scratch space to detect duplicate keys, which the JSON reader rejects too
+static bool bin_skip_object(struct bin_reader *r, GHashTable *keys) {
+	unsigned int count;
+	const char *k;
+	str v;
+
+	if (!bin_get_count(r, &count))
+		return false;
+	g_hash_table_remove_all(keys);
+	while (count--) {
+		if (!bin_get_key(r, &k) || !bin_get_value(r, &v))
+			return false;
+		if (!g_hash_table_add(keys, (void *) k)) {
+			rlog(LOG_WARNING, "Key %s already exists", k);
+			return false;
+		}
+	}
+	return true;
+}
+
+// validates the complete document, so that the getters below can skip all checks
+static int bin_load(struct redis_doc *d, const unsigned char *p, size_t len) {
+	struct bin_reader r = { p, p + len };
+	const char *err = "unsupported version";
+	GHashTable *keys = NULL;
+
+	if (len < 1 || *r.p++ != REDIS_DOC_VERSION)
+		goto err;
+
+	if (!d->sections)
+		d->sections = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	keys = g_hash_table_new(g_str_hash, g_str_equal);
+	err = "truncated or corrupt";
+	while (r.p < r.end) {
+		char type = *r.p++;
+		const char *name;
+		uint64_t id;
+		unsigned int count;
+		str v;
+
+		if (!bin_get_key(&r, &name) || !bin_get_varint(&r, &id))
+			goto err;
+		const unsigned char *start = r.p;
+
+		switch (type) {
+			case 'o':
+				if (!bin_skip_object(&r, keys))
+					goto err;
+				break;
+			case 'a':
+				if (!bin_get_count(&r, &count))
+					goto err;
+				while (count--) {
+					if (!bin_get_value(&r, &v))
+						goto err;
+				}
+				break;
+			case 'l':
+				if (!bin_get_count(&r, &count))
+					goto err;
+				while (count--) {
+					if (!bin_skip_object(&r, keys))
+						goto err;
+				}
+				break;
+			default:
+				goto err;
+		}
+
+		struct bin_section *s = g_new(struct bin_section, 1);
+		s->type = type;
+		s->start = start;
+		s->end = r.p;
+		g_hash_table_replace(d->sections,
+				id ? g_strdup_printf("%s-%" PRIu64, name, id - 1) : g_strdup(name), s);
+	}
+
+	g_hash_table_destroy(keys);
+	return 0;
+
+err:
+	rlog(LOG_ERR, "Failed to read binary call data: %s", err);
+	if (keys)
+		g_hash_table_destroy(keys);
+	redis_doc_free(d);
+	return -1;
+}
+
+static bool redis_doc_is_binary(const char *data, size_t len) {
+	return len >= REDIS_DOC_MAGIC_LEN && !memcmp(data, REDIS_DOC_MAGIC, REDIS_DOC_MAGIC_LEN);
+}
+
+int redis_doc_load(struct redis_doc *d, const char *data, size_t len) {
+	ZERO(*d);
+
+	if (redis_doc_is_binary(data, len))
+		return bin_load(d, (const unsigned char *) data + REDIS_DOC_MAGIC_LEN,
+				len - REDIS_DOC_MAGIC_LEN);
+
+	d->parser = json_parser_new();
+	if (!json_parser_load_from_data(d->parser, data, len, NULL))
+		goto err;
+	d->reader = json_reader_new(json_parser_get_root(d->parser));
+	if (!d->reader)
+		goto err;
+
+	return 0;
+
+err:
+	rlog(LOG_ERR, "Failed to parse JSON call data");
+	redis_doc_free(d);
+	return -1;
+}
+
+int redis_doc_load_parts(struct redis_doc *d, const str *parts, unsigned int num) {
+	ZERO(*d);
+
+	if (!num || !redis_doc_is_binary(parts[0].s, parts[0].len))
+		goto json;
+
+	for (unsigned int i = 0; i < num; i++) {
+		if (!redis_doc_is_binary(parts[i].s, parts[i].len))
+			goto mixed;
+		// releases everything on failure
+		if (bin_load(d, (const unsigned char *) parts[i].s + REDIS_DOC_MAGIC_LEN,
+					parts[i].len - REDIS_DOC_MAGIC_LEN))
+			return -1;
+	}
+	return 0;
+
+json:;
+	// each part is an object with a single member: join them into one
+	GString *buf = g_string_new("{");
+	for (unsigned int i = 0; i < num; i++) {
+		const str *p = &parts[i];
+		if (redis_doc_is_binary(p->s, p->len)) {
+			g_string_free(buf, TRUE);
+			goto mixed;
+		}
+		if (p->len < 2 || p->s[0] != '{' || p->s[p->len - 1] != '}') {
+			g_string_free(buf, TRUE);
+			rlog(LOG_ERR, "Failed to parse JSON call data");
+			return -1;
+		}
+		if (buf->len > 1)
+			g_string_append_c(buf, ',');
+		g_string_append_len(buf, p->s + 1, p->len - 2);
+	}
+	g_string_append_c(buf, '}');
+
+	int ret = redis_doc_load(d, buf->str, buf->len);
+	g_string_free(buf, TRUE);
+	return ret;
+
+mixed:
+	rlog(LOG_ERR, "Call data consists of both JSON and binary sections");
+	redis_doc_free(d);
+	return -1;
+}
+
+void redis_doc_free(struct redis_doc *d) {
+	if (d->reader)
+		g_object_unref(d->reader);
+	if (d->parser)
+		g_object_unref(d->parser);
+	if (d->sections)
+		g_hash_table_destroy(d->sections);
+	ZERO(*d);
+}
+
+static struct bin_section *bin_section(struct redis_doc *d, const char *name, char type) {
+	struct bin_section *s = g_hash_table_lookup(d->sections, name);
+	if (!s || s->type != type)
+		return NULL;
+	return s;
+}
+
+static str *json_reader_get_string_value_uri_enc(JsonReader *reader) {
+	const char *s = json_reader_get_string_value(reader);
+	if (!s)
+		return NULL;
+	return str_uri_decode_len(s, strlen(s)); // must be free'd
+}
+
+
+// the reader must be positioned on an object
+static int json_read_hash(JsonReader *reader, struct redis_hash *out) {
+	out->vals = NULL;
+	out->ht = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+	gchar **members = json_reader_list_members(reader);
+	int nmemb = json_reader_count_members(reader);
+
+	for (int i = 0; i < nmemb; i++) {
+		if (!json_reader_read_member(reader, members[i])) {
+			rlog(LOG_ERROR, "Could not read json member: %s", members[i]);
+			json_reader_end_member(reader);
+			goto err;
+		}
+		str *val = json_reader_get_string_value_uri_enc(reader);
+		json_reader_end_member(reader);
+		if (!val)
+			continue;
+
+		if (g_hash_table_contains(out->ht, members[i])) {
+			rlog(LOG_WARNING, "Key %s already exists", members[i]);
+			free(val);
+			goto err;
+		}
+		g_hash_table_insert(out->ht, strdup(members[i]), val);
+	}
+
+	g_strfreev(members);
+	return 0;
+
+err:
+	g_strfreev(members);
+	g_hash_table_destroy(out->ht);
+	out->ht = NULL;
+	return -1;
+}
+
+// the document has been validated
+static void bin_read_hash(struct bin_reader *r, struct redis_hash *out) {
+	unsigned int count;
+	const char *k;
+
+	bin_get_count(r, &count);
+	out->ht = g_hash_table_new(g_str_hash, g_str_equal);
+	out->vals = malloc(sizeof(*out->vals) * (count ? : 1));
+
+	for (unsigned int i = 0; i < count; i++) {
+		bin_get_key(r, &k);
+		bin_get_value(r, &out->vals[i]);
+		g_hash_table_insert(out->ht, (void *) k, &out->vals[i]);
+	}
+}
+
+int redis_doc_get_hash(struct redis_doc *d, struct redis_hash *out, const char *name, unsigned int id) {
+	char buf[128];
+	name = redis_doc_name(buf, sizeof(buf), name, id);
+
+	if (d->sections) {
+		struct bin_section *s = bin_section(d, name, 'o');
+		if (!s) {
+			rlog(LOG_ERROR, "Could not read member: %s", name);
+			return -1;
+		}
+		struct bin_reader r = { s->start, s->end };
+		bin_read_hash(&r, out);
+		return 0;
+	}
+
+	if (!json_reader_read_member(d->reader, name)) {
+		rlog(LOG_ERROR, "Could not read json member: %s", name);
+		json_reader_end_member(d->reader);
+		return -1;
+	}
+	int ret = json_read_hash(d->reader, out);
+	json_reader_end_member(d->reader);
+	return ret;
+}
+
+void redis_doc_destroy_hash(struct redis_hash *rh) {
+	if (rh->ht)
+		g_hash_table_destroy(rh->ht);
+	free(rh->vals);
+}
+
+int redis_doc_get_list(struct redis_doc *d, const char *name, unsigned int id,
+		int (*cb)(str *, void *), void *ptr)
+{
+	char buf[128];
+	name = redis_doc_name(buf, sizeof(buf), name, id);
+
+	if (d->sections) {
+		struct bin_section *s = bin_section(d, name, 'a');
+		if (!s) {
+			rlog(LOG_ERROR, "Key not found: %s", name);
+			return -1;
+		}
+		struct bin_reader r = { s->start, s->end };
+		unsigned int count;
+		str v;
+		bin_get_count(&r, &count);
+		while (count--) {
+			bin_get_value(&r, &v);
+			if (cb(&v, ptr))
+				return -1;
+		}
+		return 0;
+	}
+
+	int ret = -1;
+
+	if (!json_reader_read_member(d->reader, name)) {
+		rlog(LOG_ERROR, "Key in json not found: %s", name);
+		goto out;
+	}
+	int nmemb = json_reader_count_elements(d->reader);
+	for (int i = 0; i < nmemb; i++) {
+		if (!json_reader_read_element(d->reader, i)) {
+			rlog(LOG_ERROR, "Element in array not found.");
+			json_reader_end_element(d->reader);
+			goto out;
+		}
+		str *s = json_reader_get_string_value_uri_enc(d->reader);
+		json_reader_end_element(d->reader);
+		if (!s) {
+			rlog(LOG_ERROR, "String in json not found.");
+			goto out;
+		}
+		int fail = cb(s, ptr);
+		free(s);
+		if (fail)
+			goto out;
+	}
+	ret = 0;
+
+out:
+	json_reader_end_member(d->reader);
+	return ret;
+}
+
+// doesn't complain if the list isn't present
+int redis_doc_get_object_list(struct redis_doc *d, const char *name, unsigned int id,
+		int (*cb)(struct redis_hash *, void *), void *ptr)
+{
+	char buf[128];
+	struct redis_hash rh;
+	name = redis_doc_name(buf, sizeof(buf), name, id);
+
+	if (d->sections) {
+		struct bin_section *s = bin_section(d, name, 'l');
+		if (!s)
+			return -1;
+		struct bin_reader r = { s->start, s->end };
+		unsigned int count;
+		bin_get_count(&r, &count);
+		while (count--) {
+			bin_read_hash(&r, &rh);
+			int fail = cb(&rh, ptr);
+			redis_doc_destroy_hash(&rh);
+			if (fail)
+				return -1;
+		}
+		return 0;
+	}
+
+	int ret = -1;
+
+	if (!json_reader_read_member(d->reader, name))
+		goto out;
+	int nmemb = json_reader_count_elements(d->reader);
+	for (int i = 0; i < nmemb; i++) {
+		int fail = !json_reader_read_element(d->reader, i) || json_read_hash(d->reader, &rh);
+		json_reader_end_element(d->reader);
+		if (fail)
+			goto out;
+		fail = cb(&rh, ptr);
+		redis_doc_destroy_hash(&rh);
+		if (fail)
+			goto out;
+	}
+	ret = 0;
+
+out:
+	json_reader_end_member(d->reader);
+	return ret;
+}
@@ -46,25 +46,25 @@ error:
 	return -1;
 }
 
-static uint64_t packet_index(struct ssrc_ctx *ssrc_ctx, struct rtp_header *rtp) {
+static uint64_t packet_index(uint64_t *srtp_index, uint32_t ssrc, struct rtp_header *rtp) {
 	uint16_t seq;
 
 	seq = ntohs(rtp->seq_num);
 
-	crypto_debug_init((seq & 0x1ff) == (ssrc_ctx->parent->h.ssrc & 0x1ff));
-	crypto_debug_printf("SSRC %" PRIx32 ", seq %" PRIu16, ssrc_ctx->parent->h.ssrc, seq);
+	crypto_debug_init((seq & 0x1ff) == (ssrc & 0x1ff));
+	crypto_debug_printf("SSRC %" PRIx32 ", seq %" PRIu16, ssrc, seq);
 
 	/* rfc 3711 section 3.3.1 */
-	if (G_UNLIKELY(!ssrc_ctx->srtp_index))
-		ssrc_ctx->srtp_index = seq;
+	if (G_UNLIKELY(!*srtp_index))
+		*srtp_index = seq;
 
 	/* rfc 3711 appendix A, modified, and sections 3.3 and 3.3.1 */
-	uint16_t s_l = (ssrc_ctx->srtp_index & 0x00000000ffffULL);
-	uint32_t roc = (ssrc_ctx->srtp_index & 0xffffffff0000ULL) >> 16;
+	uint16_t s_l = (*srtp_index & 0x00000000ffffULL);
+	uint32_t roc = (*srtp_index & 0xffffffff0000ULL) >> 16;
 	uint32_t v = 0;
 
 	crypto_debug_printf(", prev seq %" PRIu64 ", s_l %" PRIu16 ", ROC %" PRIu32,
-			ssrc_ctx->srtp_index, s_l, roc);
+			*srtp_index, s_l, roc);
 
 	if (s_l < 0x8000) {
 		if (((seq - s_l) > 0x8000) && roc > 0)
@@ -78,11 +78,11 @@ static uint64_t packet_index(struct ssrc_ctx *ssrc_ctx, struct rtp_header *rtp)
 			v = roc;
 	}
 
-	ssrc_ctx->srtp_index = (uint64_t)(((v << 16) | seq) & 0xffffffffffffULL);
+	*srtp_index = (uint64_t)(((v << 16) | seq) & 0xffffffffffffULL);
 
-	crypto_debug_printf(", v %" PRIu32 ", ext seq %" PRIu64, v, ssrc_ctx->srtp_index);
+	crypto_debug_printf(", v %" PRIu32 ", ext seq %" PRIu64, v, *srtp_index);
 
-	return ssrc_ctx->srtp_index;
+	return *srtp_index;
 }
 
 void rtp_append_mki(str *s, struct crypto_context *c) {
@@ -101,19 +101,17 @@ void rtp_append_mki(str *s, struct crypto_context *c) {
 }
 
 /* rfc 3711, section 3.3 */
-int rtp_avp2savp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
+int rtp_avp2savp_index(str *s, struct crypto_context *c, uint32_t ssrc, uint64_t *srtp_index) {
 	struct rtp_header *rtp;
 	str payload, to_auth;
 	uint64_t index;
 
-	if (G_UNLIKELY(!ssrc_ctx))
-		return -1;
 	if (rtp_payload(&rtp, &payload, s))
 		return -1;
 	if (check_session_keys(c))
 		return -1;
 
-	index = packet_index(ssrc_ctx, rtp);
+	index = packet_index(srtp_index, ssrc, rtp);
 
 	crypto_debug_printf(", plain pl: ");
 	crypto_debug_dump(&payload);
@@ -143,21 +141,25 @@ int rtp_avp2savp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
 	return 0;
 }
 
+int rtp_avp2savp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
+	if (G_UNLIKELY(!ssrc_ctx))
+		return -1;
+	return rtp_avp2savp_index(s, c, ssrc_ctx->parent->h.ssrc, &ssrc_ctx->srtp_index);
+}
+
 /* rfc 3711, section 3.3 */
-int rtp_savp2avp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
+int rtp_savp2avp_index(str *s, struct crypto_context *c, uint32_t ssrc, uint64_t *srtp_index) {
 	struct rtp_header *rtp;
 	uint64_t index;
 	str payload, to_auth, to_decrypt, auth_tag;
 	char hmac[20];
 
-	if (G_UNLIKELY(!ssrc_ctx))
-		return -1;
 	if (rtp_payload(&rtp, &payload, s))
 		return -1;
 	if (check_session_keys(c))
 		return -1;
 
-	index = packet_index(ssrc_ctx, rtp);
+	index = packet_index(srtp_index, ssrc, rtp);
 	if (srtp_payloads(&to_auth, &to_decrypt, &auth_tag, NULL,
 			c->params.session_params.unauthenticated_srtp ? 0 : c->params.crypto_suite->srtp_auth_tag,
 			c->params.mki_len,
@@ -215,8 +217,8 @@ int rtp_savp2avp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
 
 decrypt_idx:
 	ilog(LOG_DEBUG, "Detected unexpected SRTP ROC reset (from %" PRIu64 " to %" PRIu64 ")",
-			ssrc_ctx->srtp_index, index);
-	ssrc_ctx->srtp_index = index;
+			*srtp_index, index);
+	*srtp_index = index;
 decrypt:;
 	int prev_len = to_decrypt.len;
 	if (c->params.session_params.unencrypted_srtp)
@@ -251,8 +253,8 @@ decrypt:;
 		}
 		if (guess != 0) {
 			ilog(LOG_DEBUG, "Detected unexpected SRTP ROC reset (from %" PRIu64 " to %" PRIu64 ")",
-					ssrc_ctx->srtp_index, index);
-			ssrc_ctx->srtp_index = index;
+					*srtp_index, index);
+			*srtp_index = index;
 		}
 	}
 
@@ -271,6 +273,12 @@ error:
 	return -1;
 }
 
+int rtp_savp2avp(str *s, struct crypto_context *c, struct ssrc_ctx *ssrc_ctx) {
+	if (G_UNLIKELY(!ssrc_ctx))
+		return -1;
+	return rtp_savp2avp_index(s, c, ssrc_ctx->parent->h.ssrc, &ssrc_ctx->srtp_index);
+}
+
 /* rfc 3711 section 3.1 and 3.4 */
 int srtp_payloads(str *to_auth, str *to_decrypt, str *auth_tag, str *mki,
 		int auth_len, int mki_len,
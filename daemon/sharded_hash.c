@@ -0,0 +1,43 @@
+#include "sharded_hash.h"
+
+
+void sharded_hash_init(struct sharded_hash *h, unsigned int bits, GHashFunc hash_func, GEqualFunc eq_func) {
+	unsigned int num = 1 << bits;
+	h->bits = bits;
+	h->hash_func = hash_func;
+	h->size = 0;
+	h->shards = g_new0(struct sharded_hash_shard, num);
+	for (unsigned int i = 0; i < num; i++) {
+		rwlock_init(&h->shards[i].lock);
+		h->shards[i].ht = g_hash_table_new(hash_func, eq_func);
+	}
+}
+
+void sharded_hash_destroy(struct sharded_hash *h) {
+	if (!h->shards)
+		return;
+	for (unsigned int i = 0; i < sharded_hash_num_shards(h); i++) {
+		g_hash_table_destroy(h->shards[i].ht);
+		rwlock_destroy(&h->shards[i].lock);
+	}
+	g_free(h->shards);
+	h->shards = NULL;
+}
+
+void sharded_hash_foreach(struct sharded_hash *h, bool (*func)(void *, void *, void *), void *arg) {
+	for (unsigned int i = 0; i < sharded_hash_num_shards(h); i++) {
+		struct sharded_hash_shard *sh = &h->shards[i];
+		GHashTableIter iter;
+		gpointer key, value;
+		bool more = true;
+
+		rwlock_lock_r(&sh->lock);
+		g_hash_table_iter_init(&iter, sh->ht);
+		while (more && g_hash_table_iter_next(&iter, &key, &value))
+			more = func(key, value, arg);
+		rwlock_unlock_r(&sh->lock);
+
+		if (!more)
+			break;
+	}
+}
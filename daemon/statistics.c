@@ -5,6 +5,12 @@
 #include "graphite.h"
 #include "main.h"
 #include "control_ng.h"
+#include "poller.h"
+#include "pktbuf.h"
+#include "kernel.h"
+#include "xdp.h"
+#include "redis.h"
+#include "timerthread.h"
 
 
 struct timeval rtpe_started;
@@ -310,6 +316,37 @@ static void add_header(GQueue *ret, const char *fmt1, const char *fmt2, ...) {
 #define HEADERl(fmt2, ...) add_header(ret, NULL, fmt2, ##__VA_ARGS__)
 
 
+// the last bucket starts at the largest power of two not above the batch size limit
+G_STATIC_ASSERT((1 << (STATS_HIST_BUCKETS - 1)) <= MAX_MMSG_BATCH
+		&& MAX_MMSG_BATCH < (1 << STATS_HIST_BUCKETS));
+
+// upper bounds of the timerthread lag buckets
+static const char *timer_lag_bucket_labels[TIMERTHREAD_LAG_BUCKETS] = {
+	"100us", "250us", "500us", "1ms", "2.5ms", "5ms", "10ms", "25ms", "100ms", "more",
+};
+
+// `prom_labels` is optional and gets prepended to the bucket label
+static void add_histogram(GQueue *ret, const char *label, const char *prom_name, const char *prom_labels,
+		const atomic64 *buckets)
+{
+	HEADER("%s", NULL, label);
+	HEADER("{", NULL);
+	for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+		unsigned int lo = 1U << i;
+		unsigned int hi = (i == STATS_HIST_BUCKETS - 1) ? MAX_MMSG_BATCH : (2U << i) - 1;
+		char bucket[16];
+		if (lo == hi)
+			snprintf(bucket, sizeof(bucket), "%u", lo);
+		else
+			snprintf(bucket, sizeof(bucket), "%u-%u", lo, hi);
+		METRICs(bucket, UINT64F, atomic64_get(&buckets[i]));
+		PROM(prom_name, "counter");
+		PROMLAB("%s%ssize=\"%s\"", prom_labels ? : "", prom_labels ? "," : "", bucket);
+	}
+	HEADER("}", NULL);
+}
+
+
 GQueue *statistics_gather_metrics(struct interface_sampled_rate_stats *interface_rate_stats) {
 	GQueue *ret = g_queue_new();
 
@@ -320,9 +357,7 @@ GQueue *statistics_gather_metrics(struct interface_sampled_rate_stats *interface
 	HEADER("currentstatistics", "Statistics over currently running sessions:");
 	HEADER("{", "");
 
-	rwlock_lock_r(&rtpe_callhash_lock);
-	cur_sessions = g_hash_table_size(rtpe_callhash);
-	rwlock_unlock_r(&rtpe_callhash_lock);
+	cur_sessions = sharded_hash_size(&rtpe_callhash);
 
 	METRIC("sessionsown", "Owned sessions", UINT64F, UINT64F, cur_sessions - atomic64_get(&rtpe_stats_gauge.foreign_sessions));
 	PROM("sessions", "gauge");
@@ -867,10 +902,236 @@ GQueue *statistics_gather_metrics(struct interface_sampled_rate_stats *interface
 			}
 		}
 
+		if (rtpe_config.send_batch) {
+			AUTO_CLEANUP_GBUF(prom_labels);
+			prom_labels = g_strdup_printf("name=\"%s\",address=\"%s\"", lif->logical->name.s,
+					sockaddr_print_buf(&lif->spec->local_address.addr));
+			add_histogram(ret, "sendbatchsizes", "interface_send_batch_sizes_total", prom_labels,
+					lif->send_batch_sizes);
+		}
+
 		HEADER("}", NULL);
 	}
 	HEADER("]", NULL);
 
+	if (rtpe_config.recv_batch > 1 || rtpe_config.send_batch) {
+		HEADER("batching", "Media socket batching:");
+		HEADER("{", "");
+		if (rtpe_config.recv_batch > 1) {
+			uint64_t batches = atomic64_get(&rtpe_stats.recv_batches);
+			uint64_t batch_packets = atomic64_get(&rtpe_stats.recv_batch_packets);
+			METRIC("recvbatches", "Batched receive calls", UINT64F, UINT64F, batches);
+			PROM("recv_batches_total", "counter");
+			METRIC("recvbatchpackets", "Packets received in batches", UINT64F, UINT64F, batch_packets);
+			PROM("recv_batch_packets_total", "counter");
+			METRIC("recvbatchavg", "Average receive batch size", "%.6f", "%.6f",
+					batches ? (double) batch_packets / (double) batches : 0.0);
+			add_histogram(ret, "recvbatchsizes", "recv_batch_sizes_total", NULL,
+					rtpe_stats.recv_batch_sizes);
+		}
+		if (rtpe_config.send_batch) {
+			uint64_t batches = atomic64_get(&rtpe_stats.send_batches);
+			uint64_t batch_packets = atomic64_get(&rtpe_stats.send_batch_packets);
+			METRIC("sendbatches", "Batched send calls", UINT64F, UINT64F, batches);
+			PROM("send_batches_total", "counter");
+			METRIC("sendbatchpackets", "Packets sent in batches", UINT64F, UINT64F, batch_packets);
+			PROM("send_batch_packets_total", "counter");
+			METRIC("sendbatchavg", "Average send batch size", "%.6f", "%.6f",
+					batches ? (double) batch_packets / (double) batches : 0.0);
+			METRIC("sendgsosegments", "Packets sent as UDP GSO segments", UINT64F, UINT64F,
+					atomic64_get(&rtpe_stats.send_gso_segments));
+			PROM("send_gso_segments_total", "counter");
+			add_histogram(ret, "sendbatchsizes", "send_batch_sizes_total", NULL,
+					rtpe_stats.send_batch_sizes);
+		}
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	if (rtpe_config.poller_cpu_affinity) {
+		GArray *load = poller_map_load(rtpe_poller_map);
+		HEADER("pollers", NULL);
+		HEADER("[", NULL);
+		for (unsigned int i = 0; i < load->len; i++) {
+			struct poller_load *pl = &g_array_index(load, struct poller_load, i);
+			HEADER("{", NULL);
+			METRICs("index", "%u", i);
+			METRICs("cpu", "%i", pl->cpu);
+			METRICs("numa_node", "%i", pl->numa_node);
+			METRICs("calls", "%u", pl->calls);
+			PROM("poller_calls", "gauge");
+			PROMLAB("poller=\"%u\",cpu=\"%i\"", i, pl->cpu);
+			METRICs("sockets", "%u", pl->sockets);
+			PROM("poller_sockets", "gauge");
+			PROMLAB("poller=\"%u\",cpu=\"%i\"", i, pl->cpu);
+			HEADER("}", NULL);
+		}
+		HEADER("]", NULL);
+		g_array_free(load, TRUE);
+	}
+
+	if (rtpe_config.timer_sweep_threads) {
+		struct call_timer_stats cts;
+		call_timer_get_stats(&cts);
+		HEADER("timersweep", "Call timer sweep:");
+		HEADER("{", "");
+		METRIC("runs", "Sweeps over all calls", UINT64F, UINT64F, cts.runs);
+		PROM("timer_sweeps_total", "counter");
+		METRIC("calls", "Calls in last sweep", UINT64F, UINT64F, cts.calls);
+		PROM("timer_sweep_calls", "gauge");
+		METRIC("kernelentries", "Kernel entries in last sweep", UINT64F, UINT64F, cts.kernel_entries);
+		PROM("timer_sweep_kernel_entries", "gauge");
+		METRIC("duration", "Duration of last sweep", "%.6f", "%.6f seconds", (double) cts.duration_us / 1000000.0);
+		PROM("timer_sweep_duration_seconds", "gauge");
+		METRIC("maxduration", "Maximum sweep duration", "%.6f", "%.6f seconds", (double) cts.max_duration_us / 1000000.0);
+		PROM("timer_sweep_max_duration_seconds", "gauge");
+		METRIC("callsduration", "Duration of last sweep over calls", "%.6f", "%.6f seconds",
+				(double) cts.calls_us / 1000000.0);
+		PROM("timer_sweep_calls_duration_seconds", "gauge");
+		METRIC("kernelduration", "Duration of last kernel stats processing", "%.6f", "%.6f seconds",
+				(double) cts.kernel_us / 1000000.0);
+		PROM("timer_sweep_kernel_duration_seconds", "gauge");
+		METRIC("callcost", "Time per call in last sweep", "%.6f", "%.3f microseconds",
+				cts.calls ? (double) cts.calls_us / cts.calls : 0.0);
+		PROM("timer_sweep_call_cost_microseconds", "gauge");
+		METRIC("interval", "Sweep interval", "%.6f", "%.6f seconds", (double) cts.interval_us / 1000000.0);
+		PROM("timer_sweep_interval_seconds", "gauge");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	GArray *tts = timerthread_get_stats();
+	if (tts->len) {
+		HEADER("timerthreads", NULL);
+		HEADER("[", NULL);
+		for (unsigned int i = 0; i < tts->len; i++) {
+			struct timerthread_stats *ts = &g_array_index(tts, struct timerthread_stats, i);
+			uint64_t runs = 0;
+			HEADER("{", NULL);
+			METRICs("name", "\"%s\"", ts->name);
+			METRICs("index", "%u", ts->idx);
+			METRICs("pending", "%u", ts->pending);
+			PROM("timer_pending", "gauge");
+			PROMLAB("timer=\"%s\",thread=\"%u\"", ts->name, ts->idx);
+			METRICs("steals", UINT64F, ts->steals);
+			PROM("timer_steals_total", "counter");
+			PROMLAB("timer=\"%s\",thread=\"%u\"", ts->name, ts->idx);
+			HEADER("lag", NULL);
+			HEADER("{", NULL);
+			for (unsigned int b = 0; b < TIMERTHREAD_LAG_BUCKETS; b++) {
+				runs += ts->lag[b];
+				METRICs(timer_lag_bucket_labels[b], UINT64F, ts->lag[b]);
+				PROM("timer_lag_total", "counter");
+				PROMLAB("timer=\"%s\",thread=\"%u\",lag=\"%s\"", ts->name, ts->idx,
+						timer_lag_bucket_labels[b]);
+			}
+			HEADER("}", NULL);
+			METRICs("runs", UINT64F, runs);
+			PROM("timer_runs_total", "counter");
+			PROMLAB("timer=\"%s\",thread=\"%u\"", ts->name, ts->idx);
+			METRICs("lagsum", "%.6f", (double) ts->lag_sum / 1000000.0);
+			PROM("timer_lag_seconds_total", "counter");
+			PROMLAB("timer=\"%s\",thread=\"%u\"", ts->name, ts->idx);
+			HEADER("}", NULL);
+		}
+		HEADER("]", NULL);
+	}
+	g_array_free(tts, TRUE);
+
+	struct socket_reaper_stats srs;
+	if (socket_reaper_get_stats(&srs)) {
+		HEADER("socketreaper", "Socket reaper:");
+		HEADER("{", "");
+		METRIC("queued", "Sockets waiting to be closed", "%u", "%u", srs.queued);
+		PROM("socket_reaper_queued", "gauge");
+		METRIC("closed", "Sockets closed", UINT64F, UINT64F, srs.closed);
+		PROM("socket_reaper_closed_total", "counter");
+		METRIC("batches", "Batches processed", UINT64F, UINT64F, srs.batches);
+		PROM("socket_reaper_batches_total", "counter");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	if (rtpe_config.buffer_pool) {
+		struct pktbuf_stats pbs;
+		pktbuf_get_stats(&pbs);
+		HEADER("bufferpool", "Packet buffer pool:");
+		HEADER("{", "");
+		METRIC("hits", "Buffer allocations from cache", UINT64F, UINT64F, pbs.hits);
+		PROM("buffer_pool_hits_total", "counter");
+		METRIC("misses", "Buffer allocations from system", UINT64F, UINT64F, pbs.misses);
+		PROM("buffer_pool_misses_total", "counter");
+		METRIC("inuse", "Buffers currently in use", UINT64F, UINT64F, pbs.in_use);
+		PROM("buffer_pool_in_use", "gauge");
+		METRIC("highwater", "Maximum buffers in use", UINT64F, UINT64F, pbs.high_water);
+		PROM("buffer_pool_high_water", "gauge");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	if (rtpe_config.redis_write_delay) {
+		struct redis_write_stats rws;
+		redis_write_get_stats(&rws);
+		HEADER("rediswriter", "Redis write-back:");
+		HEADER("{", "");
+		METRIC("pending", "Calls waiting to be written", UINT64F, UINT64F, rws.pending);
+		PROM("redis_write_pending", "gauge");
+		METRIC("highwater", "Maximum calls waiting to be written", UINT64F, UINT64F, rws.high_water);
+		PROM("redis_write_pending_high_water", "gauge");
+		METRIC("queued", "Updates scheduled", UINT64F, UINT64F, rws.queued);
+		PROM("redis_write_queued_total", "counter");
+		METRIC("coalesced", "Updates merged into a scheduled write", UINT64F, UINT64F, rws.coalesced);
+		PROM("redis_write_coalesced_total", "counter");
+		METRIC("direct", "Updates written directly due to full queue", UINT64F, UINT64F, rws.direct);
+		PROM("redis_write_direct_total", "counter");
+		METRIC("written", "Calls written", UINT64F, UINT64F, rws.written);
+		PROM("redis_write_written_total", "counter");
+		METRIC("errors", "Calls failed to write", UINT64F, UINT64F, rws.errors);
+		PROM("redis_write_errors_total", "counter");
+		METRIC("batches", "Pipelined batches sent", UINT64F, UINT64F, rws.batches);
+		PROM("redis_write_batches_total", "counter");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	if (rtpe_config.redis_delta) {
+		struct redis_delta_stats rds;
+		redis_delta_get_stats(&rds);
+		HEADER("redisdelta", "Redis delta updates:");
+		HEADER("{", "");
+		METRIC("snapshots", "Calls written completely", UINT64F, UINT64F, rds.snapshots);
+		PROM("redis_delta_snapshots_total", "counter");
+		METRIC("updates", "Calls written as changed sections", UINT64F, UINT64F, rds.updates);
+		PROM("redis_delta_updates_total", "counter");
+		METRIC("written", "Sections written", UINT64F, UINT64F, rds.sections_written);
+		PROM("redis_delta_sections_written_total", "counter");
+		METRIC("unchanged", "Unchanged sections skipped", UINT64F, UINT64F, rds.sections_unchanged);
+		PROM("redis_delta_sections_unchanged_total", "counter");
+		METRIC("removed", "Sections removed", UINT64F, UINT64F, rds.sections_removed);
+		PROM("redis_delta_sections_removed_total", "counter");
+		METRIC("bytes", "Bytes of call data written", UINT64F, UINT64F, rds.bytes);
+		PROM("redis_delta_bytes_total", "counter");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
+	if (kernel.is_xdp) {
+		struct xdp_stats xs;
+		xdp_get_stats(&xs);
+		HEADER("xdp", "XDP forwarding:");
+		HEADER("{", "");
+		METRIC("packets", "Packets sent through AF_XDP", UINT64F, UINT64F, xs.packets);
+		PROM("xdp_packets_total", "counter");
+		METRIC("fallback", "Packets sent through the kernel stack", UINT64F, UINT64F, xs.fallback);
+		PROM("xdp_fallback_total", "counter");
+		METRIC("userspace", "Packets passed back to userspace", UINT64F, UINT64F, xs.userspace);
+		PROM("xdp_userspace_total", "counter");
+		METRIC("errors", "Packets dropped due to errors", UINT64F, UINT64F, xs.errors);
+		PROM("xdp_errors_total", "counter");
+		HEADER(NULL, "");
+		HEADER("}", "");
+	}
+
 	mutex_lock(&rtpe_codec_stats_lock);
 	HEADER("transcoders", NULL);
 	HEADER("[", "");
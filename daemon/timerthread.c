@@ -1,62 +1,151 @@
 #include "timerthread.h"
 #include "aux.h"
 #include "log_funcs.h"
+#include "call.h"
 
 
-static int tt_obj_cmp(const void *a, const void *b) {
-	const struct timerthread_obj *A = a, *B = b;
-	return timeval_cmp_ptr(&A->next_check, &B->next_check);
-}
+#define tt_obj_of(e) ((struct timerthread_obj *) ((char *) (e) - G_STRUCT_OFFSET(struct timerthread_obj, tw_entry)))
+
+static const long long tt_lag_bounds[TIMERTHREAD_LAG_BUCKETS - 1] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000,
+};
+
+static mutex_t timerthreads_lock = MUTEX_STATIC_INIT;
+static GQueue timerthreads = G_QUEUE_INIT;
+
 
-void timerthread_init(struct timerthread *tt, void (*func)(void *)) {
-	tt->tree = g_tree_new(tt_obj_cmp);
-	mutex_init(&tt->lock);
-	cond_init(&tt->cond);
+void timerthread_init(struct timerthread *tt, const char *name, unsigned int num_threads,
+		void (*func)(void *))
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	tt->name = name;
+	tt->num_threads = MAX(num_threads, 1);
+	tt->threads = g_new0(struct timerthread_thread, tt->num_threads);
+	for (unsigned int i = 0; i < tt->num_threads; i++) {
+		struct timerthread_thread *tth = &tt->threads[i];
+		tth->tt = tt;
+		tth->idx = i;
+		timerwheel_init(&tth->wheel, timeval_us(&now));
+		mutex_init(&tth->lock);
+		cond_init(&tth->cond);
+	}
 	tt->func = func;
+
+	mutex_lock(&timerthreads_lock);
+	g_queue_push_tail(&timerthreads, tt);
+	mutex_unlock(&timerthreads_lock);
 }
 
-static int __tt_put_all(void *k, void *d, void *p) {
-	struct timerthread_obj *tto = d;
-	//struct timerthread *tt = p;
+static void __tt_put(struct timerwheel_entry *e) {
+	struct timerthread_obj *tto = tt_obj_of(e);
 	obj_put(tto);
-	return FALSE;
 }
 
 void timerthread_free(struct timerthread *tt) {
-	g_tree_foreach(tt->tree, __tt_put_all, tt);
-	g_tree_destroy(tt->tree);
-	mutex_destroy(&tt->lock);
+	mutex_lock(&timerthreads_lock);
+	g_queue_remove(&timerthreads, tt);
+	mutex_unlock(&timerthreads_lock);
+
+	for (unsigned int i = 0; i < tt->num_threads; i++) {
+		struct timerthread_thread *tth = &tt->threads[i];
+		timerwheel_clear(&tth->wheel, __tt_put);
+		mutex_destroy(&tth->lock);
+	}
+	g_free(tt->threads);
+	tt->threads = NULL;
+}
+
+void timerthread_obj_bind(struct timerthread_obj *tt_obj, struct timerthread *tt, struct call *call) {
+	unsigned int key;
+	if (call && call->cpu_affinity >= 0)
+		key = call->cpu_affinity; // same CPU as its sockets and poller
+	else if (call)
+		key = str_hash(&call->callid);
+	else
+		key = g_atomic_int_add(&tt->next_thread, 1);
+	tt_obj->tt = tt;
+	if (tt->threads) // not initialised in some unit tests
+		tt_obj->thread = &tt->threads[key % tt->num_threads];
 }
 
-void timerthread_run(void *p) {
-	struct timerthread *tt = p;
+static void tt_lag_add(struct timerthread_thread *tth, long long lag) {
+	unsigned int idx = 0;
+	lag = MAX(lag, 0);
+	while (idx < TIMERTHREAD_LAG_BUCKETS - 1 && lag > tt_lag_bounds[idx])
+		idx++;
+	atomic64_inc(&tth->lag[idx]);
+	atomic64_add(&tth->lag_sum, lag);
+}
 
-	struct thread_waker waker = { .lock = &tt->lock, .cond = &tt->cond };
+/* takes an overdue object from one of the other threads. the object stays bound to its own thread,
+ * which is returned locked in `from` */
+static struct timerwheel_entry *tt_steal(struct timerthread_thread *self, long long now,
+		struct timerthread_thread **from)
+{
+	struct timerthread *tt = self->tt;
+
+	for (unsigned int i = 1; i < tt->num_threads; i++) {
+		struct timerthread_thread *tth = &tt->threads[(self->idx + i) % tt->num_threads];
+		if (mutex_trylock(&tth->lock))
+			continue; // busy, try the next one
+		long long next;
+		struct timerwheel_entry *e = timerwheel_expire(&tth->wheel, now - TIMERTHREAD_STEAL_LAG, &next);
+		if (e) {
+			*from = tth;
+			return e;
+		}
+		mutex_unlock(&tth->lock);
+	}
+
+	return NULL;
+}
+
+void timerthread_run(struct timerthread *tt, unsigned int idx) {
+	struct timerthread_thread *tth = &tt->threads[idx % tt->num_threads];
+	struct timerthread_thread *helper = &tt->threads[(tth->idx + 1) % tt->num_threads];
+
+	struct thread_waker waker = { .lock = &tth->lock, .cond = &tth->cond };
 	thread_waker_add(&waker);
 
-	mutex_lock(&tt->lock);
+	mutex_lock(&tth->lock);
 
 	while (!rtpe_shutdown) {
 		gettimeofday(&rtpe_now, NULL);
-
-		/* lock our list and get the first element */
-		struct timerthread_obj *tt_obj = g_tree_find_first(tt->tree, NULL, NULL);
-		/* scheduled to run? if not, we just go to sleep, otherwise we remove it from the tree,
-		 * steal the reference and run it */
+		long long now = timeval_us(&rtpe_now);
+
+		/* get an object that's due to run, either our own or one that another thread is late
+		 * running. if there is none, we just go to sleep, otherwise it's been removed from
+		 * the wheel and we steal the reference and run it */
+		long long next;
+		struct timerthread_thread *from = tth;
+		struct timerwheel_entry *e = timerwheel_expire(&tth->wheel, now, &next);
+		if (!e && tt->num_threads > 1)
+			e = tt_steal(tth, now, &from);
 		long long sleeptime = 10000000;
-		if (!tt_obj)
-			goto sleep;
-		sleeptime = timeval_diff(&tt_obj->next_check, &rtpe_now);
-		if (sleeptime > 0)
+		if (!e) {
+			if (next != -1)
+				sleeptime = next - now;
 			goto sleep;
+		}
 
 		// steal reference
-		g_tree_remove(tt->tree, tt_obj);
+		struct timerthread_obj *tt_obj = tt_obj_of(e);
+		long long lag = now - timeval_us(&tt_obj->next_check);
 		// pretend we're running exactly at the scheduled time
 		rtpe_now = tt_obj->next_check;
 		ZERO(tt_obj->next_check);
 		tt_obj->last_run = rtpe_now;
-		mutex_unlock(&tt->lock);
+		if (from != tth) {
+			mutex_unlock(&from->lock);
+			atomic64_inc(&from->steals);
+		}
+		mutex_unlock(&tth->lock);
+
+		tt_lag_add(from, lag);
+		// falling behind? have the next thread look for work
+		if (from == tth && lag > TIMERTHREAD_STEAL_LAG && helper != tth)
+			cond_signal(&helper->cond);
 
 		// run and release
 		tt->func(tt_obj);
@@ -64,7 +153,7 @@ void timerthread_run(void *p) {
 
 		log_info_reset();
 
-		mutex_lock(&tt->lock);
+		mutex_lock(&tth->lock);
 		continue;
 
 sleep:;
@@ -72,10 +161,10 @@ sleep:;
 		sleeptime = MIN(10000000, sleeptime); /* 100 ms at the most */
 		struct timeval tv = rtpe_now;
 		timeval_add_usec(&tv, sleeptime);
-		cond_timedwait(&tt->cond, &tt->lock, &tv);
+		cond_timedwait(&tth->cond, &tth->lock, &tv);
 	}
 
-	mutex_unlock(&tt->lock);
+	mutex_unlock(&tth->lock);
 	thread_waker_del(&waker);
 }
 
@@ -86,30 +175,58 @@ void timerthread_obj_schedule_abs_nl(struct timerthread_obj *tt_obj, const struc
 	//ilog(LOG_DEBUG, "scheduling timer object at %llu.%06lu", (unsigned long long) tv->tv_sec,
 			//(unsigned long) tv->tv_usec);
 
-	struct timerthread *tt = tt_obj->tt;
+	struct timerthread_thread *tth = tt_obj->thread;
 	if (tt_obj->next_check.tv_sec && timeval_cmp(&tt_obj->next_check, tv) <= 0)
 		return; /* already scheduled sooner */
-	if (!g_tree_remove(tt->tree, tt_obj))
-		obj_hold(tt_obj); /* if it wasn't removed, we make a new reference */
+	if (!timerwheel_pending(&tt_obj->tw_entry))
+		obj_hold(tt_obj); /* if it wasn't scheduled, we make a new reference */
 	tt_obj->next_check = *tv;
-	g_tree_insert(tt->tree, tt_obj, tt_obj);
-	cond_signal(&tt->cond);
+	timerwheel_add(&tth->wheel, &tt_obj->tw_entry, timeval_us(tv));
+	cond_signal(&tth->cond);
 }
 
 void timerthread_obj_deschedule(struct timerthread_obj *tt_obj) {
 	if (!tt_obj)
 		return;
 
-	struct timerthread *tt = tt_obj->tt;
-	mutex_lock(&tt->lock);
+	struct timerthread_thread *tth = tt_obj->thread;
+	mutex_lock(&tth->lock);
 	if (!tt_obj->next_check.tv_sec)
 		goto nope; /* already descheduled */
-	int ret = g_tree_remove(tt->tree, tt_obj);
+	bool ret = timerwheel_pending(&tt_obj->tw_entry);
+	timerwheel_del(&tth->wheel, &tt_obj->tw_entry);
 	ZERO(tt_obj->next_check);
 	if (ret)
 		obj_put(tt_obj);
 nope:
-	mutex_unlock(&tt->lock);
+	mutex_unlock(&tth->lock);
+}
+
+GArray *timerthread_get_stats(void) {
+	GArray *ret = g_array_new(FALSE, TRUE, sizeof(struct timerthread_stats));
+
+	mutex_lock(&timerthreads_lock);
+	for (GList *l = timerthreads.head; l; l = l->next) {
+		struct timerthread *tt = l->data;
+		for (unsigned int i = 0; i < tt->num_threads; i++) {
+			struct timerthread_thread *tth = &tt->threads[i];
+			struct timerthread_stats s = {
+				.name = tt->name,
+				.idx = i,
+				.lag_sum = atomic64_get(&tth->lag_sum),
+				.steals = atomic64_get(&tth->steals),
+			};
+			for (unsigned int b = 0; b < TIMERTHREAD_LAG_BUCKETS; b++)
+				s.lag[b] = atomic64_get(&tth->lag[b]);
+			mutex_lock(&tth->lock);
+			s.pending = tth->wheel.count;
+			mutex_unlock(&tth->lock);
+			g_array_append_val(ret, s);
+		}
+	}
+	mutex_unlock(&timerthreads_lock);
+
+	return ret;
 }
 
 static int timerthread_queue_run_one(struct timerthread_queue *ttq,
@@ -188,7 +305,7 @@ static int ttqe_compare(const void *a, const void *b) {
 }
  
 void *timerthread_queue_new(const char *type, size_t size,
-		struct timerthread *tt,
+		struct timerthread *tt, struct call *call,
 		void (*run_now_func)(struct timerthread_queue *, void *),
 		void (*run_later_func)(struct timerthread_queue *, void *),
 		void (*free_func)(void *),
@@ -196,7 +313,7 @@ void *timerthread_queue_new(const char *type, size_t size,
 {
 	struct timerthread_queue *ttq = obj_alloc0(type, size, __timerthread_queue_free);
 	ttq->type = type;
-	ttq->tt_obj.tt = tt;
+	timerthread_obj_bind(&ttq->tt_obj, tt, call);
 	assert(tt->func == timerthread_queue_run);
 	ttq->run_now_func = run_now_func;
 	ttq->run_later_func = run_later_func;
@@ -0,0 +1,205 @@
+#include "timerwheel.h"
+#include <limits.h>
+#include <string.h>
+
+#define TW_MASK		(TIMERWHEEL_SLOTS - 1)
+#define TW_SHIFT(l)	((l) * TIMERWHEEL_BITS)
+#define TW_OVERFLOW	(TIMERWHEEL_LEVELS * TIMERWHEEL_SLOTS)
+
+// occupancy bitmaps are 64 bits wide
+G_STATIC_ASSERT(TIMERWHEEL_SLOTS == 64);
+
+
+static long long tw_tick(long long us) {
+	return us / TIMERWHEEL_TICK;
+}
+
+static void tw_link(struct timerwheel_entry **head, struct timerwheel_entry *e) {
+	e->next = *head;
+	if (e->next)
+		e->next->pprev = &e->next;
+	e->pprev = head;
+	*head = e;
+}
+
+static void tw_unlink(struct timerwheel *tw, struct timerwheel_entry *e) {
+	*e->pprev = e->next;
+	if (e->next)
+		e->next->pprev = e->pprev;
+	if (e->slot != TW_OVERFLOW) {
+		unsigned int l = e->slot / TIMERWHEEL_SLOTS, idx = e->slot % TIMERWHEEL_SLOTS;
+		if (!tw->slots[l][idx])
+			tw->occupied[l] &= ~(1ULL << idx);
+	}
+	e->next = NULL;
+	e->pprev = NULL;
+}
+
+// puts the entry into the finest level that reaches its expiry
+static void tw_place(struct timerwheel *tw, struct timerwheel_entry *e) {
+	long long expires = MAX(tw_tick(e->when), tw->tick);
+	long long delta = expires - tw->tick;
+
+	for (unsigned int l = 0; l < TIMERWHEEL_LEVELS; l++) {
+		if (delta >= (1LL << TW_SHIFT(l + 1)))
+			continue;
+		unsigned int idx = (expires >> TW_SHIFT(l)) & TW_MASK;
+		e->slot = l * TIMERWHEEL_SLOTS + idx;
+		tw_link(&tw->slots[l][idx], e);
+		tw->occupied[l] |= 1ULL << idx;
+		return;
+	}
+
+	e->slot = TW_OVERFLOW;
+	tw_link(&tw->overflow, e);
+}
+
+static void tw_replace_list(struct timerwheel *tw, struct timerwheel_entry *list) {
+	while (list) {
+		struct timerwheel_entry *e = list;
+		list = e->next;
+		tw_place(tw, e);
+	}
+}
+
+// moves the entries of the level's current slot down
+static void tw_cascade(struct timerwheel *tw, unsigned int l) {
+	unsigned int idx = (tw->tick >> TW_SHIFT(l)) & TW_MASK;
+	struct timerwheel_entry *list = tw->slots[l][idx];
+	tw->slots[l][idx] = NULL;
+	tw->occupied[l] &= ~(1ULL << idx);
+	tw_replace_list(tw, list);
+}
+
+static void tw_advance(struct timerwheel *tw) {
+	tw->tick++;
+	for (unsigned int l = 1; l < TIMERWHEEL_LEVELS; l++) {
+		if (tw->tick & ((1LL << TW_SHIFT(l)) - 1))
+			return;
+		tw_cascade(tw, l);
+	}
+	// the top level has come around, see what has come within reach
+	struct timerwheel_entry *list = tw->overflow;
+	tw->overflow = NULL;
+	tw_replace_list(tw, list);
+}
+
+// distance from the slot to the next occupied one after it, wrapping around
+static unsigned int tw_dist(uint64_t occupied, unsigned int idx) {
+	unsigned int s = (idx + 1) & TW_MASK;
+	uint64_t bits = s ? (occupied >> s) | (occupied << (64 - s)) : occupied;
+	return __builtin_ctzll(bits) + 1;
+}
+
+static long long tw_next(struct timerwheel *tw) {
+	long long next = LLONG_MAX;
+
+	if (!tw->count)
+		return -1;
+
+	if (tw->occupied[0]) {
+		unsigned int idx = (tw->tick + tw_dist(tw->occupied[0], tw->tick & TW_MASK)) & TW_MASK;
+		for (struct timerwheel_entry *e = tw->slots[0][idx]; e; e = e->next)
+			next = MIN(next, e->when);
+	}
+
+	// entries of higher levels can't expire before they're cascaded
+	for (unsigned int l = 1; l < TIMERWHEEL_LEVELS; l++) {
+		if (!tw->occupied[l])
+			continue;
+		long long block = tw->tick >> TW_SHIFT(l);
+		block += tw_dist(tw->occupied[l], block & TW_MASK);
+		next = MIN(next, (block << TW_SHIFT(l)) * TIMERWHEEL_TICK);
+	}
+
+	if (tw->overflow) {
+		long long block = (tw->tick >> TW_SHIFT(TIMERWHEEL_LEVELS - 1)) + 1;
+		next = MIN(next, (block << TW_SHIFT(TIMERWHEEL_LEVELS - 1)) * TIMERWHEEL_TICK);
+	}
+
+	return next;
+}
+
+void timerwheel_init(struct timerwheel *tw, long long now) {
+	memset(tw, 0, sizeof(*tw));
+	tw->tick = tw_tick(now);
+}
+
+void timerwheel_add(struct timerwheel *tw, struct timerwheel_entry *e, long long when) {
+	timerwheel_del(tw, e);
+	e->when = when;
+	tw_place(tw, e);
+	tw->count++;
+}
+
+void timerwheel_del(struct timerwheel *tw, struct timerwheel_entry *e) {
+	if (!e->pprev)
+		return;
+	tw_unlink(tw, e);
+	tw->count--;
+}
+
+struct timerwheel_entry *timerwheel_expire(struct timerwheel *tw, long long now, long long *next) {
+	long long now_tick = tw_tick(now);
+	struct timerwheel_entry *e;
+
+	while (true) {
+		e = tw->slots[0][tw->tick & TW_MASK];
+
+		if (e && tw->tick < now_tick)
+			goto found; // all of a past tick are due
+
+		if (e) {
+			// current tick: take what's due, the rest must wait
+			long long later = LLONG_MAX;
+			for (; e; e = e->next) {
+				if (e->when <= now)
+					goto found;
+				later = MIN(later, e->when);
+			}
+			*next = later;
+			return NULL;
+		}
+
+		if (tw->tick >= now_tick)
+			break;
+
+		if (!tw->occupied[0]) {
+			// nothing to do until level 0 comes around
+			long long wrap = (tw->tick | TW_MASK) + 1;
+			if (wrap > now_tick) {
+				tw->tick = now_tick;
+				break;
+			}
+			tw->tick = wrap - 1;
+		}
+		tw_advance(tw);
+	}
+
+	*next = tw_next(tw);
+	return NULL;
+
+found:
+	tw_unlink(tw, e);
+	tw->count--;
+	return e;
+}
+
+void timerwheel_clear(struct timerwheel *tw, void (*func)(struct timerwheel_entry *)) {
+	struct timerwheel_entry *e;
+
+	for (unsigned int l = 0; l < TIMERWHEEL_LEVELS; l++) {
+		for (unsigned int idx = 0; idx < TIMERWHEEL_SLOTS; idx++) {
+			while ((e = tw->slots[l][idx])) {
+				timerwheel_del(tw, e);
+				if (func)
+					func(e);
+			}
+		}
+	}
+	while ((e = tw->overflow)) {
+		timerwheel_del(tw, e);
+		if (func)
+			func(e);
+	}
+}
@@ -0,0 +1,1199 @@
+#include "xdp.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include <linux/types.h>
+
+#include "aux.h"
+#include "log.h"
+#include "main.h"
+#include "socket.h"
+#include "crypto.h"
+#include "rtp.h"
+#include "rtplib.h"
+#include "str.h"
+#include "xt_RTPENGINE.h"
+
+
+#ifdef HAVE_LIBXDP
+
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <xdp/libxdp.h>
+#include <xdp/xsk.h>
+#include "xdp_filter.h"
+
+
+// UMEM layout: the first half of the frames circulates between the fill and RX rings,
+// the second half is used for transmitting
+#define XDP_NUM_FRAMES		4096
+#define XDP_FRAME_SIZE		XSK_UMEM__DEFAULT_FRAME_SIZE
+#define XDP_RX_FRAMES		(XDP_NUM_FRAMES / 2)
+#define XDP_TX_FRAMES		(XDP_NUM_FRAMES - XDP_RX_FRAMES)
+#define XDP_FRAME_MASK		(~((uint64_t) XDP_FRAME_SIZE - 1))
+#define XDP_BATCH		64
+#define XDP_IDLE_SPINS		1000 // empty polls before going to sleep in poll()
+// outgoing payload starts here, leaving room for the largest ethernet + IP + UDP header
+#define XDP_HEADROOM		(sizeof(struct ether_header) + sizeof(struct ip6_hdr) + sizeof(struct udphdr))
+#define XDP_TAILROOM		288 // SRTP auth tag + MKI
+
+
+struct xdp_intf {
+	char name[IF_NAMESIZE];
+	int ifindex;
+	unsigned char mac[ETH_ALEN];
+	struct xdp_program *prog;
+	enum xdp_attach_mode mode;
+	bool attached;
+	int xsks_map_fd;
+};
+
+struct xdp_sock {
+	struct xdp_intf *intf;
+	unsigned int queue;
+	void *umem_area;
+	struct xsk_umem *umem;
+	struct xsk_socket *xsk;
+	struct xsk_ring_prod fill,
+			     tx;
+	struct xsk_ring_cons comp,
+			     rx;
+	uint64_t tx_free[XDP_TX_FRAMES];
+	unsigned int num_tx_free;
+	unsigned int tx_pending; // submitted since the last wakeup
+};
+
+struct xdp_output {
+	struct rtpengine_output_info info; // encrypt.last_index[] is kept up to date
+	struct rtpengine_stats stats;
+	struct crypto_context encrypt;
+	bool encrypt_active;
+	bool filled;
+	endpoint_t src,
+		   dst;
+};
+
+struct xdp_target {
+	struct rtpengine_target_info info; // decrypt.last_index[] is kept up to date
+	mutex_t lock;
+	struct crypto_context decrypt;
+	bool decrypt_active;
+	bool installed; // in the BPF map
+	unsigned int num_filled;
+	unsigned int last_pt;
+	struct rtpengine_stats stats_in;
+	struct rtpengine_rtp_stats rtp_stats[RTPE_NUM_PAYLOAD_TYPES];
+	struct rtpengine_ssrc_stats ssrc_stats[RTPE_NUM_SSRC_TRACKING];
+	struct xdp_output outputs[];
+};
+
+// where to send packets for a given IP address, learned from received packets
+struct xdp_neigh {
+	struct re_address addr; // port is zero
+	unsigned char mac[ETH_ALEN];
+	int ifindex;
+};
+
+
+static GQueue xdp_intfs = G_QUEUE_INIT;
+static GQueue xdp_socks = G_QUEUE_INIT;
+
+static int xdp_targets_fd = -1; // BPF map shared between all interfaces
+static rwlock_t xdp_targets_lock;
+static GHashTable *xdp_targets;
+
+static rwlock_t xdp_neighs_lock;
+static GHashTable *xdp_neighs;
+
+// for packets we can't put on the wire ourselves
+static int xdp_raw_fd[2] = { -1, -1 }; // IPv4, IPv6
+
+static atomic64 xdp_stat_packets,
+		xdp_stat_fallback,
+		xdp_stat_userspace,
+		xdp_stat_errors;
+
+
+
+static guint xdp_re_address_hash(gconstpointer p) {
+	const struct re_address *a = p;
+	return a->u.u32[0] ^ a->u.u32[1] ^ a->u.u32[2] ^ a->u.u32[3] ^ (a->port << 16) ^ a->family;
+}
+static gboolean xdp_re_address_eq(gconstpointer p, gconstpointer q) {
+	return memcmp(p, q, sizeof(struct re_address)) == 0;
+}
+
+static void xdp_filter_key(struct xdp_filter_key *key, const struct re_address *a) {
+	ZERO(*key);
+	key->family = a->family == AF_INET ? 4 : 6;
+	key->port = htons(a->port);
+	if (a->family == AF_INET)
+		key->addr[0] = a->u.ipv4;
+	else
+		memcpy(key->addr, a->u.ipv6, sizeof(key->addr));
+}
+
+static uint32_t xdp_csum_add(uint32_t sum, const void *data, size_t len) {
+	const uint16_t *p = data;
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	if (len) {
+		uint16_t w = 0;
+		memcpy(&w, p, 1);
+		sum += w;
+	}
+	return sum;
+}
+static uint16_t xdp_csum_fold(uint32_t sum) {
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+
+
+static void xdp_target_install(struct xdp_target *t) {
+	struct xdp_filter_key key;
+	struct xdp_filter_value val;
+
+	xdp_filter_key(&key, &t->info.local);
+
+	ZERO(val);
+	if (t->info.src_mismatch != MSM_IGNORE) {
+		val.src_check = t->info.src_mismatch == MSM_DROP ? XDPF_SRC_DROP : XDPF_SRC_PASS;
+		if (t->info.expected_src.family == AF_INET)
+			val.src_addr[0] = t->info.expected_src.u.ipv4;
+		else
+			memcpy(val.src_addr, t->info.expected_src.u.ipv6, sizeof(val.src_addr));
+		val.src_port = htons(t->info.expected_src.port);
+	}
+	if (t->info.rtp)
+		val.flags |= XDPF_RTP;
+	if (t->info.rtcp_mux)
+		val.flags |= XDPF_RTCP_MUX;
+	if (t->info.pt_filter) {
+		val.flags |= XDPF_PT_FILTER;
+		for (unsigned int i = 0; i < t->info.num_payload_types; i++) {
+			unsigned int pt = t->info.pt_input[i].pt_num & 0x7f;
+			val.pt_mask[pt >> 5] |= 1U << (pt & 31);
+		}
+	}
+
+	if (bpf_map_update_elem(xdp_targets_fd, &key, &val, BPF_ANY)) {
+		ilog(LOG_ERR, "Failed to add XDP filter entry: %s", strerror(errno));
+		return;
+	}
+	t->installed = true;
+}
+
+static void xdp_target_uninstall(const struct re_address *local) {
+	struct xdp_filter_key key;
+	xdp_filter_key(&key, local);
+	bpf_map_delete_elem(xdp_targets_fd, &key);
+}
+
+// returns 0 if no crypto is needed, 1 if initialised, -1 on error
+static int xdp_srtp_init(struct crypto_context *c, const struct rtpengine_srtp *s) {
+	if (s->cipher == REC_NULL && s->hmac == REH_NULL)
+		return 0;
+
+	const struct crypto_suite *cs = NULL;
+	for (unsigned int i = 0; i < num_crypto_suites; i++) {
+		const struct crypto_suite *cand = &crypto_suites[i];
+		if (s->cipher != REC_NULL && cand->kernel_cipher != s->cipher)
+			continue;
+		if (cand->kernel_hmac != s->hmac)
+			continue;
+		if (cand->master_key_len != s->master_key_len || cand->master_salt_len != s->master_salt_len)
+			continue;
+		if (s->auth_tag_len && cand->srtp_auth_tag != s->auth_tag_len)
+			continue;
+		cs = cand;
+		break;
+	}
+	if (!cs) {
+		ilog(LOG_ERR, "Unsupported SRTP parameters for XDP forwarding (cipher %i, hmac %i)",
+				s->cipher, s->hmac);
+		return -1;
+	}
+
+	struct crypto_params p = {
+		.crypto_suite = cs,
+		.mki = (unsigned char *) s->mki,
+		.mki_len = s->mki_len,
+		.session_params = {
+			.unencrypted_srtp = s->cipher == REC_NULL,
+			.unauthenticated_srtp = s->auth_tag_len == 0,
+		},
+	};
+	memcpy(p.master_key, s->master_key, s->master_key_len);
+	memcpy(p.master_salt, s->master_salt, s->master_salt_len);
+	crypto_init(c, &p);
+	return 1;
+}
+
+static void xdp_target_free(void *p) {
+	struct xdp_target *t = p;
+	crypto_cleanup(&t->decrypt);
+	for (unsigned int i = 0; i < t->info.num_destinations; i++)
+		crypto_cleanup(&t->outputs[i].encrypt);
+	mutex_destroy(&t->lock);
+	g_free(t);
+}
+
+
+
+int xdp_add_stream(const struct rtpengine_target_info *ti) {
+	if (ti->num_destinations > RTPE_MAX_FORWARD_DESTINATIONS)
+		return -1;
+	if (ti->do_intercept) {
+		ilog(LOG_DEBUG, "Recording intercept not supported by XDP forwarding");
+		return -1;
+	}
+
+	struct xdp_target *t = g_malloc0(sizeof(*t) + ti->num_destinations * sizeof(*t->outputs));
+	t->info = *ti;
+	mutex_init(&t->lock);
+	int ret = xdp_srtp_init(&t->decrypt, &ti->decrypt);
+	if (ret < 0) {
+		xdp_target_free(t);
+		return -1;
+	}
+	t->decrypt_active = ret == 1;
+
+	rwlock_lock_w(&xdp_targets_lock);
+	xdp_target_uninstall(&t->info.local);
+	g_hash_table_replace(xdp_targets, &t->info.local, t);
+	if (!t->info.num_destinations && (!t->info.non_forwarding || t->info.blackhole))
+		xdp_target_install(t);
+	rwlock_unlock_w(&xdp_targets_lock);
+
+	return 0;
+}
+
+int xdp_add_destination(const struct rtpengine_destination_info *di) {
+	int ret = -1;
+
+	rwlock_lock_w(&xdp_targets_lock);
+
+	struct xdp_target *t = g_hash_table_lookup(xdp_targets, &di->local);
+	if (!t || di->num >= t->info.num_destinations)
+		goto out;
+
+	struct xdp_output *o = &t->outputs[di->num];
+	crypto_cleanup(&o->encrypt);
+	int cr = xdp_srtp_init(&o->encrypt, &di->output.encrypt);
+	if (cr < 0)
+		goto out;
+	o->encrypt_active = cr == 1;
+	o->info = di->output;
+	kernel2endpoint(&o->src, &o->info.src_addr);
+	kernel2endpoint(&o->dst, &o->info.dst_addr);
+	if (!o->filled) {
+		o->filled = true;
+		t->num_filled++;
+	}
+	if (t->num_filled == t->info.num_destinations && !t->installed)
+		xdp_target_install(t);
+
+	ret = 0;
+out:
+	rwlock_unlock_w(&xdp_targets_lock);
+	if (ret)
+		ilog(LOG_ERR, "Failed to add XDP forwarding destination");
+	return ret;
+}
+
+int xdp_del_stream(const struct re_address *a) {
+	rwlock_lock_w(&xdp_targets_lock);
+	xdp_target_uninstall(a);
+	bool found = g_hash_table_remove(xdp_targets, a);
+	rwlock_unlock_w(&xdp_targets_lock);
+
+	if (found)
+		return 0;
+	errno = ENOENT;
+	return -1;
+}
+
+GList *xdp_list(void) {
+	GList *li = NULL;
+	GHashTableIter iter;
+	gpointer value;
+
+	rwlock_lock_r(&xdp_targets_lock);
+	g_hash_table_iter_init(&iter, xdp_targets);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct xdp_target *t = value;
+		struct rtpengine_list_entry *le = g_slice_alloc0(sizeof(*le));
+
+		mutex_lock(&t->lock);
+		le->target = t->info;
+		le->stats_in = t->stats_in;
+		memcpy(le->rtp_stats, t->rtp_stats, sizeof(le->rtp_stats));
+		for (unsigned int i = 0; i < t->info.num_destinations; i++) {
+			le->outputs[i] = t->outputs[i].info;
+			le->stats_out[i] = t->outputs[i].stats;
+		}
+		mutex_unlock(&t->lock);
+
+		li = g_list_prepend(li, le);
+	}
+	rwlock_unlock_r(&xdp_targets_lock);
+
+	return li;
+}
+
+int xdp_update_stats(const struct re_address *a, struct rtpengine_stats_info *out) {
+	rwlock_lock_r(&xdp_targets_lock);
+
+	struct xdp_target *t = g_hash_table_lookup(xdp_targets, a);
+	if (!t) {
+		rwlock_unlock_r(&xdp_targets_lock);
+		errno = ENOENT;
+		return -1;
+	}
+
+	mutex_lock(&t->lock);
+	out->local = *a;
+	for (unsigned int u = 0; u < RTPE_NUM_SSRC_TRACKING; u++) {
+		out->ssrc[u] = t->info.ssrc[u];
+		out->ssrc_stats[u] = t->ssrc_stats[u];
+		t->ssrc_stats[u].basic_stats.packets = 0;
+		t->ssrc_stats[u].basic_stats.bytes = 0;
+		t->ssrc_stats[u].total_lost = 0;
+	}
+	mutex_unlock(&t->lock);
+
+	rwlock_unlock_r(&xdp_targets_lock);
+	return 0;
+}
+
+
+
+static void xdp_learn_neigh(struct xdp_sock *xs, const struct ether_header *eth, const struct re_address *src) {
+	struct re_address key = *src;
+	key.port = 0;
+
+	rwlock_lock_r(&xdp_neighs_lock);
+	struct xdp_neigh *n = g_hash_table_lookup(xdp_neighs, &key);
+	bool known = n && n->ifindex == xs->intf->ifindex && !memcmp(n->mac, eth->ether_shost, ETH_ALEN);
+	rwlock_unlock_r(&xdp_neighs_lock);
+	if (known)
+		return;
+
+	rwlock_lock_w(&xdp_neighs_lock);
+	n = g_hash_table_lookup(xdp_neighs, &key);
+	if (!n) {
+		n = g_slice_alloc0(sizeof(*n));
+		n->addr = key;
+		g_hash_table_insert(xdp_neighs, &n->addr, n);
+	}
+	memcpy(n->mac, eth->ether_shost, ETH_ALEN);
+	n->ifindex = xs->intf->ifindex;
+	rwlock_unlock_w(&xdp_neighs_lock);
+}
+
+static bool xdp_lookup_neigh(const struct re_address *dst, int ifindex, unsigned char *mac) {
+	struct re_address key = *dst;
+	key.port = 0;
+	bool ret = false;
+
+	rwlock_lock_r(&xdp_neighs_lock);
+	struct xdp_neigh *n = g_hash_table_lookup(xdp_neighs, &key);
+	if (n && n->ifindex == ifindex) {
+		memcpy(mac, n->mac, ETH_ALEN);
+		ret = true;
+	}
+	rwlock_unlock_r(&xdp_neighs_lock);
+
+	return ret;
+}
+
+static void xdp_neigh_free(void *p) {
+	g_slice_free1(sizeof(struct xdp_neigh), p);
+}
+
+static int xdp_raw_send(const struct re_address *dst, const char *ip, size_t len) {
+	union {
+		struct sockaddr_in sin;
+		struct sockaddr_in6 sin6;
+	} sa;
+	socklen_t sa_len;
+	int fd;
+
+	ZERO(sa);
+	if (dst->family == AF_INET) {
+		sa.sin.sin_family = AF_INET;
+		sa.sin.sin_addr.s_addr = dst->u.ipv4;
+		sa_len = sizeof(sa.sin);
+		fd = xdp_raw_fd[0];
+	}
+	else {
+		sa.sin6.sin6_family = AF_INET6;
+		memcpy(&sa.sin6.sin6_addr, dst->u.ipv6, sizeof(sa.sin6.sin6_addr));
+		sa_len = sizeof(sa.sin6);
+		fd = xdp_raw_fd[1];
+	}
+
+	if (sendto(fd, ip, len, 0, (struct sockaddr *) &sa, sa_len) < 0)
+		return -1;
+	return 0;
+}
+
+// hand a received packet over to the daemon's own socket, as the kernel module
+// does with packets it can't handle
+static void xdp_to_userspace(const struct re_address *local, const char *ip, size_t len) {
+	if (xdp_raw_send(local, ip, len))
+		atomic64_inc(&xdp_stat_errors);
+	else
+		atomic64_inc(&xdp_stat_userspace);
+}
+
+
+
+static void xdp_tx_complete(struct xdp_sock *xs) {
+	uint32_t idx;
+	unsigned int n = xsk_ring_cons__peek(&xs->comp, XDP_TX_FRAMES, &idx);
+	if (!n)
+		return;
+	for (unsigned int i = 0; i < n; i++)
+		xs->tx_free[xs->num_tx_free++] = *xsk_ring_cons__comp_addr(&xs->comp, idx + i) & XDP_FRAME_MASK;
+	xsk_ring_cons__release(&xs->comp, n);
+}
+
+static char *xdp_tx_frame(struct xdp_sock *xs, uint64_t *addr) {
+	if (!xs->num_tx_free) {
+		xdp_tx_complete(xs);
+		if (!xs->num_tx_free)
+			return NULL;
+	}
+	*addr = xs->tx_free[--xs->num_tx_free];
+	return xsk_umem__get_data(xs->umem_area, *addr);
+}
+
+static void xdp_tx_kick(struct xdp_sock *xs) {
+	if (!xs->tx_pending)
+		return;
+	xs->tx_pending = 0;
+	if (!xsk_ring_prod__needs_wakeup(&xs->tx))
+		return;
+	sendto(xsk_socket__fd(xs->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+static void xdp_tx_submit(struct xdp_sock *xs, uint64_t addr, unsigned int len) {
+	uint32_t idx;
+
+	// there are never more TX frames than slots in the ring
+	if (xsk_ring_prod__reserve(&xs->tx, 1, &idx) != 1) {
+		xs->tx_free[xs->num_tx_free++] = addr & XDP_FRAME_MASK;
+		atomic64_inc(&xdp_stat_errors);
+		return;
+	}
+	struct xdp_desc *d = xsk_ring_prod__tx_desc(&xs->tx, idx);
+	d->addr = addr;
+	d->len = len;
+	xsk_ring_prod__submit(&xs->tx, 1);
+	xs->tx_pending++;
+	if (xs->tx_pending >= XDP_BATCH)
+		xdp_tx_kick(xs);
+}
+
+static int xdp_output_packet(struct xdp_sock *xs, struct xdp_output *o, const str *pkt,
+		bool is_rtp, int pt_idx, int ssrc_idx)
+{
+	uint64_t addr;
+	char *frame = xdp_tx_frame(xs, &addr);
+	if (!frame)
+		return -1;
+
+	if (XDP_HEADROOM + pkt->len + XDP_TAILROOM > XDP_FRAME_SIZE)
+		goto drop;
+
+	str s = STR_CONST_INIT_LEN(frame + XDP_HEADROOM, pkt->len);
+	memcpy(s.s, pkt->s, pkt->len);
+
+	if (is_rtp) {
+		struct rtp_header *rtp;
+		str payload;
+		if (rtp_payload(&rtp, &payload, &s))
+			goto drop;
+
+		// pattern rewriting
+		if (pt_idx >= 0 && o->info.pt_output[pt_idx].replace_pattern_len) {
+			const struct rtpengine_pt_output *po = &o->info.pt_output[pt_idx];
+			if (po->replace_pattern_len == 1)
+				memset(payload.s, po->replace_pattern[0], payload.len);
+			else {
+				for (size_t i = 0; i < payload.len; i += po->replace_pattern_len)
+					memcpy(payload.s + i, po->replace_pattern,
+							MIN(po->replace_pattern_len, payload.len - i));
+			}
+		}
+
+		if (o->info.ssrc_subst && ssrc_idx != -1 && o->info.ssrc_out[ssrc_idx])
+			rtp->ssrc = o->info.ssrc_out[ssrc_idx];
+
+		if (o->encrypt_active) {
+			uint64_t *index = &o->info.encrypt.last_index[ssrc_idx >= 0 ? ssrc_idx : 0];
+			if (rtp_avp2savp_index(&s, &o->encrypt, ntohl(rtp->ssrc), index))
+				goto drop;
+		}
+	}
+
+	bool ipv4 = o->dst.address.family->af == AF_INET;
+	char *ip = s.s - (ipv4 ? sizeof(struct iphdr) : sizeof(struct ip6_hdr)) - sizeof(struct udphdr);
+	size_t total_len = endpoint_packet_header((unsigned char *) ip, &o->src, &o->dst, s.len) + s.len;
+
+	if (ipv4) {
+		struct iphdr *iph = (void *) ip;
+		iph->tos = o->info.tos;
+		iph->check = xdp_csum_fold(xdp_csum_add(0, iph, sizeof(*iph)));
+	}
+	else {
+		struct ip6_hdr *ip6h = (void *) ip;
+		ip6h->ip6_flow = htonl(0x60000000 | ((uint32_t) o->info.tos << 20));
+		struct udphdr *uh = (void *) (ip6h + 1);
+		uint32_t sum = xdp_csum_add(0, &ip6h->ip6_src, 2 * sizeof(ip6h->ip6_src));
+		sum += htons(sizeof(*uh) + s.len);
+		sum += htons(IPPROTO_UDP);
+		sum = xdp_csum_add(sum, uh, sizeof(*uh) + s.len);
+		uh->check = xdp_csum_fold(sum);
+		if (!uh->check)
+			uh->check = 0xffff;
+	}
+
+	struct ether_header *eth = (void *) (ip - sizeof(*eth));
+	if (!xdp_lookup_neigh(&o->info.dst_addr, xs->intf->ifindex, eth->ether_dhost)) {
+		// no known next hop on this interface: let the kernel route it
+		int ret = xdp_raw_send(&o->info.dst_addr, ip, total_len);
+		xs->tx_free[xs->num_tx_free++] = addr;
+		if (ret)
+			return -1;
+		atomic64_inc(&xdp_stat_fallback);
+		return s.len;
+	}
+	memcpy(eth->ether_shost, xs->intf->mac, ETH_ALEN);
+	eth->ether_type = htons(o->dst.address.family->ethertype);
+
+	xdp_tx_submit(xs, addr + ((char *) eth - frame), total_len + sizeof(*eth));
+	atomic64_inc(&xdp_stat_packets);
+	return s.len;
+
+drop:
+	xs->tx_free[xs->num_tx_free++] = addr;
+	return -1;
+}
+
+static int xdp_pt_idx(struct xdp_target *t, const struct rtp_header *rtp) {
+	unsigned char pt = rtp->m_pt & 0x7f;
+	if (t->last_pt < t->info.num_payload_types && t->info.pt_input[t->last_pt].pt_num == pt)
+		return t->last_pt;
+	for (unsigned int i = 0; i < t->info.num_payload_types; i++) {
+		if (t->info.pt_input[i].pt_num == pt) {
+			t->last_pt = i;
+			return i;
+		}
+	}
+	return -1;
+}
+
+// same as in the kernel module
+static void xdp_rtp_stats(struct xdp_target *t, const struct rtp_header *rtp, size_t payload_len,
+		int pt_idx, int ssrc_idx)
+{
+	struct rtpengine_ssrc_stats *s = &t->ssrc_stats[ssrc_idx];
+	uint16_t seq = ntohs(rtp->seq_num);
+	uint32_t ts = ntohl(rtp->timestamp);
+
+	s->basic_stats.packets++;
+	s->basic_stats.bytes += payload_len;
+	s->timestamp = ts;
+
+	uint32_t last_seq = s->ext_seq;
+	uint32_t new_seq = last_seq;
+	uint16_t seq_diff = seq - (last_seq & 0xffff);
+	if (seq_diff == 0 || seq_diff >= 0xfeff)
+		; // old/dup seq - ignore
+	else if (seq_diff > 0x100) {
+		// reset seq and loss tracker
+		new_seq = seq;
+		s->ext_seq = seq;
+		s->lost_bits = -1;
+	}
+	else {
+		new_seq = (last_seq & 0xffff0000) | seq;
+		while (new_seq < last_seq) {
+			new_seq += 0x10000;
+			if ((new_seq & 0xffff0000) == 0) // ext seq wrapped
+				break;
+		}
+		seq_diff = new_seq - last_seq;
+		s->ext_seq = new_seq;
+
+		if (seq_diff >= sizeof(s->lost_bits) * 8) {
+			s->total_lost += sizeof(s->lost_bits) * 8;
+			s->lost_bits = -1;
+		}
+		else {
+			for (; seq_diff; seq_diff--) {
+				if ((s->lost_bits & 0x80000000) == 0)
+					s->total_lost++;
+				s->lost_bits <<= 1;
+			}
+		}
+	}
+
+	seq_diff = (new_seq & 0xffff) - seq;
+	if (seq_diff < sizeof(s->lost_bits) * 8)
+		s->lost_bits |= (1 << seq_diff);
+
+	if (pt_idx < 0)
+		return;
+
+	// jitter, RFC 3550 A.8
+	uint32_t clockrate = t->info.pt_input[pt_idx].clock_rate;
+	uint32_t transit = ((uint32_t) (g_get_real_time() / 1000 * clockrate) / 1000) - ts;
+	int32_t d = 0;
+	if (s->transit)
+		d = transit - s->transit;
+	s->transit = transit;
+	if (d < 0)
+		d = -d;
+	if (d < 100000)
+		s->jitter += d - ((s->jitter + 8) >> 4);
+}
+
+static bool xdp_is_stun(const str *s) {
+	if (s->len < 28 || (s->len & 0x3))
+		return false;
+	const uint32_t *u32 = (const void *) s->s;
+	if (u32[1] != htonl(0x2112A442UL)) // magic cookie
+		return false;
+	if ((u32[0] & htonl(0xc0000003UL)))
+		return false;
+	u32 = (const void *) (s->s + s->len - 8);
+	if (u32[0] != htonl(0x80280004UL)) // fingerprint attribute
+		return false;
+	return true;
+}
+
+// returns false if the packet should be handled by the daemon instead
+static bool xdp_target_packet(struct xdp_sock *xs, struct xdp_target *t, const struct re_address *src,
+		str *s, unsigned char tos)
+{
+	struct rtp_header *rtp = NULL;
+	str payload;
+	int ssrc_idx = -1;
+	int pt_idx = -2; // not RTP
+	bool ret = false;
+	size_t in_len = s->len;
+
+	mutex_lock(&t->lock);
+
+	if (!t->installed)
+		goto out;
+	if (t->info.stun && xdp_is_stun(s))
+		goto out;
+	if (t->info.src_mismatch != MSM_IGNORE && memcmp(&t->info.expected_src, src, sizeof(*src))) {
+		if (t->info.src_mismatch == MSM_PROPAGATE)
+			goto out;
+		t->stats_in.errors++;
+		ret = true; // drop
+		goto out;
+	}
+	if (t->info.dtls && s->len && (unsigned char) s->s[0] >= 20 && (unsigned char) s->s[0] <= 63)
+		goto out;
+	if (t->info.non_forwarding) {
+		if (!t->info.blackhole)
+			goto out;
+		ret = true;
+		goto stats;
+	}
+
+	if (t->info.rtp) {
+		if (t->info.rtcp_mux && s->len >= 8 && (unsigned char) s->s[1] >= 194
+				&& (unsigned char) s->s[1] <= 223)
+			goto out;
+		if (rtp_payload(&rtp, &payload, s)) {
+			rtp = NULL;
+			if (t->info.rtp_only)
+				goto out;
+		}
+	}
+
+	if (rtp) {
+		pt_idx = xdp_pt_idx(t, rtp);
+
+		if (t->info.track_ssrc) {
+			for (ssrc_idx = 0; ssrc_idx < RTPE_NUM_SSRC_TRACKING; ssrc_idx++) {
+				if (t->info.ssrc[ssrc_idx] == rtp->ssrc)
+					break;
+			}
+			if (ssrc_idx == RTPE_NUM_SSRC_TRACKING) {
+				// new SSRC, let the daemon resync
+				t->stats_in.errors++;
+				goto out;
+			}
+		}
+
+		if (t->info.pt_filter && pt_idx < 0)
+			goto out;
+
+		if (t->decrypt_active) {
+			uint64_t *index = &t->info.decrypt.last_index[ssrc_idx >= 0 ? ssrc_idx : 0];
+			if (rtp_savp2avp_index(s, &t->decrypt, ntohl(rtp->ssrc), index)) {
+				t->stats_in.errors++;
+				goto out;
+			}
+			// the frame has been decrypted in place and can't be handed to the
+			// daemon any more, which would try to decrypt it again
+			if (rtp_payload(&rtp, &payload, s)) {
+				t->stats_in.errors++;
+				ret = true; // drop
+				goto out;
+			}
+		}
+
+		if (t->info.rtp_stats && ssrc_idx != -1)
+			xdp_rtp_stats(t, rtp, payload.len, pt_idx, ssrc_idx);
+	}
+
+	ret = true;
+
+	for (unsigned int i = 0; i < t->info.num_destinations; i++) {
+		struct xdp_output *o = &t->outputs[i];
+		int len = xdp_output_packet(xs, o, s, rtp != NULL, pt_idx, ssrc_idx);
+		if (len < 0) {
+			t->stats_in.errors++;
+			o->stats.errors++;
+			atomic64_inc(&xdp_stat_errors);
+			continue;
+		}
+		o->stats.packets++;
+		o->stats.bytes += len;
+	}
+
+stats:
+	if (t->stats_in.packets == 0)
+		t->stats_in.tos = tos;
+	t->stats_in.packets++;
+	t->stats_in.bytes += in_len;
+	if (pt_idx >= 0) {
+		t->rtp_stats[pt_idx].packets++;
+		t->rtp_stats[pt_idx].bytes += in_len;
+	}
+	else if (pt_idx == -1)
+		t->stats_in.errors++;
+
+out:
+	mutex_unlock(&t->lock);
+	return ret;
+}
+
+static void xdp_handle_packet(struct xdp_sock *xs, char *pkt, unsigned int len) {
+	struct ether_header *eth = (void *) pkt;
+	char *ip = (char *) (eth + 1);
+	char *end = pkt + len;
+	struct re_address local, src;
+	struct udphdr *uh;
+	unsigned char tos;
+
+	if (len < sizeof(*eth))
+		goto error;
+
+	ZERO(local);
+	ZERO(src);
+
+	switch (ntohs(eth->ether_type)) {
+		case ETHERTYPE_IP: {
+			struct iphdr *iph = (void *) ip;
+			if (end < ip + sizeof(*iph))
+				goto error;
+			if (ip + ntohs(iph->tot_len) < end) // ethernet padding
+				end = ip + ntohs(iph->tot_len);
+			local.family = src.family = AF_INET;
+			local.u.ipv4 = iph->daddr;
+			src.u.ipv4 = iph->saddr;
+			tos = iph->tos;
+			uh = (void *) (iph + 1);
+			break;
+		}
+		case ETHERTYPE_IPV6: {
+			struct ip6_hdr *ip6h = (void *) ip;
+			if (end < ip + sizeof(*ip6h))
+				goto error;
+			if (ip + sizeof(*ip6h) + ntohs(ip6h->ip6_plen) < end)
+				end = ip + sizeof(*ip6h) + ntohs(ip6h->ip6_plen);
+			local.family = src.family = AF_INET6;
+			memcpy(local.u.ipv6, &ip6h->ip6_dst, sizeof(local.u.ipv6));
+			memcpy(src.u.ipv6, &ip6h->ip6_src, sizeof(src.u.ipv6));
+			tos = (ntohl(ip6h->ip6_flow) >> 20) & 0xff;
+			uh = (void *) (ip6h + 1);
+			break;
+		}
+		default:
+			goto error;
+	}
+
+	if (end < (char *) (uh + 1))
+		goto error;
+	local.port = ntohs(uh->dest);
+	src.port = ntohs(uh->source);
+
+	xdp_learn_neigh(xs, eth, &src);
+
+	struct xdp_target *t = g_hash_table_lookup(xdp_targets, &local);
+	str s = STR_CONST_INIT_LEN((char *) (uh + 1), end - (char *) (uh + 1));
+	if (t && xdp_target_packet(xs, t, &src, &s, tos))
+		return;
+
+	// removed in the meantime, or not something we can handle
+	xdp_to_userspace(&local, ip, end - ip);
+	return;
+
+error:
+	atomic64_inc(&xdp_stat_errors);
+}
+
+static unsigned int xdp_rx_batch(struct xdp_sock *xs) {
+	uint32_t idx_rx, idx_fq;
+	uint64_t addrs[XDP_BATCH];
+
+	unsigned int n = xsk_ring_cons__peek(&xs->rx, XDP_BATCH, &idx_rx);
+	if (!n) {
+		if (xsk_ring_prod__needs_wakeup(&xs->fill))
+			recvfrom(xsk_socket__fd(xs->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+		return 0;
+	}
+
+	rwlock_lock_r(&xdp_targets_lock);
+	for (unsigned int i = 0; i < n; i++) {
+		const struct xdp_desc *d = xsk_ring_cons__rx_desc(&xs->rx, idx_rx + i);
+		xdp_handle_packet(xs, xsk_umem__get_data(xs->umem_area, d->addr), d->len);
+		addrs[i] = d->addr & XDP_FRAME_MASK;
+	}
+	rwlock_unlock_r(&xdp_targets_lock);
+
+	xsk_ring_cons__release(&xs->rx, n);
+
+	// the fill ring has room for all RX frames, so this can't fail
+	if (xsk_ring_prod__reserve(&xs->fill, n, &idx_fq) == n) {
+		for (unsigned int i = 0; i < n; i++)
+			*xsk_ring_prod__fill_addr(&xs->fill, idx_fq + i) = addrs[i];
+		xsk_ring_prod__submit(&xs->fill, n);
+	}
+
+	return n;
+}
+
+static void xdp_loop(void *p) {
+	struct xdp_sock *xs = p;
+	struct pollfd pfd = { .fd = xsk_socket__fd(xs->xsk), .events = POLLIN };
+	unsigned int idle = 0;
+
+	ilog(LOG_DEBUG, "XDP thread for %s queue %u running", xs->intf->name, xs->queue);
+
+	while (!rtpe_shutdown) {
+		xdp_tx_complete(xs);
+		unsigned int n = xdp_rx_batch(xs);
+		xdp_tx_kick(xs);
+
+		if (n) {
+			idle = 0;
+			continue;
+		}
+		if (idle < XDP_IDLE_SPINS) {
+			idle++;
+			continue;
+		}
+		poll(&pfd, 1, 1);
+	}
+}
+
+
+
+static int xdp_intf_mac(struct xdp_intf *xi) {
+	struct ifreq ifr;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1)
+		return -1;
+	ZERO(ifr);
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", xi->name);
+	int ret = ioctl(fd, SIOCGIFHWADDR, &ifr);
+	close(fd);
+	if (ret)
+		return -1;
+	memcpy(xi->mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	return 0;
+}
+
+static struct xdp_intf *xdp_intf_open(const char *name) {
+	struct xdp_intf *xi = g_slice_alloc0(sizeof(*xi));
+	const char *err = NULL;
+	long lerr = 0;
+
+	g_queue_push_tail(&xdp_intfs, xi);
+
+	snprintf(xi->name, sizeof(xi->name), "%s", name);
+	xi->xsks_map_fd = -1;
+	xi->ifindex = if_nametoindex(name);
+	err = "unknown interface";
+	if (!xi->ifindex)
+		goto fail;
+	err = "failed to get MAC address";
+	if (xdp_intf_mac(xi))
+		goto fail;
+
+	xi->prog = xdp_program__open_file(rtpe_config.xdp_program, "xdp", NULL);
+	lerr = libxdp_get_error(xi->prog);
+	if (lerr) {
+		xi->prog = NULL;
+		err = "failed to open XDP program";
+		goto fail;
+	}
+
+	struct bpf_object *obj = xdp_program__bpf_obj(xi->prog);
+	if (xdp_targets_fd != -1) {
+		struct bpf_map *map = bpf_object__find_map_by_name(obj, "rtpe_targets");
+		err = "failed to share filter map";
+		if (!map || (lerr = bpf_map__reuse_fd(map, xdp_targets_fd)))
+			goto fail;
+	}
+
+	xi->mode = rtpe_config.xdp_generic ? XDP_MODE_SKB : XDP_MODE_NATIVE;
+	lerr = xdp_program__attach(xi->prog, xi->ifindex, xi->mode, 0);
+	err = "failed to attach XDP program";
+	if (lerr)
+		goto fail;
+	xi->attached = true;
+
+	if (xdp_targets_fd == -1)
+		xdp_targets_fd = bpf_object__find_map_fd_by_name(obj, "rtpe_targets");
+	xi->xsks_map_fd = bpf_object__find_map_fd_by_name(obj, "rtpe_xsks");
+	err = "BPF maps not found in XDP program";
+	if (xdp_targets_fd < 0 || xi->xsks_map_fd < 0)
+		goto fail;
+
+	return xi;
+
+fail:
+	ilog(LOG_ERR, "Failed to set up XDP on interface '%s': %s%s%s", name, err,
+			lerr ? ": " : "", lerr ? strerror(labs(lerr)) : "");
+	return NULL;
+}
+
+static struct xdp_sock *xdp_sock_open(struct xdp_intf *xi, unsigned int queue) {
+	struct xdp_sock *xs = g_slice_alloc0(sizeof(*xs));
+	const char *err;
+	int ret = 0;
+	uint32_t idx;
+
+	g_queue_push_tail(&xdp_socks, xs);
+
+	xs->intf = xi;
+	xs->queue = queue;
+
+	size_t size = (size_t) XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+	xs->umem_area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	err = "failed to allocate UMEM";
+	if (xs->umem_area == MAP_FAILED) {
+		xs->umem_area = NULL;
+		ret = -errno;
+		goto fail;
+	}
+
+	struct xsk_umem_config ucfg = {
+		.fill_size = XDP_RX_FRAMES,
+		.comp_size = XDP_TX_FRAMES,
+		.frame_size = XDP_FRAME_SIZE,
+		.frame_headroom = 0,
+	};
+	ret = xsk_umem__create(&xs->umem, xs->umem_area, size, &xs->fill, &xs->comp, &ucfg);
+	err = "failed to create UMEM";
+	if (ret)
+		goto fail;
+
+	struct xsk_socket_config scfg = {
+		.rx_size = XDP_RX_FRAMES,
+		.tx_size = XDP_TX_FRAMES,
+		.libxdp_flags = XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD,
+		.bind_flags = XDP_USE_NEED_WAKEUP | (rtpe_config.xdp_generic ? XDP_COPY : 0),
+	};
+	ret = xsk_socket__create(&xs->xsk, xi->name, queue, xs->umem, &xs->rx, &xs->tx, &scfg);
+	err = "failed to create AF_XDP socket";
+	if (ret)
+		goto fail;
+
+	ret = xsk_socket__update_xskmap(xs->xsk, xi->xsks_map_fd);
+	err = "failed to register AF_XDP socket";
+	if (ret)
+		goto fail;
+
+	ret = 0;
+	err = "failed to fill UMEM";
+	if (xsk_ring_prod__reserve(&xs->fill, XDP_RX_FRAMES, &idx) != XDP_RX_FRAMES)
+		goto fail;
+	for (unsigned int i = 0; i < XDP_RX_FRAMES; i++)
+		*xsk_ring_prod__fill_addr(&xs->fill, idx + i) = (uint64_t) i * XDP_FRAME_SIZE;
+	xsk_ring_prod__submit(&xs->fill, XDP_RX_FRAMES);
+
+	for (unsigned int i = 0; i < XDP_TX_FRAMES; i++)
+		xs->tx_free[i] = (uint64_t) (XDP_RX_FRAMES + i) * XDP_FRAME_SIZE;
+	xs->num_tx_free = XDP_TX_FRAMES;
+
+#ifdef SO_PREFER_BUSY_POLL
+	// best effort, requires NAPI busy polling to be configured on the interface
+	int fd = xsk_socket__fd(xs->xsk);
+	int opt = 1;
+	setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(opt));
+	opt = 20;
+	setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof(opt));
+	opt = XDP_BATCH;
+	setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &opt, sizeof(opt));
+#endif
+
+	return xs;
+
+fail:
+	ilog(LOG_ERR, "Failed to set up XDP on interface '%s' queue %u: %s%s%s", xi->name, queue, err,
+			ret ? ": " : "", ret ? strerror(-ret) : "");
+	return NULL;
+}
+
+int xdp_init(void) {
+	if (!rtpe_config.xdp_interfaces || !rtpe_config.xdp_interfaces[0])
+		return -1;
+
+	rwlock_init(&xdp_targets_lock);
+	rwlock_init(&xdp_neighs_lock);
+	xdp_targets = g_hash_table_new_full(xdp_re_address_hash, xdp_re_address_eq, NULL, xdp_target_free);
+	xdp_neighs = g_hash_table_new_full(xdp_re_address_hash, xdp_re_address_eq, NULL, xdp_neigh_free);
+
+	xdp_raw_fd[0] = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+	xdp_raw_fd[1] = socket(AF_INET6, SOCK_RAW, IPPROTO_RAW);
+	if (xdp_raw_fd[0] == -1 || xdp_raw_fd[1] == -1) {
+		ilog(LOG_ERR, "Failed to create raw sockets for XDP forwarding: %s", strerror(errno));
+		goto fail;
+	}
+#ifdef IPV6_HDRINCL
+	int opt = 1;
+	setsockopt(xdp_raw_fd[1], IPPROTO_IPV6, IPV6_HDRINCL, &opt, sizeof(opt));
+#endif
+
+	for (char **name = rtpe_config.xdp_interfaces; *name; name++) {
+		struct xdp_intf *xi = xdp_intf_open(*name);
+		if (!xi)
+			goto fail;
+		for (unsigned int q = 0; q < rtpe_config.xdp_queues; q++) {
+			if (!xdp_sock_open(xi, q))
+				goto fail;
+		}
+	}
+
+	ilog(LOG_INFO, "XDP forwarding enabled on %u interface(s) with %u queue(s) each",
+			xdp_intfs.length, rtpe_config.xdp_queues);
+	return 0;
+
+fail:
+	xdp_free();
+	return -1;
+}
+
+void xdp_start(void) {
+	for (GList *l = xdp_socks.head; l; l = l->next)
+		thread_create_detach_prio(xdp_loop, l->data, rtpe_config.scheduling, rtpe_config.priority, "XDP");
+}
+
+void xdp_free(void) {
+	struct xdp_sock *xs;
+	while ((xs = g_queue_pop_head(&xdp_socks))) {
+		if (xs->xsk)
+			xsk_socket__delete(xs->xsk);
+		if (xs->umem)
+			xsk_umem__delete(xs->umem);
+		if (xs->umem_area)
+			munmap(xs->umem_area, (size_t) XDP_NUM_FRAMES * XDP_FRAME_SIZE);
+		g_slice_free1(sizeof(*xs), xs);
+	}
+
+	struct xdp_intf *xi;
+	while ((xi = g_queue_pop_head(&xdp_intfs))) {
+		if (xi->attached)
+			xdp_program__detach(xi->prog, xi->ifindex, xi->mode, 0);
+		if (xi->prog)
+			xdp_program__close(xi->prog);
+		g_slice_free1(sizeof(*xi), xi);
+	}
+	xdp_targets_fd = -1;
+
+	for (unsigned int i = 0; i < G_N_ELEMENTS(xdp_raw_fd); i++) {
+		if (xdp_raw_fd[i] != -1)
+			close(xdp_raw_fd[i]);
+		xdp_raw_fd[i] = -1;
+	}
+
+	if (xdp_targets)
+		g_hash_table_destroy(xdp_targets);
+	xdp_targets = NULL;
+	if (xdp_neighs)
+		g_hash_table_destroy(xdp_neighs);
+	xdp_neighs = NULL;
+}
+
+void xdp_get_stats(struct xdp_stats *s) {
+	s->packets = atomic64_get(&xdp_stat_packets);
+	s->fallback = atomic64_get(&xdp_stat_fallback);
+	s->userspace = atomic64_get(&xdp_stat_userspace);
+	s->errors = atomic64_get(&xdp_stat_errors);
+}
+
+
+#else
+
+
+int xdp_init(void) {
+	ilog(LOG_ERR, "XDP support not compiled in");
+	return -1;
+}
+void xdp_start(void) {
+}
+void xdp_free(void) {
+}
+int xdp_add_stream(const struct rtpengine_target_info *ti) {
+	return -1;
+}
+int xdp_add_destination(const struct rtpengine_destination_info *di) {
+	return -1;
+}
+int xdp_del_stream(const struct re_address *a) {
+	return -1;
+}
+GList *xdp_list(void) {
+	return NULL;
+}
+int xdp_update_stats(const struct re_address *a, struct rtpengine_stats_info *out) {
+	return -1;
+}
+void xdp_get_stats(struct xdp_stats *s) {
+	ZERO(*s);
+}
+
+
+#endif
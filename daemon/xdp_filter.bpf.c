@@ -0,0 +1,98 @@
+// XDP program redirecting media packets for streams forwarded by the AF_XDP engine (xdp.c)
+// into the AF_XDP socket of the receiving queue. Everything else is passed to the stack.
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/in.h>
+#include <linux/udp.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+#include "xdp_filter.h"
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, XDP_FILTER_MAX_TARGETS);
+	__type(key, struct xdp_filter_key);
+	__type(value, struct xdp_filter_value);
+} rtpe_targets SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_XSKMAP);
+	__uint(max_entries, XDP_FILTER_MAX_QUEUES);
+	__type(key, __u32);
+	__type(value, __u32);
+} rtpe_xsks SEC(".maps");
+
+
+SEC("xdp")
+int rtpengine_xdp(struct xdp_md *ctx) {
+	void *data = (void *) (long) ctx->data;
+	void *data_end = (void *) (long) ctx->data_end;
+	struct xdp_filter_key key = {0,};
+	__u32 saddr[4] = {0,};
+	struct udphdr *uh;
+
+	struct ethhdr *eth = data;
+	if ((void *) (eth + 1) > data_end)
+		return XDP_PASS;
+
+	if (eth->h_proto == bpf_htons(ETH_P_IP)) {
+		struct iphdr *iph = (void *) (eth + 1);
+		if ((void *) (iph + 1) > data_end)
+			return XDP_PASS;
+		if (iph->ihl != 5 || iph->protocol != IPPROTO_UDP)
+			return XDP_PASS;
+		if (iph->frag_off & bpf_htons(0x3fff)) // fragmented
+			return XDP_PASS;
+		uh = (void *) (iph + 1);
+		key.family = 4;
+		key.addr[0] = iph->daddr;
+		saddr[0] = iph->saddr;
+	}
+	else if (eth->h_proto == bpf_htons(ETH_P_IPV6)) {
+		struct ipv6hdr *ip6h = (void *) (eth + 1);
+		if ((void *) (ip6h + 1) > data_end)
+			return XDP_PASS;
+		if (ip6h->nexthdr != IPPROTO_UDP)
+			return XDP_PASS;
+		uh = (void *) (ip6h + 1);
+		key.family = 6;
+		__builtin_memcpy(key.addr, &ip6h->daddr, sizeof(key.addr));
+		__builtin_memcpy(saddr, &ip6h->saddr, sizeof(saddr));
+	}
+	else
+		return XDP_PASS;
+
+	if ((void *) (uh + 1) > data_end)
+		return XDP_PASS;
+	key.port = uh->dest;
+
+	struct xdp_filter_value *v = bpf_map_lookup_elem(&rtpe_targets, &key);
+	if (!v)
+		return XDP_PASS;
+
+	if (v->src_check != XDPF_SRC_IGNORE) {
+		if (v->src_port != uh->source || v->src_addr[0] != saddr[0] || v->src_addr[1] != saddr[1]
+				|| v->src_addr[2] != saddr[2] || v->src_addr[3] != saddr[3])
+			return v->src_check == XDPF_SRC_DROP ? XDP_DROP : XDP_PASS;
+	}
+
+	if (v->flags & XDPF_RTP) {
+		unsigned char *rtp = (void *) (uh + 1);
+		if ((void *) (rtp + 12) > data_end)
+			return XDP_PASS;
+		if ((rtp[0] & 0xc0) != 0x80) // not RTP version 2
+			return XDP_PASS;
+		if ((v->flags & XDPF_RTCP_MUX) && rtp[1] >= 194 && rtp[1] <= 223) // RTCP (RFC 5761)
+			return XDP_PASS;
+		__u32 pt = rtp[1] & 0x7f;
+		if ((v->flags & XDPF_PT_FILTER) && !(v->pt_mask[pt >> 5] & (1U << (pt & 31))))
+			return XDP_PASS;
+	}
+
+	return bpf_redirect_map(&rtpe_xsks, ctx->rx_queue_index, XDP_PASS);
+}
+
+char _license[] SEC("license") = "GPL";
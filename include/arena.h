@@ -0,0 +1,51 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <glib.h>
+#include <stddef.h>
+#include "compat.h"
+
+/* Region allocator for objects that share a lifetime, such as everything
+ * belonging to one call. Small objects are carved out of larger chunks, with
+ * sizes rounded up to one of a set of size classes: 16-byte steps up to 256
+ * bytes, then four classes per power of two up to ARENA_MAX_CLASS. Freed objects
+ * go on a per-class list and are handed out again before the chunk is touched.
+ * Anything bigger is allocated individually. arena_destroy() releases
+ * everything at once, so freeing single objects is only needed to have their
+ * memory reused during the lifetime of the arena.
+ * Not locked, the owner must serialise access. */
+
+#define ARENA_ALIGN		16
+#define ARENA_CHUNK_SIZE	16384
+#define ARENA_MAX_CLASS		4096
+#define ARENA_CLASSES		32
+
+struct arena_chunk;
+struct arena_large;
+
+struct arena {
+	struct arena_chunk *chunks;
+	char *pos, *end; // unused part of the newest chunk
+	void *free[ARENA_CLASSES];
+	struct arena_large *large;
+	size_t size; // total memory held
+	size_t used; // handed out and not freed
+};
+
+
+void arena_init(struct arena *);
+void arena_destroy(struct arena *);
+void *arena_alloc(struct arena *, size_t);
+void *arena_alloc0(struct arena *, size_t);
+// the size must be the one given when allocating
+void arena_free(struct arena *, void *, size_t);
+
+
+INLINE size_t arena_size(const struct arena *a) {
+	return a->size;
+}
+INLINE size_t arena_used(const struct arena *a) {
+	return a->used;
+}
+
+#endif
@@ -582,6 +582,20 @@ INLINE double atomic64_div(const atomic64 *n, const atomic64 *d) {
 					- __mean * __mean))); \
 	}
 
+// number of power-of-two buckets for batch size histograms: 1, 2-3, 4-7, ... up to
+// MAX_MMSG_BATCH (64), which gets the last bucket to itself
+#define STATS_HIST_BUCKETS 7
+
+INLINE unsigned int stats_hist_bucket(uint64_t val) {
+	unsigned int idx = 0;
+	while (val > 1 && idx < STATS_HIST_BUCKETS - 1) {
+		val >>= 1;
+		idx++;
+	}
+	return idx;
+}
+#define STAT_HIST_ADD(hist, val) atomic64_inc(&(hist)[stats_hist_bucket(val)])
+
 
 
 /*** ALLOC WITH UNIQUE ID HELPERS ***/
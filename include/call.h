@@ -19,6 +19,7 @@
 #define MAX_RTP_PACKET_SIZE	8192
 #define RTP_BUFFER_HEAD_ROOM	128
 #define RTP_BUFFER_TAIL_ROOM	512
+#define CALLHASH_SHARD_BITS	6 // 64 shards
 #define RTP_BUFFER_SIZE		(MAX_RTP_PACKET_SIZE + RTP_BUFFER_HEAD_ROOM + RTP_BUFFER_TAIL_ROOM)
 
 #include "compat.h"
@@ -29,6 +30,7 @@
 #include "codeclib.h"
 #include "t38.h"
 #include "xt_RTPENGINE.h"
+#include "kernel.h"
 
 #define UNDEFINED ((unsigned int) -1)
 
@@ -78,7 +80,6 @@ enum call_stream_state {
 };
 enum {
 	CALL_ITERATOR_MAIN = 0,
-	CALL_ITERATOR_TIMER,
 	CALL_ITERATOR_GRAPHITE,
 	CALL_ITERATOR_MQTT,
 
@@ -230,12 +231,15 @@ enum block_dtmf_mode {
 #include "bencode.h"
 #include "crypto.h"
 #include "dtls.h"
+#include "sharded_hash.h"
+#include "arena.h"
 
 
 struct poller;
 struct control_stream;
 struct call;
 struct redis;
+struct redis_call_fields;
 struct crypto_suite;
 struct rtpengine_srtp;
 struct sdp_ng_flags;
@@ -255,10 +259,10 @@ struct mqtt_timer;
 struct janus_session;
 
 
-typedef bencode_buffer_t call_buffer_t;
-#define call_buffer_alloc bencode_buffer_alloc
-#define call_buffer_init bencode_buffer_init
-#define call_buffer_free bencode_buffer_free
+typedef struct arena call_buffer_t;
+#define call_buffer_alloc arena_alloc
+#define call_buffer_init arena_init
+#define call_buffer_free arena_destroy
 
 
 
@@ -364,12 +368,14 @@ struct packet_stream {
 				ssrc_out_idx;				/* LOCK: out_lock */
 	struct send_timer	*send_timer;				/* RO */
 	struct jitter_buffer	*jb;					/* RO */
+	struct media_fwd	*fwd;					/* RCU, LOCK: in_lock */
 	time_t kernel_time;
 
 	struct stream_stats	stats_in;
 	struct stream_stats	stats_out;
 	struct stream_stats	kernel_stats_in;
 	struct stream_stats	kernel_stats_out;
+	struct kernel_stats_ref	kernel_stats_ref;			/* LOCK: in_lock */
 	unsigned char		in_tos_tclass;
 	atomic64		last_packet;
 	GHashTable		*rtp_stats;				/* LOCK: call->master_lock */
@@ -548,6 +554,18 @@ struct call_iterator_entry {
 	mutex_t prev_lock; // held while the link is in use, protects link.prev
 };
 
+// the last run of call_timer(), apart from runs and max_duration_us
+struct call_timer_stats {
+	uint64_t runs;
+	uint64_t calls;
+	uint64_t kernel_entries;
+	uint64_t duration_us;
+	uint64_t max_duration_us;
+	uint64_t calls_us; // sweep over the calls
+	uint64_t kernel_us; // processing of kernel stats and the rest
+	uint64_t interval_us;
+};
+
 #define ITERATE_CALL_LIST_START(which, varname) \
 	do { \
 		int __which = (which); \
@@ -617,6 +635,9 @@ struct call {
 	 */
 	struct obj		obj;
 
+	/* Arena holding the call's strings and its monologues, medias, streams,
+	 * endpoint maps, sink handlers and subscriptions. Released in one go
+	 * when the call is freed. */
 	mutex_t			buffer_lock;
 	call_buffer_t		buffer;
 
@@ -655,12 +676,16 @@ struct call {
 	sockaddr_t		xmlrpc_callback;
 
 	unsigned int		redis_hosted_db;
+	struct redis_call_fields *redis_fields; // --redis-delta, protected by redis_fields_lock in redis.c
+	int			redis_resync; // atomic, set when the stored call may have been written by someone else
+	int			redis_deleted; // atomic, set by redis_delete(): no more writes
 
 	struct recording 	*recording;
 	str			metadata;
 
 	struct call_iterator_entry iterator[NUM_CALL_ITERATORS];
 	int			cpu_affinity;
+	struct poller		*poller;	// all sockets of the call go here, if set
 	enum block_dtmf_mode	block_dtmf;
 
 	bool			block_media;
@@ -685,12 +710,11 @@ struct call {
 
 /**
  * The main entry point into call objects for signalling events is the call-ID:
- * Therefore the main entry point is the global hash table rtpe_callhash (protected by rtpe_callhash_lock),
- * which uses call-IDs as keys and call objects as values,
+ * Therefore the main entry point is the global hash table rtpe_callhash (each shard protected by
+ * its own lock), which uses call-IDs as keys and call objects as values,
  * while holding a reference to each contained call.
  */
-extern rwlock_t rtpe_callhash_lock;
-extern GHashTable *rtpe_callhash;
+extern struct sharded_hash rtpe_callhash;
 extern struct call_iterator_list rtpe_call_iterators[NUM_CALL_ITERATORS];
 
 
@@ -747,6 +771,7 @@ int call_stream_address46(char *o, struct packet_stream *ps, enum stream_address
 
 void add_total_calls_duration_in_interval(struct timeval *interval_tv);
 void call_timer(void *ptr);
+void call_timer_get_stats(struct call_timer_stats *);
 
 void __rtp_stats_update(GHashTable *dst, struct codec_store *);
 int __init_stream(struct packet_stream *ps);
@@ -765,6 +790,34 @@ INLINE void *call_malloc(struct call *c, size_t l) {
 	return ret;
 }
 
+INLINE void *call_obj_alloc0(struct call *c, size_t l) {
+	void *ret;
+	mutex_lock(&c->buffer_lock);
+	ret = arena_alloc0(&c->buffer, l);
+	mutex_unlock(&c->buffer_lock);
+	return ret;
+}
+// the memory is kept for reuse by the same call
+INLINE void call_obj_free(struct call *c, void *p, size_t l) {
+	mutex_lock(&c->buffer_lock);
+	arena_free(&c->buffer, p, l);
+	mutex_unlock(&c->buffer_lock);
+}
+#define call_uid_alloc0(c, ptr, q) __call_uid_alloc0(c, sizeof(*(ptr)), q, \
+		G_STRUCT_OFFSET(__typeof__(*(ptr)), unique_id))
+INLINE void *__call_uid_alloc0(struct call *c, size_t size, GQueue *q, unsigned int offset) {
+	void *ret = call_obj_alloc0(c, size);
+	__uid_slice_alloc_fill(ret, q, offset);
+	return ret;
+}
+INLINE size_t call_memory(struct call *c) {
+	size_t ret;
+	mutex_lock(&c->buffer_lock);
+	ret = arena_size(&c->buffer);
+	mutex_unlock(&c->buffer_lock);
+	return ret;
+}
+
 INLINE char *call_strdup_len(struct call *c, const char *s, unsigned int len) {
 	char *r;
 	if (!s)
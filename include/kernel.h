@@ -28,18 +28,39 @@ struct kernel_interface {
 	int fd;
 	int is_open;
 	int is_wanted;
+	int is_xdp; // forwarding done by the AF_XDP engine (xdp.c) instead
+	const struct rtpengine_stats_slot *stats; // mmap'd stats region, or NULL
+	size_t stats_size;
+	unsigned int stats_num_slots;
 };
 extern struct kernel_interface kernel;
 
+// A stream's slot in the kernel's stats region, and what was last read from it, so that
+// kernel_update_stats() can return the difference like the kernel does with a reset.
+struct kernel_stats_ref {
+	unsigned int idx; // 0 if none
+	uint64_t packets[RTPE_NUM_SSRC_TRACKING];
+	uint64_t bytes[RTPE_NUM_SSRC_TRACKING];
+	uint32_t total_lost[RTPE_NUM_SSRC_TRACKING];
+};
+
 
 
 int kernel_setup_table(unsigned int);
+void kernel_shutdown_table(void);
+int kernel_setup_xdp(void);
 
 int kernel_add_stream(struct rtpengine_target_info *);
 int kernel_add_destination(struct rtpengine_destination_info *);
 int kernel_del_stream(const struct re_address *);
+int kernel_batch(struct rtpengine_message *, int *status, unsigned int num);
+void kernel_batch_begin(void);
+void kernel_batch_end(void);
+void kernel_queue_target(const struct rtpengine_target_info *, struct kernel_stats_ref *);
+void kernel_queue_destination(const struct rtpengine_destination_info *);
 GList *kernel_list(void);
-int kernel_update_stats(const struct re_address *a, struct rtpengine_stats_info *out);
+int kernel_update_stats(const struct re_address *a, struct kernel_stats_ref *,
+		struct rtpengine_stats_info *out);
 
 unsigned int kernel_add_call(const char *id);
 int kernel_del_call(unsigned int);
@@ -76,11 +76,20 @@ struct rtpengine_config {
 	int			redis_connect_timeout;
 	int			redis_delete_async;
 	int			redis_delete_async_interval;
+	int			redis_write_delay;
+	int			redis_write_queue;
+	enum {
+		REDIS_FORMAT_JSON = 0,
+		REDIS_FORMAT_BINARY,
+	}			redis_format;
+	int			redis_delta;
+	int			redis_snapshot_interval;
 	char			*redis_auth;
 	char			*redis_write_auth;
 	int			active_switchover;
 	int			num_threads;
 	int			media_num_threads;
+	int			timer_sweep_threads;
 	char			*spooldir;
 	char			*rec_method;
 	char			*rec_format;
@@ -134,6 +143,11 @@ struct rtpengine_config {
 	int			player_cache;
 	char			*software_id;
 	int			poller_per_thread;
+	int			poller_cpu_affinity;
+	enum {
+		POLLER_EPOLL = 0,
+		POLLER_IO_URING,
+	}			poller_method;
 	char			*mqtt_host;
 	int			mqtt_port;
 	char			*mqtt_tls_alpn;
@@ -162,6 +176,15 @@ struct rtpengine_config {
 	int			measure_rtp;
 	int			cpu_affinity;
 	char			*janus_secret;
+	int			recv_batch;
+	int			send_batch;
+	int			udp_gso;
+	int			media_fast_path;
+	int			buffer_pool;
+	char			**xdp_interfaces;
+	int			xdp_queues;
+	int			xdp_generic;
+	char			*xdp_program;
 };
 
 
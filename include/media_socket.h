@@ -12,6 +12,7 @@
 #include "crypto.h"
 #include "socket.h"
 #include "xt_RTPENGINE.h"
+#include "port_pool.h"
 
 
 
@@ -78,17 +79,6 @@ struct logical_intf {
 	GHashTable			*rr_specs;
 	str				name_base; // if name is "foo:bar", this is "foo"
 };
-struct port_pool {
-	BIT_ARRAY_DECLARE(ports_used, 0x10000);
-	volatile unsigned int		last_used;
-	volatile unsigned int		free_ports;
-
-	unsigned int			min, max;
-
-	mutex_t				free_list_lock;
-	GQueue				free_list;
-	BIT_ARRAY_DECLARE(free_list_used, 0x10000);
-};
 struct intf_address {
 	socktype_t			*type;
 	sockaddr_t			addr;
@@ -139,6 +129,11 @@ struct interface_sampled_rate_stats {
 	GHashTable *ht;
 	struct interface_stats_block intv;
 };
+struct socket_reaper_stats {
+	unsigned int queued;
+	uint64_t closed;
+	uint64_t batches;
+};
 INLINE void interface_sampled_calc_diff(const struct interface_sampled_stats *stats,
 		struct interface_sampled_stats *intv, struct interface_sampled_stats *diff)
 {
@@ -189,6 +184,7 @@ struct local_intf {
 	str				ice_foundation;
 
 	struct interface_stats_block	stats;
+	atomic64			send_batch_sizes[STATS_HIST_BUCKETS];
 };
 struct intf_list {
 	struct local_intf		*local_intf;
@@ -233,6 +229,7 @@ struct stream_fd {
 	struct dtls_connection		dtls;		/* LOCK: stream->in_lock */
 	int				error_strikes;
 	struct poller			*poller;
+	atomic64			send_batch_sizes[STATS_HIST_BUCKETS];
 };
 
 struct sink_attrs {
@@ -257,6 +254,7 @@ struct sink_handler {
 };
 struct media_packet {
 	str raw;
+	char *pktbuf; // receive buffer holding 'raw' if it came from pktbuf_alloc(), not a reference
 
 	endpoint_t fsin; // source address of received packet
 	struct timeval tv; // timestamp when packet was received
@@ -302,6 +300,8 @@ struct stream_fd *stream_fd_new(socket_t *fd, struct call *call, struct local_in
 struct stream_fd *stream_fd_lookup(const endpoint_t *);
 void stream_fd_release(struct stream_fd *);
 void release_closed_sockets(void);
+void socket_reaper_loop(void *);
+bool socket_reaper_get_stats(struct socket_reaper_stats *);
 
 void free_intf_list(struct intf_list *il);
 void free_release_intf_list(struct intf_list *il);
@@ -324,6 +324,10 @@ int __hunt_ssrc_ctx_idx(uint32_t ssrc, struct ssrc_ctx *list[RTPE_NUM_SSRC_TRACK
 struct ssrc_ctx *__hunt_ssrc_ctx(uint32_t ssrc, struct ssrc_ctx *list[RTPE_NUM_SSRC_TRACKING],
 		unsigned int start_idx);
 
+void media_socket_batch_begin(void);
+void media_socket_batch_end(void);
+void media_socket_sendto(struct stream_fd *, const str *, const endpoint_t *);
+
 void media_packet_copy(struct media_packet *, const struct media_packet *);
 void media_packet_release(struct media_packet *);
 int media_socket_dequeue(struct media_packet *mp, struct packet_stream *sink);
@@ -0,0 +1,30 @@
+#ifndef _PKTBUF_H_
+#define _PKTBUF_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Refcounted packet buffers, allocated from small per-thread free lists of
+ * fixed size classes. pktbuf_alloc() returns a buffer with one reference;
+ * pktbuf_hold() adds one and pktbuf_free() drops one, returning the buffer to
+ * the calling thread's cache once the last reference is gone. pktbuf_free()
+ * is suitable as a free function for anything holding such a buffer (e.g.
+ * codec_packet->free_func), as long as it's given the pointer that was
+ * returned by pktbuf_alloc(). */
+
+struct pktbuf_stats {
+	uint64_t hits; // allocations served from a thread cache
+	uint64_t misses; // allocations that had to go to the system allocator
+	uint64_t in_use; // buffers currently allocated
+	uint64_t high_water; // maximum of in_use
+};
+
+void *pktbuf_alloc(size_t len);
+void *pktbuf_hold(void *);
+void pktbuf_free(void *);
+bool pktbuf_shared(void *);
+
+void pktbuf_get_stats(struct pktbuf_stats *);
+
+#endif
@@ -25,15 +25,30 @@ struct poller_item {
 	poller_func_t			writeable;
 	poller_func_t			closed;
 	poller_func_t			timer;
+
+	/* datagram socket whose packets may be received by the poller ahead of the readable
+	 * callback (io_uring). they must be read through the socket_recv*() functions */
+	unsigned int			recv:1;
 };
 
 struct poller;
 struct poller_map;
 
+struct poller_load {
+	int				cpu;
+	int				numa_node;
+	unsigned int			calls;
+	unsigned int			sockets;
+};
+
 struct poller *poller_new(void);
 struct poller_map *poller_map_new(void);
 struct poller *poller_map_get(struct poller_map *);
 void poller_map_free(struct poller_map **);
+struct poller *poller_map_assign_call(struct poller_map *);
+GArray *poller_map_load(struct poller_map *);
+void poller_release_call(struct poller *);
+int poller_cpu(struct poller *);
 void poller_free(struct poller **);
 int poller_add_item(struct poller *, struct poller_item *);
 int poller_update_item(struct poller *, struct poller_item *);
@@ -0,0 +1,50 @@
+#ifndef _PORT_POOL_H_
+#define _PORT_POOL_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+#include "aux.h"
+
+/* Local port range of an interface. ports_used has a bit set for each port in
+ * use. Even ports whose pair (port and port + 1) is entirely free are queued in
+ * a ring, so that a pair for a new stream can be taken without searching the
+ * range, no matter how full it is. The ring starts out shuffled and released
+ * pairs go into a random place in its back half, so ports are handed out in an
+ * unpredictable order. The ring can hold stale pairs that were taken by other
+ * means in the meantime, which are skipped when they come up, so the number of
+ * free pairs is counted separately. */
+
+struct port_pool {
+	BIT_ARRAY_DECLARE(ports_used, 0x10000);
+	volatile unsigned int		last_used;
+	volatile unsigned int		free_ports;
+
+	unsigned int			min, max;
+
+	mutex_t				free_list_lock; // also serialises changes to ports_used
+	volatile unsigned int		free_pairs;
+	uint16_t			*free_list; // ring of even ports
+	unsigned int			free_list_size, free_list_head;
+	volatile unsigned int		free_list_len;
+	BIT_ARRAY_DECLARE(free_list_used, 0x10000);
+};
+
+
+void port_pool_init(struct port_pool *, unsigned int min, unsigned int max);
+void port_pool_cleanup(struct port_pool *);
+// marks the port as used, returns false if it already was
+bool port_pool_take(struct port_pool *, unsigned int port);
+void port_pool_put(struct port_pool *, unsigned int port);
+// marks a port as used for good, such as one taken by another service
+void port_pool_exclude(struct port_pool *, unsigned int port);
+// returns the even port of a free pair without taking it, or 0 if there is none
+unsigned int port_pool_get_pair(struct port_pool *);
+
+
+INLINE unsigned int port_pool_free_pairs(struct port_pool *pp) {
+	return g_atomic_int_get(&pp->free_pairs);
+}
+
+#endif
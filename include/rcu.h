@@ -0,0 +1,26 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+#include <glib.h>
+
+/* Minimal epoch-based reclamation. Readers bracket their accesses to published
+ * pointers with rcu_read_lock()/rcu_read_unlock(), which never block. Writers
+ * unpublish a pointer and hand the old object to rcu_call(), which runs the
+ * given destructor once no reader can still be referencing it. */
+
+struct poller;
+
+void rcu_init(void);
+void rcu_free(void);
+void rcu_timer(struct poller *);
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+void rcu_call(void (*)(void *), void *);
+void rcu_reclaim(void);
+
+#define rcu_dereference(p) g_atomic_pointer_get(&(p))
+#define rcu_assign_pointer(p, v) g_atomic_pointer_set(&(p), (v))
+
+#endif
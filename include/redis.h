@@ -14,6 +14,7 @@
 #include <hiredis/hiredis.h>
 #include "call.h"
 #include "str.h"
+#include "redis_doc.h"
 
 
 #define REDIS_RESTORE_NUM_THREADS 4
@@ -43,6 +44,7 @@ enum subscribe_action {
 };
 
 struct call;
+struct redis_call_fields;
 
 
 
@@ -62,6 +64,7 @@ struct redis {
 	int		consecutive_errors;
 	time_t	restore_tick;
 	int		current_db;
+	unsigned int	conn_id; // changes with every new connection
 
 	struct event_base        *async_ev;
 	struct redisAsyncContext *async_ctx;
@@ -70,8 +73,24 @@ struct redis {
 	int                       async_last;
 };
 
-struct redis_hash {
-	GHashTable *ht;
+struct redis_write_stats {
+	uint64_t pending; // calls waiting to be written
+	uint64_t high_water; // maximum of pending
+	uint64_t queued; // updates scheduled
+	uint64_t coalesced; // updates merged into an already scheduled one
+	uint64_t direct; // updates written by the caller because the queue was full
+	uint64_t written;
+	uint64_t errors;
+	uint64_t batches; // pipelines sent
+};
+
+struct redis_delta_stats {
+	uint64_t snapshots; // complete calls written
+	uint64_t updates; // calls written as changed sections only
+	uint64_t sections_written;
+	uint64_t sections_unchanged;
+	uint64_t sections_removed;
+	uint64_t bytes;
 };
 
 struct redis_list {
@@ -100,10 +119,12 @@ INLINE gboolean g_hash_table_insert_check(GHashTable *h, gpointer k, gpointer v)
 #endif
 
 
-#define rlog(l, x...) ilog(l | LOG_FLAG_RESTORE, x)
-
 void redis_notify_loop(void *d);
 void redis_delete_async_loop(void *d);
+void redis_write_loop(void *d);
+void redis_write_get_stats(struct redis_write_stats *);
+void redis_delta_get_stats(struct redis_delta_stats *);
+void redis_call_fields_free(struct redis_call_fields *);
 
 
 struct redis *redis_new(const endpoint_t *, int, const char *, enum redis_role, int);
@@ -0,0 +1,85 @@
+#ifndef _REDIS_DOC_H_
+#define _REDIS_DOC_H_
+
+#include <glib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <json-glib/json-glib.h>
+#include "str.h"
+#include "log.h"
+
+/* The call state document stored in Redis is a flat set of named sections
+ * (e.g. "sfd-3" or "rtp_sinks-7"), each of which is either an object of
+ * string values, an array of strings, or an array of such objects. It's
+ * stored either as JSON or in a compact binary encoding (see redis_doc.c).
+ * The reader detects which one it is given. */
+
+#define rlog(l, x...) ilog(l | LOG_FLAG_RESTORE, x)
+
+// id of a section without a numeric suffix
+#define REDIS_DOC_NO_ID UINT_MAX
+
+struct redis_hash {
+	GHashTable *ht;
+	str *vals; // binary format: values pointing into the document
+};
+
+struct redis_doc_writer {
+	bool binary;
+	bool error;
+	JsonBuilder *builder;
+	GString *buf;
+	unsigned int depth; // 1 within a section, 2 within an object in a list
+	bool array;
+	gsize count_pos[2]; // binary: where to fill in the number of members
+	unsigned int count[2];
+	GQueue *parts; // if set, each section is produced as a separate document
+	gsize part_start;
+	char part_name[128];
+};
+
+// one section of a call, as a document of its own
+struct redis_doc_part {
+	char *name;
+	char *data;
+	size_t len;
+};
+
+struct redis_doc {
+	JsonParser *parser;
+	JsonReader *reader;
+	GHashTable *sections; // binary: name -> section
+};
+
+
+void redis_doc_writer_init(struct redis_doc_writer *, bool binary);
+// id is REDIS_DOC_NO_ID for sections without a numeric suffix
+void redis_doc_begin_object(struct redis_doc_writer *, const char *name, unsigned int id);
+void redis_doc_begin_array(struct redis_doc_writer *, const char *name, unsigned int id);
+void redis_doc_begin_object_list(struct redis_doc_writer *, const char *name, unsigned int id);
+void redis_doc_end(struct redis_doc_writer *);
+// objects within an object list
+void redis_doc_begin_element(struct redis_doc_writer *);
+void redis_doc_end_element(struct redis_doc_writer *);
+void redis_doc_set(struct redis_doc_writer *, const char *key, const char *val, size_t len);
+void redis_doc_add(struct redis_doc_writer *, const char *val, size_t len);
+// returns g_malloc'd document, or NULL
+char *redis_doc_writer_finish(struct redis_doc_writer *, size_t *len);
+// sections are appended to the queue as struct redis_doc_part
+void redis_doc_writer_init_parts(struct redis_doc_writer *, bool binary, GQueue *parts);
+int redis_doc_writer_finish_parts(struct redis_doc_writer *);
+void redis_doc_part_free(void *);
+
+int redis_doc_load(struct redis_doc *, const char *data, size_t len);
+// merges documents produced by the parts writer, which must remain valid while the doc is used
+int redis_doc_load_parts(struct redis_doc *, const str *parts, unsigned int num);
+void redis_doc_free(struct redis_doc *);
+int redis_doc_get_hash(struct redis_doc *, struct redis_hash *out, const char *name, unsigned int id);
+void redis_doc_destroy_hash(struct redis_hash *);
+int redis_doc_get_list(struct redis_doc *, const char *name, unsigned int id,
+		int (*cb)(str *, void *), void *ptr);
+int redis_doc_get_object_list(struct redis_doc *, const char *name, unsigned int id,
+		int (*cb)(struct redis_hash *, void *), void *ptr);
+
+
+#endif
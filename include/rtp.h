@@ -5,6 +5,7 @@
 
 #include "str.h"
 #include <glib.h>
+#include <stdint.h>
 
 
 
@@ -23,6 +24,8 @@ const struct rtp_payload_type *rtp_payload_type(unsigned int, struct codec_store
 
 int rtp_avp2savp(str *, struct crypto_context *, struct ssrc_ctx *);
 int rtp_savp2avp(str *, struct crypto_context *, struct ssrc_ctx *);
+int rtp_avp2savp_index(str *, struct crypto_context *, uint32_t ssrc, uint64_t *srtp_index);
+int rtp_savp2avp_index(str *, struct crypto_context *, uint32_t ssrc, uint64_t *srtp_index);
 
 void rtp_append_mki(str *s, struct crypto_context *c);
 int srtp_payloads(str *to_auth, str *to_decrypt, str *auth_tag, str *mki,
@@ -0,0 +1,61 @@
+#ifndef _SHARDED_HASH_H_
+#define _SHARDED_HASH_H_
+
+#include <glib.h>
+#include <stdbool.h>
+#include "compat.h"
+#include "auxlib.h"
+
+/* A hash table split into 2^bits independently locked shards, so that
+ * lookups and changes of unrelated keys don't contend on a single lock. Users
+ * pick the shard of a key, lock it as required and use its table directly,
+ * but must go through the _nl functions to add and remove entries so that the
+ * total size is kept up to date. Iterating locks one shard at a time. */
+
+struct sharded_hash_shard {
+	rwlock_t lock;
+	GHashTable *ht;
+} __attribute__ ((aligned (64))); // separate cache lines
+
+struct sharded_hash {
+	struct sharded_hash_shard *shards;
+	unsigned int bits;
+	GHashFunc hash_func;
+	volatile gint size;
+};
+
+
+void sharded_hash_init(struct sharded_hash *, unsigned int bits, GHashFunc, GEqualFunc);
+void sharded_hash_destroy(struct sharded_hash *);
+// stops when the function returns false
+void sharded_hash_foreach(struct sharded_hash *, bool (*)(void *key, void *value, void *arg), void *arg);
+
+
+INLINE struct sharded_hash_shard *sharded_hash_shard(struct sharded_hash *h, const void *key) {
+	if (!h->bits)
+		return &h->shards[0];
+	// the table of the shard uses the low bits of the hash, so use the mixed high ones here
+	guint hv = h->hash_func(key) * 0x9e3779b1u;
+	return &h->shards[hv >> (32 - h->bits)];
+}
+// the key must not be present yet
+INLINE void sharded_hash_insert_nl(struct sharded_hash *h, struct sharded_hash_shard *sh, void *key,
+		void *value)
+{
+	g_hash_table_insert(sh->ht, key, value);
+	g_atomic_int_inc(&h->size);
+}
+INLINE bool sharded_hash_remove_nl(struct sharded_hash *h, struct sharded_hash_shard *sh, const void *key) {
+	if (!g_hash_table_remove(sh->ht, key))
+		return false;
+	g_atomic_int_add(&h->size, -1);
+	return true;
+}
+INLINE unsigned int sharded_hash_num_shards(struct sharded_hash *h) {
+	return 1u << h->bits;
+}
+INLINE unsigned int sharded_hash_size(struct sharded_hash *h) {
+	return g_atomic_int_get(&h->size);
+}
+
+#endif
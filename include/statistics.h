@@ -186,6 +186,7 @@ extern struct global_stats_counter rtpe_stats_rate;		// per-second, calculated o
 
 #define RTPE_STATS_ADD(field, num) atomic64_add(&rtpe_stats.field, num)
 #define RTPE_STATS_INC(field) RTPE_STATS_ADD(field, 1)
+#define RTPE_STATS_HIST(field, val) RTPE_STATS_INC(field[stats_hist_bucket(val)])
 
 
 
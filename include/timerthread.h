@@ -5,12 +5,35 @@
 #include <glib.h>
 #include <sys/time.h>
 #include "auxlib.h"
+#include "aux.h"
+#include "timerwheel.h"
 
 
-struct timerthread {
-	GTree *tree;
+// run time minus scheduled time, buckets up to 100 us, 250 us, ... 100 ms, more
+#define TIMERTHREAD_LAG_BUCKETS 10
+// how late an object must be for another thread to take it
+#define TIMERTHREAD_STEAL_LAG 2000 // us
+
+struct timerthread;
+struct call;
+
+// one per thread running the timerthread, each with its own objects
+struct timerthread_thread {
+	struct timerthread *tt;
+	unsigned int idx;
+	struct timerwheel wheel;
 	mutex_t lock;
 	cond_t cond;
+	atomic64 lag[TIMERTHREAD_LAG_BUCKETS];
+	atomic64 lag_sum; // us
+	atomic64 steals; // objects run by another thread
+};
+
+struct timerthread {
+	const char *name;
+	unsigned int num_threads;
+	struct timerthread_thread *threads;
+	unsigned int next_thread; // for objects without a call
 	void (*func)(void *);
 };
 
@@ -18,8 +41,19 @@ struct timerthread_obj {
 	struct obj obj;
 
 	struct timerthread *tt;
-	struct timeval next_check; /* protected by ->lock */
+	struct timerthread_thread *thread; /* set by timerthread_obj_bind() */
+	struct timeval next_check; /* protected by thread->lock */
 	struct timeval last_run; /* ditto */
+	struct timerwheel_entry tw_entry; /* ditto */
+};
+
+struct timerthread_stats {
+	const char *name;
+	unsigned int idx;
+	unsigned int pending;
+	uint64_t lag[TIMERTHREAD_LAG_BUCKETS];
+	uint64_t lag_sum;
+	uint64_t steals;
 };
 
 struct timerthread_queue {
@@ -41,9 +75,12 @@ struct timerthread_queue_entry {
 };
 
 
-void timerthread_init(struct timerthread *, void (*)(void *));
+void timerthread_init(struct timerthread *, const char *name, unsigned int num_threads, void (*)(void *));
 void timerthread_free(struct timerthread *);
-void timerthread_run(void *);
+void timerthread_run(struct timerthread *, unsigned int idx);
+// binds the object to the thread its call lives on, or round-robin if there's no call
+void timerthread_obj_bind(struct timerthread_obj *, struct timerthread *, struct call *);
+GArray *timerthread_get_stats(void); // of struct timerthread_stats
 
 void timerthread_obj_schedule_abs_nl(struct timerthread_obj *, const struct timeval *);
 void timerthread_obj_deschedule(struct timerthread_obj *);
@@ -51,7 +88,7 @@ void timerthread_obj_deschedule(struct timerthread_obj *);
 // run_now_func = called if newly inserted object can be processed immediately by timerthread_queue_push within its calling context
 // run_later_func = called from the separate timer thread
 void *timerthread_queue_new(const char *type, size_t size,
-		struct timerthread *tt,
+		struct timerthread *tt, struct call *,
 		void (*run_now_func)(struct timerthread_queue *, void *),
 		void (*run_later_func)(struct timerthread_queue *, void *), // optional
 		void (*free_func)(void *),
@@ -64,9 +101,9 @@ unsigned int timerthread_queue_flush(struct timerthread_queue *, void *);
 INLINE void timerthread_obj_schedule_abs(struct timerthread_obj *tt_obj, const struct timeval *tv) {
 	if (!tt_obj)
 		return;
-	mutex_lock(&tt_obj->tt->lock);
+	mutex_lock(&tt_obj->thread->lock);
 	timerthread_obj_schedule_abs_nl(tt_obj, tv);
-	mutex_unlock(&tt_obj->tt->lock);
+	mutex_unlock(&tt_obj->thread->lock);
 }
 
 
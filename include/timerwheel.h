@@ -0,0 +1,49 @@
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <glib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "compat.h"
+
+/* Hierarchical timing wheel with millisecond ticks. Entries are placed into a
+ * slot of the finest level that covers their expiry and move down a level
+ * ("cascade") when the wheel gets close enough, so that adding and removing
+ * entries is O(1) and expiring them is amortised O(1). Expiry is exact to the
+ * microsecond: entries of the current tick that aren't due yet stay put.
+ * Not locked, the owner must serialise access. Times are in microseconds. */
+
+#define TIMERWHEEL_TICK		1000 // us
+#define TIMERWHEEL_BITS		6
+#define TIMERWHEEL_SLOTS	(1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS	4 // 64 ms, 4 s, 4.4 min, 4.7 h, then an overflow list
+
+struct timerwheel_entry {
+	struct timerwheel_entry *next, **pprev; // pprev is NULL when not in a wheel
+	long long when;
+	unsigned int slot;
+};
+
+struct timerwheel {
+	long long tick; // everything before this has been expired
+	uint64_t occupied[TIMERWHEEL_LEVELS]; // bitmaps of non-empty slots
+	struct timerwheel_entry *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+	struct timerwheel_entry *overflow;
+	unsigned int count;
+};
+
+
+void timerwheel_init(struct timerwheel *, long long now);
+void timerwheel_add(struct timerwheel *, struct timerwheel_entry *, long long when);
+void timerwheel_del(struct timerwheel *, struct timerwheel_entry *);
+// removes and returns an entry due at `now`, earliest first. Otherwise returns NULL
+// and sets `next` to when there may be one, or -1 if the wheel is empty.
+struct timerwheel_entry *timerwheel_expire(struct timerwheel *, long long now, long long *next);
+// removes all entries, calling the function for each
+void timerwheel_clear(struct timerwheel *, void (*)(struct timerwheel_entry *));
+
+INLINE bool timerwheel_pending(const struct timerwheel_entry *e) {
+	return e->pprev != NULL;
+}
+
+#endif
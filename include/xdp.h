@@ -0,0 +1,36 @@
+#ifndef _XDP_H_
+#define _XDP_H_
+
+#include <glib.h>
+#include <stdint.h>
+
+/* AF_XDP based forwarding engine, used in place of the kernel module if
+ * --xdp-interface is given and the kernel module is not available. It
+ * implements the same operations as the kernel interface (kernel.c) on the
+ * same structures, and is driven through it. */
+
+struct rtpengine_target_info;
+struct rtpengine_destination_info;
+struct rtpengine_stats_info;
+struct re_address;
+
+struct xdp_stats {
+	uint64_t packets; // forwarded through AF_XDP sockets
+	uint64_t fallback; // forwarded through the kernel stack (no known next hop)
+	uint64_t userspace; // handed back to the daemon's own sockets
+	uint64_t errors; // dropped
+};
+
+int xdp_init(void);
+void xdp_start(void);
+void xdp_free(void);
+
+int xdp_add_stream(const struct rtpengine_target_info *);
+int xdp_add_destination(const struct rtpengine_destination_info *);
+int xdp_del_stream(const struct re_address *);
+GList *xdp_list(void);
+int xdp_update_stats(const struct re_address *, struct rtpengine_stats_info *);
+
+void xdp_get_stats(struct xdp_stats *);
+
+#endif
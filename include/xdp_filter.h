@@ -0,0 +1,35 @@
+#ifndef _XDP_FILTER_H_
+#define _XDP_FILTER_H_
+
+/* Shared between the daemon (xdp.c) and the XDP program (xdp_filter.bpf.c).
+ * Only fixed-size types, as this is also compiled for the BPF target. */
+
+#define XDP_FILTER_MAX_TARGETS	65536
+#define XDP_FILTER_MAX_QUEUES	64
+
+// xdp_filter_value.flags
+#define XDPF_RTP		0x01 // pass anything not looking like RTP (STUN, DTLS, RTCP) to the stack
+#define XDPF_PT_FILTER		0x02 // pass payload types not set in pt_mask to the stack
+#define XDPF_RTCP_MUX		0x04 // pass muxed RTCP to the stack
+
+// xdp_filter_value.src_check
+#define XDPF_SRC_IGNORE		0
+#define XDPF_SRC_DROP		1
+#define XDPF_SRC_PASS		2
+
+struct xdp_filter_key {
+	__u32 addr[4]; // network byte order, IPv4 in addr[0]
+	__u16 port; // network byte order
+	__u8 family; // 4 or 6
+	__u8 pad;
+};
+
+struct xdp_filter_value {
+	__u32 src_addr[4];
+	__u16 src_port;
+	__u8 src_check;
+	__u8 flags;
+	__u32 pt_mask[4];
+};
+
+#endif
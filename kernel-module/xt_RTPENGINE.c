@@ -16,6 +16,9 @@
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,25)
 #include <crypto/aead.h>
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+#include <crypto/skcipher.h>
+#endif
 #include <net/icmp.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
@@ -33,7 +36,13 @@
 #include <linux/netfilter_ipv6.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/crc32.h>
+#include <linux/rcupdate.h>
 #include <linux/math64.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
 #ifndef __RE_EXTERNAL
 #include <linux/netfilter/xt_RTPENGINE.h>
 #else
@@ -52,6 +61,11 @@ MODULE_IMPORT_NS(CRYPTO_INTERNAL);
 #define RHEL_RELEASE_VERSION(x,y) 0
 #endif
 
+#ifndef READ_ONCE
+#define READ_ONCE(x) ACCESS_ONCE(x)
+#define WRITE_ONCE(x, v) (ACCESS_ONCE(x) = (v))
+#endif
+
 
 
 
@@ -176,6 +190,7 @@ struct re_call;
 struct re_stream;
 struct rtpengine_table;
 struct crypto_aead;
+struct crypto_sync_skcipher;
 
 
 
@@ -207,6 +222,14 @@ static bool log_errors = 0;
 module_param(log_errors, bool, 0);
 MODULE_PARM_DESC(log_errors, "generate kernel log lines from forwarding errors");
 
+static uint stats_slots = 65536;
+module_param(stats_slots, uint, 0);
+MODULE_PARM_DESC(stats_slots, "number of target slots in the shared memory stats region of each table");
+
+static uint hash_bits = 8;
+module_param(hash_bits, uint, 0);
+MODULE_PARM_DESC(hash_bits, "size of the call and stream hashes of each table, as a power of two");
+
 
 
 #define log_err(fmt, ...) do { if (log_errors) printk(KERN_NOTICE "rtpengine[%s:%i]: " fmt, \
@@ -240,6 +263,8 @@ static int proc_blist_open(struct inode *, struct file *);
 static int proc_blist_close(struct inode *, struct file *);
 static ssize_t proc_blist_read(struct file *, char __user *, size_t, loff_t *);
 
+static int proc_stats_mmap(struct file *, struct vm_area_struct *);
+
 static int proc_main_list_open(struct inode *, struct file *);
 
 static void *proc_main_list_start(struct seq_file *, loff_t *);
@@ -251,10 +276,12 @@ static int proc_stream_open(struct inode *i, struct file *f);
 static int proc_stream_close(struct inode *i, struct file *f);
 static ssize_t proc_stream_read(struct file *f, char __user *b, size_t l, loff_t *o);
 static unsigned int proc_stream_poll(struct file *f, struct poll_table_struct *p);
+static int proc_stream_mmap(struct file *f, struct vm_area_struct *vma);
 
 static void table_put(struct rtpengine_table *);
 static struct rtpengine_target *get_target(struct rtpengine_table *, const struct re_address *);
 static int is_valid_address(const struct re_address *rea);
+static unsigned int re_address_hash(const struct re_address *a);
 
 static int aes_f8_session_key_init(struct re_crypto_context *, struct rtpengine_srtp *);
 static int srtp_encrypt_aes_cm(struct re_crypto_context *, struct rtpengine_srtp *,
@@ -285,6 +312,7 @@ struct re_crypto_context {
 	unsigned char			session_auth_key[20];
 	uint32_t			roc[RTPE_NUM_SSRC_TRACKING];
 	struct crypto_cipher		*tfm[2];
+	struct crypto_sync_skcipher	*skcipher; /* whole-payload AES-CM, NULL to use tfm[0] */
 	struct crypto_shash		*shash;
 	struct crypto_aead		*aead;
 	const struct re_cipher		*cipher;
@@ -292,22 +320,27 @@ struct re_crypto_context {
 };
 
 struct rtpengine_stats_a {
-	atomic64_t			packets;
-	atomic64_t			bytes;
-	atomic64_t			errors;
 	uint64_t			delay_min;
 	uint64_t			delay_avg;
 	uint64_t			delay_max;
-	atomic_t			tos;
+	atomic_t			tos; /* of the first packet, -1 before */
+};
+/* counters are kept per CPU so that packets of one target arriving on several CPUs don't
+ * contend for them, and are summed up when read */
+struct rtpengine_stats_pcpu {
+	struct u64_stats_sync		syncp;
+	uint64_t			packets;
+	uint64_t			bytes;
+	uint64_t			errors;
 };
-struct rtpengine_rtp_stats_a {
-	atomic64_t			packets;
-	atomic64_t			bytes;
+struct rtpengine_target_pcpu {
+	struct rtpengine_stats_pcpu	in;
+	struct rtpengine_rtp_stats	rtp[]; /* same index as pt_input, covered by in.syncp */
 };
 struct rtpengine_output {
 	struct rtpengine_output_info	output;
 	struct re_crypto_context	encrypt;
-	struct rtpengine_stats_a	stats_out;
+	struct rtpengine_stats_pcpu __percpu *stats_out;
 };
 struct rtpengine_target {
 	atomic_t			refcnt;
@@ -316,15 +349,19 @@ struct rtpengine_target {
 	unsigned int			last_pt; // index into pt_input[] and pt_output[]
 
 	struct rtpengine_stats_a	stats_in;
-	struct rtpengine_rtp_stats_a	rtp_stats[RTPE_NUM_PAYLOAD_TYPES];
+	struct rtpengine_target_pcpu __percpu *stats; /* stats_in counters and rtp_stats */
 	spinlock_t			ssrc_stats_lock;
 	struct rtpengine_ssrc_stats	ssrc_stats[RTPE_NUM_SSRC_TRACKING];
+	struct rtpengine_stats_slot	*stats_slot; /* mirrors ssrc_stats, protected by ssrc_stats_lock */
+	struct rtpengine_table		*stats_table; /* no reference, the table outlives its targets */
 
 	struct re_crypto_context	decrypt;
 
 	rwlock_t			outputs_lock;
 	struct rtpengine_output		*outputs;
 	unsigned int			outputs_unfilled; // only ever decreases
+
+	struct rcu_head			rcu;
 };
 
 struct re_bitfield {
@@ -332,9 +369,12 @@ struct re_bitfield {
 	unsigned int			used;
 };
 
+/* The hash is read under RCU, and modified under the table's target_lock. Buckets and
+ * targets are freed after a grace period, a re_dest_addr only with the table. */
 struct re_bucket {
 	struct re_bitfield		ports_lo_bf;
 	struct rtpengine_target		*ports_lo[256];
+	struct rcu_head			rcu;
 };
 
 struct re_dest_addr {
@@ -400,12 +440,18 @@ struct re_stream {
 	wait_queue_head_t		read_wq;
 	wait_queue_head_t		close_wq;
 	int				eof; /* protected by packet_list_lock */
+
+	/* set up by mmap, protected by packet_list_lock. the reader can write to the
+	 * ring, so the kernel keeps its own copies of head and size */
+	struct rtpengine_stream_ring	*ring;
+	uint32_t			ring_head;
+	uint32_t			ring_size;
 };
 
-#define RE_HASH_BITS 8 /* make configurable? */
+#define RE_HASH_BITS_MAX 20
 struct rtpengine_table {
 	atomic_t			refcnt;
-	rwlock_t			target_lock;
+	spinlock_t			target_lock; /* writers of dest_addr_hash */
 	pid_t				pid;
 
 	unsigned int			id;
@@ -414,24 +460,33 @@ struct rtpengine_table {
 	struct proc_dir_entry		*proc_control;
 	struct proc_dir_entry		*proc_list;
 	struct proc_dir_entry		*proc_blist;
+	struct proc_dir_entry		*proc_stats;
 	struct proc_dir_entry		*proc_calls;
 
 	struct re_dest_addr_hash	dest_addr_hash;
 
 	unsigned int			num_targets;
 
+	struct rtpengine_stats_slot	*stats; /* NULL if not available, [0] is the header */
+	unsigned int			stats_num_slots;
+	spinlock_t			stats_lock;
+	unsigned long			*stats_used; /* bitfield of slots, protected by stats_lock */
+
 	struct list_head		calls; /* protected by calls.lock */
 
-	spinlock_t			calls_hash_lock[1 << RE_HASH_BITS];
-	struct hlist_head		calls_hash[1 << RE_HASH_BITS];
-	spinlock_t			streams_hash_lock[1 << RE_HASH_BITS];
-	struct hlist_head		streams_hash[1 << RE_HASH_BITS];
+	/* 1 << hash_bits buckets each, fixed for the lifetime of the table */
+	u32				hash_mask;
+	spinlock_t			*calls_hash_lock;
+	struct hlist_head		*calls_hash;
+	spinlock_t			*streams_hash_lock;
+	struct hlist_head		*streams_hash;
 };
 
 struct re_cipher {
 	enum rtpengine_cipher		id;
 	const char			*name;
 	const char			*tfm_name;
+	const char			*skcipher_name;
 	const char			*aead_name;
 	int				(*decrypt)(struct re_crypto_context *, struct rtpengine_srtp *,
 			struct rtp_parsed *, uint64_t *);
@@ -500,6 +555,7 @@ static struct re_auto_array streams;
 #  define PROC_RELEASE release
 #  define PROC_LSEEK llseek
 #  define PROC_POLL poll
+#  define PROC_MMAP mmap
 #else
 #  define PROC_OP_STRUCT proc_ops
 #  define PROC_OWNER
@@ -509,6 +565,7 @@ static struct re_auto_array streams;
 #  define PROC_RELEASE proc_release
 #  define PROC_LSEEK proc_lseek
 #  define PROC_POLL proc_poll
+#  define PROC_MMAP proc_mmap
 #endif
 
 static const struct PROC_OP_STRUCT proc_control_ops = {
@@ -548,6 +605,13 @@ static const struct PROC_OP_STRUCT proc_blist_ops = {
 	.PROC_RELEASE		= proc_blist_close,
 };
 
+static const struct PROC_OP_STRUCT proc_stats_ops = {
+	PROC_OWNER
+	.PROC_OPEN		= proc_generic_open_modref,
+	.PROC_MMAP		= proc_stats_mmap,
+	.PROC_RELEASE		= proc_generic_close_modref,
+};
+
 static const struct seq_operations proc_list_seq_ops = {
 	.start			= proc_list_start,
 	.next			= proc_list_next,
@@ -574,6 +638,7 @@ static const struct PROC_OP_STRUCT proc_stream_ops = {
 	PROC_OWNER
 	.PROC_READ		= proc_stream_read,
 	.PROC_POLL		= proc_stream_poll,
+	.PROC_MMAP		= proc_stream_mmap,
 	.PROC_OPEN		= proc_stream_open,
 	.PROC_RELEASE		= proc_stream_close,
 };
@@ -591,6 +656,7 @@ static const struct re_cipher re_ciphers[] = {
 		.id		= REC_AES_CM_128,
 		.name		= "AES-CM-128",
 		.tfm_name	= "aes",
+		.skcipher_name	= "ctr(aes)",
 		.decrypt	= srtp_encrypt_aes_cm,
 		.encrypt	= srtp_encrypt_aes_cm,
 	},
@@ -606,6 +672,7 @@ static const struct re_cipher re_ciphers[] = {
 		.id		= REC_AES_CM_192,
 		.name		= "AES-CM-192",
 		.tfm_name	= "aes",
+		.skcipher_name	= "ctr(aes)",
 		.decrypt	= srtp_encrypt_aes_cm,
 		.encrypt	= srtp_encrypt_aes_cm,
 	},
@@ -613,6 +680,7 @@ static const struct re_cipher re_ciphers[] = {
 		.id		= REC_AES_CM_256,
 		.name		= "AES-CM-256",
 		.tfm_name	= "aes",
+		.skcipher_name	= "ctr(aes)",
 		.decrypt	= srtp_encrypt_aes_cm,
 		.encrypt	= srtp_encrypt_aes_cm,
 	},
@@ -707,6 +775,47 @@ static void auto_array_free(struct re_auto_array *a) {
 		pop_free_list_entry(a);
 }
 
+/* the table can do without, userspace then falls back to REMG_GET_RESET_STATS */
+static void table_stats_init(struct rtpengine_table *t) {
+	struct rtpengine_stats_header *h;
+
+	spin_lock_init(&t->stats_lock);
+
+	BUILD_BUG_ON(sizeof(*h) > sizeof(*t->stats));
+	if (stats_slots < 2 || stats_slots > (1 << 22))
+		return;
+
+	t->stats = vmalloc_user(stats_slots * sizeof(*t->stats));
+	t->stats_used = kcalloc(BITS_TO_LONGS(stats_slots), sizeof(unsigned long), GFP_KERNEL);
+	if (!t->stats || !t->stats_used) {
+		printk(KERN_WARNING "xt_RTPENGINE failed to allocate stats region\n");
+		if (t->stats)
+			vfree(t->stats);
+		if (t->stats_used)
+			kfree(t->stats_used);
+		t->stats = NULL;
+		t->stats_used = NULL;
+		return;
+	}
+
+	t->stats_num_slots = stats_slots;
+	__set_bit(0, t->stats_used);
+	h = (void *) &t->stats[0];
+	h->slot_size = sizeof(*t->stats);
+	h->num_slots = stats_slots;
+}
+
+static void table_hashes_free(struct rtpengine_table *t) {
+	if (t->calls_hash_lock)
+		vfree(t->calls_hash_lock);
+	if (t->calls_hash)
+		vfree(t->calls_hash);
+	if (t->streams_hash_lock)
+		vfree(t->streams_hash_lock);
+	if (t->streams_hash)
+		vfree(t->streams_hash);
+}
+
 static struct rtpengine_table *new_table(void) {
 	struct rtpengine_table *t;
 	unsigned int i;
@@ -723,20 +832,34 @@ static struct rtpengine_table *new_table(void) {
 	}
 
 	atomic_set(&t->refcnt, 1);
-	rwlock_init(&t->target_lock);
+	spin_lock_init(&t->target_lock);
 	INIT_LIST_HEAD(&t->calls);
 	t->id = -1;
 
-	for (i = 0; i < ARRAY_SIZE(t->calls_hash); i++) {
+	t->hash_mask = (1U << hash_bits) - 1;
+	t->calls_hash_lock = vmalloc(sizeof(*t->calls_hash_lock) << hash_bits);
+	t->calls_hash = vmalloc(sizeof(*t->calls_hash) << hash_bits);
+	t->streams_hash_lock = vmalloc(sizeof(*t->streams_hash_lock) << hash_bits);
+	t->streams_hash = vmalloc(sizeof(*t->streams_hash) << hash_bits);
+	if (!t->calls_hash_lock || !t->calls_hash || !t->streams_hash_lock || !t->streams_hash)
+		goto fail;
+
+	for (i = 0; i <= t->hash_mask; i++) {
 		INIT_HLIST_HEAD(&t->calls_hash[i]);
 		spin_lock_init(&t->calls_hash_lock[i]);
-	}
-	for (i = 0; i < ARRAY_SIZE(t->streams_hash); i++) {
 		INIT_HLIST_HEAD(&t->streams_hash[i]);
 		spin_lock_init(&t->streams_hash_lock[i]);
 	}
 
+	table_stats_init(t);
+
 	return t;
+
+fail:
+	table_hashes_free(t);
+	kfree(t);
+	module_put(THIS_MODULE);
+	return NULL;
 }
 
 
@@ -818,6 +941,11 @@ static int table_create_proc(struct rtpengine_table *t, uint32_t id) {
 	if (!t->proc_blist)
 		return -1;
 
+	t->proc_stats = proc_create_user("stats", S_IFREG | S_IRUSR | S_IRGRP, t->proc_root,
+			&proc_stats_ops, (void *) (unsigned long) id);
+	if (!t->proc_stats)
+		return -1;
+
 	t->proc_calls = proc_mkdir_user("calls", S_IRUGO | S_IXUGO, t->proc_root);
 	if (!t->proc_calls)
 		return -1;
@@ -874,12 +1002,193 @@ static void free_crypto_context(struct re_crypto_context *c) {
 	}
 	if (c->shash)
 		crypto_free_shash(c->shash);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+	if (c->skcipher)
+		crypto_free_sync_skcipher(c->skcipher);
+#endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,25)
 	if (c->aead)
 		crypto_free_aead(c->aead);
 #endif
 }
 
+static int target_stats_alloc(struct rtpengine_target *g) {
+	unsigned int i;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+	int cpu;
+#endif
+
+	g->stats = __alloc_percpu(sizeof(*g->stats) + sizeof(g->stats->rtp[0]) * g->target.num_payload_types,
+			__alignof__(*g->stats));
+	if (!g->stats)
+		return -ENOMEM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(g->stats, cpu)->in.syncp);
+#endif
+
+	for (i = 0; i < g->target.num_destinations; i++) {
+		g->outputs[i].stats_out = alloc_percpu(struct rtpengine_stats_pcpu);
+		if (!g->outputs[i].stats_out)
+			return -ENOMEM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+		for_each_possible_cpu(cpu)
+			u64_stats_init(&per_cpu_ptr(g->outputs[i].stats_out, cpu)->syncp);
+#endif
+	}
+
+	return 0;
+}
+
+static void target_stats_free(struct rtpengine_target *g) {
+	unsigned int i;
+
+	if (g->stats)
+		free_percpu(g->stats);
+	if (!g->outputs)
+		return;
+	for (i = 0; i < g->target.num_destinations; i++) {
+		if (g->outputs[i].stats_out)
+			free_percpu(g->outputs[i].stats_out);
+	}
+}
+
+static inline void stats_pcpu_add(struct rtpengine_stats_pcpu __percpu *pcpu, uint64_t packets,
+		uint64_t bytes, uint64_t errors)
+{
+	struct rtpengine_stats_pcpu *s = get_cpu_ptr(pcpu);
+	u64_stats_update_begin(&s->syncp);
+	s->packets += packets;
+	s->bytes += bytes;
+	s->errors += errors;
+	u64_stats_update_end(&s->syncp);
+	put_cpu_ptr(pcpu);
+}
+
+/* one received packet, pt_idx as in rtpengine46() */
+static inline void target_stats_in(struct rtpengine_target *g, unsigned int bytes, int pt_idx) {
+	struct rtpengine_target_pcpu *s = get_cpu_ptr(g->stats);
+	u64_stats_update_begin(&s->in.syncp);
+	s->in.packets++;
+	s->in.bytes += bytes;
+	if (pt_idx >= 0) {
+		s->rtp[pt_idx].packets++;
+		s->rtp[pt_idx].bytes += bytes;
+	}
+	else if (pt_idx == -1)
+		s->in.errors++;
+	u64_stats_update_end(&s->in.syncp);
+	put_cpu_ptr(g->stats);
+}
+
+static void stats_pcpu_sum(struct rtpengine_stats *out, const struct rtpengine_stats_pcpu *s) {
+	unsigned int start;
+	uint64_t packets, bytes, errors;
+
+	do {
+		start = u64_stats_fetch_begin(&s->syncp);
+		packets = s->packets;
+		bytes = s->bytes;
+		errors = s->errors;
+	} while (u64_stats_fetch_retry(&s->syncp, start));
+
+	out->packets += packets;
+	out->bytes += bytes;
+	out->errors += errors;
+}
+
+/* both must be zeroed, rtp can be NULL */
+static void target_stats_sum(struct rtpengine_target *g, struct rtpengine_stats *in,
+		struct rtpengine_rtp_stats *rtp)
+{
+	const struct rtpengine_target_pcpu *s;
+	unsigned int i, start;
+	uint64_t packets, bytes;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(g->stats, cpu);
+		stats_pcpu_sum(in, &s->in);
+		if (!rtp)
+			continue;
+		for (i = 0; i < g->target.num_payload_types; i++) {
+			do {
+				start = u64_stats_fetch_begin(&s->in.syncp);
+				packets = s->rtp[i].packets;
+				bytes = s->rtp[i].bytes;
+			} while (u64_stats_fetch_retry(&s->in.syncp, start));
+			rtp[i].packets += packets;
+			rtp[i].bytes += bytes;
+		}
+	}
+}
+
+/* must be zeroed */
+static void output_stats_sum(struct rtpengine_output *o, struct rtpengine_stats *out) {
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		stats_pcpu_sum(out, per_cpu_ptr(o->stats_out, cpu));
+}
+
+/* the writer must hold the target's ssrc_stats_lock */
+static inline void stats_slot_write_begin(struct rtpengine_stats_slot *s) {
+	s->seq++;
+	smp_wmb();
+}
+static inline void stats_slot_write_end(struct rtpengine_stats_slot *s) {
+	smp_wmb();
+	s->seq++;
+}
+
+/* before the target is published */
+static void target_stats_slot_alloc(struct rtpengine_table *t, struct rtpengine_target *g) {
+	struct rtpengine_stats_slot *s;
+	unsigned long flags;
+	unsigned int idx, u;
+
+	if (!t->stats)
+		return;
+
+	spin_lock_irqsave(&t->stats_lock, flags);
+	idx = find_first_zero_bit(t->stats_used, t->stats_num_slots);
+	if (idx < t->stats_num_slots)
+		__set_bit(idx, t->stats_used);
+	spin_unlock_irqrestore(&t->stats_lock, flags);
+
+	if (idx >= t->stats_num_slots)
+		return; /* all taken, stats remain available through REMG_GET_STATS */
+
+	s = &t->stats[idx];
+	stats_slot_write_begin(s);
+	memset(&s->local, 0, sizeof(*s) - offsetof(struct rtpengine_stats_slot, local));
+	s->local = g->target.local;
+	for (u = 0; u < RTPE_NUM_SSRC_TRACKING; u++) {
+		s->ssrc[u] = g->target.ssrc[u];
+		s->ssrc_stats[u] = g->ssrc_stats[u];
+	}
+	stats_slot_write_end(s);
+
+	g->stats_slot = s;
+	g->stats_table = t;
+	g->target.stats_idx = idx;
+}
+
+/* the slot is only handed out again once nothing can write to it any more */
+static void target_stats_slot_free(struct rtpengine_target *g) {
+	struct rtpengine_table *t = g->stats_table;
+	unsigned long flags;
+
+	if (!g->stats_slot)
+		return;
+
+	spin_lock_irqsave(&t->stats_lock, flags);
+	__clear_bit(g->stats_slot - t->stats, t->stats_used);
+	spin_unlock_irqrestore(&t->stats_lock, flags);
+
+	g->stats_slot = NULL;
+}
+
 static void target_put(struct rtpengine_target *t) {
 	unsigned int i;
 
@@ -891,6 +1200,8 @@ static void target_put(struct rtpengine_target *t) {
 
 	DBG("Freeing target\n");
 
+	target_stats_slot_free(t);
+	target_stats_free(t);
 	free_crypto_context(&t->decrypt);
 
 	if (t->outputs) {
@@ -938,6 +1249,7 @@ static void clear_table_proc_files(struct rtpengine_table *t) {
 	clear_proc(&t->proc_control);
 	clear_proc(&t->proc_list);
 	clear_proc(&t->proc_blist);
+	clear_proc(&t->proc_stats);
 	clear_proc(&t->proc_calls);
 	clear_proc(&t->proc_root);
 }
@@ -981,6 +1293,13 @@ static void table_put(struct rtpengine_table *t) {
 		t->dest_addr_hash.addrs[k] = NULL;
 	}
 
+	/* pages still mapped by userspace stay around until unmapped */
+	if (t->stats)
+		vfree(t->stats);
+	if (t->stats_used)
+		kfree(t->stats_used);
+	table_hashes_free(t);
+
 	clear_table_proc_files(t);
 	kfree(t);
 
@@ -1041,6 +1360,8 @@ static void stream_put(struct re_stream *stream) {
 
 	if (stream->call)
 		call_put(stream->call);
+	if (stream->ring)
+		vfree(stream->ring);
 
 	kfree(stream);
 }
@@ -1100,6 +1421,9 @@ static int unlink_table(struct rtpengine_table *t) {
 	}
 	_w_unlock(&calls.lock, flags);
 
+	/* deferred target puts */
+	rcu_barrier();
+
 	clear_table_proc_files(t);
 	table_put(t);
 
@@ -1128,13 +1452,50 @@ static struct rtpengine_table *get_table(unsigned int id) {
 
 
 
+struct re_hash_stats {
+	unsigned int			entries;
+	unsigned int			used; /* non-empty buckets */
+	unsigned int			max_chain;
+};
+
+static void hash_stats(struct hlist_head *hash, spinlock_t *locks, u32 mask, struct re_hash_stats *s) {
+	struct hlist_node *n;
+	unsigned int i, chain;
+	unsigned long flags;
+
+	memset(s, 0, sizeof(*s));
+
+	for (i = 0; i <= mask; i++) {
+		chain = 0;
+		spin_lock_irqsave(&locks[i], flags);
+		hlist_for_each(n, &hash[i])
+			chain++;
+		spin_unlock_irqrestore(&locks[i], flags);
+
+		if (!chain)
+			continue;
+		s->entries += chain;
+		s->used++;
+		if (chain > s->max_chain)
+			s->max_chain = chain;
+	}
+}
+
+static int sprint_hash_stats(char *buf, const char *name, u32 mask, const struct re_hash_stats *s) {
+	return sprintf(buf, "%-13s%u buckets, %u used, %u entries, max chain %u\n",
+			name, mask + 1, s->used, s->entries, s->max_chain);
+}
+
 static ssize_t proc_status(struct file *f, char __user *b, size_t l, loff_t *o) {
 	struct inode *inode;
-	char buf[256];
+	char buf[512];
 	struct rtpengine_table *t;
 	int len = 0;
 	unsigned long flags;
 	uint32_t id;
+	struct re_dest_addr *rda;
+	unsigned int i, addrs = 0, probe, max_probe = 0;
+	struct re_hash_stats calls_stats, streams_stats;
 
 	if (*o > 0)
 		return 0;
@@ -1149,11 +1510,27 @@ static ssize_t proc_status(struct file *f, char __user *b, size_t l, loff_t *o)
 	if (!t)
 		return -ENOENT;
 
-	read_lock_irqsave(&t->target_lock, flags);
+	spin_lock_irqsave(&t->target_lock, flags);
 	len += sprintf(buf + len, "Refcount:    %u\n", atomic_read(&t->refcnt) - 1);
 	len += sprintf(buf + len, "Control PID: %u\n", t->pid);
 	len += sprintf(buf + len, "Targets:     %u\n", t->num_targets);
-	read_unlock_irqrestore(&t->target_lock, flags);
+	/* distance of each local address from its hash slot, see find_dest_addr() */
+	for (i = 0; i < ARRAY_SIZE(t->dest_addr_hash.addrs); i++) {
+		rda = t->dest_addr_hash.addrs[i];
+		if (!rda)
+			continue;
+		addrs++;
+		probe = (i - re_address_hash(&rda->destination)) % ARRAY_SIZE(t->dest_addr_hash.addrs);
+		if (probe > max_probe)
+			max_probe = probe;
+	}
+	spin_unlock_irqrestore(&t->target_lock, flags);
+	len += sprintf(buf + len, "Addresses:   %u, max probe %u\n", addrs, max_probe);
+
+	hash_stats(t->calls_hash, t->calls_hash_lock, t->hash_mask, &calls_stats);
+	len += sprint_hash_stats(buf + len, "Calls hash:", t->hash_mask, &calls_stats);
+	hash_stats(t->streams_hash, t->streams_hash_lock, t->hash_mask, &streams_stats);
+	len += sprint_hash_stats(buf + len, "Streams hash:", t->hash_mask, &streams_stats);
 
 	table_put(t);
 
@@ -1270,7 +1647,6 @@ static inline void re_bitfield_clear(struct re_bitfield *bf, unsigned char i) {
 static inline struct rtpengine_target *find_next_target(struct rtpengine_table *t, int *addr_bucket,
 		int *port)
 {
-	unsigned long flags;
 	struct re_dest_addr *rda;
 	struct re_bucket *b;
 	unsigned char hi, lo, ab;
@@ -1290,7 +1666,7 @@ static inline struct rtpengine_target *find_next_target(struct rtpengine_table *
 	lo = *port & 0xff;
 	ab = *addr_bucket;
 
-	read_lock_irqsave(&t->target_lock, flags);
+	rcu_read_lock();
 
 	for (;;) {
 		rda_b = bitfield_slot(ab);
@@ -1301,7 +1677,7 @@ static inline struct rtpengine_target *find_next_target(struct rtpengine_table *
 			goto next_rda;
 		}
 
-		rda = t->dest_addr_hash.addrs[ab];
+		rda = rcu_dereference(t->dest_addr_hash.addrs[ab]);
 		if (!rda) {
 			ab++;
 			hi = 0;
@@ -1316,7 +1692,7 @@ static inline struct rtpengine_target *find_next_target(struct rtpengine_table *
 			goto next_hi;
 		}
 
-		b = rda->ports_hi[hi];
+		b = rcu_dereference(rda->ports_hi[hi]);
 		if (!b) {
 			hi++;
 			lo = 0;
@@ -1329,7 +1705,7 @@ static inline struct rtpengine_target *find_next_target(struct rtpengine_table *
 			goto next_lo;
 		}
 
-		g = b->ports_lo[lo];
+		g = rcu_dereference(b->ports_lo[lo]);
 		if (!g) {
 			lo++;
 			goto next_lo;
@@ -1349,7 +1725,7 @@ next_rda:
 			break;
 	}
 
-	read_unlock_irqrestore(&t->target_lock, flags);
+	rcu_read_unlock();
 
 	*addr_bucket = ab;
 	*port = (hi << 8) | lo;
@@ -1393,6 +1769,38 @@ static int proc_blist_close(struct inode *i, struct file *f) {
 	return 0;
 }
 
+static int proc_stats_mmap(struct file *f, struct vm_area_struct *vma) {
+	struct inode *inode;
+	uint32_t id;
+	struct rtpengine_table *t;
+	int err;
+
+	inode = f->f_path.dentry->d_inode;
+	id = (uint32_t) (unsigned long) PDE_DATA(inode);
+	t = get_table(id);
+	if (!t)
+		return -ENOENT;
+
+	err = -ENODEV;
+	if (!t->stats)
+		goto out;
+	err = -EPERM;
+	if ((vma->vm_flags & VM_WRITE))
+		goto out;
+	/* and no mprotect() to make it writable later */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	err = remap_vmalloc_range(vma, t->stats, vma->vm_pgoff);
+
+out:
+	table_put(t);
+	return err;
+}
+
 static ssize_t proc_blist_read(struct file *f, char __user *b, size_t l, loff_t *o) {
 	struct inode *inode;
 	uint32_t id;
@@ -1427,18 +1835,11 @@ static ssize_t proc_blist_read(struct file *f, char __user *b, size_t l, loff_t
 
 	memcpy(&opp->target, &g->target, sizeof(opp->target));
 
-	opp->stats_in.packets = atomic64_read(&g->stats_in.packets);
-	opp->stats_in.bytes = atomic64_read(&g->stats_in.bytes);
-	opp->stats_in.errors = atomic64_read(&g->stats_in.errors);
+	target_stats_sum(g, &opp->stats_in, opp->rtp_stats);
 	opp->stats_in.delay_min = g->stats_in.delay_min;
 	opp->stats_in.delay_max = g->stats_in.delay_max;
 	opp->stats_in.delay_avg = g->stats_in.delay_avg;
-	opp->stats_in.tos = atomic_read(&g->stats_in.tos);
-
-	for (i = 0; i < g->target.num_payload_types; i++) {
-		opp->rtp_stats[i].packets = atomic64_read(&g->rtp_stats[i].packets);
-		opp->rtp_stats[i].bytes = atomic64_read(&g->rtp_stats[i].bytes);
-	}
+	opp->stats_in.tos = max(atomic_read(&g->stats_in.tos), 0);
 
 	spin_lock_irqsave(&g->decrypt.lock, flags);
 	for (i = 0; i < ARRAY_SIZE(opp->target.decrypt.last_index); i++)
@@ -1454,9 +1855,7 @@ static ssize_t proc_blist_read(struct file *f, char __user *b, size_t l, loff_t
 			opp->outputs[i] = o->output;
 			spin_unlock_irqrestore(&o->encrypt.lock, flags);
 
-			opp->stats_out[i].packets = atomic64_read(&o->stats_out.packets);
-			opp->stats_out[i].bytes = atomic64_read(&o->stats_out.bytes);
-			opp->stats_out[i].errors = atomic64_read(&o->stats_out.errors);
+			output_stats_sum(o, &opp->stats_out[i]);
 		}
 	}
 	else
@@ -1581,6 +1980,11 @@ static void proc_list_crypto_print(struct seq_file *f, struct re_crypto_context
 		if (!hdr++)
 			seq_printf(f, "    SRTP %s parameters:\n", label);
 		seq_printf(f, "        cipher: %s\n", c->cipher->name ? : "<invalid>");
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+		if (c->skcipher)
+			seq_printf(f, "        cipher driver: %s\n",
+					crypto_skcipher_driver_name(&c->skcipher->base));
+#endif
 
 		seq_printf(f, "    master key: ");
 		for (i = 0; i < s->master_key_len; i++)
@@ -1634,6 +2038,8 @@ static int proc_list_show(struct seq_file *f, void *v) {
 	struct rtpengine_target *g = v;
 	unsigned int i, j;
 	unsigned long flags;
+	struct rtpengine_stats st;
+	struct rtpengine_rtp_stats rtp_st[RTPE_NUM_PAYLOAD_TYPES];
 
 	seq_printf(f, "local ");
 	seq_addr_print(f, &g->target.local);
@@ -1652,15 +2058,18 @@ static int proc_list_show(struct seq_file *f, void *v) {
 	proc_list_addr_print(f, "expect", &g->target.expected_src);
 	if (g->target.src_mismatch > 0 && g->target.src_mismatch <= ARRAY_SIZE(re_msm_strings))
 		seq_printf(f, "    src mismatch action: %s\n", re_msm_strings[g->target.src_mismatch]);
+	memset(&st, 0, sizeof(st));
+	memset(rtp_st, 0, sizeof(rtp_st));
+	target_stats_sum(g, &st, rtp_st);
 	seq_printf(f, "    stats: %20llu bytes, %20llu packets, %20llu errors\n",
-		(unsigned long long) atomic64_read(&g->stats_in.bytes),
-		(unsigned long long) atomic64_read(&g->stats_in.packets),
-		(unsigned long long) atomic64_read(&g->stats_in.errors));
+		(unsigned long long) st.bytes,
+		(unsigned long long) st.packets,
+		(unsigned long long) st.errors);
 	for (i = 0; i < g->target.num_payload_types; i++) {
 		seq_printf(f, "        RTP payload type %3u: %20llu bytes, %20llu packets\n",
 			g->target.pt_input[i].pt_num,
-			(unsigned long long) atomic64_read(&g->rtp_stats[i].bytes),
-			(unsigned long long) atomic64_read(&g->rtp_stats[i].packets));
+			(unsigned long long) rtp_st[i].bytes,
+			(unsigned long long) rtp_st[i].packets);
 	}
 
 	seq_printf(f, "    SSRC in:");
@@ -1701,10 +2110,12 @@ static int proc_list_show(struct seq_file *f, void *v) {
 		proc_list_addr_print(f, "src", &o->output.src_addr);
 		proc_list_addr_print(f, "dst", &o->output.dst_addr);
 
+		memset(&st, 0, sizeof(st));
+		output_stats_sum(o, &st);
 		seq_printf(f, "      stats: %20llu bytes, %20llu packets, %20llu errors\n",
-			(unsigned long long) atomic64_read(&o->stats_out.bytes),
-			(unsigned long long) atomic64_read(&o->stats_out.packets),
-			(unsigned long long) atomic64_read(&o->stats_out.errors));
+			(unsigned long long) st.bytes,
+			(unsigned long long) st.packets,
+			(unsigned long long) st.errors);
 
 		if (o->output.ssrc_subst) {
 			seq_printf(f, " SSRC out:");
@@ -1791,14 +2202,15 @@ static int re_address_match(const struct re_address *a, const struct re_address
 	return 0;
 }
 
-static struct re_dest_addr *find_dest_addr(const struct re_dest_addr_hash *h, const struct re_address *local) {
+/* under rcu_read_lock() or the target_lock */
+static struct re_dest_addr *find_dest_addr(struct rtpengine_table *t, const struct re_address *local) {
 	unsigned int rda_hash, i;
 	struct re_dest_addr *rda;
 
 	i = rda_hash = re_address_hash(local);
 
 	while (1) {
-		rda = h->addrs[i];
+		rda = rcu_dereference_check(t->dest_addr_hash.addrs[i], lockdep_is_held(&t->target_lock));
 		if (!rda)
 			return NULL;
 		if (re_address_match(local, &rda->destination))
@@ -1816,6 +2228,21 @@ static struct re_dest_addr *find_dest_addr(const struct re_dest_addr_hash *h, co
 
 
 
+static void target_put_rcu_cb(struct rcu_head *head) {
+	struct rtpengine_target *g = container_of(head, struct rtpengine_target, rcu);
+
+	target_put(g);
+}
+
+/* drops the reference held by the hash once no reader can find the target any more. runs
+ * in softirq context, so it can't hold a table reference: the final table_put() may sleep.
+ * unlink_table() waits for these instead, as the target's stats slot belongs to the table. */
+static void target_put_rcu(struct rtpengine_target *g) {
+	call_rcu(&g->rcu, target_put_rcu_cb);
+}
+
+
+
 static int table_get_target_stats(struct rtpengine_table *t, struct rtpengine_stats_info *i, int reset) {
 	struct rtpengine_target *g;
 	unsigned int u;
@@ -1838,6 +2265,8 @@ static int table_get_target_stats(struct rtpengine_table *t, struct rtpengine_st
 		}
 	}
 
+	/* the shared slot keeps counting, so that readers of it don't see resets */
+
 	spin_unlock_irqrestore(&g->ssrc_stats_lock, flags);
 
 	target_put(g);
@@ -1860,9 +2289,9 @@ static int table_del_target(struct rtpengine_table *t, const struct re_address *
 	hi = (local->port & 0xff00) >> 8;
 	lo = local->port & 0xff;
 
-	write_lock_irqsave(&t->target_lock, flags);
+	spin_lock_irqsave(&t->target_lock, flags);
 
-	rda = find_dest_addr(&t->dest_addr_hash, local);
+	rda = find_dest_addr(t, local);
 	if (!rda)
 		goto out;
 	b = rda->ports_hi[hi];
@@ -1872,11 +2301,11 @@ static int table_del_target(struct rtpengine_table *t, const struct re_address *
 	if (!g)
 		goto out;
 
-	b->ports_lo[lo] = NULL;
+	rcu_assign_pointer(b->ports_lo[lo], NULL);
 	re_bitfield_clear(&b->ports_lo_bf, lo);
 	t->num_targets--;
 	if (!b->ports_lo_bf.used) {
-		rda->ports_hi[hi] = NULL;
+		rcu_assign_pointer(rda->ports_hi[hi], NULL);
 		re_bitfield_clear(&rda->ports_hi_bf, hi);
 	}
 	else
@@ -1885,14 +2314,15 @@ static int table_del_target(struct rtpengine_table *t, const struct re_address *
 	/* not freeing or NULLing the re_dest_addr due to hash collision logic */
 
 out:
-	write_unlock_irqrestore(&t->target_lock, flags);
+	spin_unlock_irqrestore(&t->target_lock, flags);
 
 	if (!g)
 		return -ENOENT;
-	if (b)
-		kfree(b);
 
-	target_put(g);
+	/* readers may still be looking at them */
+	if (b)
+		kfree_rcu(b, rcu);
+	target_put_rcu(g);
 
 	return 0;
 }
@@ -2157,7 +2587,23 @@ static int gen_session_keys(struct re_crypto_context *c, struct rtpengine_srtp *
 	if (ret)
 		goto error;
 
-	if (c->cipher->tfm_name) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+	if (c->cipher->skcipher_name) {
+		/* only synchronous implementations can be used from the packet path. if there
+		 * is none, fall back to running the single-block cipher over the payload */
+		c->skcipher = crypto_alloc_sync_skcipher(c->cipher->skcipher_name, 0, 0);
+		if (IS_ERR(c->skcipher))
+			c->skcipher = NULL;
+		else {
+			err = "failed to set cipher key";
+			ret = crypto_sync_skcipher_setkey(c->skcipher, c->session_key, s->session_key_len);
+			if (ret)
+				goto error;
+		}
+	}
+#endif
+
+	if (c->cipher->tfm_name && !c->skcipher) {
 		err = "failed to load cipher";
 		c->tfm[0] = crypto_alloc_cipher(c->cipher->tfm_name, 0, CRYPTO_ALG_ASYNC);
 		if (IS_ERR(c->tfm[0])) {
@@ -2321,6 +2767,8 @@ static int table_new_target(struct rtpengine_table *t, struct rtpengine_target_i
 		return -EINVAL;
 	if (i->num_destinations > RTPE_MAX_FORWARD_DESTINATIONS)
 		return -EINVAL;
+	if (i->num_payload_types > RTPE_NUM_PAYLOAD_TYPES)
+		return -EINVAL;
 	if (!i->non_forwarding) {
 		if (!i->num_destinations)
 			return -EINVAL;
@@ -2350,6 +2798,9 @@ static int table_new_target(struct rtpengine_table *t, struct rtpengine_target_i
 	for (u = 0; u < RTPE_NUM_SSRC_TRACKING; u++)
 		g->ssrc_stats[u].lost_bits = -1;
 	rwlock_init(&g->outputs_lock);
+	g->target.stats_idx = 0;
+	target_stats_slot_alloc(t, g);
+	i->stats_idx = g->target.stats_idx;
 
 	if (i->num_destinations) {
 		err = -ENOMEM;
@@ -2359,6 +2810,11 @@ static int table_new_target(struct rtpengine_table *t, struct rtpengine_target_i
 		g->outputs_unfilled = i->num_destinations;
 	}
 
+	atomic_set(&g->stats_in.tos, -1);
+	err = target_stats_alloc(g);
+	if (err)
+		goto fail2;
+
 	err = gen_session_keys(&g->decrypt, &g->target.decrypt);
 	if (err)
 		goto fail2;
@@ -2371,7 +2827,7 @@ static int table_new_target(struct rtpengine_table *t, struct rtpengine_target_i
 
 retry:
 	rh_it = rda_hash;
-	write_lock_irqsave(&t->target_lock, flags);
+	spin_lock_irqsave(&t->target_lock, flags);
 
 	rda = t->dest_addr_hash.addrs[rh_it];
 	while (rda) {
@@ -2386,7 +2842,7 @@ retry:
 		rda = t->dest_addr_hash.addrs[rh_it];
 	}
 
-	write_unlock_irqrestore(&t->target_lock, flags);
+	spin_unlock_irqrestore(&t->target_lock, flags);
 
 	rda = kzalloc(sizeof(*rda), GFP_KERNEL);
 	err = -ENOMEM;
@@ -2395,15 +2851,15 @@ retry:
 
 	memcpy(&rda->destination, &i->local, sizeof(rda->destination));
 
-	write_lock_irqsave(&t->target_lock, flags);
+	spin_lock_irqsave(&t->target_lock, flags);
 
 	if (t->dest_addr_hash.addrs[rh_it]) {
-		write_unlock_irqrestore(&t->target_lock, flags);
+		spin_unlock_irqrestore(&t->target_lock, flags);
 		kfree(rda);
 		goto retry;
 	}
 
-	t->dest_addr_hash.addrs[rh_it] = rda;
+	rcu_assign_pointer(t->dest_addr_hash.addrs[rh_it], rda);
 	re_bitfield_set(&t->dest_addr_hash.addrs_bf, rh_it);
 
 got_rda:
@@ -2412,17 +2868,17 @@ got_rda:
 	if ((b = rda->ports_hi[hi]))
 		goto got_bucket;
 
-	write_unlock_irqrestore(&t->target_lock, flags);
+	spin_unlock_irqrestore(&t->target_lock, flags);
 
 	b = kzalloc(sizeof(*b), GFP_KERNEL);
 	err = -ENOMEM;
 	if (!b)
 		goto fail2;
 
-	write_lock_irqsave(&t->target_lock, flags);
+	spin_lock_irqsave(&t->target_lock, flags);
 
 	if (!rda->ports_hi[hi]) {
-		rda->ports_hi[hi] = b;
+		rcu_assign_pointer(rda->ports_hi[hi], b);
 		re_bitfield_set(&rda->ports_hi_bf, hi);
 	}
 	else {
@@ -2437,9 +2893,9 @@ got_bucket:
 	re_bitfield_set(&b->ports_lo_bf, lo);
 	t->num_targets++;
 
-	b->ports_lo[lo] = g;
+	rcu_assign_pointer(b->ports_lo[lo], g);
 	g = NULL;
-	write_unlock_irqrestore(&t->target_lock, flags);
+	spin_unlock_irqrestore(&t->target_lock, flags);
 
 	if (ba)
 		kfree(ba);
@@ -2449,10 +2905,12 @@ got_bucket:
 	return 0;
 
 fail4:
-	write_unlock_irqrestore(&t->target_lock, flags);
+	spin_unlock_irqrestore(&t->target_lock, flags);
 	if (ba)
 		kfree(ba);
 fail2:
+	target_stats_slot_free(g);
+	target_stats_free(g);
 	if (g->outputs)
 		kfree(g->outputs);
 	kfree(g);
@@ -2536,8 +2994,8 @@ out:
 static struct rtpengine_target *get_target(struct rtpengine_table *t, const struct re_address *local) {
 	unsigned char hi, lo;
 	struct re_dest_addr *rda;
+	struct re_bucket *b;
 	struct rtpengine_target *r;
-	unsigned long flags;
 
 	if (!t)
 		return NULL;
@@ -2547,13 +3005,15 @@ static struct rtpengine_target *get_target(struct rtpengine_table *t, const stru
 	hi = (local->port & 0xff00) >> 8;
 	lo = local->port & 0xff;
 
-	read_lock_irqsave(&t->target_lock, flags);
+	/* the hash holds its reference until a grace period after removal */
+	rcu_read_lock();
 
-	rda = find_dest_addr(&t->dest_addr_hash, local);
-	r = rda ? (rda->ports_hi[hi] ? rda->ports_hi[hi]->ports_lo[lo] : NULL) : NULL;
+	rda = find_dest_addr(t, local);
+	b = rda ? rcu_dereference(rda->ports_hi[hi]) : NULL;
+	r = b ? rcu_dereference(b->ports_lo[lo]) : NULL;
 	if (r)
 		target_get(r);
-	read_unlock_irqrestore(&t->target_lock, flags);
+	rcu_read_unlock();
 
 	return r;
 }
@@ -2866,7 +3326,7 @@ static int table_new_call(struct rtpengine_table *table, struct rtpengine_call_i
 	/* check for name collisions */
 
 	call->hash_bucket = crc32_le(0x52342, info->call_id, strlen(info->call_id));
-	call->hash_bucket = call->hash_bucket & ((1 << RE_HASH_BITS) - 1);
+	call->hash_bucket = call->hash_bucket & table->hash_mask;
 
 	spin_lock_irqsave(&table->calls_hash_lock[call->hash_bucket], flags);
 
@@ -3053,7 +3513,7 @@ static int table_new_stream(struct rtpengine_table *table, struct rtpengine_stre
 	/* check for name collisions */
 
 	stream->hash_bucket = crc32_le(0x52342 ^ info->call_idx, info->stream_name, strlen(info->stream_name));
-	stream->hash_bucket = stream->hash_bucket & ((1 << RE_HASH_BITS) - 1);
+	stream->hash_bucket = stream->hash_bucket & table->hash_mask;
 
 	spin_lock_irqsave(&table->streams_hash_lock[stream->hash_bucket], flags);
 
@@ -3104,7 +3564,11 @@ not_found:
 	_w_unlock(&streams.lock, flags);
 
 	/* proc_ functions may sleep, so this must be done outside of the lock */
-	pde = stream->file = proc_create_user(info->stream_name, S_IFREG | S_IRUSR | S_IRGRP, call->root,
+	/* only owner and group may write, as before only they could read: the reader maps the
+	 * ring shared and writable to hand back its tail, and the kernel only allows that on
+	 * a file opened for writing. there's no write handler, so this grants nothing else */
+	pde = stream->file = proc_create_user(info->stream_name,
+			S_IFREG | S_IRUSR | S_IRGRP | S_IWUSR | S_IWGRP, call->root,
 			&proc_stream_ops, (void *) (unsigned long) info->stream_idx);
 	err = -ENOMEM;
 	if (!pde)
@@ -3317,6 +3781,8 @@ static unsigned int proc_stream_poll(struct file *f, struct poll_table_struct *p
 
 	if (!list_empty(&stream->packet_list) || stream->eof)
 		ret |= POLLIN | POLLRDNORM;
+	else if (stream->ring && READ_ONCE(stream->ring->tail) != stream->ring_head)
+		ret |= POLLIN | POLLRDNORM;
 
 	DBG("returning from proc_stream_poll()\n");
 
@@ -3329,6 +3795,59 @@ static unsigned int proc_stream_poll(struct file *f, struct poll_table_struct *p
 	return ret;
 }
 
+static int proc_stream_mmap(struct file *f, struct vm_area_struct *vma) {
+	unsigned int stream_idx = (unsigned int) (unsigned long) PDE_DATA(f->f_path.dentry->d_inode);
+	struct re_stream *stream;
+	unsigned long flags;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct rtpengine_stream_ring *ring;
+	int err;
+
+	DBG("entering proc_stream_mmap()\n");
+
+	/* the reader must see the kernel's updates and write back its tail */
+	if (!(vma->vm_flags & VM_SHARED) || vma->vm_pgoff)
+		return -EINVAL;
+	if (size <= PAGE_SIZE || !is_power_of_2(size - PAGE_SIZE) || size - PAGE_SIZE > (1UL << 30))
+		return -EINVAL;
+
+	stream = get_stream_lock(NULL, stream_idx);
+	if (!stream)
+		return -EINVAL;
+
+	err = -ENOMEM;
+	ring = vmalloc_user(size);
+	if (!ring)
+		goto out;
+	ring->size = size - PAGE_SIZE;
+
+	spin_lock_irqsave(&stream->packet_list_lock, flags);
+	err = 0;
+	if (!stream->ring) {
+		stream->ring = ring;
+		stream->ring_size = ring->size;
+		stream->ring_head = 0;
+		ring = NULL;
+	}
+	else if (stream->ring_size != size - PAGE_SIZE)
+		err = -EBUSY;
+	spin_unlock_irqrestore(&stream->packet_list_lock, flags);
+
+	/* lost a race or mapped again */
+	if (ring)
+		vfree(ring);
+	if (err)
+		goto out;
+
+	/* the ring stays around until the stream is freed, which can't happen while
+	 * the file is open, which it is while mapped */
+	err = remap_vmalloc_range(vma, stream->ring, 0);
+
+out:
+	stream_put(stream);
+	return err;
+}
+
 static int proc_stream_open(struct inode *i, struct file *f) {
 	int err;
 	unsigned int stream_idx = (unsigned int) (unsigned long) PDE_DATA(f->f_path.dentry->d_inode);
@@ -3376,6 +3895,131 @@ static int proc_stream_close(struct inode *i, struct file *f) {
 
 
 
+/* packet_list_lock must be held and the stream must have a ring. Returns where to put
+ * `len` bytes of packet, to be followed by stream_ring_commit(), or NULL if there's no
+ * room, in which case the packet is counted as dropped. */
+static unsigned char *stream_ring_reserve(struct re_stream *stream, unsigned int len) {
+	struct rtpengine_stream_ring *r = stream->ring;
+	unsigned char *data = (unsigned char *) r + PAGE_SIZE;
+	uint32_t head = stream->ring_head;
+	uint32_t size = stream->ring_size;
+	uint32_t used, off, to_end, need;
+	uint32_t rec_len = ALIGN(sizeof(uint32_t) + len, RTPE_STREAM_RING_ALIGN);
+
+	used = head - READ_ONCE(r->tail);
+	/* the reader must be done with the space before we reuse it */
+	smp_mb();
+
+	off = head & (size - 1);
+	to_end = size - off;
+	need = rec_len;
+	if (rec_len > to_end)
+		need += to_end; /* skipped at the end */
+
+	/* a bogus tail from the reader looks like a full ring */
+	if (used > size || need > size - used) {
+		r->dropped++;
+		return NULL;
+	}
+
+	if (rec_len > to_end) {
+		*(uint32_t *) (data + off) = 0;
+		head += to_end;
+		off = 0;
+	}
+
+	*(uint32_t *) (data + off) = len;
+	stream->ring_head = head + rec_len;
+
+	return data + off + sizeof(uint32_t);
+}
+static void stream_ring_commit(struct re_stream *stream) {
+	/* packet is written before the reader can see it */
+	smp_wmb();
+	WRITE_ONCE(stream->ring->head, stream->ring_head);
+}
+
+/* Puts a packet from userspace into the stream's ring. Returns false if the stream
+ * doesn't have a ring, so the packet must be queued instead. */
+static bool stream_ring_add(struct re_stream *stream, const unsigned char *buf, unsigned int len) {
+	unsigned long flags;
+	unsigned char *p;
+
+	spin_lock_irqsave(&stream->packet_list_lock, flags);
+
+	if (!stream->ring) {
+		spin_unlock_irqrestore(&stream->packet_list_lock, flags);
+		return false;
+	}
+
+	if (!stream->eof) {
+		p = stream_ring_reserve(stream, len);
+		if (p) {
+			memcpy(p, buf, len);
+			stream_ring_commit(stream);
+		}
+	}
+
+	spin_unlock_irqrestore(&stream->packet_list_lock, flags);
+
+	wake_up_interruptible(&stream->read_wq);
+	return true;
+}
+
+/* Same for an intercepted packet, which goes into the ring straight from the skb, with
+ * its headers restored as intercept_skb_copy() does it. */
+static bool stream_ring_add_skb(struct re_stream *stream, struct sk_buff *skb,
+		const struct re_address *src)
+{
+	unsigned long flags;
+	unsigned char *p;
+	unsigned int len, th_off;
+	struct udphdr *uh;
+	struct iphdr *ih;
+	struct ipv6hdr *ih6;
+
+	if (src->family != AF_INET && src->family != AF_INET6)
+		return false;
+
+	spin_lock_irqsave(&stream->packet_list_lock, flags);
+
+	if (!stream->ring) {
+		spin_unlock_irqrestore(&stream->packet_list_lock, flags);
+		return false;
+	}
+
+	if (stream->eof)
+		goto out;
+
+	len = skb->data + skb->len - skb_network_header(skb);
+	p = stream_ring_reserve(stream, len);
+	if (!p)
+		goto out;
+
+	memcpy(p, skb_network_header(skb), len);
+
+	th_off = skb_transport_header(skb) - skb_network_header(skb);
+	uh = (void *) (p + th_off);
+	uh->len = htons(len - th_off);
+
+	if (src->family == AF_INET) {
+		ih = (void *) p;
+		ih->tot_len = htons(len);
+	}
+	else {
+		ih6 = (void *) p;
+		ih6->payload_len = htons(len - sizeof(*ih6));
+	}
+
+	stream_ring_commit(stream);
+
+out:
+	spin_unlock_irqrestore(&stream->packet_list_lock, flags);
+
+	wake_up_interruptible(&stream->read_wq);
+	return true;
+}
+
 static void add_stream_packet(struct re_stream *stream, struct re_stream_packet *packet) {
 	int err;
 	unsigned long flags;
@@ -3446,6 +4090,10 @@ static int stream_packet(struct rtpengine_table *t, const struct rtpengine_packe
 
 	DBG("data for stream %s\n", stream->info.stream_name);
 
+	err = 0;
+	if (stream_ring_add(stream, data, len))
+		goto out2;
+
 	/* alloc and copy */
 
 	err = -ENOMEM;
@@ -3473,107 +4121,147 @@ out:
 
 
 
-static inline ssize_t proc_control_read_write(struct file *file, char __user *ubuf, size_t buflen,
+static int table_control_msg(struct rtpengine_table *t, struct rtpengine_message *msg, size_t buflen,
 		int writeable)
 {
-	struct inode *inode;
-	uint32_t id;
-	struct rtpengine_table *t;
-	struct rtpengine_message msgbuf;
-	struct rtpengine_message *msg;
-	int err;
-
-	if (buflen < sizeof(*msg))
-		return -EIO;
-	if (buflen == sizeof(*msg))
-		msg = &msgbuf;
-	else { /* > */
-		msg = kmalloc(buflen, GFP_KERNEL);
-		if (!msg)
-			return -ENOMEM;
-	}
-
-	inode = file->f_path.dentry->d_inode;
-	id = (uint32_t) (unsigned long) PDE_DATA(inode);
-	t = get_table(id);
-	err = -ENOENT;
-	if (!t)
-		goto out;
-
-	err = -EFAULT;
-	if (copy_from_user(msg, ubuf, buflen))
-		goto err;
-
-	err = 0;
-
 	switch (msg->cmd) {
 		case REMG_NOOP:
 			if (msg->u.noop.size != sizeof(*msg))
-				err = -EMSGSIZE;
+				return -EMSGSIZE;
 			if (msg->u.noop.last_cmd != __REMG_LAST)
-				err = -ERANGE;
-			break;
+				return -ERANGE;
+			return 0;
 
 		case REMG_ADD_TARGET:
-			err = table_new_target(t, &msg->u.target);
-			break;
+			return table_new_target(t, &msg->u.target);
 
 		case REMG_DEL_TARGET:
-			err = table_del_target(t, &msg->u.target.local);
-			break;
+			return table_del_target(t, &msg->u.target.local);
 
 		case REMG_ADD_DESTINATION:
-			err = table_add_destination(t, &msg->u.destination);
-			break;
+			return table_add_destination(t, &msg->u.destination);
 
 		case REMG_GET_STATS:
-			err = -EINVAL;
 			if (!writeable)
-				goto err;
-			err = table_get_target_stats(t, &msg->u.stats, 0);
-			break;
+				return -EINVAL;
+			return table_get_target_stats(t, &msg->u.stats, 0);
 
 		case REMG_GET_RESET_STATS:
-			err = -EINVAL;
 			if (!writeable)
-				goto err;
-			err = table_get_target_stats(t, &msg->u.stats, 1);
-			break;
+				return -EINVAL;
+			return table_get_target_stats(t, &msg->u.stats, 1);
 
 		case REMG_ADD_CALL:
-			err = -EINVAL;
 			if (!writeable)
-				goto err;
-			err = table_new_call(t, &msg->u.call);
-			break;
+				return -EINVAL;
+			return table_new_call(t, &msg->u.call);
 
 		case REMG_DEL_CALL:
-			err = table_del_call(t, msg->u.call.call_idx);
-			break;
+			return table_del_call(t, msg->u.call.call_idx);
 
 		case REMG_ADD_STREAM:
-			err = -EINVAL;
 			if (!writeable)
-				goto err;
-			err = table_new_stream(t, &msg->u.stream);
-			break;
+				return -EINVAL;
+			return table_new_stream(t, &msg->u.stream);
 
 		case REMG_DEL_STREAM:
-			err = table_del_stream(t, &msg->u.stream);
-			break;
+			return table_del_stream(t, &msg->u.stream);
 
 		case REMG_PACKET:
-			err = stream_packet(t, &msg->u.packet, msg->data, buflen - sizeof(*msg));
-			break;
+			return stream_packet(t, &msg->u.packet, msg->data, buflen - sizeof(*msg));
 
 		default:
 			printk(KERN_WARNING "xt_RTPENGINE unimplemented op %u\n", msg->cmd);
-			err = -EINVAL;
-			break;
+			return -EINVAL;
 	}
+}
 
-	table_put(t);
+/* entries are copied in and out one by one, so that no large buffer is needed */
+static int table_control_batch(struct rtpengine_table *t, const struct rtpengine_batch_info *b,
+		char __user *ubuf, size_t buflen, int writeable)
+{
+	struct rtpengine_message *msg;
+	char __user *entries, *status;
+	unsigned int i;
+	int err, res;
+
+	if (!writeable)
+		return -EINVAL;
+	if (!b->num || b->num > RTPE_MAX_BATCH)
+		return -EINVAL;
+	if (buflen != sizeof(*msg) + b->num * (sizeof(*msg) + sizeof(int)))
+		return -EMSGSIZE;
+
+	msg = kmalloc(sizeof(*msg), GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	entries = ubuf + sizeof(*msg);
+	status = entries + b->num * sizeof(*msg);
+
+	for (i = 0; i < b->num; i++) {
+		err = -EFAULT;
+		if (copy_from_user(msg, entries + i * sizeof(*msg), sizeof(*msg)))
+			goto out;
+
+		if (msg->cmd == REMG_BATCH || msg->cmd == REMG_PACKET)
+			res = -EINVAL;
+		else
+			res = table_control_msg(t, msg, sizeof(*msg), writeable);
 
+		if (!res && copy_to_user(entries + i * sizeof(*msg), msg, sizeof(*msg)))
+			goto out;
+		if (copy_to_user(status + i * sizeof(int), &res, sizeof(res)))
+			goto out;
+	}
+
+	err = 0;
+
+out:
+	kfree(msg);
+	return err;
+}
+
+static inline ssize_t proc_control_read_write(struct file *file, char __user *ubuf, size_t buflen,
+		int writeable)
+{
+	struct inode *inode;
+	uint32_t id;
+	struct rtpengine_table *t;
+	struct rtpengine_message msgbuf;
+	struct rtpengine_message *msg;
+	int err;
+
+	if (buflen < sizeof(*msg))
+		return -EIO;
+
+	inode = file->f_path.dentry->d_inode;
+	id = (uint32_t) (unsigned long) PDE_DATA(inode);
+	t = get_table(id);
+	if (!t)
+		return -ENOENT;
+
+	msg = &msgbuf;
+	err = -EFAULT;
+	if (copy_from_user(msg, ubuf, sizeof(*msg)))
+		goto out;
+
+	if (msg->cmd == REMG_BATCH) {
+		err = table_control_batch(t, &msg->u.batch, ubuf, buflen, writeable);
+		goto out;
+	}
+
+	if (buflen > sizeof(*msg)) {
+		msg = kmalloc(buflen, GFP_KERNEL);
+		err = -ENOMEM;
+		if (!msg)
+			goto out;
+		err = -EFAULT;
+		if (copy_from_user(msg, ubuf, buflen))
+			goto out;
+	}
+
+	err = table_control_msg(t, msg, buflen, writeable);
 	if (err)
 		goto out;
 
@@ -3583,17 +4271,13 @@ static inline ssize_t proc_control_read_write(struct file *file, char __user *ub
 			goto out;
 	}
 
-	if (msg != &msgbuf)
-		kfree(msg);
-
-	return buflen;
-
-err:
-	table_put(t);
 out:
-	if (msg != &msgbuf)
+	table_put(t);
+	if (msg && msg != &msgbuf)
 		kfree(msg);
-	return err;
+	if (err)
+		return err;
+	return buflen;
 }
 static ssize_t proc_control_write(struct file *file, const char __user *ubuf, size_t buflen, loff_t *off) {
 	return proc_control_read_write(file, (char __user *) ubuf, buflen, 0);
@@ -3928,32 +4612,41 @@ static int srtp_hash(unsigned char *hmac,
 		uint64_t pkt_idx)
 {
 	uint32_t roc;
+	int ret = -1;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,0)
+	SHASH_DESC_ON_STACK(dsc, c->shash);
+#else
 	struct shash_desc *dsc;
 	size_t alloc_size;
+#endif
 
 	if (!s->auth_tag_len)
 		return 0;
 
 	roc = htonl((pkt_idx & 0xffffffff0000ULL) >> 16);
 
+	/* the keyed HMAC state is set up once in gen_session_keys(), only the
+	 * descriptor is per packet */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,0)
+	memset(dsc, 0, sizeof(*dsc));
+#else
 	alloc_size = sizeof(*dsc) + crypto_shash_descsize(c->shash);
 	dsc = kmalloc(alloc_size, GFP_ATOMIC);
 	if (!dsc)
 		return -1;
 	memset(dsc, 0, alloc_size);
+#endif
 
 	dsc->tfm = c->shash;
 
 	if (crypto_shash_init(dsc))
-		goto error;
+		goto out;
 
 	crypto_shash_update(dsc, (void *) r->header, r->header_len + r->payload_len);
 	crypto_shash_update(dsc, (void *) &roc, sizeof(roc));
 
 	crypto_shash_final(dsc, hmac);
 
-	kfree(dsc);
-
 	DBG("calculated HMAC %02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x\n",
 			hmac[0], hmac[1], hmac[2], hmac[3],
 			hmac[4], hmac[5], hmac[6], hmac[7],
@@ -3961,11 +4654,13 @@ static int srtp_hash(unsigned char *hmac,
 			hmac[12], hmac[13], hmac[14], hmac[15],
 			hmac[16], hmac[17], hmac[18], hmac[19]);
 
-	return 0;
+	ret = 0;
 
-error:
+out:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,18,0)
 	kfree(dsc);
-	return -1;
+#endif
+	return ret;
 }
 
 /* XXX shared code */
@@ -4099,6 +4794,24 @@ static int srtp_encrypt_aes_cm(struct re_crypto_context *c,
 	ivi[2] ^= idxh;
 	ivi[3] ^= idxl;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+	if (c->skcipher) {
+		SYNC_SKCIPHER_REQUEST_ON_STACK(req, c->skcipher);
+		struct scatterlist sg;
+		int ret;
+
+		/* the counter block is incremented as a 128 bit number, as in RFC 3711 */
+		sg_init_one(&sg, r->payload, r->payload_len);
+		skcipher_request_set_sync_tfm(req, c->skcipher);
+		skcipher_request_set_callback(req, 0, NULL, NULL);
+		skcipher_request_set_crypt(req, &sg, &sg, r->payload_len, iv);
+		ret = crypto_skcipher_encrypt(req);
+		skcipher_request_zero(req);
+
+		return ret;
+	}
+#endif
+
 	aes_ctr(r->payload, r->payload, r->payload_len, c->tfm[0], iv);
 
 	return 0;
@@ -4208,9 +4921,11 @@ static int srtp_decrypt_aes_gcm(struct re_crypto_context *c,
 		sg_set_buf(&sg[1], r->payload, r->payload_len);
 
 		// make copy of payload in case the decyption clobbers it
-		copy = kmalloc(r->payload_len, GFP_ATOMIC);
-		if (copy)
-			memcpy(copy, r->payload, r->payload_len);
+		if (!copy) {
+			copy = kmalloc(r->payload_len, GFP_ATOMIC);
+			if (copy)
+				memcpy(copy, r->payload, r->payload_len);
+		}
 
 		aead_request_set_callback(req, 0, NULL, NULL);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
@@ -4389,6 +5104,24 @@ static struct sk_buff *intercept_skb_copy(struct sk_buff *oskb, const struct re_
 
 
 
+/* must hold the target's ssrc_stats_lock */
+static void stats_slot_update(struct rtpengine_stats_slot *sl, int ssrc_idx,
+		const struct rtpengine_ssrc_stats *s, unsigned int bytes, uint32_t lost)
+{
+	struct rtpengine_ssrc_stats *o = &sl->ssrc_stats[ssrc_idx];
+
+	stats_slot_write_begin(sl);
+	o->basic_stats.packets++;
+	o->basic_stats.bytes += bytes;
+	o->total_lost += lost;
+	o->timestamp = s->timestamp;
+	o->ext_seq = s->ext_seq;
+	o->lost_bits = s->lost_bits;
+	o->transit = s->transit;
+	o->jitter = s->jitter;
+	stats_slot_write_end(sl);
+}
+
 static void rtp_stats(struct rtpengine_target *g, struct rtp_parsed *rtp, s64 arrival_time, int pt_idx,
 		int ssrc_idx)
 {
@@ -4401,12 +5134,15 @@ static void rtp_stats(struct rtpengine_target *g, struct rtp_parsed *rtp, s64 ar
 	uint32_t transit;
 	int32_t d;
 	uint32_t new_seq;
+	uint32_t lost;
 
 	uint16_t seq = ntohs(rtp->header->seq_num);
 	uint32_t ts = ntohl(rtp->header->timestamp);
 
 	spin_lock_irqsave(&g->ssrc_stats_lock, flags);
 
+	lost = s->total_lost;
+
 	s->basic_stats.packets++;
 	s->basic_stats.bytes += rtp->payload_len;
 	s->timestamp = ts;
@@ -4474,6 +5210,9 @@ static void rtp_stats(struct rtpengine_target *g, struct rtp_parsed *rtp, s64 ar
 	if (d < 100000)
 		s->jitter += d - ((s->jitter + 8) >> 4);
 
+	if (g->stats_slot)
+		stats_slot_update(g->stats_slot, ssrc_idx, s, rtp->payload_len, s->total_lost - lost);
+
 	spin_unlock_irqrestore(&g->ssrc_stats_lock, flags);
 }
 
@@ -4637,6 +5376,8 @@ not_rtp:
 		stream = get_stream_lock(NULL, g->target.intercept_stream_idx);
 		if (!stream)
 			goto no_intercept;
+		if (stream_ring_add_skb(stream, skb, src))
+			goto intercept_done;
 		packet = kzalloc(sizeof(*packet), GFP_ATOMIC);
 		if (!packet)
 			goto intercept_done;
@@ -4667,7 +5408,7 @@ no_intercept:
 			skb2 = skb_copy_expand(skb, MAX_HEADER, MAX_SKB_TAIL_ROOM, GFP_ATOMIC);
 			if (!skb2) {
 				log_err("out of memory while creating skb copy");
-				atomic64_inc(&g->stats_in.errors);
+				stats_pcpu_add(&g->stats->in, 0, 0, 1);
 				continue;
 			}
 			offset = skb2->data - skb->data;
@@ -4705,26 +5446,20 @@ no_intercept:
 
 		err = send_proxy_packet(skb2, &o->output.src_addr, &o->output.dst_addr, o->output.tos, par);
 		if (err) {
-			atomic64_inc(&g->stats_in.errors);
-			atomic64_inc(&o->stats_out.errors);
-		}
-		else {
-			atomic64_inc(&o->stats_out.packets);
-			atomic64_add(rtp2.payload_len + rtp2.header_len, &o->stats_out.bytes);
+			stats_pcpu_add(&g->stats->in, 0, 0, 1);
+			stats_pcpu_add(o->stats_out, 0, 0, 1);
 		}
+		else
+			stats_pcpu_add(o->stats_out, 1, rtp2.payload_len + rtp2.header_len, 0);
 	}
 
 do_stats:
-	if (atomic64_read(&g->stats_in.packets)==0)
-		atomic_set(&g->stats_in.tos,in_tos);
+	if (atomic_read(&g->stats_in.tos) < 0)
+		atomic_set(&g->stats_in.tos, in_tos);
 
-	atomic64_inc(&g->stats_in.packets);
-	atomic64_add(datalen, &g->stats_in.bytes);
+	target_stats_in(g, datalen, rtp_pt_idx);
 
 	if (rtp_pt_idx >= 0) {
-		atomic64_inc(&g->rtp_stats[rtp_pt_idx].packets);
-		atomic64_add(datalen, &g->rtp_stats[rtp_pt_idx].bytes);
-
 #if (RE_HAS_MEASUREDELAY)
 		starttime = ktime_to_ns(tstamp);
 		endtime = ktime_to_ns(ktime_get_real());
@@ -4750,10 +5485,6 @@ do_stats:
 		}
 #endif
 	}
-	else if (rtp_pt_idx == -2)
-		/* not RTP */ ;
-	else if (rtp_pt_idx == -1)
-		atomic64_inc(&g->stats_in.errors);
 
 	target_put(g);
 	table_put(t);
@@ -4764,7 +5495,7 @@ do_stats:
 
 skip_error:
 	log_err("x_tables action failed: %s", errstr);
-	atomic64_inc(&g->stats_in.errors);
+	stats_pcpu_add(&g->stats->in, 0, 0, 1);
 skip1:
 	target_put(g);
 skip2:
@@ -4919,6 +5650,9 @@ static int __init init(void) {
 	ret = -EINVAL;
 	if (stream_packets_list_limit <= 0)
 		goto fail;
+	err = "hash_bits parameter must be between 1 and " __stringify(RE_HASH_BITS_MAX);
+	if (hash_bits < 1 || hash_bits > RE_HASH_BITS_MAX)
+		goto fail;
 
 	printk(KERN_NOTICE "Registering xt_RTPENGINE module - version %s\n", RTPENGINE_VERSION);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
@@ -4967,6 +5701,9 @@ static void __exit fini(void) {
 	printk(KERN_NOTICE "Unregistering xt_RTPENGINE module\n");
 	xt_unregister_targets(xt_rtpengine_regs, ARRAY_SIZE(xt_rtpengine_regs));
 
+	/* deferred target puts */
+	rcu_barrier();
+
 	clear_proc(&proc_control);
 	clear_proc(&proc_list);
 	clear_proc(&my_proc_root);
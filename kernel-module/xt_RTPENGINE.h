@@ -6,6 +6,7 @@
 #define RTPE_NUM_PAYLOAD_TYPES 32
 #define RTPE_MAX_FORWARD_DESTINATIONS 32
 #define RTPE_NUM_SSRC_TRACKING 4
+#define RTPE_MAX_BATCH 256
 
 
 
@@ -115,6 +116,8 @@ struct rtpengine_target_info {
 	struct rtpengine_pt_input	pt_input[RTPE_NUM_PAYLOAD_TYPES]; /* must be sorted */
 	unsigned int			num_payload_types;
 
+	unsigned int			stats_idx; // output: slot in the stats region, 0 if none
+
 	unsigned int			rtcp_mux:1,
 					dtls:1,
 					stun:1,
@@ -175,6 +178,13 @@ struct rtpengine_noop_info {
 	int				last_cmd;
 };
 
+/* `data` holds `num` messages without data of their own, executed in order, followed
+ * by an int for each to receive its result (0 or negative errno). Must be sent through
+ * read(), which also returns the messages as each would have been returned on its own. */
+struct rtpengine_batch_info {
+	unsigned int			num; // up to RTPE_MAX_BATCH
+};
+
 struct rtpengine_message {
 	enum {
 		/* noop_info: */
@@ -202,6 +212,9 @@ struct rtpengine_message {
 		REMG_GET_STATS,
 		REMG_GET_RESET_STATS,
 
+		/* batch_info: */
+		REMG_BATCH,
+
 		__REMG_LAST
 	}				cmd;
 
@@ -213,11 +226,46 @@ struct rtpengine_message {
 		struct rtpengine_stream_info	stream;
 		struct rtpengine_packet_info	packet;
 		struct rtpengine_stats_info	stats;
+		struct rtpengine_batch_info	batch;
 	} u;
 
 	unsigned char			data[];
 };
 
+/* Shared memory stats region, mmap'd read-only from /proc/rtpengine/$ID/stats. It's an
+ * array of slots, one per target, and the header in place of slot 0. The slot of a
+ * target is returned in `stats_idx` from a REMG_ADD_TARGET done through read(). The
+ * kernel makes `seq` odd while it updates a slot, so a reader must retry if it found
+ * it odd or changed after the read. The SSRC stats in a slot are never reset. */
+struct rtpengine_stats_header {
+	uint32_t			slot_size;
+	uint32_t			num_slots; // including the header
+};
+struct rtpengine_stats_slot {
+	uint32_t			seq;
+	struct re_address		local; // owner
+	uint32_t			ssrc[RTPE_NUM_SSRC_TRACKING];
+	struct rtpengine_ssrc_stats	ssrc_stats[RTPE_NUM_SSRC_TRACKING];
+};
+
+/* Ring buffer of an intercept stream, set up by mmap()ing the stream's /proc file shared
+ * and writable, with a length of one page for this header plus a power of two number of
+ * pages for the data following it. From then on, packets go into the ring instead of the
+ * queue that read() takes them from, and read() only returns what was queued before,
+ * and EOF. poll() reports POLLIN while the ring isn't empty. Each packet in the ring is
+ * a uint32_t length followed by the packet, padded to RTPE_STREAM_RING_ALIGN. A length
+ * of zero means the rest of the data area is unused and the next packet is at its start.
+ * `head` and `tail` are byte counters taken modulo `size`: the kernel advances `head`
+ * after adding a packet, the reader advances `tail` after it's done with one. Packets
+ * that don't fit are dropped and counted in `dropped`. */
+#define RTPE_STREAM_RING_ALIGN 8
+struct rtpengine_stream_ring {
+	uint32_t			head;
+	uint32_t			tail;
+	uint32_t			size; // of the data area
+	uint32_t			dropped;
+};
+
 struct rtpengine_list_entry {
 	struct rtpengine_target_info	target;
 	struct rtpengine_stats		stats_in;
@@ -35,6 +35,7 @@ static int __ip4_addrport2sockaddr(void *, const sockaddr_t *, unsigned int);
 static int __ip6_addrport2sockaddr(void *, const sockaddr_t *, unsigned int);
 static ssize_t __ip_recvfrom(socket_t *s, void *buf, size_t len, endpoint_t *ep);
 static ssize_t __ip_recvfrom_ts(socket_t *s, void *buf, size_t len, endpoint_t *ep, struct timeval *);
+static int __ip_recvmmsg_ts(socket_t *s, struct socket_mmsg *, unsigned int);
 static ssize_t __ip_sendmsg(socket_t *s, struct msghdr *mh, const endpoint_t *ep);
 static ssize_t __ip_sendto(socket_t *s, const void *buf, size_t len, const endpoint_t *ep);
 static int __ip4_tos(socket_t *, unsigned int);
@@ -82,6 +83,7 @@ static struct socket_family __socket_families[__SF_LAST] = {
 		.timestamping		= __ip_timestamping,
 		.recvfrom		= __ip_recvfrom,
 		.recvfrom_ts		= __ip_recvfrom_ts,
+		.recvmmsg_ts		= __ip_recvmmsg_ts,
 		.sendmsg		= __ip_sendmsg,
 		.sendto			= __ip_sendto,
 		.tos			= __ip4_tos,
@@ -113,6 +115,7 @@ static struct socket_family __socket_families[__SF_LAST] = {
 		.timestamping		= __ip_timestamping,
 		.recvfrom		= __ip_recvfrom,
 		.recvfrom_ts		= __ip_recvfrom_ts,
+		.recvmmsg_ts		= __ip_recvmmsg_ts,
 		.sendmsg		= __ip_sendmsg,
 		.sendto			= __ip_sendto,
 		.tos			= __ip6_tos,
@@ -126,6 +129,7 @@ static struct socket_family __socket_families[__SF_LAST] = {
 
 
 socktype_t *socktype_udp;
+__thread struct socket_recv_queue *socket_recv_queue;
 
 
 
@@ -298,13 +302,39 @@ static int __ip_accept(socket_t *s, socket_t *newsock) {
 
 	return 0;
 }
+static void __ip_msg_ts(struct msghdr *msg, struct timeval *tv) {
+	struct cmsghdr *cm;
+
+	if (tv) {
+		for (cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+			if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
+				*tv = *((struct timeval *) CMSG_DATA(cm));
+				tv = NULL;
+				break;
+			}
+		}
+		if (G_UNLIKELY(tv)) {
+			ilog(LOG_WARNING, "No receive timestamp received from kernel");
+			ZERO(*tv);
+		}
+	}
+	if (G_UNLIKELY((msg->msg_flags & MSG_TRUNC)))
+		ilog(LOG_WARNING, "Kernel indicates that data was truncated");
+	if (G_UNLIKELY((msg->msg_flags & MSG_CTRUNC)))
+		ilog(LOG_WARNING, "Kernel indicates that ancillary data was truncated");
+}
+static ssize_t __ip_recvmsg(socket_t *s, struct msghdr *msg) {
+	struct socket_recv_queue *q = socket_recv_queue;
+	if (q && q->fd == s->fd)
+		return q->recvmsg(q, msg);
+	return recvmsg(s->fd, msg, 0);
+}
 static ssize_t __ip_recvfrom_ts(socket_t *s, void *buf, size_t len, endpoint_t *ep, struct timeval *tv) {
 	ssize_t ret;
 	struct sockaddr_storage sin;
 	struct msghdr msg;
 	struct iovec iov;
 	char ctrl[64];
-	struct cmsghdr *cm;
 
 	ZERO(msg);
 	msg.msg_name = &sin;
@@ -317,28 +347,58 @@ static ssize_t __ip_recvfrom_ts(socket_t *s, void *buf, size_t len, endpoint_t *
 	iov.iov_base = buf;
 	iov.iov_len = len;
 
-	ret = recvmsg(s->fd, &msg, 0);
+	ret = __ip_recvmsg(s, &msg);
 	if (ret < 0)
 		return ret;
 	s->family->sockaddr2endpoint(ep, &sin);
 
-	if (tv) {
-		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
-			if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
-				*tv = *((struct timeval *) CMSG_DATA(cm));
-				tv = NULL;
+	__ip_msg_ts(&msg, tv);
+
+	return ret;
+}
+static int __ip_recvmmsg_ts(socket_t *s, struct socket_mmsg *mm, unsigned int num) {
+	int ret;
+	struct sockaddr_storage sin[MAX_MMSG_BATCH];
+	struct mmsghdr msgs[MAX_MMSG_BATCH];
+	struct iovec iov[MAX_MMSG_BATCH];
+	char ctrl[MAX_MMSG_BATCH][64];
+
+	if (num > MAX_MMSG_BATCH)
+		num = MAX_MMSG_BATCH;
+
+	memset(msgs, 0, sizeof(*msgs) * num);
+	for (unsigned int i = 0; i < num; i++) {
+		msgs[i].msg_hdr.msg_name = &sin[i];
+		msgs[i].msg_hdr.msg_namelen = s->family->sockaddr_size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = ctrl[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+		iov[i].iov_base = mm[i].buf;
+		iov[i].iov_len = mm[i].len;
+	}
+
+	struct socket_recv_queue *q = socket_recv_queue;
+	if (q && q->fd == s->fd) {
+		for (ret = 0; ret < num; ret++) {
+			ssize_t len = q->recvmsg(q, &msgs[ret].msg_hdr);
+			if (len < 0)
 				break;
-			}
-		}
-		if (G_UNLIKELY(tv)) {
-			ilog(LOG_WARNING, "No receive timestamp received from kernel");
-			ZERO(*tv);
+			msgs[ret].msg_len = len;
 		}
+		if (!ret)
+			return -1;
+	}
+	else
+		ret = recvmmsg(s->fd, msgs, num, 0, NULL);
+	if (ret <= 0)
+		return ret;
+
+	for (int i = 0; i < ret; i++) {
+		s->family->sockaddr2endpoint(&mm[i].ep, &sin[i]);
+		mm[i].len = msgs[i].msg_len;
+		__ip_msg_ts(&msgs[i].msg_hdr, &mm[i].tv);
 	}
-	if (G_UNLIKELY((msg.msg_flags & MSG_TRUNC)))
-		ilog(LOG_WARNING, "Kernel indicates that data was truncated");
-	if (G_UNLIKELY((msg.msg_flags & MSG_CTRUNC)))
-		ilog(LOG_WARNING, "Kernel indicates that ancillary data was truncated");
 
 	return ret;
 }
@@ -26,6 +26,7 @@ struct socket_type;
 struct socket_family;
 struct endpoint;
 struct socket;
+struct socket_mmsg;
 struct re_address;
 
 typedef struct socket_address sockaddr_t;
@@ -40,6 +41,7 @@ typedef const struct socket_family sockfamily_t;
 
 
 #define MAX_PACKET_HEADER_LEN 48 // 40 bytes IPv6 + 8 bytes UDP
+#define MAX_MMSG_BATCH 64 // upper limit for recvmmsg/sendmmsg batches
 
 
 
@@ -74,6 +76,7 @@ struct socket_family {
 	int				(*timestamping)(socket_t *);
 	ssize_t				(*recvfrom)(socket_t *, void *, size_t, endpoint_t *);
 	ssize_t				(*recvfrom_ts)(socket_t *, void *, size_t, endpoint_t *, struct timeval *);
+	int				(*recvmmsg_ts)(socket_t *, struct socket_mmsg *, unsigned int);
 	ssize_t				(*sendmsg)(socket_t *, struct msghdr *, const endpoint_t *);
 	ssize_t				(*sendto)(socket_t *, const void *, size_t, const endpoint_t *);
 	int				(*tos)(socket_t *, unsigned int);
@@ -100,11 +103,25 @@ struct socket {
 	endpoint_t			local;
 	endpoint_t			remote;
 };
+struct socket_mmsg {
+	void				*buf;
+	size_t				len; /* buffer size on input, packet size on output */
+	endpoint_t			ep;
+	struct timeval			tv;
+};
+/* packets already received on behalf of a socket, such as by the io_uring poller. while
+ * set for the socket being read, its packets are taken from here */
+struct socket_recv_queue {
+	int				fd;
+	/* as recvmsg(), returning -1 with errno EAGAIN when empty */
+	ssize_t				(*recvmsg)(struct socket_recv_queue *, struct msghdr *);
+};
 
 
 
 
 extern socktype_t *socktype_udp;
+extern __thread struct socket_recv_queue *socket_recv_queue;
 
 
 
@@ -167,6 +184,7 @@ INLINE int is_addr_unspecified(const sockaddr_t *a) {
 }
 #define socket_recvfrom(s,a...) (s)->family->recvfrom((s), a)
 #define socket_recvfrom_ts(s,a...) (s)->family->recvfrom_ts((s), a)
+#define socket_recvmmsg_ts(s,a...) (s)->family->recvmmsg_ts((s), a)
 #define socket_sendmsg(s,a...) (s)->family->sendmsg((s), a)
 #define socket_sendto(s,a...) (s)->family->sendto((s), a)
 #define socket_error(s) (s)->family->error((s))
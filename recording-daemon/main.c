@@ -34,6 +34,7 @@
 
 int ktable = 0;
 int num_threads;
+int stream_ring_size = 64;
 enum output_storage_enum output_storage = OUTPUT_STORAGE_FILE;
 char *spool_dir = NULL;
 char *output_dir = NULL;
@@ -191,6 +192,7 @@ static void options(int *argc, char ***argv) {
 		{ "table",		't', 0, G_OPTION_ARG_INT,	&ktable,	"Kernel table rtpengine uses",		"INT"		},
 		{ "spool-dir",		0,   0, G_OPTION_ARG_STRING,	&spool_dir,	"Directory containing rtpengine metadata files", "PATH" },
 		{ "num-threads",	0,   0, G_OPTION_ARG_INT,	&num_threads,	"Number of worker threads",		"INT"		},
+		{ "stream-ring-size",	0,   0, G_OPTION_ARG_INT,	&stream_ring_size,"Kernel ring buffer per stream in kB, or 0 to read packets one by one","INT"},
 		{ "output-storage",	0,   0, G_OPTION_ARG_STRING,	&os_str,	"Where to store audio streams",	        "file|db|both"	},
 		{ "output-dir",		0,   0, G_OPTION_ARG_STRING,	&output_dir,	"Where to write media files to",	"PATH"		},
 		{ "output-pattern",	0,   0, G_OPTION_ARG_STRING,	&output_pattern,"File name pattern for recordings",	"STRING"	},
@@ -308,6 +310,8 @@ static void options(int *argc, char ***argv) {
 
 	if (num_threads <= 0)
 		num_threads = num_cpu_cores(8);
+	if (stream_ring_size < 0)
+		die("Invalid stream-ring-size %i", stream_ring_size);
 
 	if (!output_pattern)
 		output_pattern = g_strdup("%c-%t");
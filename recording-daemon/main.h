@@ -19,6 +19,7 @@ enum mix_method {
 
 extern int ktable;
 extern int num_threads;
+extern int stream_ring_size;
 extern enum output_storage_enum output_storage;
 extern char *spool_dir;
 extern char *output_dir;
@@ -309,7 +309,7 @@ static void packet_decode(ssrc_t *ssrc, packet_t *packet) {
 }
 
 
-// ssrc is locked and must be unlocked when returning
+// ssrc is locked
 static void ssrc_run(ssrc_t *ssrc) {
 	while (1) {
 		// see if we have a packet with the correct seq nr in the queue
@@ -324,19 +324,35 @@ static void ssrc_run(ssrc_t *ssrc) {
 		packet_free(packet);
 		dbg("packets left in queue: %i", g_tree_nnodes(ssrc->sequencer.packets));
 	}
+}
 
-	pthread_mutex_unlock(&ssrc->lock);
+
+// ssrc is locked. a packet that stays in the sequencer can't point into the kernel's ring
+static void packet_copy_buffer(packet_t *packet, const unsigned char *buf, unsigned len) {
+	unsigned char *copy = malloc(len + PACKET_PADDING);
+	memcpy(copy, buf, len);
+#define REBASE(p) (p) = (void *) (copy + ((const unsigned char *) (p) - buf))
+	if (packet->ip)
+		REBASE(packet->ip);
+	if (packet->ip6)
+		REBASE(packet->ip6);
+	REBASE(packet->udp);
+	REBASE(packet->rtp);
+	REBASE(packet->payload.s);
+#undef REBASE
+	packet->buffer = copy;
 }
 
 
-// stream is unlocked, buf is malloc'd
-void packet_process(stream_t *stream, unsigned char *buf, unsigned len) {
+// stream is unlocked. buf is malloc'd and consumed if `owned`, otherwise it's only valid
+// until this returns
+static void __packet_process(stream_t *stream, unsigned char *buf, unsigned len, bool owned) {
 	packet_t *packet = g_slice_alloc0(sizeof(*packet));
-	packet->buffer = buf; // handing it over
+	packet->buffer = owned ? buf : NULL; // handing it over
 
 	// XXX more checking here
 	str bufstr;
-	str_init_len(&bufstr, packet->buffer, len);
+	str_init_len(&bufstr, buf, len);
 	packet->ip = (void *) bufstr.s;
 	// XXX kernel already does this - add metadata?
 	if (packet->ip->version == 4) {
@@ -373,6 +389,10 @@ void packet_process(stream_t *stream, unsigned char *buf, unsigned len) {
 
 	// got a new packet, run the decoder
 	ssrc_run(ssrc);
+	// still waiting for an earlier one?
+	if (!owned && g_tree_lookup(ssrc->sequencer.packets, GINT_TO_POINTER(packet->p.seq)) == packet)
+		packet_copy_buffer(packet, buf, len);
+	pthread_mutex_unlock(&ssrc->lock);
 	log_info_ssrc = 0;
 	return;
 
@@ -389,3 +409,13 @@ ignore:
 	packet_free(packet);
 	log_info_ssrc = 0;
 }
+
+// stream is unlocked, buf is malloc'd
+void packet_process(stream_t *stream, unsigned char *buf, unsigned len) {
+	__packet_process(stream, buf, len, true);
+}
+
+// stream is unlocked, buf points into the kernel's ring and is copied only if it must be kept
+void packet_process_ring(stream_t *stream, unsigned char *buf, unsigned len) {
+	__packet_process(stream, buf, len, false);
+}
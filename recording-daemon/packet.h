@@ -2,11 +2,22 @@
 #define _PACKET_H_
 
 #include "types.h"
+#include <libavcodec/avcodec.h>
+
+#ifndef AV_INPUT_BUFFER_PADDING_SIZE
+#define AV_INPUT_BUFFER_PADDING_SIZE 0
+#endif
+#ifndef FF_INPUT_BUFFER_PADDING_SIZE
+#define FF_INPUT_BUFFER_PADDING_SIZE 0
+#endif
+// decoders may read this far past the end of a packet
+#define PACKET_PADDING (AV_INPUT_BUFFER_PADDING_SIZE + FF_INPUT_BUFFER_PADDING_SIZE)
 
 void ssrc_close(ssrc_t *s);
 void ssrc_free(void *p);
 
 void packet_process(stream_t *, unsigned char *, unsigned len);
+void packet_process_ring(stream_t *, unsigned char *, unsigned len);
 
 void ssrc_tls_state(ssrc_t *ssrc);
 
@@ -4,7 +4,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <fcntl.h>
-#include <libavcodec/avcodec.h>
+#include <sys/mman.h>
 #include "metafile.h"
 #include "epoll.h"
 #include "log.h"
@@ -12,16 +12,11 @@
 #include "packet.h"
 #include "forward.h"
 #include "recaux.h"
+#include "xt_RTPENGINE.h"
 
 
 #define MAXBUFLEN 65535
-#ifndef AV_INPUT_BUFFER_PADDING_SIZE
-#define AV_INPUT_BUFFER_PADDING_SIZE 0
-#endif
-#ifndef FF_INPUT_BUFFER_PADDING_SIZE
-#define FF_INPUT_BUFFER_PADDING_SIZE 0
-#endif
-#define ALLOCLEN (MAXBUFLEN + AV_INPUT_BUFFER_PADDING_SIZE + FF_INPUT_BUFFER_PADDING_SIZE)
+#define ALLOCLEN (MAXBUFLEN + PACKET_PADDING)
 
 
 // stream is locked
@@ -29,6 +24,12 @@ void stream_close(stream_t *stream) {
 	if (stream->fd == -1)
 		return;
 	epoll_del(stream->fd);
+	if (stream->ring) {
+		// otherwise unmapped by the handler once it's done with it
+		if (!stream->ring_reading)
+			munmap(stream->ring, stream->ring_len);
+		stream->ring = NULL;
+	}
 	close(stream->fd);
 	stream->fd = -1;
 }
@@ -38,9 +39,109 @@ void stream_free(stream_t *stream) {
 }
 
 
+// stream is unlocked
+static void stream_forward(stream_t *stream, unsigned char *buf, unsigned int len) {
+	if (!forward_to)
+		return;
+	if (forward_packet(stream->metafile,buf,len)) // leaves buf intact
+		g_atomic_int_inc(&stream->metafile->forward_failed);
+	else
+		g_atomic_int_inc(&stream->metafile->forward_count);
+}
+
+// stream is unlocked
+static void stream_packet(stream_t *stream, unsigned char *buf, unsigned int len) {
+	stream_forward(stream, buf, len);
+	if (decoding_enabled)
+		packet_process(stream, buf, len); // consumes buf
+	else
+		free(buf);
+}
+
+
+// stream is unlocked, with ring_reading set. processes the packets in the kernel's
+// ring where they are, handing the space of each back to the kernel when done
+static void stream_ring_read(stream_t *stream, struct rtpengine_stream_ring *ring, size_t ring_len) {
+	unsigned char *data = (unsigned char *) ring + getpagesize();
+	uint32_t size = ring_len - getpagesize();
+	uint32_t tail = ring->tail;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	while (tail != head) {
+		uint32_t off = tail & (size - 1);
+		uint32_t len = *(uint32_t *) (data + off);
+		if (!len) {
+			// rest of the ring is unused
+			tail += size - off;
+			continue;
+		}
+		if (len > size - off - sizeof(uint32_t) || len > MAXBUFLEN) {
+			ilog(LOG_ERR, "Invalid packet length %u in kernel ring of stream %s", len, stream->name);
+			tail = head;
+			break;
+		}
+
+		unsigned char *buf = data + off + sizeof(uint32_t);
+		if (size - off - sizeof(uint32_t) - len >= PACKET_PADDING) {
+			stream_forward(stream, buf, len);
+			if (decoding_enabled)
+				packet_process_ring(stream, buf, len); // copies buf if it must be kept
+		}
+		else {
+			// decoders could read past the end of the mapping
+			unsigned char *copy = malloc(len + PACKET_PADDING);
+			memcpy(copy, buf, len);
+			stream_packet(stream, copy, len);
+		}
+
+		// hand the space back to the kernel
+		tail += (sizeof(uint32_t) + len + RTPE_STREAM_RING_ALIGN - 1) & ~(RTPE_STREAM_RING_ALIGN - 1);
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	// and what was skipped
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+// stream is locked
+static void stream_ring_dropped(stream_t *stream) {
+	uint32_t dropped = __atomic_load_n(&stream->ring->dropped, __ATOMIC_RELAXED);
+	if (dropped != stream->ring_dropped) {
+		ilog(LOG_WARN, "Kernel ring of stream %s was full, %u packets lost",
+				stream->name, dropped - stream->ring_dropped);
+		stream->ring_dropped = dropped;
+	}
+}
+
+
+// stream is locked. returns the length of a packet read into *bufp, zero if there's
+// nothing to read, or -1 if the stream was closed
+static int stream_read(stream_t *stream, unsigned char **bufp) {
+	unsigned char *buf = malloc(ALLOCLEN);
+	int ret = read(stream->fd, buf, MAXBUFLEN);
+	if (ret > 0) {
+		*bufp = buf;
+		return ret;
+	}
+	free(buf);
+
+	if (ret == 0) {
+		ilog(LOG_INFO, "EOF on stream %s", stream->name);
+		stream_close(stream);
+		return -1;
+	}
+	if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)
+		return 0;
+	ilog(LOG_INFO, "Read error on stream %s: %s", stream->name, strerror(errno));
+	stream_close(stream);
+	return -1;
+}
+
+
 static void stream_handler(handler_t *handler) {
 	stream_t *stream = handler->ptr;
 	unsigned char *buf = NULL;
+	int ret;
 
 	log_info_call = stream->metafile->name;
 	log_info_stream = stream->name;
@@ -52,42 +153,62 @@ static void stream_handler(handler_t *handler) {
 	if (stream->fd == -1)
 		goto out;
 
-	buf = malloc(ALLOCLEN);
-	int ret = read(stream->fd, buf, MAXBUFLEN);
-	if (ret == 0) {
-		ilog(LOG_INFO, "EOF on stream %s", stream->name);
-		stream_close(stream);
-		goto out;
-	}
-	else if (ret < 0) {
-		if (errno == EAGAIN || errno == EINTR || errno == EWOULDBLOCK)
+	// with a ring, read() only returns packets queued before the ring was set up, and EOF.
+	// those are older than anything in the ring, so they're drained first
+	while (stream->ring && !stream->ring_drained) {
+		ret = stream_read(stream, &buf);
+		if (ret < 0)
+			goto out;
+		if (ret == 0) {
+			stream->ring_drained = 1;
+			break;
+		}
+
+		pthread_mutex_unlock(&stream->lock);
+		stream_packet(stream, buf, ret);
+		buf = NULL;
+		pthread_mutex_lock(&stream->lock);
+
+		if (stream->fd == -1)
 			goto out;
-		ilog(LOG_INFO, "Read error on stream %s: %s", stream->name, strerror(errno));
-		stream_close(stream);
-		goto out;
 	}
 
-	// got a packet
-	pthread_mutex_unlock(&stream->lock);
+	// the ring is processed without holding the lock, by one handler at a time. if the
+	// stream gets closed in the meantime, unmapping the ring is left to us
+	if (stream->ring && !stream->ring_reading) {
+		struct rtpengine_stream_ring *ring = stream->ring;
+		size_t ring_len = stream->ring_len;
+
+		stream->ring_reading = 1;
+		pthread_mutex_unlock(&stream->lock);
 
-	if (forward_to){
-		if (forward_packet(stream->metafile,buf,ret)) // leaves buf intact
-			g_atomic_int_inc(&stream->metafile->forward_failed);
+		stream_ring_read(stream, ring, ring_len);
+
+		pthread_mutex_lock(&stream->lock);
+		stream->ring_reading = 0;
+		if (stream->ring != ring)
+			munmap(ring, ring_len);
 		else
-			g_atomic_int_inc(&stream->metafile->forward_count);
+			stream_ring_dropped(stream);
+
+		if (stream->fd == -1)
+			goto out;
 	}
-	if (decoding_enabled)
-		packet_process(stream, buf, ret); // consumes buf
-	else
-		free(buf);
 
-	log_info_call = NULL;
-	log_info_stream = NULL;
-	return;
+	ret = stream_read(stream, &buf);
+	if (ret <= 0)
+		goto out;
+
+	// got a packet
+	pthread_mutex_unlock(&stream->lock);
+
+	stream_packet(stream, buf, ret);
+	goto done;
 
 out:
 	pthread_mutex_unlock(&stream->lock);
 	free(buf);
+done:
 	log_info_call = NULL;
 	log_info_stream = NULL;
 }
@@ -122,16 +243,37 @@ void stream_open(metafile_t *mf, unsigned long id, char *name) {
 	stream_t *stream = stream_get(mf, id);
 
 	stream->name = g_string_chunk_insert(mf->gsc, name);
+	stream->ring_dropped = 0;
+	stream->ring_drained = 0;
 
 	char fnbuf[PATH_MAX];
 	snprintf(fnbuf, sizeof(fnbuf), "/proc/rtpengine/%u/calls/%s/%s", ktable, mf->parent, name);
 
-	stream->fd = open(fnbuf, O_RDONLY | O_NONBLOCK);
+	// the ring is mapped writable to hand back the space we're done with.
+	// older kernel modules only allow reading
+	stream->fd = -1;
+	if (stream_ring_size)
+		stream->fd = open(fnbuf, O_RDWR | O_NONBLOCK);
+	if (stream->fd == -1)
+		stream->fd = open(fnbuf, O_RDONLY | O_NONBLOCK);
 	if (stream->fd == -1) {
 		ilog(LOG_ERR, "Failed to open kernel stream %s: %s", fnbuf, strerror(errno));
 		return;
 	}
 
+	if (stream_ring_size) {
+		// one page of header plus a power of two number of pages
+		size_t size = getpagesize();
+		while (size < (size_t) stream_ring_size * 1024)
+			size <<= 1;
+		stream->ring_len = getpagesize() + size;
+		void *ring = mmap(NULL, stream->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, stream->fd, 0);
+		if (ring == MAP_FAILED)
+			ilog(LOG_DEBUG, "Not using kernel ring for stream %s: %s", fnbuf, strerror(errno));
+		else
+			stream->ring = ring;
+	}
+
 	// add to epoll
 	stream->handler.ptr = stream;
 	stream->handler.func = stream_handler;
@@ -23,6 +23,7 @@ struct ip6_hdr;
 struct udphdr;
 struct rtp_header;
 struct streambuf;
+struct rtpengine_stream_ring;
 
 
 struct handler_s;
@@ -54,7 +55,12 @@ struct stream_s {
 	unsigned long tag;
 	int fd;
 	handler_t handler;
+	struct rtpengine_stream_ring *ring; // mmap'd kernel ring, or NULL to read() packets
+	size_t ring_len; // of the mapping
+	unsigned int ring_dropped;
 	unsigned int forwarding_on:1;
+	unsigned int ring_reading:1; // a handler is processing the ring without the lock
+	unsigned int ring_drained:1; // no more packets queued from before the ring was set up
 	double start_time;
 };
 typedef struct stream_s stream_t;
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <glib.h>
+#include "str.h"
+#include "sharded_hash.h"
+
+// Throughput of the call table under the access pattern of call_get_or_create(),
+// call_get() and call_destroy(): each thread creates calls, looks them up a few
+// times as signalling and timers would, and deletes them again, while the table
+// holds a standing population of other calls. A single shard corresponds to the
+// former global hash table behind one lock.
+
+#define NUM_STANDING	20000
+#define NUM_OPS		200000 // calls created and destroyed per thread
+#define NUM_GETS	4 // lookups per call
+#define MAX_THREADS	16
+
+struct bench_call {
+	str callid;
+	char buf[48];
+};
+
+struct bench_thread {
+	pthread_t thread;
+	struct sharded_hash *h;
+	unsigned int idx;
+	struct bench_call *calls;
+};
+
+static void call_init_id(struct bench_call *c, const char *pref, unsigned int a, unsigned int b) {
+	int len = snprintf(c->buf, sizeof(c->buf), "%s-%08x-%u@192.168.1.%u", pref, a * 2654435761u, b, a % 250);
+	str_init_len(&c->callid, c->buf, len);
+}
+
+static void call_create(struct sharded_hash *h, struct bench_call *c) {
+	struct sharded_hash_shard *sh = sharded_hash_shard(h, &c->callid);
+
+	rwlock_lock_r(&sh->lock);
+	void *found = g_hash_table_lookup(sh->ht, &c->callid);
+	rwlock_unlock_r(&sh->lock);
+	assert(found == NULL);
+
+	rwlock_lock_w(&sh->lock);
+	assert(g_hash_table_lookup(sh->ht, &c->callid) == NULL);
+	sharded_hash_insert_nl(h, sh, &c->callid, c);
+	rwlock_unlock_w(&sh->lock);
+}
+
+static void call_get(struct sharded_hash *h, struct bench_call *c) {
+	struct sharded_hash_shard *sh = sharded_hash_shard(h, &c->callid);
+
+	rwlock_lock_r(&sh->lock);
+	void *found = g_hash_table_lookup(sh->ht, &c->callid);
+	rwlock_unlock_r(&sh->lock);
+	assert(found == c);
+}
+
+static void call_destroy(struct sharded_hash *h, struct bench_call *c) {
+	struct sharded_hash_shard *sh = sharded_hash_shard(h, &c->callid);
+
+	rwlock_lock_w(&sh->lock);
+	assert(g_hash_table_lookup(sh->ht, &c->callid) == c);
+	bool ret = sharded_hash_remove_nl(h, sh, &c->callid);
+	rwlock_unlock_w(&sh->lock);
+	assert(ret);
+}
+
+static void *bench_thread(void *p) {
+	struct bench_thread *bt = p;
+
+	// a few calls in progress at a time
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		call_create(bt->h, &bt->calls[i]);
+		if (i >= 8) {
+			struct bench_call *c = &bt->calls[i - 8];
+			for (unsigned int j = 0; j < NUM_GETS; j++)
+				call_get(bt->h, c);
+			call_destroy(bt->h, c);
+		}
+	}
+	for (unsigned int i = NUM_OPS - 8; i < NUM_OPS; i++) {
+		for (unsigned int j = 0; j < NUM_GETS; j++)
+			call_get(bt->h, &bt->calls[i]);
+		call_destroy(bt->h, &bt->calls[i]);
+	}
+
+	return NULL;
+}
+
+static bool count_entry(void *key, void *value, void *arg) {
+	unsigned int *num = arg;
+	(*num)++;
+	return true;
+}
+
+static void bench(unsigned int bits, unsigned int num_threads, struct bench_call *standing,
+		struct bench_thread *threads)
+{
+	struct sharded_hash h;
+	sharded_hash_init(&h, bits, str_hash, str_equal);
+
+	for (unsigned int i = 0; i < NUM_STANDING; i++)
+		call_create(&h, &standing[i]);
+
+	int64_t start = g_get_monotonic_time();
+	for (unsigned int i = 0; i < num_threads; i++) {
+		threads[i].h = &h;
+		pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]);
+	}
+	for (unsigned int i = 0; i < num_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	int64_t dur = g_get_monotonic_time() - start;
+
+	unsigned int num = 0;
+	sharded_hash_foreach(&h, count_entry, &num);
+	assert(num == NUM_STANDING);
+	assert(sharded_hash_size(&h) == NUM_STANDING);
+
+	double calls = (double) NUM_OPS * num_threads;
+	printf("%3u shards %3u threads: %10.0f calls/s, %10.0f ops/s\n",
+			1u << bits, num_threads, calls * 1000000.0 / dur,
+			calls * (2 + NUM_GETS) * 1000000.0 / dur);
+
+	sharded_hash_destroy(&h);
+}
+
+int main(void) {
+	struct bench_call *standing = g_new(struct bench_call, NUM_STANDING);
+	for (unsigned int i = 0; i < NUM_STANDING; i++)
+		call_init_id(&standing[i], "standing", i, 0);
+
+	struct bench_thread threads[MAX_THREADS];
+	for (unsigned int i = 0; i < MAX_THREADS; i++) {
+		threads[i].idx = i;
+		threads[i].calls = g_new(struct bench_call, NUM_OPS);
+		for (unsigned int j = 0; j < NUM_OPS; j++)
+			call_init_id(&threads[i].calls[j], "bench", j, i);
+	}
+
+	static const unsigned int shard_bits[] = { 0, 6 }; // one lock, as many shards as for calls
+	for (unsigned int b = 0; b < G_N_ELEMENTS(shard_bits); b++) {
+		for (unsigned int t = 1; t <= MAX_THREADS; t *= 2)
+			bench(shard_bits[b], t, standing, threads);
+	}
+
+	for (unsigned int i = 0; i < MAX_THREADS; i++)
+		g_free(threads[i].calls);
+	g_free(standing);
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include "../kernel-module/xt_RTPENGINE.c"
+#include <assert.h>
+#include <inttypes.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+#include "kernel-fastpath.h"
+
+// Cost of an RTP packet through the kernel module's packet path, from the
+// xtables target function to the output, built in userspace against
+// kernel-shim.h. Crypto is done by OpenSSL here, so SRTP numbers show the cost
+// around the cipher more than the cipher the kernel would pick.
+
+#define NUM_PACKETS	1000000
+#define NUM_SRTP	4096 // pre-encrypted packets, replayed for decryption
+#define RING_SIZE	(256 * 1024)
+#define RING_BATCH	64 // packets between ring reads
+
+enum intercept {
+	NO_INTERCEPT = 0,
+	INTERCEPT_QUEUE, // read() per packet
+	INTERCEPT_RING, // ring read in batches
+};
+
+struct bench {
+	const char *name;
+	uint16_t port; // target
+	const struct rtpengine_srtp *decrypt, *encrypt;
+	enum intercept intercept;
+};
+
+static const struct rtpengine_srtp aes_cm = {
+	.cipher = REC_AES_CM_128,
+	.hmac = REH_HMAC_SHA1,
+	.master_key = "0123456789abcdef",
+	.master_key_len = 16,
+	.master_salt = "0123456789abcd",
+	.master_salt_len = 14,
+	.session_key_len = 16,
+	.session_salt_len = 14,
+	.auth_tag_len = 10,
+};
+static const struct rtpengine_srtp aes_gcm = {
+	.cipher = REC_AEAD_AES_GCM_128,
+	.hmac = REH_NULL,
+	.master_key = "0123456789abcdef",
+	.master_key_len = 16,
+	.master_salt = "0123456789ab",
+	.master_salt_len = 12,
+	.session_key_len = 16,
+	.session_salt_len = 12,
+};
+
+static const struct bench benches[] = {
+	{ "RTP",			5000 },
+	{ "AES-CM-128 encrypt",		5002, .encrypt = &aes_cm },
+	{ "AES-CM-128 decrypt",		5004, .decrypt = &aes_cm },
+	{ "AEAD-AES-GCM-128 encrypt",	5006, .encrypt = &aes_gcm },
+	{ "AEAD-AES-GCM-128 decrypt",	5008, .decrypt = &aes_gcm },
+	{ "RTP intercept, queue",	5010, .intercept = INTERCEPT_QUEUE },
+	{ "RTP intercept, ring",	5012, .intercept = INTERCEPT_RING },
+};
+
+static struct sk_buff *captured[NUM_SRTP];
+static unsigned int num_captured, num_output, num_intercepted;
+
+int kshim_output(struct sk_buff *skb) {
+	num_output++;
+	if (num_captured < NUM_SRTP) {
+		captured[num_captured++] = skb;
+		return 0;
+	}
+	kfree_skb(skb);
+	return 0;
+}
+
+// what the recording daemon does with intercept streams
+static void consume_queue(unsigned int stream_idx) {
+	struct inode inode = {
+		.data = (void *) (unsigned long) stream_idx,
+	};
+	struct dentry dentry = {
+		.d_inode = &inode,
+	};
+	struct file file = {
+		.f_flags = O_NONBLOCK,
+		.f_path = {
+			.dentry = &dentry,
+		},
+	};
+	char buf[2048];
+
+	while (proc_stream_read(&file, buf, sizeof(buf), NULL) > 0)
+		num_intercepted++;
+}
+static void consume_ring(struct rtpengine_stream_ring *ring) {
+	unsigned char *data = (unsigned char *) ring + PAGE_SIZE;
+	char buf[2048];
+	uint32_t tail = ring->tail;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	while (tail != head) {
+		uint32_t off = tail & (ring->size - 1);
+		uint32_t len = *(uint32_t *) (data + off);
+		if (!len) {
+			tail += ring->size - off;
+			continue;
+		}
+		memcpy(buf, data + off + sizeof(uint32_t), len);
+		// headers as they were received
+		struct udphdr *uh = (void *) (buf + sizeof(struct iphdr));
+		assert(ntohs(uh->len) == len - sizeof(struct iphdr));
+		tail += ALIGN(sizeof(uint32_t) + len, RTPE_STREAM_RING_ALIGN);
+		num_intercepted++;
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+static double run(struct sk_buff **skbs, unsigned int num_skbs, uint64_t *cycles,
+		enum intercept intercept, unsigned int stream_idx, struct rtpengine_stream_ring *ring)
+{
+	struct rtp_header *rtp = fastpath_rtp_header(skbs[0]);
+
+	num_output = 0;
+	num_intercepted = 0;
+	int64_t start = kshim_now_ns();
+#ifdef HAVE_RDTSC
+	uint64_t tsc = __rdtsc();
+#endif
+	for (unsigned int i = 0; i < NUM_PACKETS; i++) {
+		if (num_skbs == 1)
+			rtp->seq_num = htons(i);
+		fastpath_packet(skbs[i % num_skbs]);
+		if (intercept == INTERCEPT_QUEUE)
+			consume_queue(stream_idx);
+		else if (intercept == INTERCEPT_RING && (i % RING_BATCH) == RING_BATCH - 1)
+			consume_ring(ring);
+	}
+#ifdef HAVE_RDTSC
+	*cycles = (__rdtsc() - tsc) / NUM_PACKETS;
+#else
+	*cycles = 0;
+#endif
+	int64_t dur = kshim_now_ns() - start;
+
+	assert(num_output == NUM_PACKETS);
+	if (intercept)
+		assert(num_intercepted == NUM_PACKETS);
+	return (double) dur / NUM_PACKETS;
+}
+
+static void bench(const struct bench *b, unsigned int stream_idx, struct rtpengine_stream_ring *ring) {
+	struct sk_buff *skb = fastpath_rtp_skb(b->decrypt ? b->port - 1 : b->port, RTP_PAYLOAD_LEN);
+	struct sk_buff **skbs = &skb;
+	unsigned int num_skbs = 1;
+	uint64_t cycles;
+
+	if (b->decrypt) {
+		// encrypted packets to replay, addressed to the decrypting target
+		num_captured = 0;
+		for (unsigned int i = 0; i < NUM_SRTP; i++) {
+			fastpath_rtp_header(skb)->seq_num = htons(i);
+			fastpath_packet(skb);
+		}
+		assert(num_captured == NUM_SRTP);
+		skbs = captured;
+		num_skbs = NUM_SRTP;
+	}
+	else
+		num_captured = NUM_SRTP; // don't keep outputs
+
+	double ns = run(skbs, num_skbs, &cycles, b->intercept, stream_idx, ring);
+	printf("%-26s %6.0f ns per packet, %10.0f packets/s", b->name, ns, 1e9 / ns);
+	if (cycles)
+		printf(", %6" PRIu64 " cycles per packet", cycles);
+	printf("\n");
+
+	if (b->decrypt) {
+		for (unsigned int i = 0; i < NUM_SRTP; i++)
+			kfree_skb(captured[i]);
+	}
+	kfree_skb(skb);
+}
+
+int main(void) {
+	struct rtpengine_table *t = fastpath_init();
+	unsigned int stream_idx[ARRAY_SIZE(benches)];
+	struct rtpengine_stream_ring *ring[ARRAY_SIZE(benches)] = { 0 };
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(benches); i++) {
+		const struct bench *b = &benches[i];
+		struct rtpengine_target_info reti;
+		char name[16];
+
+		fastpath_target_info(&reti, b->port, b->decrypt);
+		if (b->intercept) {
+			snprintf(name, sizeof(name), "%u", b->port);
+			stream_idx[i] = fastpath_add_stream(t, name);
+			if (b->intercept == INTERCEPT_RING)
+				ring[i] = fastpath_stream_ring(stream_idx[i], RING_SIZE);
+			reti.do_intercept = 1;
+			reti.intercept_stream_idx = stream_idx[i];
+		}
+		fastpath_add(t, &reti, b->port + 100, b->encrypt);
+		// a decrypting target gets its input from an encrypting one just
+		// below it, with its own ROC starting from zero
+		if (b->decrypt)
+			fastpath_add_target(t, b->port - 1, b->port, NULL, b->decrypt);
+	}
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(benches); i++)
+		bench(&benches[i], stream_idx[i], ring[i]);
+
+	fini();
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "poller.h"
+#include "main.h"
+#include "aux.h"
+#include "control_ng.h"
+#include "socket.h"
+
+int _log_facility_rtcp;
+int _log_facility_cdr;
+int _log_facility_dtmf;
+struct rtpengine_config rtpe_config;
+struct rtpengine_config initial_rtpe_config;
+struct poller *rtpe_poller;
+struct poller_map *rtpe_poller_map;
+GString *dtmf_logs;
+struct control_ng *rtpe_control_ng[2];
+
+#define NUM_SOCKETS	64
+#define NUM_PACKETS	500000
+#define PACKET_SIZE	172
+
+static volatile int bench_done;
+static volatile gint received;
+static volatile gint wakeups;
+
+static socket_t socks[NUM_SOCKETS];
+
+// reads through the socket layer like the media socket handlers, so that with
+// multishot receive the packets come from the poller's buffers
+static void bench_readable(int fd, void *p, uintptr_t u) {
+	char buf[2048];
+	endpoint_t ep;
+	g_atomic_int_inc(&wakeups);
+	while (1) {
+		ssize_t ret = socket_recvfrom(&socks[u], buf, sizeof(buf), &ep);
+		if (ret < 0)
+			break;
+		g_atomic_int_inc(&received);
+	}
+}
+
+static void bench_closed(int fd, void *p, uintptr_t u) {
+	abort();
+}
+
+static void *bench_poller_thread(void *p) {
+	while (!bench_done)
+		poller_poll(p, 100);
+	return NULL;
+}
+
+static void bench(const char *name, bool recv) {
+	struct poller *p = poller_new();
+	struct sockaddr_in sins[NUM_SOCKETS];
+	char buf[PACKET_SIZE] = {0,};
+	sockaddr_t lo;
+
+	assert(sockaddr_parse_any(&lo, "127.0.0.1") == 0);
+
+	for (int i = 0; i < NUM_SOCKETS; i++) {
+		assert(open_socket(&socks[i], SOCK_DGRAM, 0, &lo) == 0);
+		int rcvbuf = 4 * 1024 * 1024;
+		setsockopt(socks[i].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		socklen_t sl = sizeof(sins[i]);
+		assert(getsockname(socks[i].fd, (struct sockaddr *) &sins[i], &sl) == 0);
+
+		struct poller_item pi;
+		ZERO(pi);
+		pi.fd = socks[i].fd;
+		pi.uintp = i;
+		pi.recv = recv;
+		pi.readable = bench_readable;
+		pi.closed = bench_closed;
+		assert(poller_add_item(p, &pi) == 0);
+	}
+
+	int snd = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(snd >= 0);
+
+	bench_done = 0;
+	g_atomic_int_set(&received, 0);
+	g_atomic_int_set(&wakeups, 0);
+
+	pthread_t thr;
+	pthread_create(&thr, NULL, bench_poller_thread, p);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	unsigned int sent = 0;
+	for (unsigned int i = 0; i < NUM_PACKETS; i++) {
+		struct sockaddr_in *sin = &sins[i % NUM_SOCKETS];
+		if (sendto(snd, buf, sizeof(buf), 0, (struct sockaddr *) sin, sizeof(*sin)) == sizeof(buf))
+			sent++;
+	}
+
+	// wait for the receiver to catch up, or until nothing happened for a while
+	int last = -1, idle = 0;
+	while (idle < 100) {
+		int now = g_atomic_int_get(&received);
+		if (now >= sent)
+			break;
+		if (now == last)
+			idle++;
+		else
+			idle = 0;
+		last = now;
+		usleep(1000);
+	}
+
+	gettimeofday(&end, NULL);
+	bench_done = 1;
+	pthread_join(thr, NULL);
+
+	long long us = timeval_diff(&end, &start);
+	int recvd = g_atomic_int_get(&received);
+	printf("%-14s %u packets sent, %i received, %i wakeups, %lli us, %.0f packets/s\n",
+			name, sent, recvd, g_atomic_int_get(&wakeups), us,
+			us ? (double) recvd * 1000000.0 / us : 0.0);
+
+	for (int i = 0; i < NUM_SOCKETS; i++) {
+		poller_del_item(p, socks[i].fd);
+		close_socket(&socks[i]);
+	}
+	close(snd);
+	poller_free(&p);
+}
+
+int main(void) {
+	rtpe_common_config_ptr = &rtpe_config.common;
+	socket_init();
+
+	rtpe_config.poller_method = POLLER_EPOLL;
+	bench("epoll", false);
+
+#ifdef HAVE_LIBURING
+	rtpe_config.poller_method = POLLER_IO_URING;
+	bench("io_uring", false);
+	bench("io_uring+recv", true);
+#else
+	printf("io_uring support not compiled in\n");
+#endif
+
+	return 0;
+}
+
+int get_local_log_level(unsigned int u) {
+	return 7;
+}
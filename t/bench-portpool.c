@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <glib.h>
+#include "port_pool.h"
+
+// Cost of finding a port pair for a new stream when the range is 95% used,
+// with streams ending and starting in random order. The ring of free pairs is
+// compared against searching the range from the last port used, as
+// __get_consecutive_ports() did before and still does as a fallback.
+
+#define PORT_MIN	30000
+#define PORT_MAX	39999
+#define UTILISATION	95 // percent
+#define NUM_OPS		2000000
+
+struct bench {
+	const char *name;
+	unsigned int (*get_pair)(struct port_pool *, unsigned int *);
+};
+
+static unsigned int ring_get_pair(struct port_pool *pp, unsigned int *probes) {
+	unsigned int port;
+	while ((port = port_pool_get_pair(pp))) {
+		(*probes)++;
+		if (port_pool_take(pp, port)) {
+			if (port_pool_take(pp, port + 1))
+				return port;
+			port_pool_put(pp, port);
+		}
+	}
+	return 0;
+}
+
+static unsigned int scan_get_pair(struct port_pool *pp, unsigned int *probes) {
+	unsigned int port = pp->last_used, cycle = 0;
+
+	while (1) {
+		if (port < pp->min)
+			port = pp->min;
+		if (port & 1)
+			port++;
+		if (port + 1 > pp->max) {
+			port = 0;
+			if (++cycle >= 2)
+				return 0;
+			continue;
+		}
+		(*probes)++;
+		if (port_pool_take(pp, port)) {
+			if (port_pool_take(pp, port + 1)) {
+				pp->last_used = port + 2;
+				return port;
+			}
+			port_pool_put(pp, port);
+		}
+		port++;
+	}
+}
+
+static void release_pair(struct port_pool *pp, unsigned int port) {
+	port_pool_put(pp, port);
+	port_pool_put(pp, port + 1);
+}
+
+static void bench(const struct bench *b) {
+	struct port_pool pp = {0};
+	port_pool_init(&pp, PORT_MIN, PORT_MAX);
+
+	unsigned int num_pairs = (PORT_MAX - PORT_MIN + 1) / 2;
+	unsigned int num_used = num_pairs * UTILISATION / 100;
+	unsigned int *used = g_new(unsigned int, num_used);
+	unsigned int probes = 0;
+
+	for (unsigned int i = 0; i < num_used; i++) {
+		used[i] = b->get_pair(&pp, &probes);
+		assert(used[i] != 0);
+	}
+	assert(g_atomic_int_get(&pp.free_ports) == PORT_MAX - PORT_MIN + 1 - num_used * 2);
+	assert(port_pool_free_pairs(&pp) == num_pairs - num_used);
+
+	probes = 0;
+	srandom(3456);
+	int64_t start = g_get_monotonic_time();
+	for (unsigned int i = 0; i < NUM_OPS; i++) {
+		unsigned int idx = random() % num_used;
+		release_pair(&pp, used[idx]);
+		used[idx] = b->get_pair(&pp, &probes);
+		assert(used[idx] != 0);
+	}
+	int64_t dur = g_get_monotonic_time() - start;
+	assert(port_pool_free_pairs(&pp) == num_pairs - num_used);
+
+	printf("%-6s %u%% used: %10.0f allocations/s, %6.2f probes per allocation\n",
+			b->name, UTILISATION, (double) NUM_OPS * 1000000.0 / dur,
+			(double) probes / NUM_OPS);
+
+	g_free(used);
+	port_pool_cleanup(&pp);
+}
+
+int main(void) {
+	static const struct bench benches[] = {
+		{ "scan", scan_get_pair },
+		{ "ring", ring_get_pair },
+	};
+
+	for (unsigned int i = 0; i < G_N_ELEMENTS(benches); i++)
+		bench(&benches[i]);
+
+	return 0;
+}
@@ -0,0 +1,404 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include "redis_doc.h"
+
+// Compares the JSON and binary Redis call formats: encoding and decoding time
+// and size of the data, for a typical two-party SRTP call. Also shows how much
+// of it is written by a --redis-delta update after new packets were seen.
+
+#define NUM_CALLS	20000
+
+#define NUM_TAGS	2
+#define NUM_MEDIAS	2
+#define NUM_STREAMS	4
+#define NUM_SFDS	4
+#define NUM_MAPS	2
+#define NUM_SSRCS	2
+
+static const char *payload_types[] = {
+	"0/PCMU/8000///0/0",
+	"8/PCMA/8000///0/0",
+	"9/G722/8000///0/0",
+	"96/opus/48000/2/useinbandfec=1/0/20",
+	"101/telephone-event/8000//0-16/0/0",
+};
+
+#define SET(k, f...) do { \
+		int len = snprintf(tmp, sizeof(tmp), f); \
+		redis_doc_set(w, k, tmp, len); \
+	} while (0)
+#define ADD(f...) do { \
+		int len = snprintf(tmp, sizeof(tmp), f); \
+		redis_doc_add(w, tmp, len); \
+	} while (0)
+
+static void set_crypto(struct redis_doc_writer *w, const char *pref) {
+	char key[64], tmp[64];
+	// binary key material, as written by redis.c
+	static const char master_key[16] = "\x01\x9a\x00\xfe\x37\x42\x7f\x80\x81\xc3\x11\x22\x33\x44\x55\x66";
+	static const char master_salt[14] = "\xde\xad\xbe\xef\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09";
+
+	snprintf(key, sizeof(key), "%s-crypto_suite", pref);
+	redis_doc_set(w, key, "AES_CM_128_HMAC_SHA1_80", 23);
+	snprintf(key, sizeof(key), "%s-master_key", pref);
+	redis_doc_set(w, key, master_key, sizeof(master_key));
+	snprintf(key, sizeof(key), "%s-master_salt", pref);
+	redis_doc_set(w, key, master_salt, sizeof(master_salt));
+	snprintf(key, sizeof(key), "%s-unenc-srtp", pref);
+	SET(key, "%i", 0);
+	snprintf(key, sizeof(key), "%s-unenc-srtcp", pref);
+	SET(key, "%i", 0);
+	snprintf(key, sizeof(key), "%s-unauth-srtp", pref);
+	SET(key, "%i", 0);
+}
+
+// `packets` changes the stream stats, as between two updates of an active call
+static void encode_call(struct redis_doc_writer *w, unsigned long long packets) {
+	char tmp[128];
+
+	redis_doc_begin_object(w, "json", REDIS_DOC_NO_ID);
+	SET("created", "%lli", 1700000000123456LL);
+	SET("destroyed", "%lli", 0LL);
+	SET("last_signal", "%li", 1700000042L);
+	SET("tos", "%u", 184);
+	SET("deleted", "%li", 0L);
+	SET("num_sfds", "%u", NUM_SFDS);
+	SET("num_streams", "%u", NUM_STREAMS);
+	SET("num_medias", "%u", NUM_MEDIAS);
+	SET("num_tags", "%u", NUM_TAGS);
+	SET("num_maps", "%u", NUM_MAPS);
+	SET("ml_deleted", "%li", 0L);
+	SET("created_from", "%s", "192.168.1.10:5060");
+	SET("created_from_addr", "%s", "192.168.1.10:5060");
+	SET("redis_hosted_db", "%u", 1);
+	SET("recording_metadata", "%s", "");
+	SET("block_dtmf", "%i", 0);
+	SET("block_media", "%i", 0);
+	redis_doc_end(w);
+
+	for (unsigned int i = 0; i < NUM_SFDS; i++) {
+		redis_doc_begin_object(w, "sfd", i);
+		SET("pref_family", "%s", "IP4");
+		SET("localport", "%u", 30000 + i);
+		SET("fd", "%i", 100 + i);
+		SET("logical_intf", "%s", "default");
+		SET("local_intf_uid", "%u", 0);
+		SET("stream", "%u", i);
+		set_crypto(w, "");
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_STREAMS; i++) {
+		redis_doc_begin_object(w, "stream", i);
+		SET("media", "%u", i / 2);
+		SET("sfd", "%u", i);
+		SET("rtcp_sibling", "%u", (i & 1) ? -1 : i + 1);
+		SET("last_packet", "%llu", 1700000041ULL);
+		SET("ps_flags", "%u", 0x1234);
+		SET("component", "%u", (i & 1) + 1);
+		SET("endpoint", "%s", "10.0.0.1:40000");
+		SET("advertised_endpoint", "%s", "10.0.0.1:40000");
+		SET("stats-packets", "%llu", packets);
+		SET("stats-bytes", "%llu", 21234567ULL);
+		SET("stats-errors", "%llu", 0ULL);
+		set_crypto(w, "");
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_STREAMS; i++) {
+		redis_doc_begin_array(w, "stream_sfds", i);
+		ADD("%u", i);
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "rtp_sinks", i);
+		ADD("%u", (i + 2) % NUM_STREAMS);
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "rtcp_sinks", i);
+		ADD("%u", (i + 3) % NUM_STREAMS);
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_TAGS; i++) {
+		redis_doc_begin_object(w, "tag", i);
+		SET("created", "%llu", 1700000000ULL);
+		SET("deleted", "%llu", 0ULL);
+		SET("block_dtmf", "%i", 0);
+		SET("block_media", "%i", 0);
+		SET("logical_intf", "%s", "default");
+		SET("tag", "%s", i ? "as4f8a7c12" : "9a8b7c6d5e4f");
+		SET("via-branch", "%s", "z9hG4bK776asdhds");
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_TAGS; i++) {
+		redis_doc_begin_array(w, "associated_tags", i);
+		ADD("%u", !i);
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "medias", i);
+		ADD("%u", i);
+		redis_doc_end(w);
+		redis_doc_begin_object_list(w, "ssrc_table", i);
+		for (unsigned int j = 0; j < NUM_SSRCS; j++) {
+			redis_doc_begin_element(w);
+			SET("ssrc", "%u", 0x12345678u + j);
+			SET("in_srtp_index", "%u", 12345);
+			SET("in_srtcp_index", "%u", 42);
+			SET("in_payload_type", "%i", 0);
+			SET("out_srtp_index", "%u", 12345);
+			SET("out_srtcp_index", "%u", 42);
+			SET("out_payload_type", "%i", 0);
+			redis_doc_end_element(w);
+		}
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "subscriptions", i);
+		ADD("%u/%u/%u/%u/%u", !i, 0, 1, 0, 0);
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_MEDIAS; i++) {
+		redis_doc_begin_object(w, "media", i);
+		SET("tag", "%u", i);
+		SET("index", "%u", 1);
+		SET("type", "%s", "audio");
+		SET("format_str", "%s", "0 8 9 96 101");
+		SET("protocol", "%s", "RTP/SAVP");
+		SET("desired_family", "%s", "IP4");
+		SET("logical_intf", "%s", "default");
+		SET("ptime", "%i", 20);
+		SET("media_flags", "%u", 0x40213);
+		SET("sdes_in_tag", "%u", 1);
+		set_crypto(w, "sdes_in");
+		SET("sdes_out_tag", "%u", 1);
+		set_crypto(w, "sdes_out");
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_MEDIAS; i++) {
+		redis_doc_begin_array(w, "streams", i);
+		ADD("%u", i * 2);
+		ADD("%u", i * 2 + 1);
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "maps", i);
+		ADD("%u", i);
+		redis_doc_end(w);
+		redis_doc_begin_array(w, "payload_types", i);
+		for (unsigned int j = 0; j < G_N_ELEMENTS(payload_types); j++)
+			ADD("%s", payload_types[j]);
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_MAPS; i++) {
+		redis_doc_begin_object(w, "map", i);
+		SET("wildcard", "%i", 0);
+		SET("num_ports", "%u", 2);
+		SET("intf_preferred_family", "%s", "IP4");
+		SET("logical_intf", "%s", "default");
+		SET("endpoint", "%s", "10.0.0.1:40000");
+		redis_doc_end(w);
+	}
+
+	for (unsigned int i = 0; i < NUM_MAPS; i++) {
+		redis_doc_begin_array(w, "map_sfds", i);
+		ADD("loc-%u", 0);
+		ADD("%u", i * 2);
+		ADD("%u", i * 2 + 1);
+		redis_doc_end(w);
+	}
+}
+
+static char *encode(bool binary, size_t *len) {
+	struct redis_doc_writer w;
+	redis_doc_writer_init(&w, binary);
+	encode_call(&w, 123456);
+	char *ret = redis_doc_writer_finish(&w, len);
+	assert(ret != NULL);
+	return ret;
+}
+
+static void encode_parts(bool binary, GQueue *parts, unsigned long long packets) {
+	struct redis_doc_writer w;
+	redis_doc_writer_init_parts(&w, binary, parts);
+	encode_call(&w, packets);
+	int ret = redis_doc_writer_finish_parts(&w);
+	assert(ret == 0);
+}
+
+
+// collects everything read back, to compare the two formats
+static void dump_hash(GString *out, struct redis_hash *rh) {
+	GList *keys = g_hash_table_get_keys(rh->ht);
+	keys = g_list_sort(keys, (GCompareFunc) strcmp);
+	for (GList *l = keys; l; l = l->next) {
+		str *v = g_hash_table_lookup(rh->ht, l->data);
+		g_string_append_printf(out, "%s=", (char *) l->data);
+		for (size_t i = 0; i < v->len; i++)
+			g_string_append_printf(out, "%02x", (unsigned char) v->s[i]);
+		g_string_append_c(out, ';');
+	}
+	g_list_free(keys);
+	g_string_append_c(out, '\n');
+}
+static int dump_item(str *s, void *p) {
+	GString *out = p;
+	if (out)
+		g_string_append_printf(out, STR_FORMAT ",", STR_FMT(s));
+	return 0;
+}
+static int dump_object(struct redis_hash *rh, void *p) {
+	GString *out = p;
+	if (out)
+		dump_hash(out, rh);
+	return 0;
+}
+
+static void read_hash(struct redis_doc *doc, GString *out, const char *name, unsigned int id) {
+	struct redis_hash rh;
+	int ret = redis_doc_get_hash(doc, &rh, name, id);
+	assert(ret == 0);
+	if (out)
+		dump_hash(out, &rh);
+	redis_doc_destroy_hash(&rh);
+}
+static void read_list(struct redis_doc *doc, GString *out, const char *name, unsigned int id) {
+	int ret = redis_doc_get_list(doc, name, id, dump_item, out);
+	assert(ret == 0);
+}
+
+// walks the document the same way the restore code does
+static void decode_doc(struct redis_doc *doc, GString *out) {
+	int ret;
+
+	read_hash(doc, out, "json", REDIS_DOC_NO_ID);
+	for (unsigned int i = 0; i < NUM_TAGS; i++)
+		read_hash(doc, out, "tag", i);
+	for (unsigned int i = 0; i < NUM_SFDS; i++)
+		read_hash(doc, out, "sfd", i);
+	for (unsigned int i = 0; i < NUM_STREAMS; i++)
+		read_hash(doc, out, "stream", i);
+	for (unsigned int i = 0; i < NUM_MEDIAS; i++)
+		read_hash(doc, out, "media", i);
+	for (unsigned int i = 0; i < NUM_MAPS; i++)
+		read_hash(doc, out, "map", i);
+
+	for (unsigned int i = 0; i < NUM_TAGS; i++) {
+		ret = redis_doc_get_object_list(doc, "ssrc_table", i, dump_object, out);
+		assert(ret == 0);
+	}
+	for (unsigned int i = 0; i < NUM_MEDIAS; i++)
+		read_list(doc, out, "payload_types", i);
+	for (unsigned int i = 0; i < NUM_STREAMS; i++) {
+		read_list(doc, out, "stream_sfds", i);
+		read_list(doc, out, "rtp_sinks", i);
+		read_list(doc, out, "rtcp_sinks", i);
+	}
+	for (unsigned int i = 0; i < NUM_TAGS; i++) {
+		read_list(doc, out, "subscriptions", i);
+		read_list(doc, out, "associated_tags", i);
+		read_list(doc, out, "medias", i);
+	}
+	for (unsigned int i = 0; i < NUM_MEDIAS; i++) {
+		read_list(doc, out, "streams", i);
+		read_list(doc, out, "maps", i);
+	}
+	for (unsigned int i = 0; i < NUM_MAPS; i++)
+		read_list(doc, out, "map_sfds", i);
+}
+
+static void decode(const char *data, size_t len, GString *out) {
+	struct redis_doc doc;
+	int ret = redis_doc_load(&doc, data, len);
+	assert(ret == 0);
+	decode_doc(&doc, out);
+	redis_doc_free(&doc);
+}
+
+// the sections of the call as stored in a hash, then updated
+static void bench_delta(const char *name, bool binary, GString *expect) {
+	GQueue parts = G_QUEUE_INIT, update = G_QUEUE_INIT;
+	size_t total = 0, changed = 0;
+
+	encode_parts(binary, &parts, 123456);
+	encode_parts(binary, &update, 123999);
+	assert(parts.length == update.length);
+
+	unsigned int num = 0;
+	str strs[parts.length];
+	for (GList *l = parts.head, *k = update.head; l; l = l->next, k = k->next) {
+		struct redis_doc_part *p = l->data, *u = k->data;
+		assert(strcmp(p->name, u->name) == 0);
+		total += p->len;
+		if (p->len != u->len || memcmp(p->data, u->data, p->len))
+			changed += u->len;
+		str_init_len(&strs[num++], p->data, p->len);
+	}
+
+	// merged sections must yield the same as the complete document
+	struct redis_doc doc;
+	int ret = redis_doc_load_parts(&doc, strs, num);
+	assert(ret == 0);
+	GString *out = g_string_new("");
+	decode_doc(&doc, out);
+	redis_doc_free(&doc);
+	if (strcmp(out->str, expect->str)) {
+		printf("decoded %s sections differ:\n%s\n---\n%s\n", name, out->str, expect->str);
+		abort();
+	}
+	g_string_free(out, TRUE);
+
+	printf("%-8s %6zu bytes in %u sections, %6zu bytes written for an update\n",
+			name, total, num, changed);
+
+	g_queue_clear_full(&parts, redis_doc_part_free);
+	g_queue_clear_full(&update, redis_doc_part_free);
+}
+
+static GString *bench(const char *name, bool binary) {
+	size_t len = 0;
+	char *data;
+
+	int64_t start = g_get_monotonic_time();
+	for (unsigned int i = 0; i < NUM_CALLS; i++) {
+		data = encode(binary, &len);
+		g_free(data);
+	}
+	int64_t enc = g_get_monotonic_time() - start;
+
+	data = encode(binary, &len);
+
+	start = g_get_monotonic_time();
+	for (unsigned int i = 0; i < NUM_CALLS; i++)
+		decode(data, len, NULL);
+	int64_t dec = g_get_monotonic_time() - start;
+
+	GString *out = g_string_new("");
+	decode(data, len, out);
+	g_free(data);
+
+	printf("%-8s %6zu bytes per call, %8.2f us to encode, %8.2f us to decode, "
+			"%6.1f MB for %u calls\n",
+			name, len, (double) enc / NUM_CALLS, (double) dec / NUM_CALLS,
+			(double) len * NUM_CALLS / 1000000.0, NUM_CALLS);
+
+	return out;
+}
+
+int main(void) {
+	GString *json = bench("json", false);
+	GString *binary = bench("binary", true);
+
+	// both must yield the same contents
+	if (strcmp(json->str, binary->str)) {
+		printf("decoded data differs:\n%s\n---\n%s\n", json->str, binary->str);
+		abort();
+	}
+
+	bench_delta("json", false, json);
+	bench_delta("binary", true, binary);
+
+	g_string_free(json, TRUE);
+	g_string_free(binary, TRUE);
+
+	return 0;
+}
@@ -0,0 +1,222 @@
+#include "../kernel-module/xt_RTPENGINE.c"
+#include "kernel-fastpath.h"
+
+// Feeds arbitrary UDP payloads through the kernel module's packet path, built
+// in userspace against kernel-shim.h. The first input byte picks the target,
+// the rest is the payload. Built with -DWITH_LIBFUZZER as a libFuzzer target,
+// otherwise as a standalone program that replays the files given on the command
+// line, or runs a fixed number of pseudo-random inputs without arguments.
+
+static const struct rtpengine_srtp aes_cm = {
+	.cipher = REC_AES_CM_128,
+	.hmac = REH_HMAC_SHA1,
+	.master_key = "0123456789abcdef",
+	.master_key_len = 16,
+	.master_salt = "0123456789abcd",
+	.master_salt_len = 14,
+	.session_key_len = 16,
+	.session_salt_len = 14,
+	.auth_tag_len = 10,
+};
+static const struct rtpengine_srtp aes_gcm = {
+	.cipher = REC_AEAD_AES_GCM_128,
+	.hmac = REH_NULL,
+	.master_key = "0123456789abcdef",
+	.master_key_len = 16,
+	.master_salt = "0123456789ab",
+	.master_salt_len = 12,
+	.session_key_len = 16,
+	.session_salt_len = 12,
+};
+
+#define RING_SIZE	4096 // small enough to fill up and wrap often
+#define RING_BATCH	256 // inputs between ring reads
+
+enum intercept {
+	NO_INTERCEPT = 0,
+	INTERCEPT_QUEUE,
+	INTERCEPT_RING,
+};
+
+static const struct {
+	uint16_t port;
+	const struct rtpengine_srtp *decrypt, *encrypt;
+	enum intercept intercept;
+} targets[] = {
+	{ 6000 },
+	{ 6002, .decrypt = &aes_cm },
+	{ 6004, .encrypt = &aes_cm },
+	{ 6006, .decrypt = &aes_cm, .encrypt = &aes_gcm },
+	{ 6008, .decrypt = &aes_gcm },
+	{ 6010, .encrypt = &aes_gcm },
+	{ 6012, .decrypt = &aes_gcm, .encrypt = &aes_cm },
+	{ 6014, .intercept = INTERCEPT_QUEUE },
+	{ 6016, .intercept = INTERCEPT_RING },
+};
+
+static struct rtpengine_stream_ring *ring;
+
+int kshim_output(struct sk_buff *skb) {
+	kfree_skb(skb);
+	return 0;
+}
+
+static void setup(void) {
+	static bool done;
+	struct rtpengine_table *t;
+
+	if (done)
+		return;
+	done = true;
+
+	t = fastpath_init();
+	for (unsigned int i = 0; i < ARRAY_SIZE(targets); i++) {
+		struct rtpengine_target_info reti;
+		char name[16];
+
+		fastpath_target_info(&reti, targets[i].port, targets[i].decrypt);
+		if (targets[i].intercept) {
+			snprintf(name, sizeof(name), "%u", targets[i].port);
+			reti.do_intercept = 1;
+			reti.intercept_stream_idx = fastpath_add_stream(t, name);
+			if (targets[i].intercept == INTERCEPT_RING)
+				ring = fastpath_stream_ring(reti.intercept_stream_idx, RING_SIZE);
+		}
+		fastpath_add(t, &reti, targets[i].port + 1, targets[i].encrypt);
+	}
+}
+
+// checks what the kernel put into the ring and releases it
+static void consume_ring(void) {
+	unsigned char *data = (unsigned char *) ring + PAGE_SIZE;
+	uint32_t tail = ring->tail;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head - tail > ring->size)
+		abort();
+	while (tail != head) {
+		uint32_t off = tail & (ring->size - 1);
+		uint32_t len = *(uint32_t *) (data + off);
+		if (!len) {
+			tail += ring->size - off;
+			continue;
+		}
+		if (len > ring->size - off - sizeof(uint32_t))
+			abort();
+		tail += ALIGN(sizeof(uint32_t) + len, RTPE_STREAM_RING_ALIGN);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	static unsigned int num_inputs;
+	struct sk_buff *skb;
+
+	setup();
+
+	if (size < 1 || size > 0xffff - sizeof(struct iphdr) - sizeof(struct udphdr))
+		return 0;
+
+	skb = fastpath_udp_skb(targets[data[0] % ARRAY_SIZE(targets)].port, data + 1, size - 1);
+	fastpath_packet(skb);
+	kfree_skb(skb);
+
+	if ((++num_inputs % RING_BATCH) == 0)
+		consume_ring();
+
+	return 0;
+}
+
+#ifndef WITH_LIBFUZZER
+
+#define NUM_RANDOM	100000
+
+// the table's status file, with one call and one stream per intercept target
+static void check_status(void) {
+	struct inode inode = {
+		.data = (void *) 0,
+	};
+	struct dentry dentry = {
+		.d_inode = &inode,
+	};
+	struct file file = {
+		.f_path = {
+			.dentry = &dentry,
+		},
+	};
+	char buf[1024], expect[128];
+	loff_t off = 0;
+	ssize_t len;
+	unsigned int num = 0;
+
+	len = proc_status(&file, buf, sizeof(buf), &off);
+	if (len <= 0)
+		abort();
+	buf[len] = '\0';
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(targets); i++)
+		num += !!targets[i].intercept;
+	snprintf(expect, sizeof(expect), "Targets:     %zu\nAddresses:   1, max probe 0\n", ARRAY_SIZE(targets));
+	if (!strstr(buf, expect))
+		abort();
+	snprintf(expect, sizeof(expect), "Calls hash:  %u buckets, %u used, %u entries, max chain 1\n",
+			1U << hash_bits, num, num);
+	if (!strstr(buf, expect))
+		abort();
+	snprintf(expect, sizeof(expect), "Streams hash:%u buckets, %u used, %u entries, max chain 1\n",
+			1U << hash_bits, num, num);
+	if (!strstr(buf, expect))
+		abort();
+}
+
+static void run_file(const char *fn) {
+	FILE *fp;
+	uint8_t buf[0x10000];
+	size_t len;
+
+	fp = fopen(fn, "rb");
+	if (!fp) {
+		fprintf(stderr, "failed to open %s: %s\n", fn, strerror(errno));
+		exit(1);
+	}
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+
+	LLVMFuzzerTestOneInput(buf, len);
+}
+
+// mostly well-formed RTP with random corruption, so that the inputs get past
+// the header checks often enough
+static void run_random(void) {
+	uint8_t buf[1 + sizeof(struct rtp_header) + 256 + 16];
+	unsigned int seed = 1;
+
+	for (unsigned int i = 0; i < NUM_RANDOM; i++) {
+		size_t len = 1 + rand_r(&seed) % (sizeof(buf) - 1);
+
+		for (size_t j = 0; j < len; j++)
+			buf[j] = rand_r(&seed);
+		if (len > sizeof(struct rtp_header) && (rand_r(&seed) % 4)) {
+			struct rtp_header *rtp = (void *) (buf + 1);
+			rtp->v_p_x_cc = 0x80 | (rtp->v_p_x_cc & 0x3f & -(rand_r(&seed) % 4 == 0));
+			rtp->m_pt = (rand_r(&seed) % 8) ? 8 : rtp->m_pt;
+		}
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++)
+			run_file(argv[i]);
+	}
+	else
+		run_random();
+
+	check_status();
+	fini();
+	printf("all tests done\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef _KERNEL_FASTPATH_H_
+#define _KERNEL_FASTPATH_H_
+
+/* Helpers for driving the kernel module's packet path in userspace. To be
+ * included after ../kernel-module/xt_RTPENGINE.c. All packets are IPv4 on
+ * 127.0.0.1, from port FASTPATH_SRC_PORT. */
+
+#define FASTPATH_SRC_PORT	9999
+#define RTP_PAYLOAD_LEN		160
+
+static inline struct rtpengine_table *fastpath_init(void) {
+	struct rtpengine_table *t;
+
+	if (init())
+		abort();
+	t = new_table_link(0);
+	if (!t)
+		abort();
+	return t;
+}
+
+static inline void fastpath_address(struct re_address *a, uint16_t port) {
+	*a = (struct re_address) {
+		.family = AF_INET,
+		.u = {
+			.ipv4 = htonl(0x7f000001),
+		},
+		.port = port,
+	};
+}
+
+// an RTP target for PCMA on `port`, without destinations
+static inline void fastpath_target_info(struct rtpengine_target_info *reti, uint16_t port,
+		const struct rtpengine_srtp *decrypt)
+{
+	static const struct rtpengine_srtp null_srtp = {
+		.cipher = REC_NULL,
+		.hmac = REH_NULL,
+	};
+
+	*reti = (struct rtpengine_target_info) {
+		.decrypt = decrypt ? *decrypt : null_srtp,
+		.src_mismatch = MSM_IGNORE,
+		.num_destinations = 1,
+		.rtp = 1,
+		.num_payload_types = 1,
+		.pt_input = {
+			{ 8, 8000 },
+		},
+	};
+	fastpath_address(&reti->local, port);
+	fastpath_address(&reti->expected_src, FASTPATH_SRC_PORT);
+}
+
+// adds the target with one destination, sending to `dst_port`
+static inline void fastpath_add(struct rtpengine_table *t, struct rtpengine_target_info *reti,
+		uint16_t dst_port, const struct rtpengine_srtp *encrypt)
+{
+	struct rtpengine_destination_info redi = {
+		.local = reti->local,
+		.num = 0,
+		.output = {
+			.encrypt = {
+				.cipher = REC_NULL,
+				.hmac = REH_NULL,
+			},
+		},
+	};
+
+	if (encrypt)
+		redi.output.encrypt = *encrypt;
+	if (table_new_target(t, reti))
+		abort();
+
+	redi.output.src_addr = reti->local;
+	fastpath_address(&redi.output.dst_addr, dst_port);
+	if (table_add_destination(t, &redi))
+		abort();
+}
+
+static inline void fastpath_add_target(struct rtpengine_table *t, uint16_t port, uint16_t dst_port,
+		const struct rtpengine_srtp *decrypt, const struct rtpengine_srtp *encrypt)
+{
+	struct rtpengine_target_info reti;
+
+	fastpath_target_info(&reti, port, decrypt);
+	fastpath_add(t, &reti, dst_port, encrypt);
+}
+
+// an intercept stream in a call of its own, returns the stream index
+static inline unsigned int fastpath_add_stream(struct rtpengine_table *t, const char *name) {
+	struct rtpengine_call_info call = { 0 };
+	struct rtpengine_stream_info stream = { 0 };
+
+	snprintf(call.call_id, sizeof(call.call_id), "%s", name);
+	if (table_new_call(t, &call))
+		abort();
+	stream.call_idx = call.call_idx;
+	snprintf(stream.stream_name, sizeof(stream.stream_name), "%s", name);
+	if (table_new_stream(t, &stream))
+		abort();
+	return stream.stream_idx;
+}
+
+// sets up the ring of an intercept stream, as the reader's mmap() would
+static inline struct rtpengine_stream_ring *fastpath_stream_ring(unsigned int stream_idx,
+		unsigned long size)
+{
+	struct inode inode = {
+		.data = (void *) (unsigned long) stream_idx,
+	};
+	struct dentry dentry = {
+		.d_inode = &inode,
+	};
+	struct file file = {
+		.f_path = {
+			.dentry = &dentry,
+		},
+	};
+	struct vm_area_struct vma = {
+		.vm_end = PAGE_SIZE + size,
+		.vm_flags = VM_SHARED | VM_WRITE,
+	};
+
+	if (proc_stream_mmap(&file, &vma))
+		abort();
+	return vma.vm_private_data;
+}
+
+// an IPv4/UDP packet to `port` carrying `data`, as netfilter would hand it to the target
+static inline struct sk_buff *fastpath_udp_skb(uint16_t port, const void *data, unsigned int len) {
+	struct sk_buff *skb = kshim_skb_alloc(MAX_HEADER, sizeof(struct iphdr) + sizeof(struct udphdr) + len, 0);
+	struct iphdr *ih;
+	struct udphdr *uh;
+
+	if (!skb)
+		abort();
+	ih = (void *) skb->data;
+	uh = (void *) (ih + 1);
+	*ih = (struct iphdr) {
+		.version = 4,
+		.ihl = 5,
+		.tot_len = htons(skb->len),
+		.ttl = 64,
+		.protocol = IPPROTO_UDP,
+		.saddr = htonl(0x7f000001),
+		.daddr = htonl(0x7f000001),
+	};
+	*uh = (struct udphdr) {
+		.source = htons(FASTPATH_SRC_PORT),
+		.dest = htons(port),
+		.len = htons(sizeof(*uh) + len),
+	};
+	if (len)
+		memcpy(uh + 1, data, len);
+	skb_reset_network_header(skb);
+	return skb;
+}
+
+static inline struct rtp_header *fastpath_rtp_header(struct sk_buff *skb) {
+	return (void *) (skb->data + sizeof(struct iphdr) + sizeof(struct udphdr));
+}
+
+// a PCMA packet with sequence number 0
+static inline struct sk_buff *fastpath_rtp_skb(uint16_t port, unsigned int payload_len) {
+	unsigned char pkt[sizeof(struct rtp_header) + payload_len];
+
+	memset(pkt, 0xd5, sizeof(pkt));
+	*(struct rtp_header *) pkt = (struct rtp_header) {
+		.v_p_x_cc = 0x80,
+		.m_pt = 8,
+		.timestamp = htonl(160),
+		.ssrc = htonl(0x12345678),
+	};
+	return fastpath_udp_skb(port, pkt, sizeof(pkt));
+}
+
+// runs the packet through the xtables target, which leaves the original alone
+static inline unsigned int fastpath_packet(struct sk_buff *skb) {
+	static const struct xt_rtpengine_info info = {
+		.id = 0,
+	};
+	static const struct nf_hook_state state;
+	static const struct xt_action_param par = {
+		.targinfo = &info,
+		.state = &state,
+	};
+
+	return rtpengine4(skb, &par);
+}
+
+#endif
@@ -0,0 +1,425 @@
+#include <stdarg.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#include "kernel-shim.h"
+
+// the module's log goes to stderr if KSHIM_PRINTK is set
+int kshim_printk(const char *fmt, ...) {
+	static int verbose = -1;
+	va_list ap;
+	int ret;
+
+	if (verbose == -1)
+		verbose = getenv("KSHIM_PRINTK") != NULL;
+	if (!verbose)
+		return 0;
+	va_start(ap, fmt);
+	ret = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+s64 kshim_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+unsigned long find_next_zero_bit(const unsigned long *a, unsigned long size, unsigned long off) {
+	for (; off < size; off++) {
+		if (!test_bit(off, a))
+			return off;
+	}
+	return size;
+}
+
+u32 crc32_le(u32 crc, const unsigned char *p, size_t len) {
+	while (len--) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return crc;
+}
+
+struct proc_dir_entry *kshim_proc_entry(void *data) {
+	struct proc_dir_entry *e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (e)
+		e->data = data;
+	return e;
+}
+
+
+/* checksums */
+
+static u32 csum_fold32(u64 sum) {
+	while (sum >> 32)
+		sum = (sum & 0xffffffff) + (sum >> 32);
+	return sum;
+}
+
+static __sum16 csum_fold(__wsum sum) {
+	u32 s = sum;
+	s = (s & 0xffff) + (s >> 16);
+	s = (s & 0xffff) + (s >> 16);
+	return ~s;
+}
+
+__wsum csum_partial(const void *buf, int len, __wsum sum) {
+	const unsigned char *p = buf;
+	u64 s = sum;
+
+	for (; len >= 2; len -= 2, p += 2)
+		s += (u16) (p[0] | (p[1] << 8));
+	if (len)
+		s += p[0];
+	return csum_fold32(s);
+}
+
+__sum16 csum_tcpudp_magic(__be32 saddr, __be32 daddr, u32 len, u8 proto, __wsum sum) {
+	u64 s = sum;
+	s += saddr;
+	s += daddr;
+	s += htons(len);
+	s += htons(proto);
+	return csum_fold(csum_fold32(s));
+}
+
+__sum16 csum_ipv6_magic(const struct in6_addr *saddr, const struct in6_addr *daddr,
+		u32 len, u8 proto, __wsum sum)
+{
+	sum = csum_partial(saddr, sizeof(*saddr), sum);
+	sum = csum_partial(daddr, sizeof(*daddr), sum);
+	u64 s = sum;
+	s += htonl(len);
+	s += htonl(proto);
+	return csum_fold(csum_fold32(s));
+}
+
+
+/* packets */
+
+struct sk_buff *kshim_skb_alloc(unsigned int headroom, unsigned int size, unsigned int tailroom) {
+	struct sk_buff *skb = kzalloc(sizeof(*skb), GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+	skb->head = kmalloc(headroom + size + tailroom, GFP_ATOMIC);
+	if (!skb->head) {
+		kfree(skb);
+		return NULL;
+	}
+	skb->data = skb->head + headroom;
+	skb->len = size;
+	skb->tail = headroom + size;
+	skb->end = headroom + size + tailroom;
+	return skb;
+}
+
+// like the kernel's, including whatever is in the old headroom
+struct sk_buff *skb_copy_expand(const struct sk_buff *skb, int headroom, int tailroom, gfp_t flags) {
+	struct sk_buff *n = kshim_skb_alloc(headroom, skb->len, tailroom);
+	unsigned int head_copy_len = skb_headroom(skb), head_copy_off = 0;
+	int offset;
+
+	if (!n)
+		return NULL;
+
+	if (headroom <= head_copy_len)
+		head_copy_len = headroom;
+	else
+		head_copy_off = headroom - head_copy_len;
+	memcpy(n->head + head_copy_off, skb->data - head_copy_len, skb->len + head_copy_len);
+
+	offset = headroom - skb_headroom(skb);
+	n->network_header = skb->network_header + offset;
+	n->transport_header = skb->transport_header + offset;
+	n->protocol = skb->protocol;
+	n->tstamp = skb->tstamp;
+	n->sk = skb->sk;
+	n->dev = skb->dev;
+	return n;
+}
+
+void kfree_skb(struct sk_buff *skb) {
+	if (!skb)
+		return;
+	kfree(skb->head);
+	kfree(skb);
+}
+
+
+/* crypto */
+
+static const EVP_CIPHER *aes_evp(const char *mode, unsigned int key_len) {
+	if (!strcmp(mode, "ecb")) {
+		switch (key_len) {
+			case 16: return EVP_aes_128_ecb();
+			case 24: return EVP_aes_192_ecb();
+			case 32: return EVP_aes_256_ecb();
+		}
+	}
+	else if (!strcmp(mode, "ctr")) {
+		switch (key_len) {
+			case 16: return EVP_aes_128_ctr();
+			case 24: return EVP_aes_192_ctr();
+			case 32: return EVP_aes_256_ctr();
+		}
+	}
+	else if (!strcmp(mode, "gcm")) {
+		switch (key_len) {
+			case 16: return EVP_aes_128_gcm();
+			case 24: return EVP_aes_192_gcm();
+			case 32: return EVP_aes_256_gcm();
+		}
+	}
+	return NULL;
+}
+
+// copies `len` bytes between a flat buffer and the scatterlist, starting `skip` bytes into it
+static void sg_copy(struct scatterlist *sg, unsigned int skip, unsigned char *buf, unsigned int len,
+		bool to_sg)
+{
+	for (; len; sg++) {
+		if (skip >= sg->length) {
+			skip -= sg->length;
+			continue;
+		}
+		unsigned int n = min(sg->length - skip, len);
+		if (to_sg)
+			memcpy((unsigned char *) sg->buf + skip, buf, n);
+		else
+			memcpy(buf, (unsigned char *) sg->buf + skip, n);
+		buf += n;
+		len -= n;
+		skip = 0;
+	}
+}
+
+
+struct crypto_cipher {
+	EVP_CIPHER_CTX *ctx;
+};
+
+struct crypto_cipher *crypto_alloc_cipher(const char *name, u32 type, u32 mask) {
+	if (strcmp(name, "aes"))
+		return ERR_PTR(-ENOENT);
+	struct crypto_cipher *c = kzalloc(sizeof(*c), GFP_KERNEL);
+	c->ctx = EVP_CIPHER_CTX_new();
+	return c;
+}
+
+int crypto_cipher_setkey(struct crypto_cipher *c, const u8 *key, unsigned int len) {
+	const EVP_CIPHER *evp = aes_evp("ecb", len);
+	if (!evp)
+		return -EINVAL;
+	EVP_EncryptInit_ex(c->ctx, evp, NULL, key, NULL);
+	EVP_CIPHER_CTX_set_padding(c->ctx, 0);
+	return 0;
+}
+
+void crypto_cipher_encrypt_one(struct crypto_cipher *c, u8 *dst, const u8 *src) {
+	int len;
+	EVP_EncryptUpdate(c->ctx, dst, &len, src, 16);
+}
+
+void crypto_free_cipher(struct crypto_cipher *c) {
+	EVP_CIPHER_CTX_free(c->ctx);
+	kfree(c);
+}
+
+
+struct crypto_sync_skcipher *crypto_alloc_sync_skcipher(const char *name, u32 type, u32 mask) {
+	if (strcmp(name, "ctr(aes)"))
+		return ERR_PTR(-ENOENT);
+	struct crypto_sync_skcipher *c = kzalloc(sizeof(*c), GFP_KERNEL);
+	c->base.ctx = EVP_CIPHER_CTX_new();
+	return c;
+}
+
+int crypto_sync_skcipher_setkey(struct crypto_sync_skcipher *c, const u8 *key, unsigned int len) {
+	const EVP_CIPHER *evp = aes_evp("ctr", len);
+	if (!evp)
+		return -EINVAL;
+	EVP_EncryptInit_ex(c->base.ctx, evp, NULL, key, NULL);
+	return 0;
+}
+
+int crypto_skcipher_encrypt(struct skcipher_request *req) {
+	EVP_CIPHER_CTX *ctx = req->tfm->base.ctx;
+	unsigned char buf[2048];
+	int len;
+
+	if (req->cryptlen > sizeof(buf))
+		return -EINVAL;
+	EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, req->iv);
+	sg_copy(req->src, 0, buf, req->cryptlen, false);
+	EVP_EncryptUpdate(ctx, buf, &len, buf, req->cryptlen);
+	sg_copy(req->dst, 0, buf, req->cryptlen, true);
+	return 0;
+}
+
+const char *crypto_skcipher_driver_name(struct crypto_skcipher *c) {
+	return "ctr-aes-openssl";
+}
+
+void crypto_free_sync_skcipher(struct crypto_sync_skcipher *c) {
+	EVP_CIPHER_CTX_free(c->base.ctx);
+	kfree(c);
+}
+
+
+// the keyed context is reinitialised for each hash, which is fine as long as
+// there is only one hash in progress at a time
+struct crypto_shash {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_MAC *mac;
+	EVP_MAC_CTX *ctx;
+#else
+	HMAC_CTX *ctx;
+#endif
+};
+
+struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask) {
+	if (strcmp(name, "hmac(sha1)"))
+		return ERR_PTR(-ENOENT);
+	struct crypto_shash *c = kzalloc(sizeof(*c), GFP_KERNEL);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	c->mac = EVP_MAC_fetch(NULL, "hmac", NULL);
+	c->ctx = EVP_MAC_CTX_new(c->mac);
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "sha1", 0),
+		OSSL_PARAM_construct_end(),
+	};
+	EVP_MAC_CTX_set_params(c->ctx, params);
+#else
+	c->ctx = HMAC_CTX_new();
+#endif
+	return c;
+}
+
+int crypto_shash_setkey(struct crypto_shash *c, const u8 *key, unsigned int len) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (!EVP_MAC_init(c->ctx, key, len, NULL))
+		return -EINVAL;
+#else
+	if (!HMAC_Init_ex(c->ctx, key, len, EVP_sha1(), NULL))
+		return -EINVAL;
+#endif
+	return 0;
+}
+
+int crypto_shash_init(struct shash_desc *d) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	return EVP_MAC_init(d->tfm->ctx, NULL, 0, NULL) ? 0 : -EINVAL;
+#else
+	return HMAC_Init_ex(d->tfm->ctx, NULL, 0, NULL, NULL) ? 0 : -EINVAL;
+#endif
+}
+
+int crypto_shash_update(struct shash_desc *d, const u8 *data, unsigned int len) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	return EVP_MAC_update(d->tfm->ctx, data, len) ? 0 : -EINVAL;
+#else
+	return HMAC_Update(d->tfm->ctx, data, len) ? 0 : -EINVAL;
+#endif
+}
+
+int crypto_shash_final(struct shash_desc *d, u8 *out) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	size_t len;
+	return EVP_MAC_final(d->tfm->ctx, out, &len, 20) ? 0 : -EINVAL;
+#else
+	return HMAC_Final(d->tfm->ctx, out, NULL) ? 0 : -EINVAL;
+#endif
+}
+
+void crypto_free_shash(struct crypto_shash *c) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_MAC_CTX_free(c->ctx);
+	EVP_MAC_free(c->mac);
+#else
+	HMAC_CTX_free(c->ctx);
+#endif
+	kfree(c);
+}
+
+
+struct crypto_aead {
+	EVP_CIPHER_CTX *ctx;
+	unsigned int authsize;
+};
+
+struct crypto_aead *crypto_alloc_aead(const char *name, u32 type, u32 mask) {
+	if (strcmp(name, "gcm(aes)"))
+		return ERR_PTR(-ENOENT);
+	struct crypto_aead *c = kzalloc(sizeof(*c), GFP_KERNEL);
+	c->ctx = EVP_CIPHER_CTX_new();
+	c->authsize = 16;
+	return c;
+}
+
+int crypto_aead_setkey(struct crypto_aead *c, const u8 *key, unsigned int len) {
+	const EVP_CIPHER *evp = aes_evp("gcm", len);
+	if (!evp)
+		return -EINVAL;
+	EVP_EncryptInit_ex(c->ctx, evp, NULL, key, NULL);
+	return 0;
+}
+
+int crypto_aead_setauthsize(struct crypto_aead *c, unsigned int len) {
+	if (len > 16)
+		return -EINVAL;
+	c->authsize = len;
+	return 0;
+}
+
+// src and dst hold the associated data followed by the text, and the tag when encrypting
+static int aead_crypt(struct aead_request *req, int enc) {
+	struct crypto_aead *c = req->tfm;
+	unsigned char buf[2048];
+	unsigned int len = req->cryptlen, total = req->assoclen + req->cryptlen;
+	int outl;
+
+	if (!enc) {
+		if (len < c->authsize)
+			return -EINVAL;
+		len -= c->authsize;
+	}
+	if (total + c->authsize > sizeof(buf))
+		return -EINVAL;
+	sg_copy(req->src, 0, buf, total, false);
+
+	EVP_CipherInit_ex(c->ctx, NULL, NULL, NULL, req->iv, enc);
+	if (!enc)
+		EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_TAG, c->authsize,
+				buf + req->assoclen + len);
+	if (req->assoclen)
+		EVP_CipherUpdate(c->ctx, NULL, &outl, buf, req->assoclen);
+	EVP_CipherUpdate(c->ctx, buf + req->assoclen, &outl, buf + req->assoclen, len);
+	if (EVP_CipherFinal_ex(c->ctx, buf + req->assoclen + len, &outl) != 1)
+		return -EBADMSG;
+	if (enc) {
+		EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_GET_TAG, c->authsize,
+				buf + req->assoclen + len);
+		len += c->authsize;
+	}
+
+	sg_copy(req->dst, req->assoclen, buf + req->assoclen, len, true);
+	return 0;
+}
+
+int crypto_aead_encrypt(struct aead_request *req) {
+	return aead_crypt(req, 1);
+}
+
+int crypto_aead_decrypt(struct aead_request *req) {
+	return aead_crypt(req, 0);
+}
+
+void crypto_free_aead(struct crypto_aead *c) {
+	EVP_CIPHER_CTX_free(c->ctx);
+	kfree(c);
+}
@@ -0,0 +1,807 @@
+#ifndef _KERNEL_SHIM_H_
+#define _KERNEL_SHIM_H_
+
+/* Just enough of the kernel API to build kernel-module/xt_RTPENGINE.c as a userspace
+ * program, so that its packet path can be benchmarked and fuzzed without loading
+ * the module. Every kernel header the module includes resolves to this file (see
+ * KSHIM_HEADERS in the Makefile).
+ *
+ * The harnesses are single threaded: locks, RCU and per-CPU data are reduced to
+ * what a single CPU needs. Crypto transforms are backed by OpenSSL. Packets sent
+ * by the module are handed to kshim_output(). Everything that only matters for
+ * the module's /proc interface or netfilter registration is a stub that does
+ * nothing or fails. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#ifndef KERNEL_VERSION
+#define KERNEL_VERSION(a,b,c)		(((a) << 16) + ((b) << 8) + (c))
+#endif
+#ifndef LINUX_VERSION_CODE
+#define LINUX_VERSION_CODE		KERNEL_VERSION(6,1,0)
+#endif
+
+
+/* compiler and module */
+
+#define __user
+#define __percpu
+#define __rcu
+#define __init
+#define __exit
+#define __must_check
+#define likely(x)			__builtin_expect(!!(x), 1)
+#define unlikely(x)			__builtin_expect(!!(x), 0)
+#define ARRAY_SIZE(a)			(sizeof(a) / sizeof(*(a)))
+#define BUILD_BUG_ON(c)			_Static_assert(!(c), #c)
+#define __stringify_1(x)		#x
+#define __stringify(x)			__stringify_1(x)
+#define READ_ONCE(x)			(*(volatile __typeof__(x) *) &(x))
+#define WRITE_ONCE(x, v)		(*(volatile __typeof__(x) *) &(x) = (v))
+#define smp_wmb()			__atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb()			__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_mb()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define barrier()			__asm__ __volatile__("" ::: "memory")
+#define container_of(p, type, member)	((type *) ((char *) (p) - offsetof(type, member)))
+#define min(a, b)			((a) < (b) ? (a) : (b))
+#define max(a, b)			((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)			min((t) (a), (t) (b))
+#define max_t(t, a, b)			max((t) (a), (t) (b))
+#define DIV_ROUND_UP(n, d)		(((n) + (d) - 1) / (d))
+#define ALIGN(x, a)			(((x) + (a) - 1) & ~((__typeof__(x)) (a) - 1))
+#define is_power_of_2(n)		((n) != 0 && ((n) & ((n) - 1)) == 0)
+#define PAGE_SIZE			4096UL
+#define PAGE_ALIGN(x)			(((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define BITS_PER_LONG			(sizeof(long) * 8)
+
+#define THIS_MODULE			NULL
+#define MODULE_LICENSE(x)
+#define MODULE_IMPORT_NS(x)
+#define MODULE_ALIAS(x)
+#define module_param(n, t, p)
+#define MODULE_PARM_DESC(n, d)
+#define module_init(f)
+#define module_exit(f)
+#define try_module_get(m)		1
+#define module_put(m)			do { } while (0)
+
+typedef int8_t				s8;
+typedef uint8_t				u8;
+typedef int16_t				s16;
+typedef uint16_t			u16;
+typedef int32_t				s32;
+typedef uint32_t			u32;
+typedef int64_t				s64;
+typedef uint64_t			u64;
+typedef uint16_t			__be16;
+typedef uint32_t			__be32;
+typedef uint16_t			__sum16;
+typedef uint32_t			__wsum;
+typedef unsigned int			gfp_t;
+typedef unsigned short			umode_t;
+
+#define ERESTARTSYS			512
+
+#define GFP_KERNEL			0
+#define GFP_ATOMIC			1
+#define __GFP_ZERO			2
+
+#define KERN_DEBUG
+#define KERN_INFO
+#define KERN_NOTICE
+#define KERN_WARNING
+#define KERN_ERR
+#define printk(fmt...)			kshim_printk(fmt)
+#define pr_err(fmt...)			kshim_printk(fmt)
+#define WARN_ON(c)			({ int __c = !!(c); if (__c) kshim_printk("WARN_ON(%s)\n", #c); __c; })
+#define BUG_ON(c)			do { if (c) abort(); } while (0)
+#define panic(fmt...)			do { kshim_printk(fmt); abort(); } while (0)
+
+struct task_struct {
+	int pid;
+	int tgid;
+};
+#define current				((struct task_struct *) NULL)
+
+extern int kshim_printk(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+
+/* errors */
+
+#define MAX_ERRNO			4095
+#define IS_ERR_VALUE(x)			((unsigned long) (void *) (x) >= (unsigned long) -MAX_ERRNO)
+static inline void *ERR_PTR(long error) { return (void *) error; }
+static inline long PTR_ERR(const void *ptr) { return (long) ptr; }
+static inline bool IS_ERR(const void *ptr) { return IS_ERR_VALUE((unsigned long) ptr); }
+static inline bool IS_ERR_OR_NULL(const void *ptr) { return !ptr || IS_ERR(ptr); }
+
+
+/* memory */
+
+static inline void *kmalloc(size_t size, gfp_t flags) {
+	return (flags & __GFP_ZERO) ? calloc(1, size ? : 1) : malloc(size ? : 1);
+}
+static inline void *kzalloc(size_t size, gfp_t flags) {
+	return calloc(1, size ? : 1);
+}
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags) {
+	return calloc(n ? : 1, size ? : 1);
+}
+static inline void kfree(const void *p) {
+	free((void *) p);
+}
+static inline void *krealloc(const void *p, size_t size, gfp_t flags) {
+	return realloc((void *) p, size ? : 1);
+}
+#define kfree_sensitive(p)		kfree(p)
+#define kzfree(p)			kfree(p)
+#define vmalloc(s)			kmalloc(s, 0)
+#define vzalloc(s)			kzalloc(s, 0)
+#define vmalloc_user(s)			kzalloc(s, 0)
+#define vfree(p)			kfree(p)
+
+
+/* atomics */
+
+typedef struct { int counter; } atomic_t;
+typedef struct { long long counter; } atomic64_t;
+
+#define ATOMIC_INIT(i)			{ (i) }
+#define atomic_read(a)			__atomic_load_n(&(a)->counter, __ATOMIC_RELAXED)
+#define atomic_set(a, i)		__atomic_store_n(&(a)->counter, (i), __ATOMIC_RELAXED)
+#define atomic_inc(a)			((void) __atomic_add_fetch(&(a)->counter, 1, __ATOMIC_SEQ_CST))
+#define atomic_dec(a)			((void) __atomic_sub_fetch(&(a)->counter, 1, __ATOMIC_SEQ_CST))
+#define atomic_add(i, a)		((void) __atomic_add_fetch(&(a)->counter, (i), __ATOMIC_SEQ_CST))
+#define atomic_sub(i, a)		((void) __atomic_sub_fetch(&(a)->counter, (i), __ATOMIC_SEQ_CST))
+#define atomic_inc_return(a)		__atomic_add_fetch(&(a)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_return(a)		__atomic_sub_fetch(&(a)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(a)		(atomic_dec_return(a) == 0)
+#define atomic_inc_not_zero(a)		({ int __v = atomic_read(a); if (__v) atomic_inc(a); __v != 0; })
+#define atomic_xchg(a, i)		__atomic_exchange_n(&(a)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_cmpxchg(a, o, n)		({ __typeof__((a)->counter) __o = (o); \
+		__atomic_compare_exchange_n(&(a)->counter, &__o, (n), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
+		__o; })
+#define atomic64_read(a)		atomic_read(a)
+#define atomic64_set(a, i)		atomic_set(a, i)
+#define atomic64_inc(a)			atomic_inc(a)
+#define atomic64_add(i, a)		atomic_add(i, a)
+#define atomic64_add_return(i, a)	__atomic_add_fetch(&(a)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic64_inc_return(a)		atomic64_add_return(1, a)
+#define atomic64_xchg(a, i)		atomic_xchg(a, i)
+#define atomic64_cmpxchg(a, o, n)	atomic_cmpxchg(a, o, n)
+#define xchg(p, v)			__atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+
+
+/* bit operations */
+
+#define BIT_WORD(nr)			((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)			(1UL << ((nr) % BITS_PER_LONG))
+static inline int test_bit(unsigned int nr, const volatile unsigned long *a) {
+	return (a[BIT_WORD(nr)] & BIT_MASK(nr)) != 0;
+}
+static inline void set_bit(unsigned int nr, volatile unsigned long *a) {
+	a[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+static inline void clear_bit(unsigned int nr, volatile unsigned long *a) {
+	a[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+static inline int test_and_set_bit(unsigned int nr, volatile unsigned long *a) {
+	int r = test_bit(nr, a);
+	set_bit(nr, a);
+	return r;
+}
+static inline int test_and_clear_bit(unsigned int nr, volatile unsigned long *a) {
+	int r = test_bit(nr, a);
+	clear_bit(nr, a);
+	return r;
+}
+#define __set_bit(nr, a)		set_bit(nr, a)
+#define __clear_bit(nr, a)		clear_bit(nr, a)
+extern unsigned long find_next_zero_bit(const unsigned long *a, unsigned long size, unsigned long off);
+#define find_first_zero_bit(a, s)	find_next_zero_bit(a, s, 0)
+#define bitmap_zalloc(n, f)		kcalloc(BITS_TO_LONGS(n), sizeof(long), f)
+#define bitmap_free(p)			kfree(p)
+#define BITS_TO_LONGS(n)		DIV_ROUND_UP(n, BITS_PER_LONG)
+
+
+/* locking: the harnesses are single threaded */
+
+typedef struct { int locked; } spinlock_t;
+typedef struct { int locked; } rwlock_t;
+struct mutex { int locked; };
+
+#define DEFINE_SPINLOCK(n)		spinlock_t n = { 0 }
+#define DEFINE_RWLOCK(n)		rwlock_t n = { 0 }
+#define DEFINE_MUTEX(n)			struct mutex n = { 0 }
+#define __SPIN_LOCK_UNLOCKED(n)		{ 0 }
+#define __RW_LOCK_UNLOCKED(n)		{ 0 }
+#define spin_lock_init(l)		((l)->locked = 0)
+#define rwlock_init(l)			((l)->locked = 0)
+#define mutex_init(l)			((l)->locked = 0)
+#define spin_lock(l)			((void) (l))
+#define spin_unlock(l)			((void) (l))
+#define spin_lock_bh(l)			((void) (l))
+#define spin_unlock_bh(l)		((void) (l))
+#define spin_lock_irqsave(l, f)		((void) (l), (f) = 0)
+#define spin_unlock_irqrestore(l, f)	((void) (l), (void) (f))
+#define read_lock(l)			((void) (l))
+#define read_unlock(l)			((void) (l))
+#define write_lock(l)			((void) (l))
+#define write_unlock(l)			((void) (l))
+#define read_lock_irqsave(l, f)		((void) (l), (f) = 0)
+#define read_unlock_irqrestore(l, f)	((void) (l), (void) (f))
+#define write_lock_irqsave(l, f)	((void) (l), (f) = 0)
+#define write_unlock_irqrestore(l, f)	((void) (l), (void) (f))
+#define mutex_lock(l)			((void) (l))
+#define mutex_unlock(l)			((void) (l))
+#define lockdep_is_held(l)		1
+#define local_irq_save(f)		((f) = 0)
+#define local_irq_restore(f)		((void) (f))
+
+/* RCU: readers never run concurrently with a writer, so callbacks run right away */
+struct rcu_head {
+	void (*func)(struct rcu_head *);
+};
+#define rcu_read_lock()			do { } while (0)
+#define rcu_read_unlock()		do { } while (0)
+#define rcu_dereference(p)		(p)
+#define rcu_dereference_check(p, c)	(p)
+#define rcu_dereference_protected(p, c)	(p)
+#define rcu_access_pointer(p)		(p)
+#define rcu_assign_pointer(p, v)	((p) = (v))
+#define RCU_INIT_POINTER(p, v)		((p) = (v))
+#define synchronize_rcu()		do { } while (0)
+#define rcu_barrier()			do { } while (0)
+static inline void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *)) {
+	func(head);
+}
+#define kfree_rcu(p, field)		kfree(p)
+
+/* per-CPU data: there is a single CPU */
+#define alloc_percpu(type)		((type *) kzalloc(sizeof(type), 0))
+#define __alloc_percpu_gfp(s, a, f)	kzalloc(s, f)
+#define __alloc_percpu(s, a)		kzalloc(s, 0)
+#define free_percpu(p)			kfree(p)
+#define per_cpu_ptr(p, cpu)		((void) (cpu), (p))
+#define this_cpu_ptr(p)			(p)
+#define get_cpu_ptr(p)			(p)
+#define put_cpu_ptr(p)			do { } while (0)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define smp_processor_id()		0
+
+struct u64_stats_sync { int unused; };
+#define u64_stats_init(s)		do { } while (0)
+#define u64_stats_update_begin(s)	do { } while (0)
+#define u64_stats_update_end(s)		do { } while (0)
+#define u64_stats_fetch_begin(s)	0
+#define u64_stats_fetch_retry(s, st)	0
+#define u64_stats_fetch_begin_irq(s)	0
+#define u64_stats_fetch_retry_irq(s, st) 0
+
+/* sequence counters */
+typedef struct { unsigned int sequence; } seqcount_t;
+#define seqcount_init(s)		((s)->sequence = 0)
+
+
+/* lists */
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+#define LIST_HEAD_INIT(n)		{ &(n), &(n) }
+#define LIST_HEAD(n)			struct list_head n = LIST_HEAD_INIT(n)
+static inline void INIT_LIST_HEAD(struct list_head *l) {
+	l->next = l->prev = l;
+}
+static inline void __list_add(struct list_head *n, struct list_head *prev, struct list_head *next) {
+	next->prev = n;
+	n->next = next;
+	n->prev = prev;
+	prev->next = n;
+}
+static inline void list_add(struct list_head *n, struct list_head *head) {
+	__list_add(n, head, head->next);
+}
+static inline void list_add_tail(struct list_head *n, struct list_head *head) {
+	__list_add(n, head->prev, head);
+}
+static inline void list_del(struct list_head *e) {
+	e->next->prev = e->prev;
+	e->prev->next = e->next;
+	e->next = e->prev = NULL;
+}
+static inline void list_del_init(struct list_head *e) {
+	list_del(e);
+	INIT_LIST_HEAD(e);
+}
+static inline int list_empty(const struct list_head *l) {
+	return l->next == l;
+}
+#define list_entry(p, type, member)	container_of(p, type, member)
+#define list_first_entry(p, type, member) list_entry((p)->next, type, member)
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_entry((head)->next, __typeof__(*pos), member); \
+			&pos->member != (head); \
+			pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+struct hlist_head {
+	struct hlist_node *first;
+};
+#define INIT_HLIST_HEAD(h)		((h)->first = NULL)
+#define INIT_HLIST_NODE(n)		((n)->next = NULL, (n)->pprev = NULL)
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h) {
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+static inline void hlist_del(struct hlist_node *n) {
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+static inline void hlist_del_init(struct hlist_node *n) {
+	if (n->pprev)
+		hlist_del(n);
+}
+static inline int hlist_unhashed(const struct hlist_node *n) {
+	return !n->pprev;
+}
+#define hlist_entry(p, type, member)	container_of(p, type, member)
+#define hlist_entry_safe(p, type, member) ({ __typeof__(p) __p = (p); __p ? hlist_entry(__p, type, member) : NULL; })
+#define hlist_for_each(pos, head) \
+	for (pos = (head)->first; pos; pos = pos->next)
+#define hlist_for_each_entry(pos, head, member) \
+	for (pos = hlist_entry_safe((head)->first, __typeof__(*(pos)), member); \
+			pos; \
+			pos = hlist_entry_safe((pos)->member.next, __typeof__(*(pos)), member))
+
+
+/* wait queues, scheduling and time */
+
+typedef struct { int unused; } wait_queue_head_t;
+#define init_waitqueue_head(w)		do { } while (0)
+#define wake_up_interruptible(w)	do { } while (0)
+#define wake_up_interruptible_all(w)	do { } while (0)
+#define wait_event_interruptible(w, c)	((c) ? 0 : -EINTR)
+#define signal_pending(t)		0
+#define schedule()			do { } while (0)
+#define cond_resched()			do { } while (0)
+
+typedef s64 ktime_t;
+extern s64 kshim_now_ns(void);
+#define ktime_get()			kshim_now_ns()
+#define ktime_get_real()		kshim_now_ns()
+#define ktime_to_ns(t)			((s64) (t))
+#define ktime_to_us(t)			((s64) (t) / 1000)
+#define ktime_to_ms(t)			((s64) (t) / 1000000)
+#define ktime_get_real_ns()		kshim_now_ns()
+#define jiffies				((unsigned long) (kshim_now_ns() / 4000000))
+#define HZ				250
+
+struct timespec64 {
+	s64 tv_sec;
+	long tv_nsec;
+};
+static inline void ktime_get_real_ts64(struct timespec64 *ts) {
+	s64 ns = kshim_now_ns();
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+static inline u64 div64_u64(u64 a, u64 b) { return a / b; }
+static inline s64 div64_s64(s64 a, s64 b) { return a / b; }
+static inline u64 div_u64(u64 a, u32 b) { return a / b; }
+static inline s64 div_s64(s64 a, s32 b) { return a / b; }
+#define do_div(n, base)			({ uint32_t __rem = (n) % (base); (n) /= (base); __rem; })
+
+extern u32 crc32_le(u32 crc, const unsigned char *p, size_t len);
+#define crc32(seed, p, len)		crc32_le(seed, p, len)
+
+
+/* user memory and files: nothing in the harnesses goes through /proc */
+
+#define copy_from_user(to, from, n)	(memcpy(to, from, n), 0UL)
+#define copy_to_user(to, from, n)	(memcpy(to, from, n), 0UL)
+#define get_user(x, p)			((x) = *(p), 0)
+#define put_user(x, p)			(*(p) = (x), 0)
+#define simple_strtoul(s, e, b)		strtoul(s, e, b)
+#define simple_strtol(s, e, b)		strtol(s, e, b)
+#define kstrtouint(s, b, r)		(*(r) = strtoul(s, NULL, b), 0)
+
+typedef unsigned int			__poll_t;
+#define POLLIN				0x0001
+#define POLLRDNORM			0x0040
+#define POLLERR				0x0008
+#define EPOLLIN				POLLIN
+#define EPOLLRDNORM			POLLRDNORM
+#define EPOLLERR			POLLERR
+
+struct inode {
+	void *data;
+};
+struct dentry {
+	struct inode *d_inode;
+};
+struct path {
+	struct dentry *dentry;
+};
+struct file {
+	void *private_data;
+	unsigned int f_flags;
+	struct path f_path;
+};
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+#define poll_wait(f, w, p)		do { } while (0)
+#define stream_open(i, f)		0
+#define O_NONBLOCK			04000
+
+struct vm_area_struct {
+	unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+	void *vm_private_data;
+};
+#define VM_WRITE			0x2
+#define VM_SHARED			0x8
+#define VM_MAYWRITE			0x20
+#define vm_flags_clear(v, f)		((v)->vm_flags &= ~(f))
+// the "mapping" is the kernel's memory itself
+#define remap_vmalloc_range(v, p, o)	((v)->vm_private_data = (char *) (p) + ((o) << 12), 0)
+
+struct proc_dir_entry {
+	void *data;
+};
+struct proc_ops {
+	int (*proc_open)(struct inode *, struct file *);
+	ssize_t (*proc_read)(struct file *, char *, size_t, loff_t *);
+	ssize_t (*proc_write)(struct file *, const char *, size_t, loff_t *);
+	loff_t (*proc_lseek)(struct file *, loff_t, int);
+	int (*proc_release)(struct inode *, struct file *);
+	__poll_t (*proc_poll)(struct file *, struct poll_table_struct *);
+	int (*proc_mmap)(struct file *, struct vm_area_struct *);
+};
+extern struct proc_dir_entry *kshim_proc_entry(void *data);
+#define proc_mkdir_mode(n, m, p)	kshim_proc_entry(NULL)
+#define proc_mkdir(n, p)		kshim_proc_entry(NULL)
+#define proc_create_data(n, m, p, o, d)	kshim_proc_entry(d)
+#define proc_create(n, m, p, o)		kshim_proc_entry(NULL)
+#define proc_set_user(e, u, g)		do { } while (0)
+#define proc_remove(e)			kfree(e)
+#define remove_proc_entry(n, p)		do { } while (0)
+#define pde_data(i)			((i)->data)
+#define S_IFREG				0100000
+#define S_IRUSR				00400
+#define S_IWUSR				00200
+#define S_IXUSR				00100
+#define S_IRGRP				00040
+#define S_IWGRP				00020
+#define S_IXGRP				00010
+#define S_IROTH				00004
+#define S_IXOTH				00001
+#define S_IRUGO				(S_IRUSR | S_IRGRP | S_IROTH)
+#define S_IXUGO				(S_IXUSR | S_IXGRP | S_IXOTH)
+
+typedef struct { unsigned int val; } kuid_t;
+typedef struct { unsigned int val; } kgid_t;
+#define KUIDT_INIT(u)			((kuid_t) { u })
+#define KGIDT_INIT(g)			((kgid_t) { g })
+#define uid_valid(u)			1
+#define gid_valid(g)			1
+#define current_user_ns()		NULL
+
+struct seq_file {
+	void *private;
+};
+struct seq_operations {
+	void *(*start)(struct seq_file *, loff_t *);
+	void (*stop)(struct seq_file *, void *);
+	void *(*next)(struct seq_file *, void *, loff_t *);
+	int (*show)(struct seq_file *, void *);
+};
+#define seq_printf(f, fmt...)		((void) (f))
+#define seq_puts(f, s)			((void) (f))
+#define seq_open(f, o)			(-ENODEV)
+#define seq_release(i, f)		0
+#define seq_read			NULL
+#define seq_lseek			NULL
+
+
+/* checksums */
+
+extern __wsum csum_partial(const void *buf, int len, __wsum sum);
+extern __sum16 csum_tcpudp_magic(__be32 saddr, __be32 daddr, u32 len, u8 proto, __wsum sum);
+extern __sum16 csum_ipv6_magic(const struct in6_addr *saddr, const struct in6_addr *daddr,
+		u32 len, u8 proto, __wsum sum);
+#define CSUM_MANGLED_0			((__sum16) 0xffff)
+
+
+/* packets */
+
+#define CHECKSUM_NONE			0
+#define CHECKSUM_UNNECESSARY		1
+#define CHECKSUM_PARTIAL		3
+#define ETH_P_IP			0x0800
+#define ETH_P_IPV6			0x86DD
+#define MAX_HEADER			128
+
+struct sock;
+struct net;
+struct net_device;
+
+struct sk_buff {
+	unsigned char *head, *data;
+	unsigned int len, data_len;
+	unsigned int tail, end; /* offsets from head */
+	u16 network_header, transport_header;
+	__be16 protocol;
+	u16 csum_start, csum_offset;
+	u8 ip_summed;
+	ktime_t tstamp;
+	struct sock *sk;
+	struct net_device *dev;
+};
+
+extern struct sk_buff *kshim_skb_alloc(unsigned int headroom, unsigned int size, unsigned int tailroom);
+extern struct sk_buff *skb_copy_expand(const struct sk_buff *skb, int headroom, int tailroom, gfp_t flags);
+extern void kfree_skb(struct sk_buff *skb);
+#define consume_skb(s)			kfree_skb(s)
+
+static inline unsigned char *skb_tail_pointer(const struct sk_buff *skb) {
+	return skb->head + skb->tail;
+}
+static inline unsigned int skb_headroom(const struct sk_buff *skb) {
+	return skb->data - skb->head;
+}
+static inline int skb_tailroom(const struct sk_buff *skb) {
+	return skb->end - skb->tail;
+}
+static inline unsigned char *skb_push(struct sk_buff *skb, unsigned int len) {
+	if (len > skb_headroom(skb))
+		abort();
+	skb->data -= len;
+	skb->len += len;
+	return skb->data;
+}
+static inline unsigned char *skb_pull(struct sk_buff *skb, unsigned int len) {
+	if (len > skb->len)
+		return NULL;
+	skb->len -= len;
+	return skb->data += len;
+}
+static inline unsigned char *skb_put(struct sk_buff *skb, unsigned int len) {
+	unsigned char *tmp = skb_tail_pointer(skb);
+	if (len > skb_tailroom(skb))
+		abort();
+	skb->tail += len;
+	skb->len += len;
+	return tmp;
+}
+static inline void skb_trim(struct sk_buff *skb, unsigned int len) {
+	if (skb->len > len) {
+		skb->len = len;
+		skb->tail = skb->data - skb->head + len;
+	}
+}
+static inline int pskb_may_pull(struct sk_buff *skb, unsigned int len) {
+	return len <= skb->len;
+}
+static inline int skb_linearize(struct sk_buff *skb) {
+	return 0;
+}
+static inline void skb_reset_network_header(struct sk_buff *skb) {
+	skb->network_header = skb->data - skb->head;
+}
+static inline void skb_reset_transport_header(struct sk_buff *skb) {
+	skb->transport_header = skb->data - skb->head;
+}
+static inline unsigned char *skb_network_header(const struct sk_buff *skb) {
+	return skb->head + skb->network_header;
+}
+static inline unsigned char *skb_transport_header(const struct sk_buff *skb) {
+	return skb->head + skb->transport_header;
+}
+static inline void *skb_dst(const struct sk_buff *skb) {
+	return NULL;
+}
+
+struct ipv6hdr {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	u8 priority:4,
+	   version:4;
+#else
+	u8 version:4,
+	   priority:4;
+#endif
+	u8 flow_lbl[3];
+	__be16 payload_len;
+	u8 nexthdr;
+	u8 hop_limit;
+	struct in6_addr saddr;
+	struct in6_addr daddr;
+};
+
+static inline struct iphdr *ip_hdr(const struct sk_buff *skb) {
+	return (void *) skb_network_header(skb);
+}
+static inline struct ipv6hdr *ipv6_hdr(const struct sk_buff *skb) {
+	return (void *) skb_network_header(skb);
+}
+static inline struct udphdr *udp_hdr(const struct sk_buff *skb) {
+	return (void *) skb_transport_header(skb);
+}
+static inline u8 ipv6_get_dsfield(const struct ipv6hdr *ih) {
+	return ntohs(*(const __be16 *) ih) >> 4;
+}
+static inline void ip_send_check(struct iphdr *ih) {
+	ih->check = 0;
+	ih->check = ~csum_partial(ih, ih->ihl * 4, 0);
+}
+
+/* output: handed to the harness */
+extern int kshim_output(struct sk_buff *skb);
+#define RTN_UNSPEC			0
+#define ip_route_me_harder(net, sk, skb, type)	0
+#define ip6_route_me_harder(net, sk, skb)	0
+#define ip_select_ident(net, skb, sk)	do { } while (0)
+#define ip_local_out(net, sk, skb)	kshim_output(skb)
+#define ip6_local_out(net, sk, skb)	kshim_output(skb)
+
+
+/* netfilter */
+
+#define NF_DROP				0
+#define NF_ACCEPT			1
+#define XT_CONTINUE			0xFFFFFFFF
+#define NFPROTO_IPV4			2
+#define NFPROTO_IPV6			10
+
+struct nf_hook_state {
+	struct net *net;
+	struct sock *sk;
+};
+struct xt_action_param {
+	const void *targinfo;
+	const struct nf_hook_state *state;
+};
+struct xt_tgchk_param {
+	void *targinfo;
+};
+struct xt_target {
+	const char *name;
+	int family;
+	unsigned int (*target)(struct sk_buff *, const struct xt_action_param *);
+	int (*checkentry)(const struct xt_tgchk_param *);
+	unsigned int targetsize;
+	const char *table;
+	unsigned int hooks;
+	void *me;
+	unsigned int revision;
+};
+#define NF_INET_LOCAL_IN		1
+#define xt_register_targets(t, n)	0
+#define xt_unregister_targets(t, n)	do { } while (0)
+
+
+/* crypto, backed by OpenSSL */
+
+#define CRYPTO_ALG_ASYNC		0x80
+
+struct scatterlist {
+	void *buf;
+	unsigned int length;
+};
+static inline void sg_init_table(struct scatterlist *sg, unsigned int n) {
+	memset(sg, 0, sizeof(*sg) * n);
+}
+static inline void sg_set_buf(struct scatterlist *sg, const void *buf, unsigned int len) {
+	sg->buf = (void *) buf;
+	sg->length = len;
+}
+static inline void sg_init_one(struct scatterlist *sg, const void *buf, unsigned int len) {
+	sg_init_table(sg, 1);
+	sg_set_buf(sg, buf, len);
+}
+
+struct crypto_cipher;
+extern struct crypto_cipher *crypto_alloc_cipher(const char *name, u32 type, u32 mask);
+extern int crypto_cipher_setkey(struct crypto_cipher *, const u8 *key, unsigned int len);
+extern void crypto_cipher_encrypt_one(struct crypto_cipher *, u8 *dst, const u8 *src);
+extern void crypto_free_cipher(struct crypto_cipher *);
+
+struct crypto_skcipher {
+	void *ctx;
+};
+struct crypto_sync_skcipher {
+	struct crypto_skcipher base;
+};
+struct skcipher_request {
+	struct crypto_sync_skcipher *tfm;
+	struct scatterlist *src, *dst;
+	unsigned int cryptlen;
+	u8 *iv;
+};
+extern struct crypto_sync_skcipher *crypto_alloc_sync_skcipher(const char *name, u32 type, u32 mask);
+extern int crypto_sync_skcipher_setkey(struct crypto_sync_skcipher *, const u8 *key, unsigned int len);
+extern int crypto_skcipher_encrypt(struct skcipher_request *);
+extern void crypto_free_sync_skcipher(struct crypto_sync_skcipher *);
+extern const char *crypto_skcipher_driver_name(struct crypto_skcipher *);
+#define SYNC_SKCIPHER_REQUEST_ON_STACK(name, tfm) \
+	struct skcipher_request __##name##_req = { 0 }, *name = &__##name##_req
+#define skcipher_request_set_sync_tfm(req, t)	((req)->tfm = (t))
+#define skcipher_request_set_callback(req, f, cb, d)	do { } while (0)
+static inline void skcipher_request_set_crypt(struct skcipher_request *req, struct scatterlist *src,
+		struct scatterlist *dst, unsigned int len, void *iv)
+{
+	req->src = src;
+	req->dst = dst;
+	req->cryptlen = len;
+	req->iv = iv;
+}
+#define skcipher_request_zero(req)	memset(req, 0, sizeof(*(req)))
+
+struct crypto_shash;
+struct shash_desc {
+	struct crypto_shash *tfm;
+};
+extern struct crypto_shash *crypto_alloc_shash(const char *name, u32 type, u32 mask);
+extern int crypto_shash_setkey(struct crypto_shash *, const u8 *key, unsigned int len);
+extern int crypto_shash_init(struct shash_desc *);
+extern int crypto_shash_update(struct shash_desc *, const u8 *data, unsigned int len);
+extern int crypto_shash_final(struct shash_desc *, u8 *out);
+extern void crypto_free_shash(struct crypto_shash *);
+#define crypto_shash_descsize(t)	0
+#define SHASH_DESC_ON_STACK(name, t) \
+	struct shash_desc __##name##_desc, *name = &__##name##_desc
+
+struct crypto_aead;
+struct aead_request {
+	struct crypto_aead *tfm;
+	struct scatterlist *src, *dst;
+	unsigned int assoclen, cryptlen;
+	u8 *iv;
+};
+extern struct crypto_aead *crypto_alloc_aead(const char *name, u32 type, u32 mask);
+extern int crypto_aead_setkey(struct crypto_aead *, const u8 *key, unsigned int len);
+extern int crypto_aead_setauthsize(struct crypto_aead *, unsigned int len);
+extern int crypto_aead_encrypt(struct aead_request *);
+extern int crypto_aead_decrypt(struct aead_request *);
+extern void crypto_free_aead(struct crypto_aead *);
+#define crypto_aead_ivsize(t)		12
+static inline struct aead_request *aead_request_alloc(struct crypto_aead *tfm, gfp_t gfp) {
+	struct aead_request *req = kzalloc(sizeof(*req), gfp);
+	if (req)
+		req->tfm = tfm;
+	return req;
+}
+#define aead_request_free(req)		kfree(req)
+#define aead_request_set_callback(req, f, cb, d)	do { } while (0)
+#define aead_request_set_ad(req, len)	((req)->assoclen = (len))
+static inline void aead_request_set_crypt(struct aead_request *req, struct scatterlist *src,
+		struct scatterlist *dst, unsigned int len, u8 *iv)
+{
+	req->src = src;
+	req->dst = dst;
+	req->cryptlen = len;
+	req->iv = iv;
+}
+
+#endif
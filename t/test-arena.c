@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glib.h>
+#include "arena.h"
+
+#define NUM_OBJS	5000
+
+struct obj {
+	unsigned char *p;
+	size_t size;
+	unsigned char fill;
+};
+
+static struct arena a;
+static struct obj objs[NUM_OBJS];
+
+#define err(fmt...) do { \
+		fprintf(stderr, fmt); \
+		exit(1); \
+	} while (0)
+
+// object sizes of a call: small strings, list nodes, structs up to a few kB, and the odd big one
+static size_t rnd_size(void) {
+	switch (random() % 8) {
+		case 0:
+			return random() % 40;
+		case 1:
+		case 2:
+			return 1 + random() % 256;
+		case 3:
+		case 4:
+			return 1 + random() % 1500;
+		case 5:
+		case 6:
+			return 1 + random() % ARENA_MAX_CLASS;
+		default:
+			return ARENA_MAX_CLASS + random() % 20000;
+	}
+}
+
+static void check(struct obj *o) {
+	for (size_t i = 0; i < o->size; i++) {
+		if (o->p[i] != o->fill)
+			err("object of %zu bytes overwritten at offset %zu\n", o->size, i);
+	}
+}
+
+static void alloc(struct obj *o) {
+	o->size = rnd_size();
+	o->fill = random();
+	o->p = arena_alloc0(&a, o->size);
+	if ((uintptr_t) o->p % ARENA_ALIGN)
+		err("object of %zu bytes not aligned\n", o->size);
+	for (size_t i = 0; i < o->size; i++) {
+		if (o->p[i])
+			err("object of %zu bytes not zeroed\n", o->size);
+	}
+	memset(o->p, o->fill, o->size);
+}
+
+static void release(struct obj *o) {
+	check(o);
+	arena_free(&a, o->p, o->size);
+	o->p = NULL;
+}
+
+int main(void) {
+	srandom(2345);
+	arena_init(&a);
+
+	for (unsigned int round = 0; round < 200000; round++) {
+		struct obj *o = &objs[random() % NUM_OBJS];
+		if (o->p)
+			release(o);
+		else
+			alloc(o);
+	}
+
+	size_t used = 0;
+	for (unsigned int i = 0; i < NUM_OBJS; i++) {
+		if (!objs[i].p)
+			continue;
+		check(&objs[i]);
+		used += objs[i].size;
+	}
+	if (arena_used(&a) < used)
+		err("arena reports %zu bytes in use, expected at least %zu\n", arena_used(&a), used);
+	if (arena_size(&a) < arena_used(&a))
+		err("arena size %zu smaller than its use %zu\n", arena_size(&a), arena_used(&a));
+
+	// everything freed: memory stays with the arena for reuse
+	size_t size = arena_size(&a);
+	for (unsigned int i = 0; i < NUM_OBJS; i++) {
+		if (objs[i].p)
+			release(&objs[i]);
+	}
+	if (arena_used(&a) != 0)
+		err("%zu bytes still in use after freeing everything\n", arena_used(&a));
+	if (arena_size(&a) > size)
+		err("arena grew from freeing\n");
+
+	// freed objects are reused before new chunks are taken
+	size = arena_size(&a);
+	void *p = arena_alloc(&a, 100);
+	arena_free(&a, p, 100);
+	if (arena_alloc(&a, 112) != p)
+		err("freed object of the same size class not reused\n");
+	if (arena_size(&a) != size)
+		err("arena grew despite free objects\n");
+
+	// bulk release, and usable again afterwards
+	arena_destroy(&a);
+	if (arena_size(&a) || arena_used(&a))
+		err("arena not empty after destroy\n");
+	for (unsigned int i = 0; i < NUM_OBJS; i++)
+		alloc(&objs[i]);
+	for (unsigned int i = 0; i < NUM_OBJS; i++)
+		check(&objs[i]);
+	arena_destroy(&a);
+
+	printf("arena ok\n");
+
+	return 0;
+}
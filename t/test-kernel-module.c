@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include "kernel.h"
 #include "../kernel-module/xt_RTPENGINE.h"
 
@@ -116,6 +117,7 @@ int main(void) {
 	ret = kernel_add_destination(&redi);
 	assert(ret == 0);
 
+	unsigned int last_idx = reti.stats_idx;
 	reti.local.port = 4450;
 	redi.local.port = 4450;
 	ret = kernel_add_stream(&reti);
@@ -123,6 +125,54 @@ int main(void) {
 	ret = kernel_add_destination(&redi);
 	assert(ret == 0);
 
+	// each target gets its own slot in the stats region
+	if (kernel.stats) {
+		assert(reti.stats_idx != 0);
+		assert(reti.stats_idx != last_idx);
+	}
+	struct kernel_stats_ref ref = { .idx = reti.stats_idx };
+	struct rtpengine_stats_info stats_info;
+	ret = kernel_update_stats(&reti.local, &ref, &stats_info);
+	assert(ret == 0);
+	assert(stats_info.ssrc[0] == reti.ssrc[0]);
+	assert(stats_info.ssrc_stats[0].basic_stats.packets == 0);
+
+	// target and destination in one batch, with results for each
+	struct rtpengine_message msgs[3] = {0};
+	int status[3];
+	reti.local.port = 4452;
+	redi.local.port = 4452;
+	msgs[0].cmd = REMG_ADD_TARGET;
+	msgs[0].u.target = reti;
+	msgs[1].cmd = REMG_ADD_DESTINATION;
+	msgs[1].u.destination = redi;
+	msgs[2] = msgs[0]; // duplicate
+	ret = kernel_batch(msgs, status, 3);
+	assert(ret == 0);
+	assert(status[0] == 0);
+	assert(status[1] == 0);
+	assert(status[2] == -EEXIST);
+	if (kernel.stats)
+		assert(msgs[0].u.target.stats_idx != 0);
+
+	// the same through the per-thread queue, together with a removal
+	struct kernel_stats_ref queued_ref = {0};
+	reti.local.port = 4454;
+	redi.local.port = 4454;
+	kernel_batch_begin();
+	kernel_queue_target(&reti, &queued_ref);
+	kernel_queue_destination(&redi);
+	ret = kernel_del_stream(&msgs[0].u.target.local);
+	assert(ret == 0);
+	assert(queued_ref.idx == 0); // nothing sent yet
+	kernel_batch_end();
+	if (kernel.stats)
+		assert(queued_ref.idx != 0);
+	ret = kernel_del_stream(&msgs[0].u.target.local); // already gone
+	assert(ret == -1);
+	ret = kernel_del_stream(&reti.local);
+	assert(ret == 0);
+
 	return 0;
 }
 
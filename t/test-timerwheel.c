@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <glib.h>
+#include "timerwheel.h"
+
+#define NUM_ENTRIES	2000
+
+struct item {
+	struct timerwheel_entry e;
+	bool pending;
+	long long when;
+};
+
+static struct timerwheel tw;
+static struct item items[NUM_ENTRIES];
+static long long now;
+static unsigned int num_pending, num_expired, num_cleared;
+
+#define err(fmt...) do { \
+		fprintf(stderr, fmt); \
+		exit(1); \
+	} while (0)
+
+static long long rnd(long long max) {
+	return (((long long) random() << 31) ^ random()) % max;
+}
+
+// from sub-millisecond to beyond the reach of the wheel
+static long long rnd_delay(void) {
+	switch (random() % 6) {
+		case 0:
+			return rnd(1000);
+		case 1:
+			return rnd(64000);
+		case 2:
+			return rnd(5000000);
+		case 3:
+			return rnd(300000000LL);
+		case 4:
+			return rnd(20000000000LL);
+		default:
+			return 20000 * (1 + random() % 5); // packet intervals
+	}
+}
+
+static void add(struct item *it, long long when) {
+	if (!it->pending)
+		num_pending++;
+	it->pending = true;
+	it->when = when;
+	timerwheel_add(&tw, &it->e, when);
+	if (!timerwheel_pending(&it->e))
+		err("entry not pending after add\n");
+}
+
+static void del(struct item *it) {
+	if (it->pending)
+		num_pending--;
+	it->pending = false;
+	timerwheel_del(&tw, &it->e);
+	if (timerwheel_pending(&it->e))
+		err("entry still pending after del\n");
+}
+
+static void check_count(void) {
+	if (tw.count != num_pending)
+		err("wheel has %u entries, expected %u\n", tw.count, num_pending);
+}
+
+// expires everything that's due and checks that nothing else is
+static void run(void) {
+	struct timerwheel_entry *e;
+	long long next;
+
+	while ((e = timerwheel_expire(&tw, now, &next))) {
+		struct item *it = (struct item *) e;
+		if (!it->pending)
+			err("expired an entry that wasn't scheduled\n");
+		if (it->when > now)
+			err("entry expired %lli us early\n", it->when - now);
+		if (e->when != it->when)
+			err("entry has wrong time\n");
+		it->pending = false;
+		num_pending--;
+		num_expired++;
+	}
+	check_count();
+
+	long long earliest = -1;
+	for (unsigned int i = 0; i < NUM_ENTRIES; i++) {
+		if (!items[i].pending)
+			continue;
+		if (items[i].when <= now)
+			err("entry due %lli us ago wasn't expired\n", now - items[i].when);
+		if (earliest == -1 || items[i].when < earliest)
+			earliest = items[i].when;
+	}
+	if (earliest == -1) {
+		if (next != -1)
+			err("empty wheel returned next time %lli\n", next);
+		return;
+	}
+	if (next <= now)
+		err("next time %lli not in the future (%lli)\n", next, now);
+	if (next > earliest)
+		err("next time %lli us later than earliest entry\n", next - earliest);
+}
+
+static void cleared(struct timerwheel_entry *e) {
+	struct item *it = (struct item *) e;
+	if (!it->pending)
+		err("cleared an entry that wasn't scheduled\n");
+	it->pending = false;
+	num_pending--;
+	num_cleared++;
+}
+
+int main(void) {
+	srandom(1234);
+	now = 1700000000000000LL + 123;
+	timerwheel_init(&tw, now);
+
+	// past, present and exact tick boundaries
+	add(&items[0], now - 5000);
+	add(&items[1], now);
+	add(&items[2], (now / TIMERWHEEL_TICK + 1) * TIMERWHEEL_TICK);
+	add(&items[3], now + 1);
+	run();
+	if (items[0].pending || items[1].pending || !items[2].pending || !items[3].pending)
+		err("wrong entries expired at start\n");
+	now += 1;
+	run();
+	if (items[3].pending || !items[2].pending)
+		err("sub-millisecond entry not expired\n");
+
+	for (unsigned int round = 0; round < 200000; round++) {
+		struct item *it = &items[random() % NUM_ENTRIES];
+
+		switch (random() % 8) {
+			case 0:
+				del(it);
+				break;
+			case 1:
+			case 2:
+			case 3:
+			case 4:
+				add(it, now + rnd_delay());
+				break;
+			default:
+				// mostly small steps, occasionally long sleeps
+				if (random() % 100)
+					now += rnd(20000);
+				else
+					now += rnd(3000000000LL);
+				run();
+				break;
+		}
+	}
+
+	// let everything expire
+	while (num_pending) {
+		now += rnd(600000000LL);
+		run();
+	}
+
+	for (unsigned int i = 0; i < NUM_ENTRIES; i++)
+		add(&items[i], now + rnd_delay());
+	timerwheel_clear(&tw, cleared);
+	check_count();
+	if (num_cleared != NUM_ENTRIES)
+		err("cleared %u entries, expected %u\n", num_cleared, NUM_ENTRIES);
+
+	printf("%u entries expired\n", num_expired);
+
+	return 0;
+}
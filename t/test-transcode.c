@@ -92,7 +92,7 @@ static void __start(const char *file, int line) {
 	obj_hold(&call);
 	call.tags = g_hash_table_new(g_str_hash, g_str_equal);
 	str_init(&call.callid, "test-call");
-	bencode_buffer_init(&call.buffer);
+	call_buffer_init(&call.buffer);
 	media_A = call_media_new(&call); // originator
 	media_B = call_media_new(&call); // output destination
 	g_queue_push_tail(&media_A->streams, ps_new(&call));
@@ -369,7 +369,7 @@ static void end(void) {
 	g_queue_clear_full(&media_B->streams, free);
 	call_media_free(&media_A);
 	call_media_free(&media_B);
-	bencode_buffer_free(&call.buffer);
+	call_buffer_free(&call.buffer);
 	g_hash_table_destroy(call.tags);
 	g_queue_clear(&call.medias);
 	__cleanup();
@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# Test for the AF_XDP forwarding engine, run through "make xdp-veth-test". Must
+# be run as root from the t/ directory after building the daemon (including
+# daemon/xdp_filter.bpf.o).
+#
+# A network namespace is connected to the host through a veth pair. The daemon
+# runs on the host side with XDP in generic mode attached to the veth, and
+# test-basic-ipv4.pl is run from inside the namespace, so that all media passes
+# through the XDP program. Afterwards the daemon's XDP counters are checked.
+
+set -e
+
+NS=rtpe-xdp-test
+HOST_IF=rtpe-xdp0
+NS_IF=rtpe-xdp1
+HOST_V4=10.99.0.1
+NS_V4=10.99.0.2
+HOST_V6=fd00:99::1
+NS_V6=fd00:99::2
+HTTP_PORT=2298
+NG_PORT=2299
+
+cleanup() {
+	[ -n "$RTPE_PID" ] && kill "$RTPE_PID" 2> /dev/null && wait "$RTPE_PID" || true
+	ip link del "$HOST_IF" 2> /dev/null || true
+	ip netns del "$NS" 2> /dev/null || true
+}
+trap cleanup EXIT
+
+ip netns add "$NS"
+ip link add "$HOST_IF" type veth peer name "$NS_IF"
+ip link set "$NS_IF" netns "$NS"
+ip addr add "$HOST_V4"/24 dev "$HOST_IF"
+ip addr add "$HOST_V6"/64 dev "$HOST_IF" nodad
+ip link set "$HOST_IF" up
+ip netns exec "$NS" ip addr add "$NS_V4"/24 dev "$NS_IF"
+ip netns exec "$NS" ip addr add "$NS_V6"/64 dev "$NS_IF" nodad
+ip netns exec "$NS" ip link set "$NS_IF" up
+ip netns exec "$NS" ip link set lo up
+
+../daemon/rtpengine --foreground --log-stderr --log-level=6 --table=-1 \
+	--xdp-interface="$HOST_IF" --xdp-generic --xdp-program=../daemon/xdp_filter.bpf.o \
+	--interface="$HOST_V4" --listen-ng="$HOST_V4":"$NG_PORT" \
+	--listen-http=127.0.0.1:"$HTTP_PORT" &
+RTPE_PID=$!
+sleep 2
+
+ip netns exec "$NS" env RTPE_TEST_V4_ADDRS="$NS_V4" RTPE_TEST_V6_ADDRS="$NS_V6" \
+	RTPENGINE_HOST="$HOST_V4" RTPENGINE_PORT="$NG_PORT" \
+	perl -I../perl test-basic-ipv4.pl
+
+METRICS=$(curl -s http://127.0.0.1:"$HTTP_PORT"/metrics)
+echo "$METRICS" | grep '^rtpengine_xdp_'
+
+PACKETS=$(echo "$METRICS" | awk '/^rtpengine_xdp_packets_total / {print $2}')
+FALLBACK=$(echo "$METRICS" | awk '/^rtpengine_xdp_fallback_total / {print $2}')
+if [ "$((PACKETS + FALLBACK))" -le 0 ]; then
+	echo "no packets were forwarded through XDP"
+	exit 1
+fi
+
+echo "XDP forwarding test passed"
@@ -9,6 +9,9 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
 #include "../kernel-module/xt_RTPENGINE.h"
 
 #define NUM_SOCKETS 41
@@ -73,6 +76,142 @@
 		assert(sin.sin_port == htons(PORT_BASE + port)); \
 	}
 
+#define COST_PACKETS 100000
+
+// average time in ns to send an RTP packet to `port` and receive it on `rcv_fd`,
+// grown by `overhead` bytes on the way
+static double packet_cost(int snd_fd, int port, int rcv_fd, int overhead) {
+	unsigned char pkt[172] = { 0x80, 0x08, };
+	char buf[sizeof(pkt) + 64];
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(PORT_BASE + port),
+		.sin_addr = { LOCALHOST },
+	};
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned int i = 0; i < COST_PACKETS; i++) {
+		pkt[2] = i >> 8;
+		pkt[3] = i;
+		int ret = sendto(snd_fd, pkt, sizeof(pkt), 0, (struct sockaddr *) &sin, sizeof(sin));
+		assert(ret == sizeof(pkt));
+		alarm(1);
+		ret = recv(rcv_fd, buf, sizeof(buf), 0);
+		alarm(0);
+		assert(ret == sizeof(pkt) + overhead);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1000000000.0 + (end.tv_nsec - start.tv_nsec)) / COST_PACKETS;
+}
+
+// adds and deletes targets on other ports until killed, keeping about 500 around
+static void churn_targets(int fd) {
+	struct rtpengine_message rm;
+
+	for (unsigned int i = 0; ; i++) {
+		rm = (struct rtpengine_message) {
+			.cmd = REMG_ADD_TARGET,
+			.u = {
+				.target = {
+					.local = {
+						.family = AF_INET,
+						.u = {
+							.ipv4 = LOCALHOST,
+						},
+						.port = PORT_BASE + 1000 + (i % 1000),
+					},
+					.expected_src = {
+						.family = AF_INET,
+						.u = {
+							.ipv4 = LOCALHOST,
+						},
+						.port = 9999,
+					},
+					.decrypt = {
+						.cipher = REC_NULL,
+						.hmac = REH_NULL,
+					},
+					.src_mismatch = MSM_IGNORE,
+					.non_forwarding = 1,
+				},
+			},
+		};
+		if (write(fd, &rm, sizeof(rm)) != sizeof(rm))
+			; // already there from the last round
+		rm.cmd = REMG_DEL_TARGET;
+		rm.u.target.local.port = PORT_BASE + 1000 + ((i + 500) % 1000);
+		if (write(fd, &rm, sizeof(rm)) != sizeof(rm))
+			; // not there yet
+	}
+}
+
+// adds an RTP target on `port` forwarding to `dst_port` with the given SRTP encryption
+static void srtp_target(int fd, int port, int dst_port, const struct rtpengine_srtp *encrypt) {
+	struct rtpengine_message rm;
+	int ret;
+
+	MSG(REMG_ADD_TARGET,
+		.target = {
+			.local = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = PORT_BASE + port,
+			},
+			.expected_src = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = 9999,
+			},
+			.decrypt = {
+				.cipher = REC_NULL,
+				.hmac = REH_NULL,
+			},
+			.src_mismatch = MSM_IGNORE,
+			.num_destinations = 1,
+			.rtp = 1,
+			.num_payload_types = 1,
+			.pt_input = {
+				{ 8, 8000 },
+			},
+		},
+	);
+	MSG(REMG_ADD_DESTINATION,
+		.destination = {
+			.local = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = PORT_BASE + port,
+			},
+			.num = 0,
+			.output = {
+				.src_addr = {
+					.family = AF_INET,
+					.u = {
+						.ipv4 = LOCALHOST,
+					},
+					.port = PORT_BASE + port,
+				},
+				.dst_addr = {
+					.family = AF_INET,
+					.u = {
+						.ipv4 = LOCALHOST,
+					},
+					.port = PORT_BASE + dst_port,
+				},
+				.encrypt = *encrypt,
+			},
+		},
+	);
+}
+
 int main(void) {
 	int fd = open("/proc/rtpengine/0/control", O_RDWR);
 	assert(fd != -1);
@@ -876,5 +1015,189 @@ int main(void) {
 	SND(40, 27, "\x80\x08\x44\x0d\xc2\x3e\xd8\xc0\x21\x9f\x0b\x2e\xd0\x42\xf4\x50\xbb\x7d\x73\xab\xb9\x4e\xd8\x65\xe8\xbf\xeb\xfb\xdc\xdf\xf3\xa6\x63\x58\x84\x37\x49\xc9\xc9\x61\xd9\x43\x51\xde\xfa\x1f\xe5\x34\x9d\x05\x30\x0f\x06\x4f\xb1\x81\x13\x8c\x84\xb2\x26\x93\x0c\x8f\xf1\x6a\x97\x7b\x8c\xe0\xc8\x0a\x66\xe3\xdc\xe4\xd3\xec\x4e\xa5\x8d\x58\x55\x71\x2a\x19\x7c\xad\x55\x46\xe9\xcb\xb4\x79\xde\x8c\x2f\x33\xea\x70\x1b\x08\x4f\xf4\xf4\x2f\x2c\xe6\xb8\x5e\x2a\x65\xab\x06\x74\xbf\xc4\xb1\xc8\x27\x54\x53\xaf\xe8\xca\x1f\x75\xfa\x23\xe9\x6b\x2b\x3e\xed\x4d\x67\x4c\x71\x4c\x53\x74\x4b\x1e\xa7\x5b\x75\x49\x6b\xb3\x64\x6b\x0e\xa5\x12\x8f\x46\x2b\x7d\x17\x54\x2a\x75\xd1\x42\x6b\x7a\xbf\x0e\xd7\x19\x4a\x96\xea\xd9\xd1\xc8\x12\x30\xc3\x33\x4f\xc6\xa6\x0e\x36\xe0\x1f\x0c");
 	EXPF(29, "\x80\x08\x44\x0d\xc2\x3e\xd8\xc0\x21\x9f\x0b\x2e\x57\x55\x55\xd5\xd6\xd1\xd1\xd1\xd4\x55\x57\x56\x54\xd5\xd6\xd4\x55\xd5\xd4\xd1\xd0\xd7\xd4\x54\x54\x55\x55\x57\x51\x56\x56\x55\xd7\xd1\xd6\xd7\xd7\xd7\xd0\xd1\xd1\xd7\x55\x56\x51\x50\x51\x56\x50\x50\x52\x53\xd5\xdc\xdc\xd1\x55\x56\xd5\xdd\xdc\xd3\x57\x53\x53\x54\x57\x54\x54\x54\x54\xd5\x55\xd4\xd6\xd7\x54\x57\x56\x54\x55\x57\x5d\x5c\x53\x56\xd7\xd6\xd4\xd5\xd4\xd6\xd1\xd6\xd7\xd4\x55\x55\xd5\x55\x55\xd1\xd3\xd0\xd3\xdd\xd1\xd0\xd0\xd1\xd6\xd6\xd5\x55\x55\x56\x50\x53\x5f\x5e\x5f\x5d\x50\x56\x50\x56\x54\xd4\xd7\xd6\x55\x53\x5d\x56\xd6\xd0\xd6\x56\x5d\x5f\x51\xd0\xd3\xd4\x54\x54\xd4\xd1\xd6\xd6\xd1\xd1\xd6\xd4\xd5\x55\xd6\xd7\x55\x57", 26);
 
+	// cost per forwarded packet: through the kernel, compared to the same packet sent directly
+	MSG(REMG_ADD_TARGET,
+		.target = {
+			.local = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = PORT_BASE + 30,
+			},
+			.expected_src = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = 9999,
+			},
+			.decrypt = {
+				.cipher = REC_NULL,
+				.hmac = REH_NULL,
+			},
+			.src_mismatch = MSM_IGNORE,
+			.num_destinations = 1,
+			.rtp = 1,
+			.num_payload_types = 1,
+			.pt_input = {
+				{ 8, 8000 },
+			},
+		},
+	);
+	MSG(REMG_ADD_DESTINATION,
+		.destination = {
+			.local = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = PORT_BASE + 30,
+			},
+			.num = 0,
+			.output = {
+				.src_addr = {
+					.family = AF_INET,
+					.u = {
+						.ipv4 = LOCALHOST,
+					},
+					.port = PORT_BASE + 30,
+				},
+				.dst_addr = {
+					.family = AF_INET,
+					.u = {
+						.ipv4 = LOCALHOST,
+					},
+					.port = PORT_BASE + 31,
+				},
+				.encrypt = {
+					.cipher = REC_NULL,
+					.hmac = REH_NULL,
+				},
+			},
+		},
+	);
+	double forwarded = packet_cost(fds[40], 30, fds[31], 0);
+	double direct = packet_cost(fds[40], 32, fds[32], 0);
+	printf("per packet: %.0f ns forwarded, %.0f ns direct, %.0f ns in the forwarding path\n",
+			forwarded, direct, forwarded - direct);
+
+	// forwarding throughput while another process adds and deletes targets
+	pid_t pid = fork();
+	assert(pid != -1);
+	if (pid == 0) {
+		churn_targets(fd);
+		_exit(0);
+	}
+	double churned = packet_cost(fds[40], 30, fds[31], 0);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	printf("forwarding: %.0f packets/s idle, %.0f packets/s while targets are churned\n",
+			1e9 / forwarded, 1e9 / churned);
+
+	// forwarding throughput with SRTP encryption, see `cipher driver` in the
+	// target list for the implementation used
+	srtp_target(fd, 33, 34, &(struct rtpengine_srtp) {
+		.cipher = REC_AES_CM_128,
+		.hmac = REH_HMAC_SHA1,
+		.master_key = "0123456789abcdef",
+		.master_key_len = 16,
+		.master_salt = "0123456789abcd",
+		.master_salt_len = 14,
+		.session_key_len = 16,
+		.session_salt_len = 14,
+		.auth_tag_len = 10,
+	});
+	srtp_target(fd, 35, 36, &(struct rtpengine_srtp) {
+		.cipher = REC_AEAD_AES_GCM_128,
+		.hmac = REH_NULL,
+		.master_key = "0123456789abcdef",
+		.master_key_len = 16,
+		.master_salt = "0123456789ab",
+		.master_salt_len = 12,
+		.session_key_len = 16,
+		.session_salt_len = 12,
+	});
+	double aes_cm = packet_cost(fds[40], 33, fds[34], 10);
+	double aes_gcm = packet_cost(fds[40], 35, fds[36], 16);
+	printf("SRTP: %.0f packets/s AES-CM-128 with HMAC-SHA1-80, %.0f packets/s AEAD-AES-GCM-128\n",
+			1e9 / aes_cm, 1e9 / aes_gcm);
+
+	// intercept stream with a ring buffer
+	rm = (struct rtpengine_message) { .cmd = REMG_ADD_CALL, .u = { .call = { .call_id = "ring-test" } } };
+	ret = read(fd, &rm, sizeof(rm));
+	assert(ret == sizeof(rm));
+	unsigned int call_idx = rm.u.call.call_idx;
+	rm = (struct rtpengine_message) { .cmd = REMG_ADD_STREAM,
+		.u = { .stream = { .call_idx = call_idx, .stream_name = "ring" } } };
+	ret = read(fd, &rm, sizeof(rm));
+	assert(ret == sizeof(rm));
+	unsigned int stream_idx = rm.u.stream.stream_idx;
+
+	int sfd = open("/proc/rtpengine/0/calls/ring-test/ring", O_RDWR | O_NONBLOCK);
+	assert(sfd != -1);
+	size_t page = getpagesize();
+	assert(mmap(NULL, page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE, sfd, 0) == MAP_FAILED);
+	assert(mmap(NULL, page * 4, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0) == MAP_FAILED);
+	struct rtpengine_stream_ring *ring = mmap(NULL, page * 2, PROT_READ | PROT_WRITE, MAP_SHARED, sfd, 0);
+	assert(ring != MAP_FAILED);
+	assert(ring->size == page);
+	assert(ring->head == 0 && ring->tail == 0);
+
+	MSG(REMG_ADD_TARGET,
+		.target = {
+			.local = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = PORT_BASE + 37,
+			},
+			.expected_src = {
+				.family = AF_INET,
+				.u = {
+					.ipv4 = LOCALHOST,
+				},
+				.port = 9999,
+			},
+			.decrypt = {
+				.cipher = REC_NULL,
+				.hmac = REH_NULL,
+			},
+			.src_mismatch = MSM_IGNORE,
+			.non_forwarding = 1,
+			.do_intercept = 1,
+			.intercept_stream_idx = stream_idx,
+		},
+	);
+	SND(40, 37, "six");
+	usleep(10000); // the packet is dropped after interception, so nothing to wait for
+	// IP and UDP headers, then the payload
+	const unsigned char *data = (unsigned char *) ring + page;
+	assert(ring->head == 40); // 4 + 20 + 8 + 3, padded
+	assert(*(uint32_t *) data == 20 + 8 + 3);
+	assert(memcmp(data + 4 + 20 + 8, "six", 3) == 0);
+	ret = read(sfd, (char [64]) { 0 }, 64);
+	assert(ret == -1);
+	ring->tail = ring->head;
+
+	// fill it up: what doesn't fit is dropped
+	for (unsigned int i = 0; i < 200; i++) {
+		SND(40, 37, "seven");
+	}
+	usleep(10000);
+	assert(ring->dropped > 0);
+	assert(ring->head - ring->tail <= page);
+	ring->tail = ring->head;
+	SND(40, 37, "eight");
+	usleep(10000);
+	assert(ring->head - ring->tail == 40);
+
+	// deleting the stream waits for the file to be closed
+	munmap(ring, page * 2);
+	close(sfd);
+	MSG(REMG_DEL_STREAM, .stream = { .call_idx = call_idx, .stream_idx = stream_idx });
+	MSG(REMG_DEL_CALL, .call = { .call_idx = call_idx });
+
 	return 0;
 }